@@ -1,6 +1,6 @@
 QT       += core gui
 
-greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
+greaterThan(QT_MAJOR_VERSION, 4): QT += widgets concurrent
 
 CONFIG += c++11
 
@@ -15,21 +15,77 @@ DEFINES += QT_DEPRECATED_WARNINGS
 # You can also select to disable deprecated APIs only up to a certain version of Qt.
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
 
+# Счётчики этапов разбора и вычисления (панель диагностики в строке состояния)
+#DEFINES += CALC_INSTRUMENTATION
+
 SOURCES += \
+    anglekernels.cpp \
+    biginteger.cpp \
+    calculationerror.cpp \
+    columnstatistics.cpp \
+    complexkernels.cpp \
+    csvformat.cpp \
+    exactnumber.cpp \
     expressioncalculator.cpp \
+    expressiontree.cpp \
+    geometry.cpp \
+    geometrygraphicsitem.cpp \
+    instrumentation.cpp \
     main.cpp \
     mainwindow.cpp \
+    matrix.cpp \
+    matrixkernels.cpp \
+    montecarlo.cpp \
+    polynomialkernels.cpp \
+    reductionkernels.cpp \
+    spreadsheet.cpp \
+    spreadsheetmodel.cpp \
+    startuptrace.cpp \
+    statistics.cpp \
+    threadpool.cpp \
     triangle.cpp \
-    trianglegraphicsitem.cpp
+    trianglebatchitem.cpp \
+    trianglesolver.cpp \
+    trianglegraphicsitem.cpp \
+    trigcore.cpp
 
 HEADERS += \
+    anglekernels.h \
+    biginteger.h \
+    calculationerror.h \
+    columnstatistics.h \
+    compiledexpression.h \
+    complexkernels.h \
+    csvformat.h \
+    exactnumber.h \
     expressioncalculator.h \
+    expressiontree.h \
+    grammar.h \
+    geometry.h \
+    geometrygraphicsitem.h \
+    instrumentation.h \
     mainwindow.h \
+    matrix.h \
+    matrixkernels.h \
+    montecarlo.h \
+    polynomialkernels.h \
+    reductionkernels.h \
+    simd.h \
+    spreadsheet.h \
+    spreadsheetmodel.h \
+    startuptrace.h \
+    staticexpression.h \
+    statistics.h \
+    threadpool.h \
     triangle.h \
-    trianglegraphicsitem.h
+    trianglebatchitem.h \
+    trianglesolver.h \
+    trianglegraphicsitem.h \
+    trigcore.h
 
 FORMS += \
-    mainwindow.ui
+    mainwindow.ui \
+    trigtab.ui
 
 # Default rules for deployment.
 qnx: target.path = /tmp/$${TARGET}/bin
@@ -0,0 +1,171 @@
+#include "anglekernels.h"
+#include "trigcore.h"
+
+#include <cmath>
+
+static const double PI = 3.14159265358979323846;
+
+// Точное приведение: x = quadrant * (четверть оборота) + t, |t| <= 1/8 оборота.
+// fmod точен, а вычитание целого кратного четверти не теряет битов,
+// так как t кратно младшему разряду остатка
+template <int HalfTurn>
+static double reduceQuarter(double x, int &quadrant) {
+
+    const double quarter = HalfTurn / 2.0;
+    double r = std::fmod(x, 4 * quarter);
+    double q = std::nearbyint(r / quarter);
+    quadrant = (static_cast<int>(q) % 4 + 4) % 4;
+    return r - q * quarter;
+}
+
+// Синус и косинус приведённого аргумента с точными значениями в узлах
+template <int HalfTurn>
+static double sinReduced(double t) {
+
+    if (t == 0) return 0.0;
+    if (HalfTurn == DEGREES_HALF_TURN && std::fabs(t) == 30) return t > 0 ? 0.5 : -0.5;
+    // Приведённый аргумент не превышает pi/4, так что нужен только многочлен
+    return trigKernelSin(t * (PI / HalfTurn), 0.0);
+}
+
+template <int HalfTurn>
+static double cosReduced(double t) {
+
+    if (t == 0) return 1.0;
+    return trigKernelCos(t * (PI / HalfTurn), 0.0);
+}
+
+template <int HalfTurn>
+double sinAngle(double x) {
+
+    int quadrant;
+    double t = reduceQuarter<HalfTurn>(x, quadrant);
+    double result;
+    switch (quadrant) {
+    case 0: result = sinReduced<HalfTurn>(t); break;
+    case 1: result = cosReduced<HalfTurn>(t); break;
+    case 2: result = -sinReduced<HalfTurn>(t); break;
+    default: result = -cosReduced<HalfTurn>(t); break;
+    }
+    // Убираем отрицательный ноль: sin(180) = 0, а не -0
+    return result + 0.0;
+}
+
+template <int HalfTurn>
+double cosAngle(double x) {
+
+    int quadrant;
+    double t = reduceQuarter<HalfTurn>(x, quadrant);
+    double result;
+    switch (quadrant) {
+    case 0: result = cosReduced<HalfTurn>(t); break;
+    case 1: result = -sinReduced<HalfTurn>(t); break;
+    case 2: result = -cosReduced<HalfTurn>(t); break;
+    default: result = sinReduced<HalfTurn>(t); break;
+    }
+    return result + 0.0;
+}
+
+template <int HalfTurn>
+double tanAngle(double x) {
+
+    int quadrant;
+    double t = reduceQuarter<HalfTurn>(x, quadrant);
+    double ratio;
+    if (std::fabs(t) == HalfTurn / 4.0) {
+        // 45 градусов: sin/cos дают 0.9999999999999999
+        ratio = t > 0 ? 1.0 : -1.0;
+    } else {
+        ratio = sinReduced<HalfTurn>(t) / cosReduced<HalfTurn>(t);
+    }
+    // Период тангенса - пол-оборота; в нечётных четвертях tan = -1/tan(t),
+    // для t = 0 это даёт бесконечность (tan(90))
+    if (quadrant % 2) {
+        return -1.0 / ratio;
+    }
+    return ratio + 0.0;
+}
+
+template <int HalfTurn>
+void sinCosAngle(double x, double &s, double &c) {
+
+    int quadrant;
+    double t = reduceQuarter<HalfTurn>(x, quadrant);
+    double ks = sinReduced<HalfTurn>(t);
+    double kc = cosReduced<HalfTurn>(t);
+    switch (quadrant) {
+    case 0: s = ks; c = kc; break;
+    case 1: s = kc; c = -ks; break;
+    case 2: s = -ks; c = -kc; break;
+    default: s = -kc; c = ks; break;
+    }
+    s += 0.0;
+    c += 0.0;
+}
+
+template <int HalfTurn>
+double secAngle(double x) {
+    return 1.0 / cosAngle<HalfTurn>(x);
+}
+
+template <int HalfTurn>
+double cscAngle(double x) {
+    return 1.0 / sinAngle<HalfTurn>(x);
+}
+
+template <int HalfTurn>
+double cotAngle(double x) {
+    // cot(90) = 0 точно, так как tan(90) = inf
+    return 1.0 / tanAngle<HalfTurn>(x) + 0.0;
+}
+
+template <int HalfTurn>
+double asinAngle(double x) {
+
+    if (x == 0) return 0.0;
+    if (std::fabs(x) == 1) return x * (HalfTurn / 2.0);
+    if (std::fabs(x) == 0.5) return x * (HalfTurn / 3.0);
+    return std::asin(x) * (HalfTurn / PI);
+}
+
+template <int HalfTurn>
+double acosAngle(double x) {
+
+    if (x == 1) return 0.0;
+    if (x == 0) return HalfTurn / 2.0;
+    if (x == -1) return HalfTurn;
+    if (x == 0.5) return HalfTurn / 3.0;
+    if (x == -0.5) return 2.0 * HalfTurn / 3.0;
+    return std::acos(x) * (HalfTurn / PI);
+}
+
+template <int HalfTurn>
+double atanAngle(double x) {
+
+    if (x == 0) return 0.0;
+    if (std::fabs(x) == 1) return x * (HalfTurn / 4.0);
+    if (std::isinf(x)) return x > 0 ? HalfTurn / 2.0 : -HalfTurn / 2.0;
+    return std::atan(x) * (HalfTurn / PI);
+}
+
+template double sinAngle<DEGREES_HALF_TURN>(double);
+template double cosAngle<DEGREES_HALF_TURN>(double);
+template double tanAngle<DEGREES_HALF_TURN>(double);
+template double secAngle<DEGREES_HALF_TURN>(double);
+template double cscAngle<DEGREES_HALF_TURN>(double);
+template double cotAngle<DEGREES_HALF_TURN>(double);
+template void sinCosAngle<DEGREES_HALF_TURN>(double, double&, double&);
+template double asinAngle<DEGREES_HALF_TURN>(double);
+template double acosAngle<DEGREES_HALF_TURN>(double);
+template double atanAngle<DEGREES_HALF_TURN>(double);
+
+template double sinAngle<GRADIANS_HALF_TURN>(double);
+template double cosAngle<GRADIANS_HALF_TURN>(double);
+template double tanAngle<GRADIANS_HALF_TURN>(double);
+template double secAngle<GRADIANS_HALF_TURN>(double);
+template double cscAngle<GRADIANS_HALF_TURN>(double);
+template double cotAngle<GRADIANS_HALF_TURN>(double);
+template void sinCosAngle<GRADIANS_HALF_TURN>(double, double&, double&);
+template double asinAngle<GRADIANS_HALF_TURN>(double);
+template double acosAngle<GRADIANS_HALF_TURN>(double);
+template double atanAngle<GRADIANS_HALF_TURN>(double);
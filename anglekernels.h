@@ -0,0 +1,27 @@
+#ifndef ANGLEKERNELS_H
+#define ANGLEKERNELS_H
+
+// Тригонометрические функции для углов в градусах (HalfTurn = 180)
+// и градах (HalfTurn = 200).
+// Аргумент сначала точно приводится к четверти оборота, поэтому
+// значения в "круглых" углах точные: sin(180) = 0, cos(60) = 0.5, tan(45) = 1.
+// Обратные функции возвращают угол в тех же единицах.
+
+template <int HalfTurn> double sinAngle(double x);
+template <int HalfTurn> double cosAngle(double x);
+template <int HalfTurn> double tanAngle(double x);
+template <int HalfTurn> double secAngle(double x);
+template <int HalfTurn> double cscAngle(double x);
+template <int HalfTurn> double cotAngle(double x);
+
+// Синус и косинус за одно приведение аргумента
+template <int HalfTurn> void sinCosAngle(double x, double& s, double& c);
+
+template <int HalfTurn> double asinAngle(double x);
+template <int HalfTurn> double acosAngle(double x);
+template <int HalfTurn> double atanAngle(double x);
+
+const int DEGREES_HALF_TURN = 180;
+const int GRADIANS_HALF_TURN = 200;
+
+#endif // ANGLEKERNELS_H
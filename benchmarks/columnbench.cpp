@@ -0,0 +1,142 @@
+// Статистика столбцов файла данных: файл CSV из нескольких столбцов
+// генерируется во временном каталоге и читается summarizeFile в одном
+// потоке и во всех. Результаты должны совпадать побитово; среднее,
+// отклонение и корреляция сравниваются с двухпроходным расчётом
+// в long double, квантили t-digest - с точными.
+
+#include "columnstatistics.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+typedef std::chrono::steady_clock Clock;
+
+static bool sameSummary(const FileSummary& a, const FileSummary& b) {
+
+    if (a.rows != b.rows || a.summaries.size() != b.summaries.size()
+            || std::memcmp(&a.covariance, &b.covariance, sizeof(a.covariance)) != 0) {
+        return false;
+    }
+    for (size_t k = 0; k < a.summaries.size(); k++) {
+        const ColumnSummary& x = a.summaries[k];
+        const ColumnSummary& y = b.summaries[k];
+        double left[3] = { x.quantiles.quantile(0.01), x.quantiles.quantile(0.5), x.quantiles.quantile(0.99) };
+        double right[3] = { y.quantiles.quantile(0.01), y.quantiles.quantile(0.5), y.quantiles.quantile(0.99) };
+        if (x.values != y.values || x.skipped != y.skipped
+                || std::memcmp(&x.moments, &y.moments, sizeof(x.moments)) != 0
+                || std::memcmp(left, right, sizeof(left)) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t rows = 5000000;
+    unsigned int threads = std::max(1u, std::thread::hardware_concurrency());
+    std::string path = "/tmp/column-bench.csv";
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string option = argv[i];
+        std::string value = argv[i + 1];
+        if (option == "--rows") rows = static_cast<size_t>(std::max(1LL, std::atoll(value.c_str())));
+        else if (option == "--threads") threads = std::max(1, std::atoi(value.c_str()));
+        else if (option == "--file") path = value;
+        else {
+            std::cerr << "Usage: column-bench [--rows N] [--threads N] [--file PATH]\n";
+            return 1;
+        }
+    }
+
+    // Столбцы: нормальный с большим средним (проверка устойчивости
+    // дисперсии), линейно зависимый от первого с шумом, логнормальный
+    // (тяжёлый хвост); в каждой тысячной строке два последних поля -
+    // пропуск и текст, в массивах вместо них nan
+    const double nan = std::numeric_limits<double>::quiet_NaN();
+    std::vector<std::vector<double>> columns(3);
+    std::mt19937_64 random(1);
+    std::normal_distribution<double> normal(0.0, 1.0);
+    FILE* file = std::fopen(path.c_str(), "w");
+    if (!file) {
+        std::cerr << "Cannot create " << path << "\n";
+        return 1;
+    }
+    std::fprintf(file, "level;response;latency\n");
+    for (size_t i = 0; i < rows; i++) {
+        double level = 1e9 + normal(random);
+        double response = 2.0 * (level - 1e9) + 0.5 * normal(random);
+        double latency = std::exp(normal(random));
+        if (i % 1000 == 999) {
+            std::fprintf(file, "%.17g;;n/a\n", level);
+            response = latency = nan;
+        } else {
+            std::fprintf(file, "%.17g;%.17g;%.17g\n", level, response, latency);
+        }
+        columns[0].push_back(level);
+        columns[1].push_back(response);
+        columns[2].push_back(latency);
+    }
+    long bytes = std::ftell(file);
+    std::fclose(file);
+
+    FileSummary results[2];
+    double times[2];
+    unsigned int counts[2] = { 1, threads };
+    for (int k = 0; k < 2; k++) {
+        std::string error;
+        Clock::time_point start = Clock::now();
+        if (!summarizeFile(path, std::vector<size_t>(), counts[k], nullptr, results[k], error)) {
+            std::cerr << error << "\n";
+            return 1;
+        }
+        times[k] = std::chrono::duration<double>(Clock::now() - start).count();
+    }
+    std::printf("%zu rows, %.1f MB: %.0f MB/s in 1 thread, %.0f MB/s in %u\n", rows, bytes / 1e6,
+                bytes / 1e6 / times[0], bytes / 1e6 / times[1], threads);
+    if (!sameSummary(results[0], results[1])) {
+        std::printf("  results with 1 and %u threads differ\n", threads);
+    }
+
+    const FileSummary& summary = results[1];
+    std::printf("%-8s %10s %22s %12s %12s %12s %12s\n", "column", "values", "mean", "mean err",
+                "stddev err", "q 1% err", "q 50% err");
+    static const char* const NAMES[] = { "level", "response", "latency" };
+    for (size_t k = 0; k < columns.size() && k < summary.summaries.size(); k++) {
+        std::vector<double> x;
+        for (double v : columns[k]) {
+            if (std::isfinite(v)) x.push_back(v);
+        }
+        const ColumnSummary& column = summary.summaries[k];
+        long double sum = 0;
+        for (double v : x) sum += v;
+        long double mean = sum / x.size();
+        long double m2 = 0;
+        for (double v : x) m2 += (v - mean) * (v - mean);
+        double deviation = static_cast<double>(std::sqrt(m2 / (x.size() - 1)));
+        // Ошибка квантилей - в долях отклонения
+        double q01 = columnQuantile(x.data(), x.size(), 0.01);
+        double q50 = columnQuantile(x.data(), x.size(), 0.5);
+        std::printf("%-8s %10llu %22.17g %12.3g %12.3g %12.3g %12.3g\n", NAMES[k],
+                    static_cast<unsigned long long>(column.values), column.moments.mean,
+                    static_cast<double>((column.moments.mean - mean) / mean),
+                    (column.moments.standardDeviation() - deviation) / deviation,
+                    (column.quantiles.quantile(0.01) - q01) / deviation,
+                    (column.quantiles.quantile(0.5) - q50) / deviation);
+    }
+    RunningCovariance reference = columnCovariance(columns[0].data(), columns[1].data(), rows);
+    std::printf("correlation level/response %.12f (%llu pairs), in memory %.12f, expected %.12f\n",
+                summary.covariance.correlation(), static_cast<unsigned long long>(summary.covariance.count),
+                reference.correlation(), 2.0 / std::sqrt(4.25));
+    std::remove(path.c_str());
+    return 0;
+}
@@ -0,0 +1,20 @@
+# Статистика столбцов файла: скорость чтения, совпадение результата при разном числе потоков и точность
+TEMPLATE = app
+TARGET = column-bench
+
+CONFIG += console c++11 thread
+CONFIG -= app_bundle qt
+
+INCLUDEPATH += ..
+
+SOURCES += \
+    ../columnstatistics.cpp \
+    ../csvformat.cpp \
+    ../statistics.cpp \
+    columnbench.cpp
+
+HEADERS += \
+    ../columnstatistics.h \
+    ../csvformat.h \
+    ../grammar.h \
+    ../statistics.h
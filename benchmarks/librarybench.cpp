@@ -0,0 +1,158 @@
+// Запуск с библиотекой формул: разбор текста всех формул против
+// открытия двоичной библиотеки (отображение и проверка) и загрузки
+// программ из неё. Загруженные программы сверяются с только что
+// скомпилированными по значениям в нескольких точках.
+
+#include "compiledlibrary.h"
+#include "expressioncalculator.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+typedef std::chrono::steady_clock Clock;
+
+static double seconds(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// Формула среднего размера из служебных сервисов: полиномы, функции,
+// общие подвыражения, иногда sum
+static std::string randomFormula(std::mt19937& generator, int depth) {
+
+    static const char* const FUNCTIONS[] = { "sin", "cos", "exp", "ln", "sqrt", "abs", "atan", "tanh" };
+    static const char* const VARIABLES[] = { "x", "y", "z", "t" };
+    std::uniform_int_distribution<int> choice(0, 9);
+
+    int kind = depth <= 0 ? choice(generator) % 2 : choice(generator);
+    if (kind == 0) {
+        return std::to_string(std::uniform_int_distribution<int>(1, 999)(generator) / 10.0).substr(0, 4);
+    }
+    if (kind == 1) {
+        return VARIABLES[choice(generator) % 4];
+    }
+    if (kind <= 3) {
+        return std::string(FUNCTIONS[choice(generator) % 8]) + "(" + randomFormula(generator, depth - 1) + ")";
+    }
+    if (kind == 4 && depth >= 2) {
+        return "sum(k,1,4," + randomFormula(generator, depth - 2) + "*k)";
+    }
+    static const char OPERATORS[] = "+-*/^";
+    char op = OPERATORS[choice(generator) % (kind == 9 ? 5 : 4)];
+    std::string right = op == '^' ? std::to_string(choice(generator) % 3 + 2) : randomFormula(generator, depth - 1);
+    return "(" + randomFormula(generator, depth - 1) + op + right + ")";
+}
+
+int main(int argc, char *argv[])
+{
+    size_t count = 20000;
+    int depth = 6;
+    std::string path = "expression-library.bin";
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string option = argv[i];
+        std::string value = argv[i + 1];
+        if (option == "--count") count = static_cast<size_t>(std::max(1, std::atoi(value.c_str())));
+        else if (option == "--depth") depth = std::max(1, std::atoi(value.c_str()));
+        else if (option == "--file") path = value;
+        else {
+            std::cerr << "Usage: library-bench [--count N] [--depth N] [--file PATH]\n";
+            return 1;
+        }
+    }
+
+    std::mt19937 generator(12345);
+    std::vector<std::string> formulas;
+    size_t textBytes = 0;
+    for (size_t i = 0; i < count; i++) {
+        formulas.push_back(randomFormula(generator, depth));
+        textBytes += formulas.back().size();
+    }
+    const std::vector<std::string> variables = { "x", "y", "z", "t" };
+
+    // Запуск из текста: каждая строка проходит разбор и компиляцию
+    ExpressionCalculator calculator;
+    std::vector<CompiledLibrary::Entry> entries(count);
+    Clock::time_point start = Clock::now();
+    for (size_t i = 0; i < count; i++) {
+        CalculationError error;
+        if (!calculator.tryCompile(formulas[i], variables, entries[i].program, error)) {
+            std::cerr << "Cannot compile " << formulas[i] << ": " << error.message(formulas[i]) << "\n";
+            return 1;
+        }
+    }
+    double textTime = seconds(start);
+
+    for (size_t i = 0; i < count; i++) {
+        entries[i].name = "formula" + std::to_string(i);
+        entries[i].source = formulas[i];
+    }
+    std::string error;
+    start = Clock::now();
+    if (!CompiledLibrary::write(path, entries, error)) {
+        std::cerr << error << "\n";
+        return 1;
+    }
+    double writeTime = seconds(start);
+
+    // Запуск из библиотеки: отображение с проверкой, затем загрузка всех программ
+    CompiledLibrary library;
+    start = Clock::now();
+    if (!library.open(path, error)) {
+        std::cerr << error << "\n";
+        return 1;
+    }
+    double openTime = seconds(start);
+
+    std::vector<CompiledExpression> loaded(count);
+    start = Clock::now();
+    for (size_t i = 0; i < library.size(); i++) {
+        if (!library.load(i, loaded[i], error)) {
+            std::cerr << error << "\n";
+            return 1;
+        }
+    }
+    double loadTime = seconds(start);
+
+    // Сервис, которому сразу нужна одна формула, загружает только её
+    start = Clock::now();
+    CompiledExpression single;
+    size_t index = library.find("formula" + std::to_string(count / 2));
+    if (index == library.size() || !library.load(index, single, error)) {
+        std::cerr << "Cannot find formula" << count / 2 << "\n";
+        return 1;
+    }
+    double singleTime = seconds(start);
+
+    // Загруженная программа должна вычислять то же, что скомпилированная
+    double x[4] = { 0.5, 1.25, 2.0, -0.75 };
+    double y[4] = { -1.5, 0.25, 3.0, 0.125 };
+    double z[4] = { 2.5, -0.5, 0.75, 1.0 };
+    double t[4] = { 0.1, 0.2, 0.3, 0.4 };
+    size_t mismatches = 0;
+    for (size_t i = 0; i < count; i++) {
+        size_t k = library.find(entries[i].name);
+        double expected[4], got[4];
+        calculator.evaluateBatch(entries[i].program, { x, y, z, t }, 4, expected);
+        calculator.evaluateBatch(loaded[k], { x, y, z, t }, 4, got);
+        if (std::memcmp(expected, got, sizeof(got)) != 0 || library.source(k) != formulas[i]) {
+            mismatches++;
+        }
+    }
+
+    std::printf("%zu formulas, %.1f KB of text, library %s\n", count, textBytes / 1024.0, path.c_str());
+    std::printf("%-28s %10.2f ms\n", "parse and compile text", textTime * 1e3);
+    std::printf("%-28s %10.2f ms\n", "write library", writeTime * 1e3);
+    std::printf("%-28s %10.2f ms\n", "map and validate", openTime * 1e3);
+    std::printf("%-28s %10.2f ms\n", "load all programs", loadTime * 1e3);
+    std::printf("%-28s %10.3f ms\n", "find and load one", singleTime * 1e3);
+    std::printf("%-28s %10.1fx\n", "start speedup (all)", textTime / (openTime + loadTime));
+    std::printf("mismatches: %zu\n", mismatches);
+    return mismatches ? 1 : 0;
+}
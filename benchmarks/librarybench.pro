@@ -0,0 +1,50 @@
+# Запуск из текста формул против отображённой двоичной библиотеки
+TEMPLATE = app
+TARGET = library-bench
+
+CONFIG += console c++11 thread
+CONFIG -= app_bundle qt
+
+INCLUDEPATH += ..
+
+SOURCES += \
+    ../anglekernels.cpp \
+    ../biginteger.cpp \
+    ../calculationerror.cpp \
+    ../columnstatistics.cpp \
+    ../compiledlibrary.cpp \
+    ../complexkernels.cpp \
+    ../csvformat.cpp \
+    ../exactnumber.cpp \
+    ../expressioncalculator.cpp \
+    ../expressiontree.cpp \
+    ../instrumentation.cpp \
+    ../matrix.cpp \
+    ../matrixkernels.cpp \
+    ../polynomialkernels.cpp \
+    ../reductionkernels.cpp \
+    ../statistics.cpp \
+    ../trigcore.cpp \
+    librarybench.cpp
+
+HEADERS += \
+    ../anglekernels.h \
+    ../biginteger.h \
+    ../calculationerror.h \
+    ../columnstatistics.h \
+    ../compiledexpression.h \
+    ../compiledlibrary.h \
+    ../complexkernels.h \
+    ../csvformat.h \
+    ../exactnumber.h \
+    ../expressioncalculator.h \
+    ../expressiontree.h \
+    ../grammar.h \
+    ../instrumentation.h \
+    ../matrix.h \
+    ../matrixkernels.h \
+    ../polynomialkernels.h \
+    ../reductionkernels.h \
+    ../simd.h \
+    ../statistics.h \
+    ../trigcore.h
@@ -0,0 +1,78 @@
+// Сравнение блочного умножения матриц (gemm) с простым тройным циклом.
+// Для каждого размера печатаются время, GFLOP/s обоих вариантов
+// и наибольшее расхождение результатов.
+
+#include "matrixkernels.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+typedef std::chrono::steady_clock Clock;
+
+// Лучшее время из repeats запусков, в секундах
+template <typename F>
+static double measure(F multiply, int repeats) {
+
+    double best = 1e300;
+    for (int i = 0; i < repeats; i++) {
+        Clock::time_point start = Clock::now();
+        multiply();
+        best = std::min(best, std::chrono::duration<double>(Clock::now() - start).count());
+    }
+    return best;
+}
+
+int main(int argc, char *argv[])
+{
+    std::vector<size_t> sizes = { 64, 128, 256, 512, 1024 };
+    int repeats = 3;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string option = argv[i];
+        std::string value = argv[i + 1];
+        if (option == "--size") sizes.assign(1, static_cast<size_t>(std::max(1, std::atoi(value.c_str()))));
+        else if (option == "--repeats") repeats = std::max(1, std::atoi(value.c_str()));
+        else {
+            std::cerr << "Usage: matrix-bench [--size N] [--repeats N]\n";
+            return 1;
+        }
+    }
+
+    std::mt19937 generator(12345);
+    std::uniform_real_distribution<double> distribution(-1.0, 1.0);
+
+    std::printf("%6s %12s %10s %12s %10s %8s %12s\n",
+                "n", "naive ms", "GFLOP/s", "blocked ms", "GFLOP/s", "speedup", "max diff");
+    for (size_t n : sizes) {
+        std::vector<double> a(n * n);
+        std::vector<double> b(n * n);
+        std::vector<double> naive(n * n);
+        std::vector<double> blocked(n * n);
+        for (double& x : a) x = distribution(generator);
+        for (double& x : b) x = distribution(generator);
+
+        double naiveTime = measure([&]() {
+            matrixMultiplyNaive(a.data(), b.data(), naive.data(), n, n, n);
+        }, repeats);
+        double blockedTime = measure([&]() {
+            matrixMultiply(a.data(), b.data(), blocked.data(), n, n, n);
+        }, repeats);
+
+        double difference = 0.0;
+        for (size_t i = 0; i < n * n; i++) {
+            difference = std::max(difference, std::fabs(naive[i] - blocked[i]));
+        }
+        double flops = 2.0 * n * n * n;
+        std::printf("%6zu %12.2f %10.2f %12.2f %10.2f %7.1fx %12.3g\n", n,
+                    naiveTime * 1e3, flops / naiveTime * 1e-9,
+                    blockedTime * 1e3, flops / blockedTime * 1e-9,
+                    naiveTime / blockedTime, difference);
+    }
+    return 0;
+}
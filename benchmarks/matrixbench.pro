@@ -0,0 +1,16 @@
+# Сравнение блочного и простого умножения матриц
+TEMPLATE = app
+TARGET = matrix-bench
+
+CONFIG += console c++11 thread
+CONFIG -= app_bundle qt
+
+INCLUDEPATH += ..
+
+SOURCES += \
+    ../matrixkernels.cpp \
+    matrixbench.cpp
+
+HEADERS += \
+    ../matrixkernels.h \
+    ../simd.h
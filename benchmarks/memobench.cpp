@@ -0,0 +1,88 @@
+// Перебор одной переменной при неизменных остальных (таблица значений,
+// график по x с параметрами): время интерпретатора на точку без кэша
+// и с кэшем подвыражений (ExpressionCalculator::MemoCache), доля попаданий
+// и ускорение. Результаты обоих способов должны совпадать побитово.
+
+#include "expressioncalculator.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+typedef std::chrono::steady_clock Clock;
+
+template <typename F>
+static double measure(F run, int repeats) {
+
+    double best = 1e300;
+    for (int i = 0; i < repeats; i++) {
+        Clock::time_point start = Clock::now();
+        run();
+        best = std::min(best, std::chrono::duration<double>(Clock::now() - start).count());
+    }
+    return best;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t points = 20000;
+    int repeats = 3;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string option = argv[i];
+        std::string value = argv[i + 1];
+        if (option == "--points") points = static_cast<size_t>(std::max(1, std::atoi(value.c_str())));
+        else if (option == "--repeats") repeats = std::max(1, std::atoi(value.c_str()));
+        else {
+            std::cerr << "Usage: memo-bench [--points N] [--repeats N]\n";
+            return 1;
+        }
+    }
+
+    // Перебирается x, параметры a, b, c постоянны; последняя формула
+    // целиком зависит от x, и кэш в ней только мешает
+    static const char* const FORMULAS[] = {
+        "exp(-a^2/2)*sin(b)*cos(c) + ln(a + b)*x^2 + sqrt(c)*sin(x)",
+        "sum(k, 1, 1000, 1/(k^2 + a)) * x + b",
+        "integral(t, 0, a, exp(-t^2)) + c*x",
+        "atan(a/b)*x^3 + tanh(c)*x + exp(a)",
+        "sin(x)*cos(x) + exp(-x^2)"
+    };
+
+    ExpressionCalculator calculator;
+    std::printf("%-58s %6s %9s %9s %7s %8s\n", "formula", "memos", "plain ns", "memo ns", "hits %", "speedup");
+    for (const char* formula : FORMULAS) {
+        CompiledExpression program = calculator.compile(formula, { "x", "a", "b", "c" });
+        std::vector<double> plain(points), memoized(points);
+        std::vector<double> values = { 0.0, 0.7, 1.1, 2.0 };
+
+        double plainTime = measure([&]() {
+            CalculationError error;
+            for (size_t i = 0; i < points; i++) {
+                values[0] = 1e-3 * i;
+                calculator.tryEvaluate(program, values, plain[i], error);
+            }
+        }, repeats) / points;
+        ExpressionCalculator::MemoCache cache;
+        double memoTime = measure([&]() {
+            CalculationError error;
+            for (size_t i = 0; i < points; i++) {
+                values[0] = 1e-3 * i;
+                calculator.tryEvaluate(program, values, cache, memoized[i], error);
+            }
+        }, repeats) / points;
+
+        size_t lookups = cache.hits() + cache.misses();
+        std::printf("%-58s %6zu %9.1f %9.1f %7.1f %7.1fx\n", formula, program.memos.size(),
+                    plainTime * 1e9, memoTime * 1e9, lookups ? 100.0 * cache.hits() / lookups : 0.0,
+                    plainTime / memoTime);
+        if (std::memcmp(plain.data(), memoized.data(), points * sizeof(double)) != 0) {
+            std::printf("  results with and without the cache differ\n");
+        }
+    }
+    return 0;
+}
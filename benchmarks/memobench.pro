@@ -0,0 +1,48 @@
+# Перебор одной переменной с кэшем подвыражений (MemoCache) и без него
+TEMPLATE = app
+TARGET = memo-bench
+
+CONFIG += console c++11 thread
+CONFIG -= app_bundle qt
+
+INCLUDEPATH += ..
+
+SOURCES += \
+    ../anglekernels.cpp \
+    ../biginteger.cpp \
+    ../calculationerror.cpp \
+    ../columnstatistics.cpp \
+    ../complexkernels.cpp \
+    ../csvformat.cpp \
+    ../exactnumber.cpp \
+    ../expressioncalculator.cpp \
+    ../expressiontree.cpp \
+    ../instrumentation.cpp \
+    ../matrix.cpp \
+    ../matrixkernels.cpp \
+    ../polynomialkernels.cpp \
+    ../reductionkernels.cpp \
+    ../statistics.cpp \
+    ../trigcore.cpp \
+    memobench.cpp
+
+HEADERS += \
+    ../anglekernels.h \
+    ../biginteger.h \
+    ../calculationerror.h \
+    ../columnstatistics.h \
+    ../compiledexpression.h \
+    ../complexkernels.h \
+    ../csvformat.h \
+    ../exactnumber.h \
+    ../expressioncalculator.h \
+    ../expressiontree.h \
+    ../grammar.h \
+    ../instrumentation.h \
+    ../matrix.h \
+    ../matrixkernels.h \
+    ../polynomialkernels.h \
+    ../reductionkernels.h \
+    ../simd.h \
+    ../statistics.h \
+    ../trigcore.h
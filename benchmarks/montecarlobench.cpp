@@ -0,0 +1,91 @@
+// Распространение неопределённости методом Монте-Карло для нескольких
+// формул: время на испытание в одном потоке и во всех, среднее, отклонение
+// и квантили. Результаты при разном числе потоков должны совпадать побитово.
+
+#include "expressioncalculator.h"
+#include "montecarlo.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+typedef std::chrono::steady_clock Clock;
+
+static bool sameResult(const MonteCarloResult& a, const MonteCarloResult& b) {
+
+    double left[5] = { a.moments.mean, a.moments.m2, a.quantiles.quantile(0.025),
+                       a.quantiles.quantile(0.5), a.quantiles.quantile(0.975) };
+    double right[5] = { b.moments.mean, b.moments.m2, b.quantiles.quantile(0.025),
+                        b.quantiles.quantile(0.5), b.quantiles.quantile(0.975) };
+    return a.samples == b.samples && a.nonFinite == b.nonFinite
+            && std::memcmp(left, right, sizeof(left)) == 0;
+}
+
+int main(int argc, char *argv[])
+{
+    uint64_t samples = 10000000;
+    uint64_t seed = 1;
+    unsigned int threads = std::max(1u, std::thread::hardware_concurrency());
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string option = argv[i];
+        std::string value = argv[i + 1];
+        if (option == "--samples") samples = std::max(1LL, std::atoll(value.c_str()));
+        else if (option == "--seed") seed = std::strtoull(value.c_str(), nullptr, 10);
+        else if (option == "--threads") threads = std::max(1, std::atoi(value.c_str()));
+        else {
+            std::cerr << "Usage: montecarlo-bench [--samples N] [--seed S] [--threads N]\n";
+            return 1;
+        }
+    }
+
+    static const char* const PROBLEMS[] = {
+        "x*y^2 + sin(z); x ~ N(1.2, 0.01); y ~ U(2, 3); z = pi/4",
+        "m*g*h; m ~ N(2, 0.05); g = 9.81; h ~ T(0.9, 1, 1.2)",
+        "exp(-k*t)*cos(w*t); k ~ LN(-1, 0.2); w ~ N(6.28, 0.1); t ~ U(0, 2)",
+        "1/(1/r1 + 1/r2 + 1/r3); r1 ~ N(100, 1); r2 ~ N(220, 2.2); r3 ~ N(330, 3.3)"
+    };
+
+    ExpressionCalculator calculator;
+    std::printf("%-68s %7s %7s %12s %10s %12s %12s %12s\n", "problem", "ns/1", "ns/all",
+                "mean", "stddev", "q 2.5%", "median", "q 97.5%");
+    for (const char* problem : PROBLEMS) {
+        std::string expression;
+        std::vector<std::string> names;
+        std::vector<Distribution> inputs;
+        CalculationError error;
+        CompiledExpression program;
+        if (!parseMonteCarlo(calculator, problem, expression, names, inputs, error)
+                || !calculator.tryCompile(expression, names, program, error)) {
+            std::cerr << problem << ": " << error.message(problem) << "\n";
+            return 1;
+        }
+
+        MonteCarloResult results[2];
+        double times[2];
+        unsigned int counts[2] = { 1, threads };
+        for (int k = 0; k < 2; k++) {
+            Clock::time_point start = Clock::now();
+            runMonteCarlo(calculator, program, inputs, samples, seed, counts[k], nullptr, results[k], error);
+            times[k] = std::chrono::duration<double>(Clock::now() - start).count();
+        }
+
+        const MonteCarloResult& r = results[1];
+        std::printf("%-68s %7.1f %7.1f %12.8g %10.3g %12.8g %12.8g %12.8g\n", problem,
+                    times[0] / samples * 1e9, times[1] / samples * 1e9,
+                    r.moments.mean, r.moments.standardDeviation(), r.quantiles.quantile(0.025),
+                    r.quantiles.quantile(0.5), r.quantiles.quantile(0.975));
+        if (!sameResult(results[0], results[1])) {
+            std::printf("  results with 1 and %u threads differ\n", threads);
+        }
+        if (r.nonFinite) {
+            std::printf("  %llu samples without a finite value\n", static_cast<unsigned long long>(r.nonFinite));
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,50 @@
+# Монте-Карло: испытаний в секунду и совпадение результата при разном числе потоков
+TEMPLATE = app
+TARGET = montecarlo-bench
+
+CONFIG += console c++11 thread
+CONFIG -= app_bundle qt
+
+INCLUDEPATH += ..
+
+SOURCES += \
+    ../anglekernels.cpp \
+    ../biginteger.cpp \
+    ../calculationerror.cpp \
+    ../columnstatistics.cpp \
+    ../complexkernels.cpp \
+    ../csvformat.cpp \
+    ../exactnumber.cpp \
+    ../expressioncalculator.cpp \
+    ../expressiontree.cpp \
+    ../instrumentation.cpp \
+    ../matrix.cpp \
+    ../matrixkernels.cpp \
+    ../montecarlo.cpp \
+    ../polynomialkernels.cpp \
+    ../reductionkernels.cpp \
+    ../statistics.cpp \
+    ../trigcore.cpp \
+    montecarlobench.cpp
+
+HEADERS += \
+    ../anglekernels.h \
+    ../biginteger.h \
+    ../calculationerror.h \
+    ../columnstatistics.h \
+    ../compiledexpression.h \
+    ../complexkernels.h \
+    ../csvformat.h \
+    ../exactnumber.h \
+    ../expressioncalculator.h \
+    ../expressiontree.h \
+    ../grammar.h \
+    ../instrumentation.h \
+    ../matrix.h \
+    ../matrixkernels.h \
+    ../montecarlo.h \
+    ../polynomialkernels.h \
+    ../reductionkernels.h \
+    ../simd.h \
+    ../statistics.h \
+    ../trigcore.h
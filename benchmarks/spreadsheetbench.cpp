@@ -0,0 +1,137 @@
+// Пересчёт таблицы в миллион формул: загрузка, полный пересчёт в одном
+// потоке и во всех, частичный пересчёт после изменения одной ячейки.
+// Значения после частичного пересчёта и при любом числе потоков должны
+// совпадать с полным пересчётом побитово.
+//
+//   grid    - первая строка и первый столбец - числа, остальные ячейки
+//             "=A1*0.5 + B0*0.5" от верхней и левой: уровни - диагонали
+//   columns - столбец A - числа, следующие столбцы - формулы от соседнего
+//             слева: уровень - целый столбец
+
+#include "expressioncalculator.h"
+#include "spreadsheet.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+typedef std::chrono::steady_clock Clock;
+
+static double secondsSince(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+static std::vector<double> snapshot(const Spreadsheet& sheet) {
+
+    std::vector<double> values;
+    values.reserve(static_cast<size_t>(sheet.usedRows()) * sheet.usedColumns());
+    for (int row = 0; row < sheet.usedRows(); row++) {
+        for (int column = 0; column < sheet.usedColumns(); column++) {
+            values.push_back(sheet.value(row, column));
+        }
+    }
+    return values;
+}
+
+static bool sameValues(const std::vector<double>& a, const std::vector<double>& b) {
+    return a.size() == b.size() && std::memcmp(a.data(), b.data(), a.size() * sizeof(double)) == 0;
+}
+
+static void fillGrid(Spreadsheet& sheet, int rows, int columns) {
+
+    for (int row = 0; row < rows; row++) {
+        for (int column = 0; column < columns; column++) {
+            if (row == 0 || column == 0) {
+                sheet.setCell(row, column, std::to_string(1 + (row + column) % 7));
+            } else {
+                sheet.setCell(row, column, "=" + Spreadsheet::cellName(row - 1, column) + "*0.5 + "
+                              + Spreadsheet::cellName(row, column - 1) + "*0.5");
+            }
+        }
+    }
+}
+
+static void fillColumns(Spreadsheet& sheet, int rows, int columns) {
+
+    for (int row = 0; row < rows; row++) {
+        sheet.setCell(row, 0, std::to_string(row % 1000 * 0.001));
+        std::string a = Spreadsheet::cellName(row, 0);
+        for (int column = 1; column < columns; column++) {
+            std::string left = Spreadsheet::cellName(row, column - 1);
+            sheet.setCell(row, column, "=" + left + "*1.0001 + sin(" + a + ")^2");
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    int size = 1000;
+    unsigned int threads = std::max(1u, std::thread::hardware_concurrency());
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string option = argv[i];
+        std::string value = argv[i + 1];
+        if (option == "--size") size = std::max(2, std::min(1000, std::atoi(value.c_str())));
+        else if (option == "--threads") threads = std::max(1, std::atoi(value.c_str()));
+        else {
+            std::cerr << "Usage: spreadsheet-bench [--size N (<= 1000)] [--threads N]\n";
+            return 1;
+        }
+    }
+
+    ExpressionCalculator calculator;
+    std::printf("%-8s %9s %7s %8s %9s %9s %10s %9s %9s\n", "sheet", "formulas", "levels",
+                "load s", "full 1 s", "full N s", "edited", "edit ms", "ns/form");
+    for (int kind = 0; kind < 2; kind++) {
+        Spreadsheet sheet(calculator);
+        int rows = kind == 0 ? size : size * size / 100;
+        int columns = kind == 0 ? size : 100;
+        Clock::time_point start = Clock::now();
+        if (kind == 0) {
+            fillGrid(sheet, rows, columns);
+        } else {
+            fillColumns(sheet, rows, columns);
+        }
+        sheet.recalculate(threads);
+        double load = secondsSince(start);
+
+        start = Clock::now();
+        Spreadsheet::RecalculationStats full = sheet.recalculateAll(1);
+        double serial = secondsSince(start);
+        std::vector<double> expected = snapshot(sheet);
+
+        start = Clock::now();
+        sheet.recalculateAll(threads);
+        double parallel = secondsSince(start);
+        bool threadsMatch = sameValues(snapshot(sheet), expected);
+
+        // Изменение в середине: пересчитываются только зависимые формулы.
+        // Первый пересчёт после загрузки строит указатель зависимостей,
+        // поэтому ячейка меняется дважды и измеряется второй раз
+        sheet.setCell(rows / 2, 0, "5");
+        sheet.recalculate(threads);
+        sheet.setCell(rows / 2, 0, "3");
+        start = Clock::now();
+        Spreadsheet::RecalculationStats edit = sheet.recalculate(threads);
+        double edited = secondsSince(start);
+        std::vector<double> incremental = snapshot(sheet);
+        sheet.recalculateAll(threads);
+        bool editMatches = sameValues(snapshot(sheet), incremental);
+
+        std::printf("%-8s %9zu %7zu %8.3f %9.3f %9.3f %10zu %9.2f %9.1f\n",
+                    kind == 0 ? "grid" : "columns", full.formulas, full.levels, load, serial, parallel,
+                    edit.formulas, edited * 1e3, serial / full.formulas * 1e9);
+        if (!threadsMatch) {
+            std::printf("  values with 1 and %u threads differ\n", threads);
+        }
+        if (!editMatches) {
+            std::printf("  values after the partial and the full recalculation differ\n");
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,52 @@
+# Таблица: полный и частичный пересчёт миллиона формул в одном потоке и во всех
+TEMPLATE = app
+TARGET = spreadsheet-bench
+
+CONFIG += console c++11 thread
+CONFIG -= app_bundle qt
+
+INCLUDEPATH += ..
+
+SOURCES += \
+    ../anglekernels.cpp \
+    ../biginteger.cpp \
+    ../calculationerror.cpp \
+    ../columnstatistics.cpp \
+    ../complexkernels.cpp \
+    ../csvformat.cpp \
+    ../exactnumber.cpp \
+    ../expressioncalculator.cpp \
+    ../expressiontree.cpp \
+    ../instrumentation.cpp \
+    ../matrix.cpp \
+    ../matrixkernels.cpp \
+    ../polynomialkernels.cpp \
+    ../reductionkernels.cpp \
+    ../spreadsheet.cpp \
+    ../statistics.cpp \
+    ../threadpool.cpp \
+    ../trigcore.cpp \
+    spreadsheetbench.cpp
+
+HEADERS += \
+    ../anglekernels.h \
+    ../biginteger.h \
+    ../calculationerror.h \
+    ../columnstatistics.h \
+    ../compiledexpression.h \
+    ../complexkernels.h \
+    ../csvformat.h \
+    ../exactnumber.h \
+    ../expressioncalculator.h \
+    ../expressiontree.h \
+    ../grammar.h \
+    ../instrumentation.h \
+    ../matrix.h \
+    ../matrixkernels.h \
+    ../polynomialkernels.h \
+    ../reductionkernels.h \
+    ../simd.h \
+    ../spreadsheet.h \
+    ../statistics.h \
+    ../threadpool.h \
+    ../trigcore.h
@@ -0,0 +1,126 @@
+// Таблицы приближения (TabulatedFunction) для нескольких формул:
+// время построения, число кусков и вычислений программы, проверенная
+// погрешность и фактическая на случайных точках, время вычисления
+// интерпретатором, пакетом и таблицей в наносекундах на точку
+// и ускорение таблицы относительно первых двух.
+
+#include "expressioncalculator.h"
+#include "tabulatedfunction.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+typedef std::chrono::steady_clock Clock;
+
+template <typename F>
+static double measure(F run, int repeats) {
+
+    double best = 1e300;
+    for (int i = 0; i < repeats; i++) {
+        Clock::time_point start = Clock::now();
+        run();
+        best = std::min(best, std::chrono::duration<double>(Clock::now() - start).count());
+    }
+    return best;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t points = 1000000;
+    double tolerance = 1e-10;
+    int repeats = 3;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string option = argv[i];
+        std::string value = argv[i + 1];
+        if (option == "--points") points = static_cast<size_t>(std::max(1, std::atoi(value.c_str())));
+        else if (option == "--tolerance") tolerance = std::atof(value.c_str());
+        else if (option == "--repeats") repeats = std::max(1, std::atoi(value.c_str()));
+        else {
+            std::cerr << "Usage: tabulation-bench [--points N] [--tolerance E] [--repeats N]\n";
+            return 1;
+        }
+    }
+
+    // Гладкие формулы, излом производной в нуле (sqrt) и полюс внутри отрезка
+    struct Case {
+        const char* formula;
+        double lower;
+        double upper;
+    };
+    static const Case CASES[] = {
+        { "exp(-x^2/2)*sin(3*x)/(1 + x^2)", -5.0, 5.0 },
+        { "ln(1 + x)*cos(x)^2 + atan(x/3)", 0.0, 20.0 },
+        { "tanh(sinh(x)) - x^3/(2 + cos(x))", -3.0, 3.0 },
+        { "sqrt(x)*exp(-x)", 0.0, 10.0 },
+        { "1/(x - 0.3) + sin(x)", -1.0, 1.0 }
+    };
+
+    ExpressionCalculator calculator;
+    std::mt19937 generator(12345);
+    std::printf("%-34s %-9s %8s %9s %8s %9s %9s %7s %7s %7s %7s %7s\n", "formula", "method", "build ms",
+                "pieces", "samples", "certified", "measured", "interp", "batch", "table", "x interp", "x batch");
+
+    for (const Case& c : CASES) {
+        CompiledExpression program = calculator.compile(c.formula, { "x" });
+        std::uniform_real_distribution<double> distribution(c.lower, c.upper);
+        std::vector<double> x(points), exact(points), table(points);
+        for (double& value : x) {
+            value = distribution(generator);
+        }
+
+        double interpreterTime = measure([&]() {
+            size_t n = std::min<size_t>(points, 100000);
+            CalculationError error;
+            for (size_t i = 0; i < n; i++) {
+                calculator.tryEvaluate(program, { x[i] }, exact[i], error);
+            }
+        }, repeats) / std::min<size_t>(points, 100000);
+        double batchTime = measure([&]() {
+            calculator.evaluateBatch(program, { x.data() }, points, exact.data());
+        }, repeats) / points;
+
+        for (TabulatedFunction::Method method : { TabulatedFunction::CHEBYSHEV, TabulatedFunction::SPLINE }) {
+            TabulatedFunction function;
+            std::string error;
+            Clock::time_point start = Clock::now();
+            if (!function.build(calculator, program, c.lower, c.upper, tolerance, method, error)) {
+                std::cerr << c.formula << ": " << error << "\n";
+                return 1;
+            }
+            double buildTime = std::chrono::duration<double>(Clock::now() - start).count();
+            double tableTime = measure([&]() {
+                function.evaluate(x.data(), points, table.data());
+            }, repeats) / points;
+
+            // Погрешность в тех же единицах, что tolerance; inf/nan должны совпадать
+            double measured = 0.0;
+            size_t mismatches = 0;
+            for (size_t i = 0; i < points; i++) {
+                if (!std::isfinite(exact[i]) || !std::isfinite(table[i])) {
+                    if (!(exact[i] == table[i] || (std::isnan(exact[i]) && std::isnan(table[i])))) mismatches++;
+                    continue;
+                }
+                measured = std::max(measured, std::fabs(table[i] - exact[i]) / std::max(1.0, std::fabs(exact[i])));
+            }
+
+            char pieces[32];
+            std::snprintf(pieces, sizeof(pieces), "%zu/%zu", function.pieces(), function.fallbackPieces());
+            std::printf("%-34s %-9s %8.1f %9s %8zu %9.2g %9.2g %7.1f %7.1f %7.1f %7.1f %7.1f\n",
+                        c.formula, method == TabulatedFunction::SPLINE ? "spline" : "chebyshev",
+                        buildTime * 1e3, pieces, function.samples(), function.maxError(), measured,
+                        interpreterTime * 1e9, batchTime * 1e9, tableTime * 1e9,
+                        interpreterTime / tableTime, batchTime / tableTime);
+            if (mismatches) {
+                std::printf("  %zu points with inf/nan differ from the program\n", mismatches);
+            }
+        }
+    }
+    return 0;
+}
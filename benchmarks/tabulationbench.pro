@@ -0,0 +1,50 @@
+# Таблицы приближения выражений с одной переменной
+TEMPLATE = app
+TARGET = tabulation-bench
+
+CONFIG += console c++11 thread
+CONFIG -= app_bundle qt
+
+INCLUDEPATH += ..
+
+SOURCES += \
+    ../anglekernels.cpp \
+    ../biginteger.cpp \
+    ../calculationerror.cpp \
+    ../columnstatistics.cpp \
+    ../complexkernels.cpp \
+    ../csvformat.cpp \
+    ../exactnumber.cpp \
+    ../expressioncalculator.cpp \
+    ../expressiontree.cpp \
+    ../instrumentation.cpp \
+    ../matrix.cpp \
+    ../matrixkernels.cpp \
+    ../polynomialkernels.cpp \
+    ../reductionkernels.cpp \
+    ../statistics.cpp \
+    ../tabulatedfunction.cpp \
+    ../trigcore.cpp \
+    tabulationbench.cpp
+
+HEADERS += \
+    ../anglekernels.h \
+    ../biginteger.h \
+    ../calculationerror.h \
+    ../columnstatistics.h \
+    ../compiledexpression.h \
+    ../complexkernels.h \
+    ../csvformat.h \
+    ../exactnumber.h \
+    ../expressioncalculator.h \
+    ../expressiontree.h \
+    ../grammar.h \
+    ../instrumentation.h \
+    ../matrix.h \
+    ../matrixkernels.h \
+    ../polynomialkernels.h \
+    ../reductionkernels.h \
+    ../simd.h \
+    ../statistics.h \
+    ../tabulatedfunction.h \
+    ../trigcore.h
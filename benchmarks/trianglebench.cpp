@@ -0,0 +1,110 @@
+// Пакетное решение треугольников: смесь строк SSS, SAS, ASA, AAS и SSA,
+// построенных по случайным треугольникам. Печатаются время решения
+// в одном потоке и пакетом, число строк в секунду и наибольшее
+// отклонение от исходного треугольника.
+
+#include "trianglesolver.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+typedef std::chrono::steady_clock Clock;
+
+template <typename F>
+static double measure(F solve, int repeats) {
+
+    double best = 1e300;
+    for (int i = 0; i < repeats; i++) {
+        Clock::time_point start = Clock::now();
+        solve();
+        best = std::min(best, std::chrono::duration<double>(Clock::now() - start).count());
+    }
+    return best;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t rows = 4000000;
+    int repeats = 3;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string option = argv[i];
+        std::string value = argv[i + 1];
+        if (option == "--rows") rows = static_cast<size_t>(std::max(1, std::atoi(value.c_str())));
+        else if (option == "--repeats") repeats = std::max(1, std::atoi(value.c_str()));
+        else {
+            std::cerr << "Usage: triangle-bench [--rows N] [--repeats N]\n";
+            return 1;
+        }
+    }
+
+    // Исходные треугольники и строки с тремя известными элементами из них
+    std::mt19937 generator(12345);
+    std::uniform_real_distribution<double> side(0.1, 10.0);
+    std::uniform_real_distribution<double> share(0.02, 0.98);
+    std::vector<TriangleSpec> specs(rows);
+    std::vector<double> truth(6 * rows);
+    for (size_t i = 0; i < rows; i++) {
+        double s[3], t[3];
+        s[0] = side(generator);
+        s[1] = side(generator);
+        double low = std::fabs(s[0] - s[1]);
+        s[2] = low + (s[0] + s[1] - low) * share(generator);
+        triangleAngles(s[0], s[1], s[2], t);
+        std::copy(s, s + 3, &truth[6 * i]);
+        std::copy(t, t + 3, &truth[6 * i + 3]);
+
+        TriangleSpec& spec = specs[i];
+        std::fill(spec.sides, spec.sides + 3, TRIANGLE_UNKNOWN);
+        std::fill(spec.angles, spec.angles + 3, TRIANGLE_UNKNOWN);
+        int r = static_cast<int>(i / 5 % 3), r1 = (r + 1) % 3, r2 = (r + 2) % 3;
+        switch (i % 5) {
+        case 0: std::copy(s, s + 3, spec.sides); break;                                    // SSS
+        case 1: spec.angles[r] = t[r]; spec.sides[r1] = s[r1]; spec.sides[r2] = s[r2]; break;  // SAS
+        case 2: spec.sides[r] = s[r]; spec.angles[r1] = t[r1]; spec.angles[r2] = t[r2]; break; // ASA
+        case 3: spec.sides[r] = s[r]; spec.angles[r] = t[r]; spec.angles[r1] = t[r1]; break;   // AAS
+        default: spec.angles[r] = t[r]; spec.sides[r] = s[r]; spec.sides[r1] = s[r1]; break;   // SSA
+        }
+    }
+
+    std::vector<TriangleSolution> serial(rows), batch(rows);
+    double serialTime = measure([&]() {
+        for (size_t i = 0; i < rows; i++) serial[i] = solveTriangle(specs[i]);
+    }, repeats);
+    double batchTime = measure([&]() {
+        solveTriangles(specs.data(), rows, batch.data());
+    }, repeats);
+
+    // Для SSA исходный треугольник - одно из решений
+    double error = 0.0;
+    size_t unsolved = 0;
+    for (size_t i = 0; i < rows; i++) {
+        const TriangleSolution& solution = batch[i];
+        if (solution.count == 0) {
+            unsolved++;
+            continue;
+        }
+        double best = 1e300;
+        for (int k = 0; k < solution.count; k++) {
+            double e = 0.0;
+            for (int q = 0; q < 3; q++) {
+                e = std::max(e, std::fabs(solution.sides[k][q] - truth[6 * i + q]) / truth[6 * i + q]);
+                e = std::max(e, std::fabs(solution.angles[k][q] - truth[6 * i + 3 + q]));
+            }
+            best = std::min(best, e);
+        }
+        error = std::max(error, best);
+    }
+
+    std::printf("%10s %12s %12s %12s %12s %10s %12s\n",
+                "rows", "serial ms", "rows/s", "batch ms", "rows/s", "unsolved", "max error");
+    std::printf("%10zu %12.1f %12.3g %12.1f %12.3g %10zu %12.3g\n", rows,
+                serialTime * 1e3, rows / serialTime, batchTime * 1e3, rows / batchTime, unsolved, error);
+    return 0;
+}
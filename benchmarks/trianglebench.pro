@@ -0,0 +1,15 @@
+# Пакетное решение треугольников по трём известным элементам
+TEMPLATE = app
+TARGET = triangle-bench
+
+CONFIG += console c++11 thread
+CONFIG -= app_bundle qt
+
+INCLUDEPATH += ..
+
+SOURCES += \
+    ../trianglesolver.cpp \
+    trianglebench.cpp
+
+HEADERS += \
+    ../trianglesolver.h
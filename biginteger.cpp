@@ -0,0 +1,613 @@
+#include "biginteger.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+namespace {
+
+const uint64_t DIGIT_BASE = 1ull << 32;
+// Наибольшая степень 10 в одной цифре - для перевода в десятичную запись
+const uint32_t DECIMAL_CHUNK = 1000000000u;
+const int DECIMAL_CHUNK_DIGITS = 9;
+
+int leadingZeros(uint32_t x) {
+#if defined(__GNUC__)
+    return x ? __builtin_clz(x) : 32;
+#else
+    int n = 0;
+    for (uint32_t bit = 0x80000000u; bit && !(x & bit); bit >>= 1) n++;
+    return n;
+#endif
+}
+
+int trailingZeros(uint64_t x) {
+#if defined(__GNUC__)
+    return __builtin_ctzll(x);
+#else
+    int n = 0;
+    for (; !(x & 1); x >>= 1) n++;
+    return n;
+#endif
+}
+
+// Бинарный НОД (Стейн): только сдвиги и вычитания
+uint64_t binaryGcd(uint64_t u, uint64_t v) {
+
+    if (u == 0) return v;
+    if (v == 0) return u;
+    int shift = trailingZeros(u | v);
+    u >>= trailingZeros(u);
+    do {
+        v >>= trailingZeros(v);
+        if (u > v) std::swap(u, v);
+        v -= u;
+    } while (v != 0);
+    return u << shift;
+}
+
+} // namespace
+
+BigInteger::BigInteger(int64_t value) {
+
+    negative = value < 0;
+    uint64_t magnitude = negative ? ~static_cast<uint64_t>(value) + 1 : static_cast<uint64_t>(value);
+    local[0] = static_cast<uint32_t>(magnitude);
+    local[1] = static_cast<uint32_t>(magnitude >> 32);
+    count = local[1] ? 2 : local[0] ? 1 : 0;
+}
+
+BigInteger::BigInteger(const BigInteger& other) {
+
+    allocate(other.count);
+    std::memcpy(digits, other.digits, other.count * sizeof(uint32_t));
+    count = other.count;
+    negative = other.negative;
+}
+
+BigInteger::BigInteger(BigInteger&& other) {
+    *this = std::move(other);
+}
+
+BigInteger& BigInteger::operator=(const BigInteger& other) {
+
+    if (this != &other) {
+        allocate(other.count);
+        std::memcpy(digits, other.digits, other.count * sizeof(uint32_t));
+        count = other.count;
+        negative = other.negative;
+    }
+    return *this;
+}
+
+BigInteger& BigInteger::operator=(BigInteger&& other) {
+
+    if (this == &other) {
+        return *this;
+    }
+    if (other.digits != other.local) {
+        // Буфер в куче переходит без копирования
+        if (digits != local) {
+            delete[] digits;
+        }
+        digits = other.digits;
+        capacity = other.capacity;
+        other.digits = other.local;
+        other.capacity = INLINE_DIGITS;
+    } else {
+        allocate(other.count);
+        std::memcpy(digits, other.digits, other.count * sizeof(uint32_t));
+    }
+    count = other.count;
+    negative = other.negative;
+    other.count = 0;
+    other.negative = false;
+    return *this;
+}
+
+BigInteger::~BigInteger() {
+
+    if (digits != local) {
+        delete[] digits;
+    }
+}
+
+void BigInteger::allocate(size_t size) {
+
+    if (size <= capacity) {
+        return;
+    }
+    if (digits != local) {
+        delete[] digits;
+    }
+    capacity = static_cast<uint32_t>(std::max<size_t>(size, 2 * capacity));
+    digits = new uint32_t[capacity];
+}
+
+void BigInteger::reserve(size_t size) {
+
+    if (size <= capacity) {
+        return;
+    }
+    uint32_t newCapacity = static_cast<uint32_t>(std::max<size_t>(size, 2 * capacity));
+    uint32_t* buffer = new uint32_t[newCapacity];
+    std::memcpy(buffer, digits, count * sizeof(uint32_t));
+    if (digits != local) {
+        delete[] digits;
+    }
+    digits = buffer;
+    capacity = newCapacity;
+}
+
+void BigInteger::trim() {
+
+    while (count > 0 && digits[count - 1] == 0) {
+        count--;
+    }
+    if (count == 0) {
+        negative = false;
+    }
+}
+
+uint64_t BigInteger::low64() const {
+
+    return count == 0 ? 0 : count == 1 ? digits[0]
+                                       : digits[0] | static_cast<uint64_t>(digits[1]) << 32;
+}
+
+bool BigInteger::toInt64(int64_t& value) const {
+
+    if (count > 2) {
+        return false;
+    }
+    uint64_t magnitude = low64();
+    if (magnitude > (negative ? 1ull << 63 : (1ull << 63) - 1)) {
+        return false;
+    }
+    value = negative ? static_cast<int64_t>(~magnitude + 1) : static_cast<int64_t>(magnitude);
+    return true;
+}
+
+size_t BigInteger::bitLength() const {
+    return count == 0 ? 0 : 32 * count - leadingZeros(digits[count - 1]);
+}
+
+uint64_t BigInteger::bitsFrom(size_t shift) const {
+
+    size_t index = shift / 32;
+    unsigned int bit = shift % 32;
+    uint64_t result = 0;
+    // Три цифры покрывают 64 бита при любом сдвиге внутри цифры
+    for (size_t k = 0; k < 3 && index + k < count; k++) {
+        uint64_t digit = digits[index + k];
+        int position = static_cast<int>(32 * k) - static_cast<int>(bit);
+        result |= position >= 0 ? (position < 64 ? digit << position : 0) : digit >> -position;
+    }
+    return result;
+}
+
+long double BigInteger::toLongDouble(long& exponent) const {
+
+    size_t bits = bitLength();
+    exponent = static_cast<long>(bits);
+    if (bits == 0) {
+        return 0.0L;
+    }
+    uint64_t top = bits > 64 ? bitsFrom(bits - 64) : low64() << (64 - bits);
+    long double mantissa = std::ldexp(static_cast<long double>(top), -64);
+    return negative ? -mantissa : mantissa;
+}
+
+long double BigInteger::toLongDouble() const {
+
+    long exponent = 0;
+    long double mantissa = toLongDouble(exponent);
+    return std::ldexp(mantissa, static_cast<int>(std::min<long>(exponent, 1 << 20)));
+}
+
+BigInteger BigInteger::operator-() const {
+
+    BigInteger result(*this);
+    result.negative = count != 0 && !negative;
+    return result;
+}
+
+BigInteger BigInteger::abs() const {
+
+    BigInteger result(*this);
+    result.negative = false;
+    return result;
+}
+
+int BigInteger::compareMagnitude(const BigInteger& a, const BigInteger& b) {
+
+    if (a.count != b.count) {
+        return a.count < b.count ? -1 : 1;
+    }
+    for (size_t i = a.count; i-- > 0;) {
+        if (a.digits[i] != b.digits[i]) {
+            return a.digits[i] < b.digits[i] ? -1 : 1;
+        }
+    }
+    return 0;
+}
+
+int BigInteger::compare(const BigInteger& a, const BigInteger& b) {
+
+    if (a.negative != b.negative) {
+        return a.negative ? -1 : 1;
+    }
+    int magnitude = compareMagnitude(a, b);
+    return a.negative ? -magnitude : magnitude;
+}
+
+void BigInteger::addMagnitude(const BigInteger& x, const BigInteger& y, BigInteger& result) {
+
+    const BigInteger& a = x.count >= y.count ? x : y;
+    const BigInteger& b = x.count >= y.count ? y : x;
+    result.allocate(a.count + 1);
+    uint64_t carry = 0;
+    for (size_t i = 0; i < a.count; i++) {
+        uint64_t sum = static_cast<uint64_t>(a.digits[i]) + (i < b.count ? b.digits[i] : 0) + carry;
+        result.digits[i] = static_cast<uint32_t>(sum);
+        carry = sum >> 32;
+    }
+    result.digits[a.count] = static_cast<uint32_t>(carry);
+    result.count = a.count + 1;
+    result.trim();
+}
+
+void BigInteger::subtractMagnitude(const BigInteger& a, const BigInteger& b, BigInteger& result) {
+
+    result.allocate(a.count);
+    int64_t borrow = 0;
+    for (size_t i = 0; i < a.count; i++) {
+        int64_t difference = static_cast<int64_t>(a.digits[i]) - (i < b.count ? b.digits[i] : 0) - borrow;
+        borrow = difference < 0;
+        result.digits[i] = static_cast<uint32_t>(difference + (borrow ? static_cast<int64_t>(DIGIT_BASE) : 0));
+    }
+    result.count = a.count;
+    result.trim();
+}
+
+void BigInteger::addSigned(const BigInteger& a, const BigInteger& b, bool subtract, BigInteger& result) {
+
+    bool bNegative = subtract ? !b.negative && b.count != 0 : b.negative;
+    if (a.negative == bNegative) {
+        addMagnitude(a, b, result);
+        result.negative = a.negative && result.count != 0;
+    } else if (compareMagnitude(a, b) >= 0) {
+        subtractMagnitude(a, b, result);
+        result.negative = a.negative && result.count != 0;
+    } else {
+        subtractMagnitude(b, a, result);
+        result.negative = bNegative && result.count != 0;
+    }
+}
+
+BigInteger operator+(const BigInteger& a, const BigInteger& b) {
+
+    BigInteger result;
+    BigInteger::addSigned(a, b, false, result);
+    return result;
+}
+
+BigInteger operator-(const BigInteger& a, const BigInteger& b) {
+
+    BigInteger result;
+    BigInteger::addSigned(a, b, true, result);
+    return result;
+}
+
+void BigInteger::multiplyMagnitude(const BigInteger& a, const BigInteger& b, BigInteger& result) {
+
+    if (a.count == 0 || b.count == 0) {
+        result.count = 0;
+        return;
+    }
+    size_t n = a.count + b.count;
+    result.allocate(n);
+    std::fill(result.digits, result.digits + n, 0u);
+    for (size_t i = 0; i < a.count; i++) {
+        uint64_t carry = 0;
+        uint64_t ai = a.digits[i];
+        for (size_t j = 0; j < b.count; j++) {
+            uint64_t t = ai * b.digits[j] + result.digits[i + j] + carry;
+            result.digits[i + j] = static_cast<uint32_t>(t);
+            carry = t >> 32;
+        }
+        result.digits[i + b.count] = static_cast<uint32_t>(carry);
+    }
+    result.count = static_cast<uint32_t>(n);
+    result.trim();
+}
+
+BigInteger operator*(const BigInteger& a, const BigInteger& b) {
+
+    BigInteger result;
+    BigInteger::multiplyMagnitude(a, b, result);
+    result.negative = result.count != 0 && a.negative != b.negative;
+    return result;
+}
+
+void BigInteger::multiplyAddSmall(uint32_t factor, uint32_t addend) {
+
+    uint64_t carry = addend;
+    for (size_t i = 0; i < count; i++) {
+        uint64_t t = static_cast<uint64_t>(digits[i]) * factor + carry;
+        digits[i] = static_cast<uint32_t>(t);
+        carry = t >> 32;
+    }
+    if (carry) {
+        reserve(count + 1);
+        digits[count++] = static_cast<uint32_t>(carry);
+    }
+}
+
+uint32_t BigInteger::divideSmall(const BigInteger& a, uint32_t divisor, BigInteger& quotient) {
+
+    quotient.allocate(a.count);
+    uint64_t remainder = 0;
+    for (size_t i = a.count; i-- > 0;) {
+        uint64_t current = remainder << 32 | a.digits[i];
+        quotient.digits[i] = static_cast<uint32_t>(current / divisor);
+        remainder = current % divisor;
+    }
+    quotient.count = a.count;
+    quotient.negative = false;
+    quotient.trim();
+    return static_cast<uint32_t>(remainder);
+}
+
+void BigInteger::shiftRight(size_t bits) {
+
+    size_t whole = bits / 32;
+    unsigned int part = bits % 32;
+    if (whole >= count) {
+        count = 0;
+        negative = false;
+        return;
+    }
+    size_t n = count - whole;
+    for (size_t i = 0; i < n; i++) {
+        uint64_t pair = digits[i + whole] | (i + whole + 1 < count ? static_cast<uint64_t>(digits[i + whole + 1]) << 32 : 0);
+        digits[i] = static_cast<uint32_t>(pair >> part);
+    }
+    count = static_cast<uint32_t>(n);
+    trim();
+}
+
+// Алгоритм D (Кнут, т. 2, 4.3.1) в записи "Алгоритмических трюков"
+// Уоррена: делитель нормализуется так, чтобы старший бит старшей цифры
+// был 1, тогда пробная цифра частного ошибается не больше чем на 2
+void BigInteger::divideMagnitude(const BigInteger& a, const BigInteger& b,
+                                 BigInteger& quotient, BigInteger& remainder) {
+
+    if (compareMagnitude(a, b) < 0) {
+        quotient = BigInteger();
+        remainder = a;
+        remainder.negative = false;
+        return;
+    }
+    if (b.count == 1) {
+        uint32_t rest = divideSmall(a, b.digits[0], quotient);
+        remainder = BigInteger(static_cast<int64_t>(rest));
+        return;
+    }
+
+    size_t n = b.count;
+    size_t m = a.count - n;
+    int s = leadingZeros(b.digits[n - 1]);
+    BigInteger vn, un;
+    vn.allocate(n);
+    un.allocate(a.count + 1);
+    for (size_t i = n - 1; i > 0; i--) {
+        vn.digits[i] = s ? (b.digits[i] << s) | (b.digits[i - 1] >> (32 - s)) : b.digits[i];
+    }
+    vn.digits[0] = b.digits[0] << s;
+    un.digits[a.count] = s ? a.digits[a.count - 1] >> (32 - s) : 0;
+    for (size_t i = a.count - 1; i > 0; i--) {
+        un.digits[i] = s ? (a.digits[i] << s) | (a.digits[i - 1] >> (32 - s)) : a.digits[i];
+    }
+    un.digits[0] = a.digits[0] << s;
+
+    quotient.allocate(m + 1);
+    for (size_t j = m + 1; j-- > 0;) {
+        uint64_t numerator = static_cast<uint64_t>(un.digits[j + n]) << 32 | un.digits[j + n - 1];
+        uint64_t qhat = numerator / vn.digits[n - 1];
+        uint64_t rhat = numerator % vn.digits[n - 1];
+        while (qhat >= DIGIT_BASE || qhat * vn.digits[n - 2] > (rhat << 32 | un.digits[j + n - 2])) {
+            qhat--;
+            rhat += vn.digits[n - 1];
+            if (rhat >= DIGIT_BASE) break;
+        }
+
+        // Вычитание qhat * делитель
+        int64_t borrow = 0;
+        int64_t t = 0;
+        for (size_t i = 0; i < n; i++) {
+            uint64_t p = qhat * vn.digits[i];
+            t = static_cast<int64_t>(un.digits[i + j]) - borrow - static_cast<int64_t>(p & 0xffffffffu);
+            un.digits[i + j] = static_cast<uint32_t>(t);
+            borrow = static_cast<int64_t>(p >> 32) - (t >> 32);
+        }
+        t = static_cast<int64_t>(un.digits[j + n]) - borrow;
+        un.digits[j + n] = static_cast<uint32_t>(t);
+
+        // Пробная цифра была на 1 больше: делитель прибавляется обратно
+        if (t < 0) {
+            qhat--;
+            uint64_t carry = 0;
+            for (size_t i = 0; i < n; i++) {
+                uint64_t sum = static_cast<uint64_t>(un.digits[i + j]) + vn.digits[i] + carry;
+                un.digits[i + j] = static_cast<uint32_t>(sum);
+                carry = sum >> 32;
+            }
+            un.digits[j + n] += static_cast<uint32_t>(carry);
+        }
+        quotient.digits[j] = static_cast<uint32_t>(qhat);
+    }
+    quotient.count = static_cast<uint32_t>(m + 1);
+    quotient.negative = false;
+    quotient.trim();
+
+    remainder.allocate(n);
+    for (size_t i = 0; i < n; i++) {
+        remainder.digits[i] = s ? (un.digits[i] >> s) | (un.digits[i + 1] << (32 - s)) : un.digits[i];
+    }
+    remainder.count = static_cast<uint32_t>(n);
+    remainder.negative = false;
+    remainder.trim();
+}
+
+void BigInteger::divide(const BigInteger& dividend, const BigInteger& divisor,
+                        BigInteger& quotient, BigInteger& remainder) {
+
+    BigInteger q, r;
+    divideMagnitude(dividend, divisor, q, r);
+    q.negative = q.count != 0 && dividend.negative != divisor.negative;
+    r.negative = r.count != 0 && dividend.negative;
+    quotient = std::move(q);
+    remainder = std::move(r);
+}
+
+BigInteger operator/(const BigInteger& a, const BigInteger& b) {
+
+    BigInteger quotient, remainder;
+    BigInteger::divide(a, b, quotient, remainder);
+    return quotient;
+}
+
+BigInteger operator%(const BigInteger& a, const BigInteger& b) {
+
+    BigInteger quotient, remainder;
+    BigInteger::divide(a, b, quotient, remainder);
+    return remainder;
+}
+
+// Алгоритм Лемера (Кнут, т. 2, 4.5.2, алгоритм L): шаги Евклида
+// выполняются над старшими 62 битами, пока частные совпадают для обеих
+// границ приближения, и затем применяются к длинным числам одной
+// линейной комбинацией вместо деления длинных чисел на каждом шаге.
+// Когда оба числа укладываются в 64 бита - бинарный НОД
+BigInteger BigInteger::gcd(const BigInteger& first, const BigInteger& second) {
+
+    BigInteger x = first.abs();
+    BigInteger y = second.abs();
+    if (compareMagnitude(x, y) < 0) {
+        std::swap(x, y);
+    }
+    while (!y.isZero()) {
+        if (x.count <= 2) {
+            return BigInteger(static_cast<int64_t>(binaryGcd(x.low64(), y.low64())));
+        }
+        size_t shift = x.bitLength() - 62;
+        int64_t xh = static_cast<int64_t>(x.bitsFrom(shift) & ((1ull << 62) - 1));
+        int64_t yh = y.bitLength() > shift ? static_cast<int64_t>(y.bitsFrom(shift) & ((1ull << 62) - 1)) : 0;
+        int64_t a = 1, b = 0, c = 0, d = 1;
+        while (yh + c != 0 && yh + d != 0) {
+            int64_t q = (xh + a) / (yh + c);
+            if (q != (xh + b) / (yh + d)) {
+                break;
+            }
+            int64_t t = a - q * c; a = c; c = t;
+            t = b - q * d; b = d; d = t;
+            t = xh - q * yh; xh = yh; yh = t;
+        }
+        if (b == 0) {
+            // Приближение не дало ни одного шага: одно деление длинных чисел
+            BigInteger q, r;
+            divideMagnitude(x, y, q, r);
+            x = std::move(y);
+            y = std::move(r);
+        } else {
+            BigInteger nextX = x * BigInteger(a) + y * BigInteger(b);
+            BigInteger nextY = x * BigInteger(c) + y * BigInteger(d);
+            x = std::move(nextX);
+            y = std::move(nextY);
+        }
+    }
+    return x;
+}
+
+BigInteger BigInteger::power(const BigInteger& base, uint64_t exponent) {
+
+    BigInteger result(1);
+    BigInteger square(base);
+    while (exponent) {
+        if (exponent & 1) {
+            result = result * square;
+        }
+        exponent >>= 1;
+        if (exponent) {
+            square = square * square;
+        }
+    }
+    return result;
+}
+
+// Метод Ньютона с начальным приближением сверху: последовательность
+// убывает, пока не достигнет целой части корня
+BigInteger BigInteger::squareRoot(const BigInteger& n) {
+
+    if (n.count == 0 || n.negative) {
+        return BigInteger();
+    }
+    BigInteger x = power(BigInteger(2), (n.bitLength() + 1) / 2);
+    for (;;) {
+        BigInteger y = x + n / x;
+        y.shiftRight(1);
+        if (compareMagnitude(y, x) >= 0) {
+            return x;
+        }
+        x = std::move(y);
+    }
+}
+
+bool BigInteger::fromDecimal(const char* text, size_t length, BigInteger& result) {
+
+    result = BigInteger();
+    for (size_t i = 0; i < length;) {
+        size_t chunk = std::min<size_t>(DECIMAL_CHUNK_DIGITS, length - i);
+        uint32_t value = 0;
+        uint32_t scale = 1;
+        for (size_t k = 0; k < chunk; k++, i++) {
+            if (text[i] < '0' || text[i] > '9') {
+                return false;
+            }
+            value = value * 10 + static_cast<uint32_t>(text[i] - '0');
+            scale *= 10;
+        }
+        if (result.count == 0) {
+            result = BigInteger(static_cast<int64_t>(value));
+        } else {
+            result.multiplyAddSmall(scale, value);
+        }
+    }
+    return true;
+}
+
+std::string BigInteger::toString() const {
+
+    if (count == 0) {
+        return "0";
+    }
+    // Куски по 9 цифр с младших
+    std::vector<uint32_t> chunks;
+    BigInteger rest = abs();
+    while (!rest.isZero()) {
+        BigInteger quotient;
+        chunks.push_back(divideSmall(rest, DECIMAL_CHUNK, quotient));
+        rest = std::move(quotient);
+    }
+    std::string text = negative ? "-" : "";
+    text += std::to_string(chunks.back());
+    for (size_t i = chunks.size() - 1; i-- > 0;) {
+        std::string chunk = std::to_string(chunks[i]);
+        text.append(DECIMAL_CHUNK_DIGITS - chunk.size(), '0');
+        text += chunk;
+    }
+    return text;
+}
@@ -0,0 +1,96 @@
+#ifndef BIGINTEGER_H
+#define BIGINTEGER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Целое произвольной длины: знак и модуль из 32-битных цифр (младшие
+// первыми, без старших нулей). До четырёх цифр (128 бит) хранятся в самом
+// объекте, поэтому обычные числа калькулятора не обращаются к куче.
+// Умножение - школьное, деление - алгоритм D Кнута; НОД - бинарный
+// для 64-битных значений и алгоритм Лемера для длинных
+class BigInteger
+{
+public:
+    BigInteger() = default;
+    BigInteger(int64_t);
+    BigInteger(const BigInteger&);
+    BigInteger(BigInteger&&);
+    BigInteger& operator=(const BigInteger&);
+    BigInteger& operator=(BigInteger&&);
+    ~BigInteger();
+
+    // Десятичные цифры без знака; false, если встретилась не цифра
+    static bool fromDecimal(const char* digits, size_t length, BigInteger& result);
+    std::string toString() const;
+
+    bool isZero() const { return count == 0; }
+    bool isNegative() const { return negative; }
+    bool isOne() const { return count == 1 && digits[0] == 1 && !negative; }
+    bool isEven() const { return count == 0 || (digits[0] & 1) == 0; }
+    // Значение, если оно помещается в int64_t
+    bool toInt64(int64_t& value) const;
+    size_t bitLength() const;
+    // Старшие биты: value = mantissa * 2^exponent с mantissa в [0.5, 1)
+    long double toLongDouble(long& exponent) const;
+    long double toLongDouble() const;
+
+    BigInteger operator-() const;
+    BigInteger abs() const;
+
+    friend BigInteger operator+(const BigInteger&, const BigInteger&);
+    friend BigInteger operator-(const BigInteger&, const BigInteger&);
+    friend BigInteger operator*(const BigInteger&, const BigInteger&);
+    // Частное с округлением к нулю и остаток со знаком делимого; divisor != 0
+    static void divide(const BigInteger& dividend, const BigInteger& divisor,
+                       BigInteger& quotient, BigInteger& remainder);
+    friend BigInteger operator/(const BigInteger&, const BigInteger&);
+    friend BigInteger operator%(const BigInteger&, const BigInteger&);
+
+    // Неотрицательный НОД; gcd(0, 0) = 0
+    static BigInteger gcd(const BigInteger&, const BigInteger&);
+    static BigInteger power(const BigInteger& base, uint64_t exponent);
+    // Целая часть квадратного корня из неотрицательного числа
+    static BigInteger squareRoot(const BigInteger&);
+
+    // Сравнение со знаком: -1, 0, 1
+    static int compare(const BigInteger&, const BigInteger&);
+    friend bool operator==(const BigInteger& a, const BigInteger& b) { return compare(a, b) == 0; }
+    friend bool operator!=(const BigInteger& a, const BigInteger& b) { return compare(a, b) != 0; }
+    friend bool operator<(const BigInteger& a, const BigInteger& b) { return compare(a, b) < 0; }
+
+private:
+    static const size_t INLINE_DIGITS = 4;
+
+    // Место под size цифр; значения не сохраняются
+    void allocate(size_t size);
+    // Место под size цифр с сохранением значения
+    void reserve(size_t size);
+    void trim();
+    uint64_t low64() const;
+
+    // Операции над модулями
+    static int compareMagnitude(const BigInteger&, const BigInteger&);
+    static void addMagnitude(const BigInteger&, const BigInteger&, BigInteger& result);
+    // a + b или a - b со знаками
+    static void addSigned(const BigInteger& a, const BigInteger& b, bool subtract, BigInteger& result);
+    // |a| >= |b|
+    static void subtractMagnitude(const BigInteger&, const BigInteger&, BigInteger& result);
+    static void multiplyMagnitude(const BigInteger&, const BigInteger&, BigInteger& result);
+    // Деление модуля на одну цифру, возвращает остаток
+    static uint32_t divideSmall(const BigInteger&, uint32_t divisor, BigInteger& quotient);
+    static void divideMagnitude(const BigInteger&, const BigInteger&, BigInteger& quotient, BigInteger& remainder);
+    void multiplyAddSmall(uint32_t factor, uint32_t addend);
+    void shiftRight(size_t bits);
+    // Биты модуля начиная с shift, младшие 64
+    uint64_t bitsFrom(size_t shift) const;
+
+    uint32_t* digits = local;
+    uint32_t count = 0;
+    uint32_t capacity = INLINE_DIGITS;
+    bool negative = false;
+    uint32_t local[INLINE_DIGITS];
+};
+
+#endif // BIGINTEGER_H
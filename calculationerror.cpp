@@ -0,0 +1,27 @@
+#include "calculationerror.h"
+
+std::string CalculationError::message(const std::string &expression) const {
+
+    std::string fragment = offset < expression.size() ? expression.substr(offset, length) : std::string();
+
+    switch (code) {
+    case NONE: return std::string();
+    case UNBALANCED_PARENTHESES: return "Unbalanced parentheses";
+    case UNEXPECTED_CHARACTER: return "Unexpected character: " + fragment;
+    case UNKNOWN_IDENTIFIER: return "Unknown identifier: " + fragment;
+    case UNKNOWN_FUNCTION: return "Unknown function: " + fragment;
+    case INVALID_EXPRESSION: return "Invalid expression";
+    case INVALID_FUNCTION_ARGUMENT: return "Invalid expression for function " + fragment;
+    case DIVISION_BY_ZERO: return "Division by zero";
+    case COMPLEX_IN_REAL_MODE: return "Complex value in real mode: " + fragment;
+    case CANCELLED: return "Calculation cancelled";
+    case MATRIX_IN_SCALAR_MODE: return "Matrix value in scalar mode: " + fragment;
+    case DIMENSION_MISMATCH: return "Dimension mismatch: " + fragment;
+    case SINGULAR_MATRIX: return "Singular matrix: " + fragment;
+    case INVALID_DISTRIBUTION: return "Invalid distribution: " + fragment;
+    case CIRCULAR_REFERENCE: return "Circular reference: " + fragment;
+    case INVALID_REFERENCE: return "Reference to a cell without a number: " + fragment;
+    case NO_CONVERGENCE: return "No convergence: " + fragment;
+    }
+    return "Unknown error";
+}
@@ -0,0 +1,42 @@
+#ifndef CALCULATIONERROR_H
+#define CALCULATIONERROR_H
+
+#include <string>
+#include <cstddef>
+
+// Ошибка разбора или вычисления выражения с позицией в исходной строке.
+// Возвращается без исключений, поэтому почти ничего не стоит
+// при пакетной обработке, где многие строки могут быть ошибочными
+struct CalculationError
+{
+    enum Code {
+        NONE = 0,
+        UNBALANCED_PARENTHESES,
+        UNEXPECTED_CHARACTER,
+        UNKNOWN_IDENTIFIER,
+        UNKNOWN_FUNCTION,
+        INVALID_EXPRESSION,
+        INVALID_FUNCTION_ARGUMENT,
+        DIVISION_BY_ZERO,
+        COMPLEX_IN_REAL_MODE,
+        CANCELLED,
+        MATRIX_IN_SCALAR_MODE,
+        DIMENSION_MISMATCH,
+        SINGULAR_MATRIX,
+        INVALID_DISTRIBUTION,
+        CIRCULAR_REFERENCE,
+        INVALID_REFERENCE,
+        NO_CONVERGENCE          // integral не достиг точности
+    };
+
+    Code code = NONE;
+    size_t offset = 0;   // смещение в байтах от начала исходной строки
+    size_t length = 0;   // длина ошибочного фрагмента в байтах
+
+    bool ok() const { return code == NONE; }
+
+    // Текст ошибки, например "Unknown identifier: foo"
+    std::string message(const std::string& expression) const;
+};
+
+#endif // CALCULATIONERROR_H
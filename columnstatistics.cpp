@@ -0,0 +1,397 @@
+#include "columnstatistics.h"
+#include "csvformat.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define COLUMN_STATISTICS_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+// Значений в блоке массива: состояние блока считается пакетными
+// add(x, n), которые векторизуются
+const size_t VALUE_BLOCK = 65536;
+// Байт в блоке файла
+const size_t FILE_BLOCK = size_t(4) << 20;
+
+// blocks блоков: process(block, state) заполняет состояние блока (в любом
+// потоке), merge(state) получает их строго по порядку номеров. Блок,
+// который закончился раньше предыдущих, ждёт в pending. false - отмена
+template <typename State, typename Process, typename Merge>
+bool reduceInOrder(size_t blocks, unsigned int threads, const std::atomic<bool>* cancel,
+                   Process process, Merge merge) {
+
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    threads = static_cast<unsigned int>(std::min<size_t>(threads, std::max<size_t>(blocks, 1)));
+
+    std::vector<std::unique_ptr<State>> pending(blocks);
+    size_t nextMerged = 0;
+    std::mutex mergeMutex;
+    std::atomic<size_t> next(0);
+    std::atomic<bool> stopped(false);
+
+    auto worker = [&]() {
+        for (size_t block = next++; block < blocks && !stopped.load(); block = next++) {
+            if (cancel && cancel->load()) {
+                stopped = true;
+                break;
+            }
+            std::unique_ptr<State> state(new State());
+            process(block, *state);
+
+            std::lock_guard<std::mutex> lock(mergeMutex);
+            pending[block] = std::move(state);
+            while (nextMerged < blocks && pending[nextMerged]) {
+                merge(*pending[nextMerged]);
+                pending[nextMerged++].reset();
+            }
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (unsigned int i = 1; i < threads; i++) {
+        pool.emplace_back(worker);
+    }
+    worker();
+    for (std::thread& thread : pool) {
+        thread.join();
+    }
+    return !stopped;
+}
+
+// Состояние блока файла
+struct FileBlock
+{
+    uint64_t rows = 0;
+    std::vector<ColumnSummary> summaries;
+    RunningCovariance covariance;
+};
+
+// Разбор строк файла: slots[номер поля] - место столбца в сводке или -1
+class CsvColumns
+{
+public:
+    CsvColumns(const std::vector<size_t>& columns, char delimiter)
+        : columns(columns), delimiter(delimiter), decimal(csv::decimalFor(delimiter)) {
+
+        size_t count = columns.empty() ? 0 : *std::max_element(columns.begin(), columns.end()) + 1;
+        slots.assign(count, -1);
+        for (size_t k = 0; k < columns.size(); k++) {
+            if (slots[columns[k]] < 0) {
+                slots[columns[k]] = static_cast<int>(k);
+            }
+        }
+    }
+
+    // Строки [begin, end), end - после перевода строки или конец файла
+    void process(const char* begin, const char* end, FileBlock& block) const {
+
+        std::vector<std::vector<double>> values(columns.size());
+        const double nan = std::numeric_limits<double>::quiet_NaN();
+        std::vector<double> row(columns.size());
+        for (const char* line = begin; line < end;) {
+            const char* lineEnd = static_cast<const char*>(std::memchr(line, '\n', end - line));
+            lineEnd = lineEnd ? lineEnd : end;
+            const char* contentEnd = lineEnd;
+            if (contentEnd > line && contentEnd[-1] == '\r') {
+                contentEnd--;
+            }
+            if (contentEnd > line) {
+                std::fill(row.begin(), row.end(), nan);
+                parseLine(line, contentEnd, row.data());
+                for (size_t k = 0; k < columns.size(); k++) {
+                    values[k].push_back(row[k]);
+                }
+                block.rows++;
+            }
+            line = lineEnd + 1;
+        }
+
+        block.summaries.resize(columns.size());
+        for (size_t k = 0; k < columns.size(); k++) {
+            ColumnSummary& summary = block.summaries[k];
+            summary.moments.add(values[k].data(), values[k].size());
+            summary.quantiles.add(values[k].data(), values[k].size());
+            summary.values = summary.moments.count;
+            summary.skipped = block.rows - summary.values;
+        }
+        if (columns.size() >= 2) {
+            block.covariance.add(values[0].data(), values[1].data(), block.rows);
+        }
+    }
+
+private:
+    void parseLine(const char* line, const char* end, double* row) const {
+
+        size_t field = 0;
+        const char* start = line;
+        bool quoted = false;
+        bool fieldQuoted = false;
+        for (const char* p = line; field < slots.size(); p++) {
+            if (p < end && *p == '"') {
+                quoted = !quoted;
+                fieldQuoted = true;
+                continue;
+            }
+            if (p < end && (quoted || *p != delimiter)) {
+                continue;
+            }
+            // Поле [start, p); числа в кавычках - текст, как при импорте в таблицу
+            int slot = slots[field];
+            double number;
+            if (slot >= 0 && !fieldQuoted
+                    && (csv::parseNumber(start, p, '.', number) || csv::parseNumber(start, p, decimal, number))) {
+                row[slot] = number;
+            }
+            if (p == end) {
+                break;
+            }
+            field++;
+            start = p + 1;
+            fieldQuoted = false;
+        }
+    }
+
+    const std::vector<size_t>& columns;
+    char delimiter;
+    char decimal;
+    std::vector<int> slots;
+};
+
+// Число полей первой строки
+size_t fieldCount(const char* begin, const char* end, char delimiter) {
+
+    size_t count = 1;
+    bool quoted = false;
+    for (const char* p = begin; p < end && (quoted || *p != '\n'); p++) {
+        if (*p == '"') {
+            quoted = !quoted;
+        } else if (!quoted && *p == delimiter) {
+            count++;
+        }
+    }
+    return count;
+}
+
+void mergeBlock(FileSummary& summary, const FileBlock& block) {
+
+    summary.rows += block.rows;
+    for (size_t k = 0; k < block.summaries.size(); k++) {
+        ColumnSummary& target = summary.summaries[k];
+        target.values += block.summaries[k].values;
+        target.skipped += block.summaries[k].skipped;
+        target.moments.merge(block.summaries[k].moments);
+        target.quantiles.merge(block.summaries[k].quantiles);
+    }
+    summary.covariance.merge(block.covariance);
+}
+
+#ifdef COLUMN_STATISTICS_MMAP
+// Первая строка, начинающаяся не раньше position: блок k содержит строки,
+// которые начинаются в [k * FILE_BLOCK, (k + 1) * FILE_BLOCK)
+size_t lineStart(const char* data, size_t size, size_t position) {
+
+    if (position == 0) {
+        return 0;
+    }
+    if (position >= size) {
+        return size;
+    }
+    const char* newline = static_cast<const char*>(std::memchr(data + position - 1, '\n', size - position + 1));
+    return newline ? static_cast<size_t>(newline - data) + 1 : size;
+}
+#endif
+
+} // namespace
+
+RunningMoments columnMoments(const double *x, size_t n, unsigned int threads) {
+
+    RunningMoments result;
+    reduceInOrder<RunningMoments>((n + VALUE_BLOCK - 1) / VALUE_BLOCK, threads, nullptr,
+        [&](size_t block, RunningMoments& state) {
+            size_t first = block * VALUE_BLOCK;
+            state.add(x + first, std::min(VALUE_BLOCK, n - first));
+        },
+        [&](const RunningMoments& state) { result.merge(state); });
+    return result;
+}
+
+RunningCovariance columnCovariance(const double *x, const double *y, size_t n, unsigned int threads) {
+
+    RunningCovariance result;
+    reduceInOrder<RunningCovariance>((n + VALUE_BLOCK - 1) / VALUE_BLOCK, threads, nullptr,
+        [&](size_t block, RunningCovariance& state) {
+            size_t first = block * VALUE_BLOCK;
+            state.add(x + first, y + first, std::min(VALUE_BLOCK, n - first));
+        },
+        [&](const RunningCovariance& state) { result.merge(state); });
+    return result;
+}
+
+double columnQuantile(const double *x, size_t n, double q) {
+
+    std::vector<double> finite;
+    finite.reserve(n);
+    for (size_t i = 0; i < n; i++) {
+        if (std::isfinite(x[i])) {
+            finite.push_back(x[i]);
+        }
+    }
+    if (finite.empty() || !(q >= 0.0 && q <= 1.0)) {
+        return std::numeric_limits<double>::quiet_NaN();
+    }
+    // Позиция q (n - 1): между порядковыми статистиками lower и lower + 1
+    double position = q * (finite.size() - 1);
+    size_t lower = static_cast<size_t>(position);
+    double fraction = position - lower;
+    std::nth_element(finite.begin(), finite.begin() + lower, finite.end());
+    double low = finite[lower];
+    if (fraction == 0.0 || lower + 1 >= finite.size()) {
+        return low;
+    }
+    // Следующая статистика - наименьшее справа от lower
+    double high = *std::min_element(finite.begin() + lower + 1, finite.end());
+    return low + fraction * (high - low);
+}
+
+bool summarizeFile(const std::string &path, const std::vector<size_t> &requested,
+                   unsigned int threads, const std::atomic<bool> *cancel,
+                   FileSummary &summary, std::string &error) {
+
+    summary = FileSummary();
+
+#ifdef COLUMN_STATISTICS_MMAP
+    int descriptor = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (descriptor < 0) {
+        error = "Cannot open " + path + ": " + std::strerror(errno);
+        return false;
+    }
+    struct stat status;
+    if (fstat(descriptor, &status) != 0) {
+        error = "Cannot open " + path + ": " + std::strerror(errno);
+        ::close(descriptor);
+        return false;
+    }
+    size_t size = static_cast<size_t>(status.st_size);
+    const char* data = "";
+    void* address = nullptr;
+    if (size > 0) {
+        address = mmap(nullptr, size, PROT_READ, MAP_SHARED, descriptor, 0);
+        if (address == MAP_FAILED) {
+            error = "Cannot map " + path + ": " + std::strerror(errno);
+            ::close(descriptor);
+            return false;
+        }
+        madvise(address, size, MADV_SEQUENTIAL);
+        data = static_cast<const char*>(address);
+    }
+    ::close(descriptor);
+
+    char delimiter = csv::detectDelimiter(data, data + size);
+    summary.columns = requested;
+    if (requested.empty() && size > 0) {
+        size_t count = fieldCount(data, data + size, delimiter);
+        for (size_t k = 0; k < count; k++) {
+            summary.columns.push_back(k);
+        }
+    }
+    summary.summaries.resize(summary.columns.size());
+    CsvColumns parser(summary.columns, delimiter);
+
+    bool finished = reduceInOrder<FileBlock>((size + FILE_BLOCK - 1) / FILE_BLOCK, threads, cancel,
+        [&](size_t block, FileBlock& state) {
+            size_t begin = lineStart(data, size, block * FILE_BLOCK);
+            size_t end = lineStart(data, size, (block + 1) * FILE_BLOCK);
+            parser.process(data + begin, data + end, state);
+        },
+        [&](const FileBlock& state) { mergeBlock(summary, state); });
+    if (address) {
+        munmap(address, size);
+    }
+#else
+    // Последовательное чтение теми же блоками, что и при отображении,
+    // поэтому результат совпадает побитово
+    (void)threads;
+    std::ifstream file(path.c_str(), std::ios::binary);
+    if (!file) {
+        error = "Cannot open " + path;
+        return false;
+    }
+    std::string pending;        // байты с начала текущего блока
+    size_t position = 0;        // смещение pending[0] в файле
+    bool finished = true;
+    bool first = true;
+    char delimiter = ',';
+    std::unique_ptr<CsvColumns> parser;
+    std::vector<char> chunk(FILE_BLOCK);
+    for (size_t target = FILE_BLOCK; !pending.empty() || file; target += FILE_BLOCK) {
+        while (file && position + pending.size() < target) {
+            file.read(chunk.data(), std::min(chunk.size(), target - position - pending.size()));
+            pending.append(chunk.data(), static_cast<size_t>(file.gcount()));
+        }
+        if (target <= position) {
+            continue;
+        }
+        // Конец блока - начало первой строки не раньше target
+        size_t end = std::string::npos;
+        for (size_t from = target - position - 1; ; ) {
+            size_t newline = from < pending.size() ? pending.find('\n', from) : std::string::npos;
+            if (newline != std::string::npos) {
+                end = newline + 1;
+                break;
+            }
+            if (!file) {
+                end = pending.size();
+                break;
+            }
+            from = pending.size();
+            file.read(chunk.data(), chunk.size());
+            pending.append(chunk.data(), static_cast<size_t>(file.gcount()));
+        }
+        if (first) {
+            first = false;
+            delimiter = csv::detectDelimiter(pending.data(), pending.data() + pending.size());
+            summary.columns = requested;
+            if (requested.empty() && !pending.empty()) {
+                size_t count = fieldCount(pending.data(), pending.data() + pending.size(), delimiter);
+                for (size_t k = 0; k < count; k++) {
+                    summary.columns.push_back(k);
+                }
+            }
+            summary.summaries.resize(summary.columns.size());
+            parser.reset(new CsvColumns(summary.columns, delimiter));
+        }
+        if (cancel && cancel->load()) {
+            finished = false;
+            break;
+        }
+        FileBlock state;
+        parser->process(pending.data(), pending.data() + end, state);
+        mergeBlock(summary, state);
+        pending.erase(0, end);
+        position += end;
+    }
+#endif
+
+    if (!finished) {
+        summary = FileSummary();
+        error = "Cancelled";
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,62 @@
+#ifndef COLUMNSTATISTICS_H
+#define COLUMNSTATISTICS_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "statistics.h"
+
+// Статистика столбцов данных за один проход: массив в памяти (значение
+// матричного режима) или столбцы текстового файла, который может не
+// помещаться в память.
+//
+// Данные делятся на блоки фиксированного размера, блоки обрабатываются
+// в нескольких потоках, их частичные состояния (RunningMoments,
+// RunningCovariance, QuantileSketch) объединяются строго по порядку
+// номеров. Поэтому результат одинаков побитово при любом числе потоков.
+// threads = 0 - по числу ядер.
+
+// Моменты значений x[0..n-1]; inf и nan пропускаются
+RunningMoments columnMoments(const double* x, size_t n, unsigned int threads = 0);
+
+// Совместные моменты пар (x[i], y[i])
+RunningCovariance columnCovariance(const double* x, const double* y, size_t n,
+                                   unsigned int threads = 0);
+
+// Точный квантиль q (0 <= q <= 1) конечных значений с линейной
+// интерполяцией между соседними порядковыми статистиками (как
+// PERCENTILE в электронных таблицах). Копирует значения и делит их
+// nth_element, O(n). NaN, если конечных значений нет
+double columnQuantile(const double* x, size_t n, double q);
+
+// Сводка одного столбца файла
+struct ColumnSummary
+{
+    uint64_t values = 0;        // числовые поля
+    uint64_t skipped = 0;       // пустые и нечисловые поля (заголовок), короткие строки
+    RunningMoments moments;
+    QuantileSketch quantiles;   // приближённые квантили
+};
+
+struct FileSummary
+{
+    uint64_t rows = 0;          // непустые строки
+    std::vector<size_t> columns;            // номера столбцов (с 0)
+    std::vector<ColumnSummary> summaries;   // по одному на столбец
+    // Пары первых двух столбцов, где оба поля числовые
+    RunningCovariance covariance;
+};
+
+// Столбцы columns (номера с 0; пусто - все столбцы первой строки) файла
+// CSV. Разделитель полей и десятичный разделитель определяются как при
+// импорте в таблицу (csvformat.h). Файл отображается в память и делится
+// на блоки по границам строк; без mmap читается последовательно теми же
+// блоками. false и error - файл не открыт или вычисление отменено
+bool summarizeFile(const std::string& path, const std::vector<size_t>& columns,
+                   unsigned int threads, const std::atomic<bool>* cancel,
+                   FileSummary& summary, std::string& error);
+
+#endif // COLUMNSTATISTICS_H
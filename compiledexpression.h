@@ -0,0 +1,148 @@
+#ifndef COMPILEDEXPRESSION_H
+#define COMPILEDEXPRESSION_H
+
+#include <memory>
+#include <string>
+#include <vector>
+
+struct BuiltinFunction;
+
+// Единицы измерения углов тригонометрических функций
+enum AngleMode {
+    ANGLE_RADIANS,
+    ANGLE_DEGREES,
+    ANGLE_GRADIANS
+};
+
+// Скомпилированное выражение: ОПН в виде последовательности кодов операций.
+// Программа не зависит от режима вычислений и используется как для
+// действительных, так и для комплексных чисел.
+struct CompiledExpression
+{
+    enum OpCode : unsigned char {
+        OP_CONST,   // константа constants[arg]
+        OP_VAR,     // переменная variables[arg]
+        OP_IMAG,    // мнимая единица i
+        OP_ADD,
+        OP_SUB,
+        OP_MUL,
+        OP_DIV,
+        OP_POW,
+        OP_CALL,    // функция functions[arg]
+        OP_SINCOS,  // sin или cos из общего вычисления sincos: sinCos[arg]
+        OP_STORE,   // сохранить вершину стека в ячейку arg (значение остаётся в стеке)
+        OP_LOAD,    // положить в стек значение ячейки arg
+        OP_OUTPUT,  // снять вершину стека в выход arg (только при outputCount > 1)
+        OP_REDUCE,  // sum/prod/integral reductions[arg] по пределам из двух верхних ячеек стека
+        OP_HCAT,    // склейка матриц по горизонтали (',' в литерале [1,2;3,4])
+        OP_VCAT,    // склейка по вертикали (';')
+        OP_MATRIX_CALL, // матричная функция functions[arg] (det, inv, matmul, solve, transpose)
+        OP_POLY,    // многочлен или дробь polynomials[arg] от вершины стека
+        OP_MEMO,    // начало подвыражения memos[arg]: при попадании в кэш - его значение и переход за OP_MEMO_END
+        OP_MEMO_END // конец подвыражения memos[arg]: значение на вершине стека сохраняется в кэш
+    };
+
+    struct Instruction {
+        OpCode op;
+        unsigned int arg;
+    };
+
+    // Фрагмент исходной строки, из которого получена инструкция
+    struct SourceSpan {
+        unsigned int offset;
+        unsigned int length;
+    };
+
+    std::vector<Instruction> code;
+    // Позиции инструкций в исходном тексте (параллельно code),
+    // хранятся отдельно, чтобы не раздувать горячий цикл вычисления
+    std::vector<SourceSpan> spans;
+    std::vector<double> constants;
+    std::vector<std::string> functions;
+    std::vector<std::string> variables;
+
+    // Встроенные функции functions[k] (nullptr для матричных) и sin, cos
+    // в единицах angleMode. Находятся по именам при компиляции и загрузке
+    // (ExpressionCalculator::resolveFunctions), вычисление имён не ищет
+    std::vector<const BuiltinFunction*> calls;
+    const BuiltinFunction* sinFunction = nullptr;
+    const BuiltinFunction* cosFunction = nullptr;
+
+    // Вызовы sin и cos от одинакового аргумента: первый по порядку вызов
+    // вычисляет обе функции за одно приведение и сохраняет их в ячейку slot,
+    // остальные берут готовое значение
+    struct SinCosCall {
+        unsigned int slot;
+        bool cosine;
+        bool first;
+    };
+    std::vector<SinCosCall> sinCos;
+    size_t sinCosSlots = 0;
+
+    // Ячейки для общих подвыражений: подвыражение, встречающееся
+    // несколько раз, вычисляется один раз и сохраняется через OP_STORE
+    size_t slotCount = 0;
+
+    // Сумма, произведение или интеграл по связанной переменной.
+    // Тело - отдельная программа: переменная 0 - связанная,
+    // далее переменные внешней программы в том же порядке
+    struct Reduction {
+        enum Kind : unsigned char {
+            SUM,
+            PRODUCT,
+            INTEGRAL
+        };
+        Kind kind;
+        std::shared_ptr<const CompiledExpression> body;
+    };
+    std::vector<Reduction> reductions;
+
+    // Многочлен или дробь от одного аргумента, найденные при компиляции
+    // (3*x^4 - 2*x^3 + x - 7). В constants начиная с first лежит блок
+    // числителя: degree + 1 коэффициент от младшего к старшему и значения
+    // исходного подвыражения при аргументе +0 и -0 (со знаком нуля, который
+    // дало бы вычисление по исходной формуле). Для дроби за ним такой же блок
+    // знаменателя; без знаменателя (denominatorDegree == 0) это многочлен
+    struct Polynomial {
+        enum Scheme : unsigned char {
+            HORNER,     // последовательная схема, меньше всего умножений
+            ESTRIN      // попарная схема: независимые умножения идут параллельно
+        };
+        unsigned int first;
+        unsigned int degree;
+        unsigned int denominatorDegree;
+        Scheme scheme;
+    };
+    std::vector<Polynomial> polynomials;
+
+    // Подвыражение, зависящее не от всех переменных программы (при переборе
+    // одной переменной остальное не меняется), между OP_MEMO и OP_MEMO_END.
+    // При вычислении с кэшем (ExpressionCalculator::MemoCache) оно берётся
+    // из кэша, если его переменные не изменились; без кэша обе инструкции
+    // ничего не делают. В memoIndices начиная с first - номера переменных
+    // подвыражения, затем номера ячеек, которые оно записывает, а программа
+    // читает после него (в общем массиве: ячейки slotCount, затем sin и cos
+    // пар sincos), - при попадании они восстанавливаются из кэша
+    struct Memo {
+        unsigned int end;           // номер инструкции OP_MEMO_END
+        unsigned int first;
+        unsigned int variableCount;
+        unsigned int slotCount;
+    };
+    std::vector<Memo> memos;
+    std::vector<unsigned int> memoIndices;
+
+    // Число выходов. Программа с одним выходом оставляет результат в стеке;
+    // совмещённая программа нескольких выражений (compileFused)
+    // записывает каждый результат инструкцией OP_OUTPUT
+    size_t outputCount = 1;
+
+    // Максимальная глубина стека при вычислении
+    size_t maxStackDepth = 0;
+
+    // Единицы углов фиксируются при компиляции: тригонометрические функции
+    // заменяются вариантами для градусов/град, и при вычислении режим не проверяется
+    AngleMode angleMode = ANGLE_RADIANS;
+};
+
+#endif // COMPILEDEXPRESSION_H
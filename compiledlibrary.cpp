@@ -0,0 +1,602 @@
+#include "compiledlibrary.h"
+#include "expressioncalculator.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <map>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define COMPILED_LIBRARY_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Формат файла (порядок байт записавшей машины, всё выровнено на 8 байт):
+//   FileHeader
+//   данные: байты строк и массивы программ
+//   ProgramRecord[programCount]  - записи программ, тела sum/prod/integral после родителя
+//   EntryRecord[entryCount]      - по возрастанию имени
+//   StringRecord[stringCount]
+// Смещения отсчитываются от начала файла, контрольная сумма - по всему,
+// что после заголовка
+
+namespace {
+
+const char MAGIC[8] = { 'C', 'A', 'L', 'C', 'L', 'I', 'B', '\0' };
+const uint32_t BYTE_ORDER_MARK = 0x01020304;
+
+struct FileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrder;
+    uint64_t fileSize;
+    uint64_t checksum;
+    uint32_t entryCount;
+    uint32_t programCount;
+    uint32_t stringCount;
+    uint32_t reserved;
+    uint64_t entriesOffset;
+    uint64_t programsOffset;
+    uint64_t stringsOffset;
+};
+
+struct StringRecord {
+    uint64_t offset;
+    uint64_t length;
+};
+
+struct EntryRecord {
+    uint32_t name;      // номера строк
+    uint32_t source;
+    uint32_t program;
+    uint32_t reserved;
+};
+
+struct ArrayRecord {
+    uint64_t offset;
+    uint64_t count;
+};
+
+struct SpanRecord {
+    uint32_t offset;
+    uint32_t length;
+};
+
+struct SinCosRecord {
+    uint32_t slot;
+    uint8_t cosine;
+    uint8_t first;
+    uint16_t reserved;
+};
+
+struct ReductionRecord {
+    uint32_t kind;
+    uint32_t body;      // номер программы, больше номера родителя
+};
+
+struct PolynomialRecord {
+    uint32_t first;
+    uint32_t degree;
+    uint32_t denominatorDegree;
+    uint8_t scheme;
+    uint8_t reserved[3];
+};
+
+struct MemoRecord {
+    uint32_t end;
+    uint32_t first;
+    uint32_t variableCount;
+    uint32_t slotCount;
+};
+
+struct ProgramRecord {
+    ArrayRecord code;           // InstructionRecord
+    ArrayRecord spans;          // SpanRecord
+    ArrayRecord constants;      // double
+    ArrayRecord functions;      // uint32_t - номера строк
+    ArrayRecord variables;      // uint32_t - номера строк
+    ArrayRecord sinCos;         // SinCosRecord
+    ArrayRecord reductions;     // ReductionRecord
+    ArrayRecord polynomials;    // PolynomialRecord
+    ArrayRecord memos;          // MemoRecord
+    ArrayRecord memoIndices;    // uint32_t
+    uint64_t sinCosSlots;
+    uint64_t slotCount;
+    uint64_t outputCount;
+    uint64_t maxStackDepth;
+    uint32_t angleMode;
+    uint32_t reserved;
+};
+
+struct InstructionRecord {
+    uint8_t op;
+    uint8_t reserved[3];
+    uint32_t arg;
+};
+
+// Инструкции и позиции в памяти устроены так же, как в файле,
+// поэтому копируются одним memcpy
+static_assert(sizeof(CompiledExpression::Instruction) == sizeof(InstructionRecord)
+              && offsetof(CompiledExpression::Instruction, arg) == offsetof(InstructionRecord, arg),
+              "Instruction layout differs from the file format");
+static_assert(sizeof(CompiledExpression::SourceSpan) == sizeof(SpanRecord),
+              "SourceSpan layout differs from the file format");
+static_assert(sizeof(FileHeader) % 8 == 0 && sizeof(ProgramRecord) % 8 == 0, "Records must keep 8-byte alignment");
+
+// Контрольная сумма по 8-байтовым словам: ловит повреждение и обрезку файла,
+// а не подделку
+uint64_t checksum(const unsigned char* bytes, size_t size) {
+
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i + 8 <= size; i += 8) {
+        uint64_t word;
+        std::memcpy(&word, bytes + i, 8);
+        hash = (hash ^ word) * 0x9e3779b97f4a7c15ULL;
+        hash ^= hash >> 29;
+    }
+    return hash;
+}
+
+// Массив из count элементов size байт по смещению offset целиком внутри файла
+bool inside(uint64_t offset, uint64_t count, size_t size, uint64_t fileSize, size_t alignment = 8) {
+    return offset % alignment == 0 && offset <= fileSize && count <= (fileSize - offset) / size;
+}
+
+// Массив файла в вектор того же устройства
+template <typename T>
+void copyArray(std::vector<T>& to, const unsigned char* from, uint64_t count) {
+    to.resize(count);
+    if (count) {
+        std::memcpy(to.data(), from, count * sizeof(T));
+    }
+}
+
+// Сборка образа файла в памяти
+class Writer
+{
+public:
+    std::vector<unsigned char> bytes;
+    std::vector<ProgramRecord> programs;
+    std::vector<StringRecord> strings;
+    std::map<std::string, uint32_t> stringIds;
+
+    Writer() : bytes(sizeof(FileHeader), 0) {}
+
+    void align() {
+        bytes.resize((bytes.size() + 7) / 8 * 8, 0);
+    }
+
+    template <typename T>
+    ArrayRecord append(const T* items, size_t count) {
+        align();
+        ArrayRecord array = { bytes.size(), count };
+        const unsigned char* begin = reinterpret_cast<const unsigned char*>(items);
+        bytes.insert(bytes.end(), begin, begin + count * sizeof(T));
+        return array;
+    }
+
+    uint32_t addString(const std::string& text) {
+        auto it = stringIds.find(text);
+        if (it != stringIds.end()) {
+            return it->second;
+        }
+        StringRecord record = { bytes.size(), text.size() };
+        bytes.insert(bytes.end(), text.begin(), text.end());
+        uint32_t id = static_cast<uint32_t>(strings.size());
+        strings.push_back(record);
+        stringIds.emplace(text, id);
+        return id;
+    }
+
+    ArrayRecord appendStrings(const std::vector<std::string>& texts) {
+        std::vector<uint32_t> ids;
+        for (const std::string& text : texts) {
+            ids.push_back(addString(text));
+        }
+        return append(ids.data(), ids.size());
+    }
+
+    // Номер программы; тела sum/prod/integral получают следующие номера
+    uint32_t addProgram(const CompiledExpression& program) {
+
+        uint32_t index = static_cast<uint32_t>(programs.size());
+        programs.push_back(ProgramRecord());
+
+        std::vector<InstructionRecord> code(program.code.size());
+        for (size_t i = 0; i < code.size(); i++) {
+            code[i].op = program.code[i].op;
+            code[i].arg = program.code[i].arg;
+        }
+        std::vector<SpanRecord> spans(program.spans.size());
+        for (size_t i = 0; i < spans.size(); i++) {
+            spans[i].offset = program.spans[i].offset;
+            spans[i].length = program.spans[i].length;
+        }
+        std::vector<SinCosRecord> sinCos(program.sinCos.size());
+        for (size_t i = 0; i < sinCos.size(); i++) {
+            sinCos[i].slot = program.sinCos[i].slot;
+            sinCos[i].cosine = program.sinCos[i].cosine;
+            sinCos[i].first = program.sinCos[i].first;
+        }
+        std::vector<PolynomialRecord> polynomials(program.polynomials.size());
+        for (size_t i = 0; i < polynomials.size(); i++) {
+            polynomials[i].first = program.polynomials[i].first;
+            polynomials[i].degree = program.polynomials[i].degree;
+            polynomials[i].denominatorDegree = program.polynomials[i].denominatorDegree;
+            polynomials[i].scheme = program.polynomials[i].scheme;
+        }
+        std::vector<MemoRecord> memos(program.memos.size());
+        for (size_t i = 0; i < memos.size(); i++) {
+            memos[i].end = program.memos[i].end;
+            memos[i].first = program.memos[i].first;
+            memos[i].variableCount = program.memos[i].variableCount;
+            memos[i].slotCount = program.memos[i].slotCount;
+        }
+        std::vector<uint32_t> memoIndices(program.memoIndices.begin(), program.memoIndices.end());
+        std::vector<ReductionRecord> reductions(program.reductions.size());
+        for (size_t i = 0; i < reductions.size(); i++) {
+            reductions[i].kind = program.reductions[i].kind;
+            reductions[i].body = addProgram(*program.reductions[i].body);
+        }
+
+        ProgramRecord record = ProgramRecord();
+        record.code = append(code.data(), code.size());
+        record.spans = append(spans.data(), spans.size());
+        record.constants = append(program.constants.data(), program.constants.size());
+        record.functions = appendStrings(program.functions);
+        record.variables = appendStrings(program.variables);
+        record.sinCos = append(sinCos.data(), sinCos.size());
+        record.reductions = append(reductions.data(), reductions.size());
+        record.polynomials = append(polynomials.data(), polynomials.size());
+        record.memos = append(memos.data(), memos.size());
+        record.memoIndices = append(memoIndices.data(), memoIndices.size());
+        record.sinCosSlots = program.sinCosSlots;
+        record.slotCount = program.slotCount;
+        record.outputCount = program.outputCount;
+        record.maxStackDepth = program.maxStackDepth;
+        record.angleMode = program.angleMode;
+        programs[index] = record;
+        return index;
+    }
+};
+
+// Проверка заголовка и таблиц образа; nullptr - образ корректен.
+// Дальше записи читаются прямо из отображения без проверок границ
+const char* validateImage(const unsigned char* data, size_t fileSize) {
+
+    const FileHeader& header = *reinterpret_cast<const FileHeader*>(data);
+    if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0) {
+        return "not a compiled expression library";
+    } else if (header.byteOrder != BYTE_ORDER_MARK) {
+        return "written on a machine with different byte order";
+    } else if (header.version != CompiledLibrary::FORMAT_VERSION) {
+        return "unsupported format version";
+    } else if (header.fileSize != fileSize || fileSize % 8 != 0) {
+        return "file is truncated";
+    } else if (header.checksum != checksum(data + sizeof(FileHeader), fileSize - sizeof(FileHeader))) {
+        return "checksum mismatch";
+    } else if (!inside(header.entriesOffset, header.entryCount, sizeof(EntryRecord), fileSize)
+               || !inside(header.programsOffset, header.programCount, sizeof(ProgramRecord), fileSize)
+               || !inside(header.stringsOffset, header.stringCount, sizeof(StringRecord), fileSize)) {
+        return "table outside of file";
+    }
+
+    const StringRecord* strings = reinterpret_cast<const StringRecord*>(data + header.stringsOffset);
+    for (uint32_t i = 0; i < header.stringCount; i++) {
+        if (!inside(strings[i].offset, strings[i].length, 1, fileSize, 1)) {
+            return "string outside of file";
+        }
+    }
+
+    const ProgramRecord* programs = reinterpret_cast<const ProgramRecord*>(data + header.programsOffset);
+    std::vector<bool> isBody(header.programCount, false);
+    for (uint32_t i = 0; i < header.programCount; i++) {
+        const ProgramRecord& program = programs[i];
+        if (!inside(program.code.offset, program.code.count, sizeof(InstructionRecord), fileSize)
+                || !inside(program.spans.offset, program.spans.count, sizeof(SpanRecord), fileSize)
+                || !inside(program.constants.offset, program.constants.count, sizeof(double), fileSize)
+                || !inside(program.functions.offset, program.functions.count, sizeof(uint32_t), fileSize)
+                || !inside(program.variables.offset, program.variables.count, sizeof(uint32_t), fileSize)
+                || !inside(program.sinCos.offset, program.sinCos.count, sizeof(SinCosRecord), fileSize)
+                || !inside(program.reductions.offset, program.reductions.count, sizeof(ReductionRecord), fileSize)
+                || !inside(program.polynomials.offset, program.polynomials.count, sizeof(PolynomialRecord), fileSize)
+                || !inside(program.memos.offset, program.memos.count, sizeof(MemoRecord), fileSize)
+                || !inside(program.memoIndices.offset, program.memoIndices.count, sizeof(uint32_t), fileSize)) {
+            return "program array outside of file";
+        }
+        const uint32_t* functions = reinterpret_cast<const uint32_t*>(data + program.functions.offset);
+        const uint32_t* variables = reinterpret_cast<const uint32_t*>(data + program.variables.offset);
+        const ReductionRecord* reductions = reinterpret_cast<const ReductionRecord*>(data + program.reductions.offset);
+        for (uint64_t k = 0; k < program.functions.count; k++) {
+            if (functions[k] >= header.stringCount) return "invalid function name";
+        }
+        for (uint64_t k = 0; k < program.variables.count; k++) {
+            if (variables[k] >= header.stringCount) return "invalid variable name";
+        }
+        // Тело всегда дальше родителя и принадлежит одной конструкции:
+        // циклов нет, и загрузка не дольше размера файла
+        for (uint64_t k = 0; k < program.reductions.count; k++) {
+            uint32_t body = reductions[k].body;
+            if (body <= i || body >= header.programCount || isBody[body]) return "invalid reduction body";
+            isBody[body] = true;
+        }
+    }
+
+    const EntryRecord* entries = reinterpret_cast<const EntryRecord*>(data + header.entriesOffset);
+    for (uint32_t i = 0; i < header.entryCount; i++) {
+        if (entries[i].name >= header.stringCount || entries[i].source >= header.stringCount
+                || entries[i].program >= header.programCount) {
+            return "invalid entry";
+        } else if (i > 0) {
+            const StringRecord& previous = strings[entries[i - 1].name];
+            const StringRecord& current = strings[entries[i].name];
+            std::string a(reinterpret_cast<const char*>(data + previous.offset), previous.length);
+            std::string b(reinterpret_cast<const char*>(data + current.offset), current.length);
+            if (!(a < b)) return "entries are not sorted by name";
+        }
+    }
+
+    return nullptr;
+}
+
+} // namespace
+
+bool CompiledLibrary::write(const std::string &path, const std::vector<Entry> &entries, std::string &error) {
+
+    std::vector<size_t> order(entries.size());
+    for (size_t i = 0; i < order.size(); i++) order[i] = i;
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) { return entries[a].name < entries[b].name; });
+    for (size_t i = 1; i < order.size(); i++) {
+        if (entries[order[i - 1]].name == entries[order[i]].name) {
+            error = "Duplicate name: " + entries[order[i]].name;
+            return false;
+        }
+    }
+
+    Writer writer;
+    std::vector<EntryRecord> records(entries.size());
+    for (size_t i = 0; i < order.size(); i++) {
+        const Entry& entry = entries[order[i]];
+        records[i].name = writer.addString(entry.name);
+        records[i].source = writer.addString(entry.source);
+        records[i].program = writer.addProgram(entry.program);
+        records[i].reserved = 0;
+    }
+
+    FileHeader header = FileHeader();
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = CompiledLibrary::FORMAT_VERSION;
+    header.byteOrder = BYTE_ORDER_MARK;
+    header.entryCount = static_cast<uint32_t>(records.size());
+    header.programCount = static_cast<uint32_t>(writer.programs.size());
+    header.stringCount = static_cast<uint32_t>(writer.strings.size());
+    header.programsOffset = writer.append(writer.programs.data(), writer.programs.size()).offset;
+    header.entriesOffset = writer.append(records.data(), records.size()).offset;
+    header.stringsOffset = writer.append(writer.strings.data(), writer.strings.size()).offset;
+    writer.align();
+    header.fileSize = writer.bytes.size();
+    header.checksum = checksum(writer.bytes.data() + sizeof(FileHeader), writer.bytes.size() - sizeof(FileHeader));
+    std::memcpy(writer.bytes.data(), &header, sizeof(header));
+
+    std::string temporary = path + ".tmp";
+    {
+        std::ofstream file(temporary.c_str(), std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char*>(writer.bytes.data()), writer.bytes.size());
+        if (!file) {
+            error = "Cannot write " + temporary;
+            return false;
+        }
+    }
+    if (std::rename(temporary.c_str(), path.c_str()) != 0) {
+        std::remove(temporary.c_str());
+        error = "Cannot rename " + temporary + " to " + path;
+        return false;
+    }
+    return true;
+}
+
+CompiledLibrary::~CompiledLibrary() {
+    close();
+}
+
+void CompiledLibrary::close() {
+
+#ifdef COMPILED_LIBRARY_MMAP
+    if (mapped && data) {
+        munmap(const_cast<unsigned char*>(data), fileSize);
+    }
+#endif
+    data = nullptr;
+    fileSize = 0;
+    mapped = false;
+    buffer.clear();
+    entryCount = 0;
+}
+
+bool CompiledLibrary::open(const std::string &path, std::string &error) {
+
+    close();
+
+#ifdef COMPILED_LIBRARY_MMAP
+    int descriptor = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (descriptor < 0) {
+        error = "Cannot open " + path + ": " + std::strerror(errno);
+        return false;
+    }
+    struct stat status;
+    if (fstat(descriptor, &status) != 0 || status.st_size < static_cast<off_t>(sizeof(FileHeader))) {
+        ::close(descriptor);
+        error = "Not a compiled expression library: " + path;
+        return false;
+    }
+    fileSize = static_cast<size_t>(status.st_size);
+    void* address = mmap(nullptr, fileSize, PROT_READ, MAP_SHARED, descriptor, 0);
+    ::close(descriptor);
+    if (address == MAP_FAILED) {
+        fileSize = 0;
+        error = "Cannot map " + path + ": " + std::strerror(errno);
+        return false;
+    }
+    data = static_cast<const unsigned char*>(address);
+    mapped = true;
+#else
+    std::ifstream file(path.c_str(), std::ios::binary | std::ios::ate);
+    if (!file) {
+        error = "Cannot open " + path;
+        return false;
+    }
+    fileSize = static_cast<size_t>(file.tellg());
+    buffer.resize((fileSize + 7) / 8);
+    file.seekg(0);
+    file.read(reinterpret_cast<char*>(buffer.data()), fileSize);
+    if (!file || fileSize < sizeof(FileHeader)) {
+        close();
+        error = "Cannot read " + path;
+        return false;
+    }
+    data = reinterpret_cast<const unsigned char*>(buffer.data());
+#endif
+
+    const char* problem = validateImage(data, fileSize);
+    if (problem) {
+        close();
+        error = path + ": " + problem;
+        return false;
+    }
+    entryCount = reinterpret_cast<const FileHeader*>(data)->entryCount;
+    return true;
+}
+
+std::string CompiledLibrary::text(uint32_t id) const {
+
+    const FileHeader& header = *reinterpret_cast<const FileHeader*>(data);
+    const StringRecord& record = reinterpret_cast<const StringRecord*>(data + header.stringsOffset)[id];
+    return std::string(reinterpret_cast<const char*>(data + record.offset), record.length);
+}
+
+std::string CompiledLibrary::name(size_t index) const {
+
+    const FileHeader& header = *reinterpret_cast<const FileHeader*>(data);
+    return text(reinterpret_cast<const EntryRecord*>(data + header.entriesOffset)[index].name);
+}
+
+std::string CompiledLibrary::source(size_t index) const {
+
+    const FileHeader& header = *reinterpret_cast<const FileHeader*>(data);
+    return text(reinterpret_cast<const EntryRecord*>(data + header.entriesOffset)[index].source);
+}
+
+size_t CompiledLibrary::find(const std::string &name) const {
+
+    if (!data) {
+        return 0;
+    }
+    const FileHeader& header = *reinterpret_cast<const FileHeader*>(data);
+    const EntryRecord* entries = reinterpret_cast<const EntryRecord*>(data + header.entriesOffset);
+    const StringRecord* strings = reinterpret_cast<const StringRecord*>(data + header.stringsOffset);
+
+    // Сравнение прямо с байтами отображения, без создания строк
+    size_t low = 0, high = entryCount;
+    while (low < high) {
+        size_t middle = (low + high) / 2;
+        const StringRecord& record = strings[entries[middle].name];
+        int order = name.compare(0, std::string::npos,
+                                 reinterpret_cast<const char*>(data + record.offset), record.length);
+        if (order == 0) return middle;
+        if (order > 0) low = middle + 1;
+        else high = middle;
+    }
+    return entryCount;
+}
+
+bool CompiledLibrary::loadProgram(uint32_t index, CompiledExpression &program) const {
+
+    const FileHeader& header = *reinterpret_cast<const FileHeader*>(data);
+    const ProgramRecord& record = reinterpret_cast<const ProgramRecord*>(data + header.programsOffset)[index];
+
+    // Поля с ограниченным набором значений проверяются до приведения к enum
+    const InstructionRecord* code = reinterpret_cast<const InstructionRecord*>(data + record.code.offset);
+    for (uint64_t i = 0; i < record.code.count; i++) {
+        if (code[i].op > CompiledExpression::OP_MEMO_END) return false;
+    }
+    if (record.angleMode > ANGLE_GRADIANS) return false;
+
+    program = CompiledExpression();
+    copyArray(program.code, data + record.code.offset, record.code.count);
+    copyArray(program.spans, data + record.spans.offset, record.spans.count);
+    copyArray(program.constants, data + record.constants.offset, record.constants.count);
+
+    const uint32_t* functions = reinterpret_cast<const uint32_t*>(data + record.functions.offset);
+    for (uint64_t i = 0; i < record.functions.count; i++) {
+        program.functions.push_back(text(functions[i]));
+    }
+    const uint32_t* variables = reinterpret_cast<const uint32_t*>(data + record.variables.offset);
+    for (uint64_t i = 0; i < record.variables.count; i++) {
+        program.variables.push_back(text(variables[i]));
+    }
+
+    const SinCosRecord* sinCos = reinterpret_cast<const SinCosRecord*>(data + record.sinCos.offset);
+    for (uint64_t i = 0; i < record.sinCos.count; i++) {
+        CompiledExpression::SinCosCall call = { sinCos[i].slot, sinCos[i].cosine != 0, sinCos[i].first != 0 };
+        program.sinCos.push_back(call);
+    }
+
+    const PolynomialRecord* polynomials = reinterpret_cast<const PolynomialRecord*>(data + record.polynomials.offset);
+    for (uint64_t i = 0; i < record.polynomials.count; i++) {
+        if (polynomials[i].scheme > CompiledExpression::Polynomial::ESTRIN) return false;
+        CompiledExpression::Polynomial polynomial = {
+            polynomials[i].first, polynomials[i].degree, polynomials[i].denominatorDegree,
+            static_cast<CompiledExpression::Polynomial::Scheme>(polynomials[i].scheme)
+        };
+        program.polynomials.push_back(polynomial);
+    }
+
+    const MemoRecord* memos = reinterpret_cast<const MemoRecord*>(data + record.memos.offset);
+    for (uint64_t i = 0; i < record.memos.count; i++) {
+        CompiledExpression::Memo memo = { memos[i].end, memos[i].first, memos[i].variableCount, memos[i].slotCount };
+        program.memos.push_back(memo);
+    }
+    const uint32_t* memoIndices = reinterpret_cast<const uint32_t*>(data + record.memoIndices.offset);
+    program.memoIndices.assign(memoIndices, memoIndices + record.memoIndices.count);
+
+    const ReductionRecord* reductions = reinterpret_cast<const ReductionRecord*>(data + record.reductions.offset);
+    for (uint64_t i = 0; i < record.reductions.count; i++) {
+        if (reductions[i].kind > CompiledExpression::Reduction::INTEGRAL) return false;
+        std::shared_ptr<CompiledExpression> body = std::make_shared<CompiledExpression>();
+        if (!loadProgram(reductions[i].body, *body)) return false;
+        CompiledExpression::Reduction reduction;
+        reduction.kind = static_cast<CompiledExpression::Reduction::Kind>(reductions[i].kind);
+        reduction.body = body;
+        program.reductions.push_back(reduction);
+    }
+
+    program.sinCosSlots = record.sinCosSlots;
+    program.slotCount = record.slotCount;
+    program.outputCount = record.outputCount;
+    program.maxStackDepth = record.maxStackDepth;
+    program.angleMode = static_cast<AngleMode>(record.angleMode);
+    ExpressionCalculator::resolveFunctions(program);
+    return true;
+}
+
+bool CompiledLibrary::load(size_t index, CompiledExpression &program, std::string &error) const {
+
+    if (index >= entryCount) {
+        error = "No entry " + std::to_string(index);
+        return false;
+    }
+    const FileHeader& header = *reinterpret_cast<const FileHeader*>(data);
+    const EntryRecord& entry = reinterpret_cast<const EntryRecord*>(data + header.entriesOffset)[index];
+    if (!loadProgram(entry.program, program) || !ExpressionCalculator::checkProgram(program)) {
+        program = CompiledExpression();
+        error = "Invalid program: " + text(entry.name);
+        return false;
+    }
+    return true;
+}
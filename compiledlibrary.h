@@ -0,0 +1,71 @@
+#ifndef COMPILEDLIBRARY_H
+#define COMPILEDLIBRARY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "compiledexpression.h"
+
+// Библиотека скомпилированных выражений в двоичном файле. Файл пишется
+// один раз, а при запуске отображается в память только для чтения:
+// процессы, открывшие один файл, делят одни и те же страницы. Внутри
+// только смещения от начала файла, поэтому образ не настраивается под
+// адрес отображения; текст формул не разбирается. Коды операций,
+// константы и позиции копируются в CompiledExpression целиком, функции
+// и переменные хранятся по номерам в общей таблице строк.
+//
+// При открытии проверяются версия формата, порядок байт, размер,
+// контрольная сумма и границы всех таблиц, при загрузке программы -
+// её структура (ExpressionCalculator::checkProgram). Повреждённый или
+// чужой файл даёт ошибку, а не обращение за пределы отображения
+class CompiledLibrary
+{
+public:
+    struct Entry {
+        std::string name;
+        std::string source;         // исходный текст, может быть пустым
+        CompiledExpression program;
+    };
+
+    // Версия формата; файл другой версии не открывается
+    // (2 - многочлены OP_POLY, 3 - подвыражения кэша OP_MEMO)
+    static const uint32_t FORMAT_VERSION = 3;
+
+    // Запись через временный файл и переименование: процессы, уже
+    // отобразившие прежний файл, продолжают работать со старой версией.
+    // Имена записей должны быть различны
+    static bool write(const std::string& path, const std::vector<Entry>& entries, std::string& error);
+
+    CompiledLibrary() = default;
+    ~CompiledLibrary();
+    CompiledLibrary(const CompiledLibrary&) = delete;
+    CompiledLibrary& operator=(const CompiledLibrary&) = delete;
+
+    bool open(const std::string& path, std::string& error);
+    void close();
+    bool isOpen() const { return data != nullptr; }
+
+    size_t size() const { return entryCount; }
+    std::string name(size_t index) const;
+    std::string source(size_t index) const;
+    // Номер записи с данным именем (двоичный поиск) или size()
+    size_t find(const std::string& name) const;
+
+    // Программа записи index; false, если её структура некорректна
+    bool load(size_t index, CompiledExpression& program, std::string& error) const;
+
+private:
+    // Программа номер index таблицы программ (тела sum/prod/integral - отдельные программы)
+    bool loadProgram(uint32_t index, CompiledExpression& program) const;
+    std::string text(uint32_t id) const;
+
+    const unsigned char* data = nullptr;
+    size_t fileSize = 0;
+    bool mapped = false;                // false - файл прочитан в buffer
+    std::vector<uint64_t> buffer;
+    size_t entryCount = 0;
+};
+
+#endif // COMPILEDLIBRARY_H
@@ -0,0 +1,253 @@
+#include "complexkernels.h"
+#include "simd.h"
+#include "trigcore.h"
+
+#include <cmath>
+#include <complex>
+#include <algorithm>
+
+void complexAdd(const double* aRe, const double* aIm,
+                const double* bRe, const double* bIm,
+                double* outRe, double* outIm, size_t n) {
+
+    size_t i = 0;
+    for (; i + simd::width <= n; i += simd::width) {
+        simd::store(outRe + i, simd::load(aRe + i) + simd::load(bRe + i));
+        simd::store(outIm + i, simd::load(aIm + i) + simd::load(bIm + i));
+    }
+    for (; i < n; i++) {
+        outRe[i] = aRe[i] + bRe[i];
+        outIm[i] = aIm[i] + bIm[i];
+    }
+}
+
+void complexSub(const double* aRe, const double* aIm,
+                const double* bRe, const double* bIm,
+                double* outRe, double* outIm, size_t n) {
+
+    size_t i = 0;
+    for (; i + simd::width <= n; i += simd::width) {
+        simd::store(outRe + i, simd::load(aRe + i) - simd::load(bRe + i));
+        simd::store(outIm + i, simd::load(aIm + i) - simd::load(bIm + i));
+    }
+    for (; i < n; i++) {
+        outRe[i] = aRe[i] - bRe[i];
+        outIm[i] = aIm[i] - bIm[i];
+    }
+}
+
+void complexMul(const double* aRe, const double* aIm,
+                const double* bRe, const double* bIm,
+                double* outRe, double* outIm, size_t n) {
+
+    // (a + bi)(c + di) = (ac - bd) + (ad + bc)i
+    size_t i = 0;
+    for (; i + simd::width <= n; i += simd::width) {
+        simd::vdouble ar = simd::load(aRe + i), ai = simd::load(aIm + i);
+        simd::vdouble br = simd::load(bRe + i), bi = simd::load(bIm + i);
+        simd::store(outRe + i, ar * br - ai * bi);
+        simd::store(outIm + i, ar * bi + ai * br);
+    }
+    for (; i < n; i++) {
+        double ar = aRe[i], ai = aIm[i];
+        double br = bRe[i], bi = bIm[i];
+        outRe[i] = ar * br - ai * bi;
+        outIm[i] = ar * bi + ai * br;
+    }
+}
+
+void complexDiv(const double* aRe, const double* aIm,
+                const double* bRe, const double* bIm,
+                double* outRe, double* outIm, size_t n) {
+
+    // Делим числитель и знаменатель на max(|c|, |d|), чтобы избежать
+    // переполнения при вычислении c^2 + d^2
+    size_t i = 0;
+    for (; i + simd::width <= n; i += simd::width) {
+        simd::vdouble ar = simd::load(aRe + i), ai = simd::load(aIm + i);
+        simd::vdouble br = simd::load(bRe + i), bi = simd::load(bIm + i);
+        simd::vdouble s = simd::max(simd::abs(br), simd::abs(bi));
+        simd::vdouble cr = br / s, ci = bi / s;
+        simd::vdouble den = br * cr + bi * ci;
+        simd::store(outRe + i, (ar * cr + ai * ci) / den);
+        simd::store(outIm + i, (ai * cr - ar * ci) / den);
+    }
+    for (; i < n; i++) {
+        double ar = aRe[i], ai = aIm[i];
+        double br = bRe[i], bi = bIm[i];
+        double s = std::max(std::fabs(br), std::fabs(bi));
+        double cr = br / s, ci = bi / s;
+        double den = br * cr + bi * ci;
+        outRe[i] = (ar * cr + ai * ci) / den;
+        outIm[i] = (ai * cr - ar * ci) / den;
+    }
+}
+
+namespace {
+
+// Векторный путь sqrt и ln считает |z| как s*sqrt(1 + (m/s)^2), где
+// s = max(|a|, |b|), m = min(|a|, |b|), и годится для s в этих пределах;
+// ноль, nan, inf, очень малые и очень большие модули идут скалярным путём
+const double MODULUS_LOWER = 1e-300;
+const double MODULUS_UPPER = 1e300;
+// exp, sin и cos: дальше e^x переполняется, и нужны особые случаи std::complex
+const double EXPONENT_LIMIT = 700.0;
+// Части массива, для которых sin и cos считаются одним вызовом trigSinCosArray
+const size_t CHUNK = 64;
+
+// max и min не передают nan первого операнда, поэтому nan и inf ловятся
+// по сумме: для nan сравнение "меньше" ложно
+bool modulusNeedsScalar(simd::vdouble absA, simd::vdouble absB, simd::vdouble s) {
+    return !simd::all(simd::lt(absA + absB, simd::set1(MODULUS_UPPER)))
+            || simd::any(simd::lt(s, simd::set1(MODULUS_LOWER)));
+}
+
+bool exponentInRange(double x) {
+    return std::fabs(x) <= EXPONENT_LIMIT;
+}
+
+// sinh x и cosh x через одну экспоненту: e^|x| - 1 точна и у нуля
+void sinhCosh(double x, double& sinh, double& cosh) {
+
+    double e = std::expm1(std::fabs(x));
+    double inverse = 1.0 / (e + 1.0);
+    sinh = std::copysign(0.5 * (e + e * inverse), x);
+    cosh = 0.5 * (e + 1.0) + 0.5 * inverse;
+}
+
+// ln z = ln|z| + i arg z, делённый на divisor (как std::log10 - на ln 10).
+// При |z| от 1/2 до 2 ln|z| = log1p(|z|^2 - 1) / 2, где
+// |z|^2 - 1 = (s - 1)(s + 1) + m^2 не теряет разрядов в s - 1
+void logarithm(const double* re, const double* im, double* outRe, double* outIm, size_t n, double divisor) {
+
+    double modulus[simd::width], squareMinusOne[simd::width];
+    size_t i = 0;
+    for (; i + simd::width <= n; i += simd::width) {
+        simd::vdouble a = simd::abs(simd::load(re + i)), b = simd::abs(simd::load(im + i));
+        simd::vdouble s = simd::max(a, b), m = simd::min(a, b);
+        if (modulusNeedsScalar(a, b, s)) {
+            for (int k = 0; k < simd::width; k++) {
+                std::complex<double> z = std::log(std::complex<double>(re[i + k], im[i + k]));
+                outRe[i + k] = z.real() / divisor;
+                outIm[i + k] = z.imag() / divisor;
+            }
+            continue;
+        }
+        simd::vdouble one = simd::set1(1.0);
+        simd::vdouble q = m / s;
+        simd::store(modulus, s * simd::sqrt(one + q * q));
+        simd::store(squareMinusOne, (s - one) * (s + one) + m * m);
+        for (int k = 0; k < simd::width; k++) {
+            double logModulus = modulus[k] >= 0.5 && modulus[k] <= 2.0 ? 0.5 * std::log1p(squareMinusOne[k])
+                                                                      : std::log(modulus[k]);
+            double argument = std::atan2(im[i + k], re[i + k]);
+            outRe[i + k] = logModulus / divisor;
+            outIm[i + k] = argument / divisor;
+        }
+    }
+    for (; i < n; i++) {
+        std::complex<double> z = std::log(std::complex<double>(re[i], im[i]));
+        outRe[i] = z.real() / divisor;
+        outIm[i] = z.imag() / divisor;
+    }
+}
+
+// sin z = sin a cosh b + i cos a sinh b, cos z = cos a cosh b - i sin a sinh b
+template <bool Cosine>
+void sineOrCosine(const double* re, const double* im, double* outRe, double* outIm, size_t n) {
+
+    double s[CHUNK], c[CHUNK];
+    for (size_t start = 0; start < n; start += CHUNK) {
+        size_t count = std::min(CHUNK, n - start);
+        trigSinCosArray(re + start, s, c, count);
+        for (size_t j = 0; j < count; j++) {
+            double a = re[start + j], b = im[start + j];
+            if (!std::isfinite(a) || !exponentInRange(b)) {
+                std::complex<double> z(a, b);
+                z = Cosine ? std::cos(z) : std::sin(z);
+                outRe[start + j] = z.real();
+                outIm[start + j] = z.imag();
+                continue;
+            }
+            double sinh, cosh;
+            sinhCosh(b, sinh, cosh);
+            outRe[start + j] = (Cosine ? c[j] : s[j]) * cosh;
+            outIm[start + j] = Cosine ? -(s[j] * sinh) : c[j] * sinh;
+        }
+    }
+}
+
+} // namespace
+
+void complexExp(const double* re, const double* im, double* outRe, double* outIm, size_t n) {
+
+    // e^(a + bi) = e^a (cos b + i sin b)
+    double s[CHUNK], c[CHUNK];
+    for (size_t start = 0; start < n; start += CHUNK) {
+        size_t count = std::min(CHUNK, n - start);
+        trigSinCosArray(im + start, s, c, count);
+        for (size_t j = 0; j < count; j++) {
+            double a = re[start + j], b = im[start + j];
+            if (!exponentInRange(a) || !std::isfinite(b)) {
+                std::complex<double> z = std::exp(std::complex<double>(a, b));
+                outRe[start + j] = z.real();
+                outIm[start + j] = z.imag();
+                continue;
+            }
+            double scale = std::exp(a);
+            outRe[start + j] = scale * c[j];
+            outIm[start + j] = scale * s[j];
+        }
+    }
+}
+
+void complexLn(const double* re, const double* im, double* outRe, double* outIm, size_t n) {
+    logarithm(re, im, outRe, outIm, n, 1.0);
+}
+
+void complexLog10(const double* re, const double* im, double* outRe, double* outIm, size_t n) {
+    logarithm(re, im, outRe, outIm, n, std::log(10.0));
+}
+
+void complexSqrt(const double* re, const double* im, double* outRe, double* outIm, size_t n) {
+
+    // t = sqrt((|a| + |z|) / 2); при a >= 0 корень равен t + i b/(2t),
+    // иначе |b|/(2t) + i t со знаком b (и знаком нуля: sqrt(-4 - 0i) = -2i)
+    size_t i = 0;
+    for (; i + simd::width <= n; i += simd::width) {
+        simd::vdouble a = simd::load(re + i), b = simd::load(im + i);
+        simd::vdouble absA = simd::abs(a), absB = simd::abs(b);
+        simd::vdouble s = simd::max(absA, absB), m = simd::min(absA, absB);
+        if (modulusNeedsScalar(absA, absB, s)) {
+            for (int k = 0; k < simd::width; k++) {
+                std::complex<double> z = std::sqrt(std::complex<double>(re[i + k], im[i + k]));
+                outRe[i + k] = z.real();
+                outIm[i + k] = z.imag();
+            }
+            continue;
+        }
+        simd::vdouble zero = simd::set1(0.0), one = simd::set1(1.0);
+        simd::vdouble q = m / s;
+        simd::vdouble modulus = s * simd::sqrt(one + q * q);
+        simd::vdouble t = simd::sqrt(simd::set1(0.5) * (absA + modulus));
+        simd::vdouble other = b / (t + t);
+        // 1/b отличает -0 от +0
+        simd::vdouble negativeB = simd::maskOr(simd::lt(b, zero), simd::lt(one / b, zero));
+        simd::vdouble negativeA = simd::lt(a, zero);
+        simd::store(outRe + i, simd::select(negativeA, simd::abs(other), t));
+        simd::store(outIm + i, simd::select(negativeA, simd::select(negativeB, simd::negate(t), t), other));
+    }
+    for (; i < n; i++) {
+        std::complex<double> z = std::sqrt(std::complex<double>(re[i], im[i]));
+        outRe[i] = z.real();
+        outIm[i] = z.imag();
+    }
+}
+
+void complexSin(const double* re, const double* im, double* outRe, double* outIm, size_t n) {
+    sineOrCosine<false>(re, im, outRe, outIm, n);
+}
+
+void complexCos(const double* re, const double* im, double* outRe, double* outIm, size_t n) {
+    sineOrCosine<true>(re, im, outRe, outIm, n);
+}
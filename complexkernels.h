@@ -0,0 +1,40 @@
+#ifndef COMPLEXKERNELS_H
+#define COMPLEXKERNELS_H
+
+#include <cstddef>
+
+// Поэлементные операции над комплексными массивами в формате SoA
+// (действительные и мнимые части хранятся в отдельных массивах).
+// Результат можно записывать на место первого операнда.
+
+void complexAdd(const double* aRe, const double* aIm,
+                const double* bRe, const double* bIm,
+                double* outRe, double* outIm, size_t n);
+
+void complexSub(const double* aRe, const double* aIm,
+                const double* bRe, const double* bIm,
+                double* outRe, double* outIm, size_t n);
+
+void complexMul(const double* aRe, const double* aIm,
+                const double* bRe, const double* bIm,
+                double* outRe, double* outIm, size_t n);
+
+// Деление с масштабированием знаменателя, без ветвлений
+void complexDiv(const double* aRe, const double* aIm,
+                const double* bRe, const double* bIm,
+                double* outRe, double* outIm, size_t n);
+
+// Функции с аргументом в радианах. sin и cos аргумента делят одно приведение
+// (trigSinCosArray), sqrt и модуль для ln/log10 считаются векторно, exp,
+// expm1, log и atan2 - по элементам. Отличие от std::complex - несколько ulp,
+// у ln|z| при |z| около 1 - несколько ulp от |z|^2 - 1. Нули, nan, inf,
+// модули вне 1e-300..1e300 и показатели больше 700 по модулю считаются
+// через std::complex
+void complexExp(const double* re, const double* im, double* outRe, double* outIm, size_t n);
+void complexLn(const double* re, const double* im, double* outRe, double* outIm, size_t n);
+void complexLog10(const double* re, const double* im, double* outRe, double* outIm, size_t n);
+void complexSqrt(const double* re, const double* im, double* outRe, double* outIm, size_t n);
+void complexSin(const double* re, const double* im, double* outRe, double* outIm, size_t n);
+void complexCos(const double* re, const double* im, double* outRe, double* outIm, size_t n);
+
+#endif // COMPLEXKERNELS_H
@@ -0,0 +1,82 @@
+#include "csvformat.h"
+#include "grammar.h"
+
+#include <algorithm>
+#include <clocale>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+namespace csv {
+
+bool parseNumber(const char* begin, const char* end, char decimal, double& value) {
+
+    while (begin < end && grammar::isSpace(*begin)) begin++;
+    while (end > begin && grammar::isSpace(end[-1])) end--;
+    char buffer[64];
+    if (begin == end || end - begin >= static_cast<long>(sizeof(buffer))) {
+        return false;
+    }
+    const char* p = begin;
+    if (*p == '+' || *p == '-') p++;
+    size_t digits = 0;
+    while (p < end && grammar::isDigit(*p)) { p++; digits++; }
+    const char* point = nullptr;
+    if (p < end && *p == decimal) {
+        point = p++;
+        while (p < end && grammar::isDigit(*p)) { p++; digits++; }
+    }
+    if (digits == 0) {
+        return false;
+    }
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        p++;
+        if (p < end && (*p == '+' || *p == '-')) p++;
+        if (p == end || !grammar::isDigit(*p)) {
+            return false;
+        }
+        while (p < end && grammar::isDigit(*p)) p++;
+    }
+    if (p != end) {
+        return false;
+    }
+    size_t length = static_cast<size_t>(end - begin);
+    std::copy(begin, end, buffer);
+    buffer[length] = '\0';
+    if (point) {
+        buffer[point - begin] = *std::localeconv()->decimal_point;
+    }
+    value = std::strtod(buffer, nullptr);
+    return std::isfinite(value);
+}
+
+std::string formatNumber(double value) {
+
+    char buffer[32];
+    std::snprintf(buffer, sizeof(buffer), "%.15g", value);
+    if (std::strtod(buffer, nullptr) != value) {
+        std::snprintf(buffer, sizeof(buffer), "%.17g", value);
+    }
+    std::string text = buffer;
+    // Обратное преобразование того же разделителя, что и в parseNumber
+    std::replace(text.begin(), text.end(), *std::localeconv()->decimal_point, '.');
+    return text;
+}
+
+char detectDelimiter(const char* begin, const char* end) {
+
+    const char delimiters[3] = { ',', ';', '\t' };
+    size_t counts[3] = { 0, 0, 0 };
+    bool quoted = false;
+    for (const char* p = begin; p < end && (quoted || *p != '\n'); p++) {
+        if (*p == '"') {
+            quoted = !quoted;
+        }
+        for (int k = 0; k < 3 && !quoted; k++) {
+            counts[k] += *p == delimiters[k];
+        }
+    }
+    return delimiters[std::max_element(counts, counts + 3) - counts];
+}
+
+} // namespace csv
@@ -0,0 +1,30 @@
+#ifndef CSVFORMAT_H
+#define CSVFORMAT_H
+
+#include <string>
+
+// Числа и поля в текстовых файлах данных (CSV): общие правила для
+// импорта в таблицу и для статистики по столбцам файла
+namespace csv {
+
+// Число в записи "C": знак, цифры с десятичным разделителем decimal,
+// показатель; пробелы по краям допускаются. strtod зависит от LC_NUMERIC
+// (Qt на Unix устанавливает локаль окружения), поэтому разделитель
+// заменяется разделителем локали. inf и nan - не числа
+bool parseNumber(const char* begin, const char* end, char decimal, double& value);
+
+// Кратчайшая запись числа, которая читается обратно в то же значение
+std::string formatNumber(double value);
+
+// Разделитель полей - самый частый из ',', ';' и табуляции в первой
+// строке вне кавычек (',' при равенстве)
+char detectDelimiter(const char* begin, const char* end);
+
+// Десятичная запятая допускается, если разделитель полей не запятая
+inline char decimalFor(char delimiter) {
+    return delimiter == ',' ? '.' : ',';
+}
+
+} // namespace csv
+
+#endif // CSVFORMAT_H
@@ -0,0 +1,379 @@
+#include "exactnumber.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+namespace {
+
+const long double PI_LONG = 3.141592653589793238462643383279502884L;
+
+// Значения sin(k * 30 градусов) в половинах; NOT_RATIONAL - иррациональные
+const int NOT_RATIONAL = 100;
+const int SIN_TWELFTHS[12] = { 0, 1, NOT_RATIONAL, 2, NOT_RATIONAL, 1, 0, -1, NOT_RATIONAL, -2, NOT_RATIONAL, -1 };
+// tan(k * 45 градусов); полюс тоже пропускается
+const int TAN_EIGHTHS[8] = { 0, 1, NOT_RATIONAL, -1, 0, 1, NOT_RATIONAL, -1 };
+
+// Полоборота в единицах углов
+int halfTurn(AngleMode mode) {
+    return mode == ANGLE_DEGREES ? 180 : mode == ANGLE_GRADIANS ? 200 : 0;
+}
+
+// Остаток целого x по модулю m в [0, m)
+int modulo(const BigInteger& x, int m) {
+
+    int64_t rest = 0;
+    (x % BigInteger(m)).toInt64(rest);
+    return static_cast<int>(rest < 0 ? rest + m : rest);
+}
+
+bool isPowerOfTen(const BigInteger& x, int64_t& exponent) {
+
+    std::string digits = x.toString();
+    if (digits[0] != '1' || digits.find_first_not_of('0', 1) != std::string::npos) {
+        return false;
+    }
+    exponent = static_cast<int64_t>(digits.size()) - 1;
+    return true;
+}
+
+} // namespace
+
+ExactNumber ExactNumber::fraction(const BigInteger& numerator, const BigInteger& denominator) {
+
+    ExactNumber result;
+    if (denominator.isOne() || numerator.isZero()) {
+        result.num = numerator;
+    } else {
+        BigInteger g = BigInteger::gcd(numerator, denominator);
+        result.num = numerator / g;
+        result.den = denominator / g;
+        if (result.den.isNegative()) {
+            result.num = -result.num;
+            result.den = -result.den;
+        }
+    }
+    return result.limit();
+}
+
+ExactNumber ExactNumber::approximate(long double value) {
+
+    ExactNumber result;
+    result.value = value;
+    result.exact = false;
+    return result;
+}
+
+bool ExactNumber::fromDecimal(const std::string& text, ExactNumber& result) {
+
+    size_t point = text.find('.');
+    std::string digits = text;
+    size_t places = 0;
+    if (point != std::string::npos) {
+        digits.erase(point, 1);
+        places = text.size() - point - 1;
+    }
+    BigInteger numerator;
+    if (digits.empty() || !BigInteger::fromDecimal(digits.data(), digits.size(), numerator)) {
+        return false;
+    }
+    result = fraction(numerator, BigInteger::power(BigInteger(10), places));
+    return true;
+}
+
+ExactNumber& ExactNumber::limit() {
+
+    if (exact && (num.bitLength() > MAX_EXACT_BITS || den.bitLength() > MAX_EXACT_BITS)) {
+        value = toLongDouble();
+        exact = false;
+        num = BigInteger();
+        den = BigInteger(1);
+    }
+    return *this;
+}
+
+long double ExactNumber::toLongDouble() const {
+
+    if (!exact) {
+        return value;
+    }
+    if (den.isOne() && num.bitLength() <= 64) {
+        return num.toLongDouble();
+    }
+    // Мантиссы отдельно от порядков: числитель и знаменатель могут
+    // не помещаться в long double, а их отношение - помещаться
+    long numeratorExponent = 0, denominatorExponent = 0;
+    long double mantissa = num.toLongDouble(numeratorExponent) / den.toLongDouble(denominatorExponent);
+    long exponent = std::max(-100000L, std::min(100000L, numeratorExponent - denominatorExponent));
+    return std::ldexp(mantissa, static_cast<int>(exponent));
+}
+
+std::string ExactNumber::toString() const {
+
+    if (!exact) {
+        char buffer[64];
+        std::snprintf(buffer, sizeof(buffer), "%.18Lg", value);
+        return buffer;
+    }
+    if (den.isOne()) {
+        return num.toString();
+    }
+
+    // Знаменатель 2^a * 5^b - конечная десятичная дробь с max(a, b) знаками
+    BigInteger rest = den;
+    int twos = 0, fives = 0;
+    const BigInteger two(2), five(5);
+    while (rest.isEven() && twos <= MAX_DECIMAL_PLACES) {
+        rest = rest / two;
+        twos++;
+    }
+    while ((rest % five).isZero() && fives <= MAX_DECIMAL_PLACES) {
+        rest = rest / five;
+        fives++;
+    }
+    int places = std::max(twos, fives);
+    if (!rest.isOne() || places > MAX_DECIMAL_PLACES) {
+        return num.toString() + "/" + den.toString();
+    }
+    std::string digits = (num.abs() * BigInteger::power(BigInteger(10), places) / den).toString();
+    if (digits.size() <= static_cast<size_t>(places)) {
+        digits.insert(0, places + 1 - digits.size(), '0');
+    }
+    digits.insert(digits.size() - places, ".");
+    return (num.isNegative() ? "-" : "") + digits;
+}
+
+ExactNumber ExactNumber::operator-() const {
+
+    ExactNumber result(*this);
+    result.num = -num;
+    result.value = -value;
+    return result;
+}
+
+ExactNumber operator+(const ExactNumber& a, const ExactNumber& b) {
+
+    if (!a.exact || !b.exact) {
+        return ExactNumber::approximate(a.toLongDouble() + b.toLongDouble());
+    }
+    if (a.den.isOne() && b.den.isOne()) {
+        ExactNumber result;
+        result.num = a.num + b.num;
+        return result.limit();
+    }
+    // a/b + c/d = (a * d/g + c * b/g) / (b/g * d), g = НОД(b, d) - числа
+    // короче, чем при приведении к b * d (Кнут, т. 2, 4.5.1)
+    BigInteger g = BigInteger::gcd(a.den, b.den);
+    BigInteger aScale = b.den / g;
+    BigInteger bScale = a.den / g;
+    return ExactNumber::fraction(a.num * aScale + b.num * bScale, a.den * aScale);
+}
+
+ExactNumber operator-(const ExactNumber& a, const ExactNumber& b) {
+    return a + -b;
+}
+
+ExactNumber operator*(const ExactNumber& a, const ExactNumber& b) {
+
+    if (!a.exact || !b.exact) {
+        return ExactNumber::approximate(a.toLongDouble() * b.toLongDouble());
+    }
+    ExactNumber result;
+    if (a.den.isOne() && b.den.isOne()) {
+        result.num = a.num * b.num;
+        return result.limit();
+    }
+    if (a.num.isZero() || b.num.isZero()) {
+        return result;
+    }
+    // Перекрёстное сокращение до умножения: произведение уже несократимо
+    BigInteger g1 = BigInteger::gcd(a.num, b.den);
+    BigInteger g2 = BigInteger::gcd(b.num, a.den);
+    result.num = (a.num / g1) * (b.num / g2);
+    result.den = (a.den / g2) * (b.den / g1);
+    return result.limit();
+}
+
+ExactNumber operator/(const ExactNumber& a, const ExactNumber& b) {
+
+    if (!a.exact || !b.exact) {
+        return ExactNumber::approximate(a.toLongDouble() / b.toLongDouble());
+    }
+    ExactNumber inverse;
+    inverse.num = b.num.isNegative() ? -b.den : b.den;
+    inverse.den = b.num.abs();
+    return a * inverse;
+}
+
+bool ExactNumber::power(const ExactNumber& base, const ExactNumber& exponent, ExactNumber& result) {
+
+    if (base.isZero() && exponent.toLongDouble() < 0) {
+        return false;
+    }
+    int64_t n = 0;
+    if (base.exact && exponent.isInteger() && exponent.num.toInt64(n)) {
+        uint64_t magnitude = n < 0 ? ~static_cast<uint64_t>(n) + 1 : static_cast<uint64_t>(n);
+        if (base.isZero()) {
+            result = ExactNumber(n == 0 ? 1 : 0);
+            return true;
+        }
+        if (base.den.isOne() && base.num.abs().isOne()) {
+            result = ExactNumber(base.num.isNegative() && magnitude % 2 ? -1 : 1);
+            return true;
+        }
+        // Оценка длины результата до возведения
+        size_t bits = std::max(base.num.bitLength(), base.den.bitLength());
+        if (magnitude <= MAX_EXACT_BITS && bits * magnitude <= MAX_EXACT_BITS + bits) {
+            // Степени взаимно простых чисел взаимно просты
+            BigInteger p = BigInteger::power(base.num, magnitude);
+            BigInteger q = BigInteger::power(base.den, magnitude);
+            result = ExactNumber();
+            if (n < 0) {
+                std::swap(p, q);
+                if (q.isNegative()) {
+                    p = -p;
+                    q = -q;
+                }
+            }
+            result.num = std::move(p);
+            result.den = std::move(q);
+            result.limit();
+            return true;
+        }
+    }
+    result = approximate(std::pow(base.toLongDouble(), exponent.toLongDouble()));
+    return true;
+}
+
+BigInteger ExactNumber::floor() const {
+
+    BigInteger quotient, remainder;
+    BigInteger::divide(num, den, quotient, remainder);
+    if (remainder.isNegative()) {
+        quotient = quotient - BigInteger(1);
+    }
+    return quotient;
+}
+
+ExactNumber ExactNumber::apply(grammar::Function function, AngleMode mode, const ExactNumber& x) {
+
+    using namespace grammar;
+    int half = halfTurn(mode);
+    if (x.exact) {
+        switch (function) {
+        case FUNCTION_ABS:
+            return x.num.isNegative() ? -x : x;
+        case FUNCTION_SQRT:
+            if (!x.num.isNegative()) {
+                BigInteger p = BigInteger::squareRoot(x.num);
+                BigInteger q = BigInteger::squareRoot(x.den);
+                if (p * p == x.num && q * q == x.den) {
+                    return fraction(p, q);
+                }
+            }
+            break;
+        case FUNCTION_LOG: {
+            int64_t exponent = 0;
+            if (!x.num.isNegative() && x.den.isOne() && isPowerOfTen(x.num, exponent)) {
+                return ExactNumber(exponent);
+            }
+            if (x.num.isOne() && isPowerOfTen(x.den, exponent)) {
+                return ExactNumber(-exponent);
+            }
+            break;
+        }
+        case FUNCTION_LN:
+            if (x.isInteger() && x.num.isOne()) {
+                return ExactNumber();
+            }
+            break;
+        case FUNCTION_EXP:
+        case FUNCTION_COSH:
+            if (x.isZero()) {
+                return ExactNumber(1);
+            }
+            break;
+        case FUNCTION_SINH:
+        case FUNCTION_TANH:
+            if (x.isZero()) {
+                return ExactNumber();
+            }
+            break;
+        case FUNCTION_SIN:
+        case FUNCTION_COS:
+        case FUNCTION_SEC:
+        case FUNCTION_CSC:
+        case FUNCTION_TAN:
+        case FUNCTION_COT:
+            // Углы, кратные 30 (для тангенса - 45) градусам, с рациональным
+            // значением; в радианах такой угол только 0
+            if (half || x.isZero()) {
+                ExactNumber turns = half ? x / ExactNumber(2 * half) : ExactNumber();
+                bool tangent = function == FUNCTION_TAN || function == FUNCTION_COT;
+                ExactNumber parts = turns * ExactNumber(tangent ? 8 : 12);
+                if (!parts.isInteger()) {
+                    break;
+                }
+                int k = modulo(parts.num, tangent ? 8 : 12);
+                int halves = tangent ? TAN_EIGHTHS[k]
+                           : SIN_TWELFTHS[function == FUNCTION_SIN || function == FUNCTION_CSC ? k : (k + 3) % 12];
+                if (halves == NOT_RATIONAL) {
+                    break;
+                }
+                ExactNumber value = tangent ? ExactNumber(halves) : fraction(halves, 2);
+                if (function == FUNCTION_SIN || function == FUNCTION_COS || function == FUNCTION_TAN) {
+                    return value;
+                }
+                if (!value.isZero()) {
+                    return ExactNumber(1) / value;
+                }
+            }
+            break;
+        case FUNCTION_ASIN:
+        case FUNCTION_ACOS:
+        case FUNCTION_ATAN: {
+            // Значения с рациональным углом: 0, +-1/2, +-1
+            ExactNumber twice = x * ExactNumber(2);
+            int64_t k = 0;
+            if (!twice.isInteger() || !twice.num.toInt64(k) || k < -2 || k > 2
+                    || (function == FUNCTION_ATAN && k % 2 != 0)) {
+                break;
+            }
+            static const int ASIN_DEGREES[5] = { -90, -30, 0, 30, 90 };
+            int degrees = function == FUNCTION_ATAN ? 45 * static_cast<int>(k / 2)
+                        : function == FUNCTION_ASIN ? ASIN_DEGREES[k + 2] : 90 - ASIN_DEGREES[k + 2];
+            if (half) {
+                return fraction(BigInteger(degrees) * BigInteger(half), BigInteger(180));
+            }
+            if (degrees == 0) {
+                return ExactNumber();
+            }
+            break;
+        }
+        default:
+            break;
+        }
+    }
+
+    long double v = x.toLongDouble();
+    long double toRadians = half ? PI_LONG / half : 1.0L;
+    switch (function) {
+    case FUNCTION_ABS: return approximate(std::fabs(v));
+    case FUNCTION_ACOS: return approximate(std::acos(v) / toRadians);
+    case FUNCTION_ASIN: return approximate(std::asin(v) / toRadians);
+    case FUNCTION_ATAN: return approximate(std::atan(v) / toRadians);
+    case FUNCTION_COS: return approximate(std::cos(v * toRadians));
+    case FUNCTION_COSH: return approximate(std::cosh(v));
+    case FUNCTION_COT: return approximate(std::cos(v * toRadians) / std::sin(v * toRadians));
+    case FUNCTION_CSC: return approximate(1.0L / std::sin(v * toRadians));
+    case FUNCTION_EXP: return approximate(std::exp(v));
+    case FUNCTION_LN: return approximate(std::log(v));
+    case FUNCTION_LOG: return approximate(std::log10(v));
+    case FUNCTION_SEC: return approximate(1.0L / std::cos(v * toRadians));
+    case FUNCTION_SIN: return approximate(std::sin(v * toRadians));
+    case FUNCTION_SINH: return approximate(std::sinh(v));
+    case FUNCTION_SQRT: return approximate(std::sqrt(v));
+    case FUNCTION_TAN: return approximate(std::tan(v * toRadians));
+    default: return approximate(std::tanh(v));
+    }
+}
@@ -0,0 +1,73 @@
+#ifndef EXACTNUMBER_H
+#define EXACTNUMBER_H
+
+#include "biginteger.h"
+#include "compiledexpression.h"
+#include "grammar.h"
+
+#include <string>
+
+// Число точного режима: несократимая дробь p/q с q > 0 или, после
+// иррациональной функции, приближённое значение long double.
+// Сложение, вычитание, умножение, деление и целая степень точных чисел
+// точны; операция с приближённым операндом даёт приближённый результат.
+// Точное число, числитель или знаменатель которого длиннее
+// MAX_EXACT_BITS, тоже становится приближённым, чтобы 2^100000 не
+// занимало всю память
+class ExactNumber
+{
+public:
+    static const size_t MAX_EXACT_BITS = 8192;
+
+    ExactNumber() : den(1) {}
+    ExactNumber(int64_t value) : num(value), den(1) {}
+
+    // Дробь numerator / denominator (denominator != 0) после сокращения
+    static ExactNumber fraction(const BigInteger& numerator, const BigInteger& denominator);
+    static ExactNumber approximate(long double);
+    // Десятичная запись без знака и показателя: "12", "12.5", ".5", "5."
+    static bool fromDecimal(const std::string&, ExactNumber&);
+
+    bool isExact() const { return exact; }
+    bool isInteger() const { return exact && den.isOne(); }
+    bool isZero() const { return exact ? num.isZero() : value == 0; }
+    const BigInteger& numerator() const { return num; }
+    const BigInteger& denominator() const { return den; }
+    long double toLongDouble() const;
+
+    // Целое - полностью, конечная десятичная дробь - десятичной записью
+    // (не больше MAX_DECIMAL_PLACES знаков после точки), остальные
+    // дроби - "p/q"; приближённое значение - 18 значащих цифр
+    std::string toString() const;
+
+    ExactNumber operator-() const;
+    friend ExactNumber operator+(const ExactNumber&, const ExactNumber&);
+    friend ExactNumber operator-(const ExactNumber&, const ExactNumber&);
+    friend ExactNumber operator*(const ExactNumber&, const ExactNumber&);
+    // Делитель не ноль (проверяет вызывающий)
+    friend ExactNumber operator/(const ExactNumber&, const ExactNumber&);
+    // Точна для точного основания и целого показателя, иначе powl.
+    // Ноль в отрицательной степени - false
+    static bool power(const ExactNumber& base, const ExactNumber& exponent, ExactNumber& result);
+    // Наибольшее целое, не большее числа; только для точных
+    BigInteger floor() const;
+
+    // Встроенная функция калькулятора. Точны abs, sqrt от квадрата
+    // дроби, log от степени 10 и значения в 0 и 1, которые являются
+    // целыми (sin(0), cos(0), exp(0), ln(1), ...); остальное - в long double
+    // с переводом единиц углов
+    static ExactNumber apply(grammar::Function, AngleMode, const ExactNumber&);
+
+private:
+    static const int MAX_DECIMAL_PLACES = 40;
+
+    // Приближённое значение, если точное слишком длинное
+    ExactNumber& limit();
+
+    BigInteger num;
+    BigInteger den;
+    long double value = 0;
+    bool exact = true;
+};
+
+#endif // EXACTNUMBER_H
@@ -1,72 +1,1976 @@
 #include "expressioncalculator.h"
+#include "exactnumber.h"
+#include "grammar.h"
+#include "complexkernels.h"
+#include "anglekernels.h"
+#include "trigcore.h"
+#include "simd.h"
+#include "instrumentation.h"
+#include "reductionkernels.h"
+#include "polynomialkernels.h"
+#include "columnstatistics.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+
+// Возведение в целую степень двоичным методом: (-1)^2 даёт ровно 1,
+// без мнимой погрешности, которую вносит pow через логарифм
+static std::complex<double> integerPower(std::complex<double> base, int exponent) {
+
+    bool negative = exponent < 0;
+    unsigned int n = negative ? -exponent : exponent;
+    std::complex<double> result(1.0, 0.0);
+    while (n) {
+        if (n & 1) result *= base;
+        base *= base;
+        n >>= 1;
+    }
+    return negative ? 1.0 / result : result;
+}
+
+// Синус и косинус одного аргумента в заданных единицах углов
+static void sinCosByMode(AngleMode mode, double x, double &s, double &c) {
+
+    switch (mode) {
+    case ANGLE_DEGREES: sinCosAngle<DEGREES_HALF_TURN>(x, s, c); break;
+    case ANGLE_GRADIANS: sinCosAngle<GRADIANS_HALF_TURN>(x, s, c); break;
+    default: trigSinCos(x, s, c); break;
+    }
+}
+
+// Встроенная функция: вещественный и комплексный варианты, векторный - если есть
+struct BuiltinFunction {
+    const char* name;
+    double (*real)(double);
+    std::complex<double> (*complex)(std::complex<double>);
+    void (*array)(const double*, double*, size_t);
+    // Комплексный вариант над массивами SoA (complexkernels.h) или nullptr
+    void (*complexArray)(const double*, const double*, double*, double*, size_t);
+};
+
+// Матричная функция одного или двух аргументов (второй для одноместных не используется)
+struct BuiltinMatrixFunction {
+    const char* name;
+    int arity;
+    CalculationError::Code (*apply)(const Matrix&, const Matrix&, Matrix&);
+};
+
+namespace {
+
+typedef std::complex<double> complex;
+
+double asinReal(double x) { return std::asin(x); }
+double acosReal(double x) { return std::acos(x); }
+double atanReal(double x) { return std::atan(x); }
+double sinhReal(double x) { return std::sinh(x); }
+double coshReal(double x) { return std::cosh(x); }
+double tanhReal(double x) { return std::tanh(x); }
+double logReal(double x) { return std::log10(x); }
+double lnReal(double x) { return std::log(x); }
+double expReal(double x) { return std::exp(x); }
+double sqrtReal(double x) { return std::sqrt(x); }
+double absReal(double x) { return std::abs(x); }
+
+complex sinComplex(complex z) { return std::sin(z); }
+complex cosComplex(complex z) { return std::cos(z); }
+complex tanComplex(complex z) { return std::tan(z); }
+complex secComplex(complex z) { return 1.0 / std::cos(z); }
+complex cscComplex(complex z) { return 1.0 / std::sin(z); }
+complex cotComplex(complex z) { return std::cos(z) / std::sin(z); }
+complex asinComplex(complex z) { return std::asin(z); }
+complex acosComplex(complex z) { return std::acos(z); }
+complex atanComplex(complex z) { return std::atan(z); }
+complex sinhComplex(complex z) { return std::sinh(z); }
+complex coshComplex(complex z) { return std::cosh(z); }
+complex tanhComplex(complex z) { return std::tanh(z); }
+complex logComplex(complex z) { return std::log10(z); }
+complex lnComplex(complex z) { return std::log(z); }
+complex expComplex(complex z) { return std::exp(z); }
+complex sqrtComplex(complex z) { return std::sqrt(z); }
+complex absComplex(complex z) { return complex(std::abs(z), 0.0); }
+
+// Комплексные варианты для градусов и град: аргумент прямых функций
+// переводится в радианы, результат обратных - из радиан
+template <complex (*F)(complex), int HalfTurn>
+complex directAngle(complex z) { return F(z * (3.14159265358979323846 / HalfTurn)); }
+template <complex (*F)(complex), int HalfTurn>
+complex inverseAngle(complex z) { return F(z) / (3.14159265358979323846 / HalfTurn); }
+
+CalculationError::Code determinantCall(const Matrix& a, const Matrix&, Matrix& result) { return determinant(a, result); }
+CalculationError::Code inverseCall(const Matrix& a, const Matrix&, Matrix& result) { return inverse(a, result); }
+CalculationError::Code transposeCall(const Matrix& a, const Matrix&, Matrix& result) { return transpose(a, result); }
+
+// Статистика по всем элементам матрицы (столбец, строка или таблица
+// данных), результат - число. inf или nan среди элементов дают nan
+bool allFinite(const Matrix& a) {
+    for (size_t i = 0; i < a.size(); i++) {
+        if (!std::isfinite(a.data()[i])) return false;
+    }
+    return true;
+}
+
+template <double (*Statistic)(const RunningMoments&)>
+CalculationError::Code momentCall(const Matrix& a, const Matrix&, Matrix& result) {
+    result = Matrix::scalar(allFinite(a) ? Statistic(columnMoments(a.data(), a.size()))
+                                         : std::numeric_limits<double>::quiet_NaN());
+    return CalculationError::NONE;
+}
+
+double meanOf(const RunningMoments& m) { return m.mean; }
+double deviationOf(const RunningMoments& m) { return m.standardDeviation(); }
+double minimumOf(const RunningMoments& m) { return m.minimum; }
+double maximumOf(const RunningMoments& m) { return m.maximum; }
+
+CalculationError::Code quantileOf(const Matrix& a, double q, Matrix& result) {
+    result = Matrix::scalar(allFinite(a) ? columnQuantile(a.data(), a.size(), q)
+                                         : std::numeric_limits<double>::quiet_NaN());
+    return CalculationError::NONE;
+}
+
+CalculationError::Code medianCall(const Matrix& a, const Matrix&, Matrix& result) {
+    return quantileOf(a, 0.5, result);
+}
+
+// percentile(A, p), p от 0 до 100
+CalculationError::Code percentileCall(const Matrix& a, const Matrix& p, Matrix& result) {
+    if (!p.isScalar() || !(p(0, 0) >= 0.0 && p(0, 0) <= 100.0)) {
+        return CalculationError::INVALID_FUNCTION_ARGUMENT;
+    }
+    return quantileOf(a, p(0, 0) / 100.0, result);
+}
+
+// Корреляция Пирсона соответствующих элементов; nan, если одна из
+// величин постоянна
+CalculationError::Code correlationCall(const Matrix& a, const Matrix& b, Matrix& result) {
+    if (a.rows() != b.rows() || a.cols() != b.cols()) {
+        return CalculationError::DIMENSION_MISMATCH;
+    }
+    result = Matrix::scalar(allFinite(a) && allFinite(b)
+                            ? columnCovariance(a.data(), b.data(), a.size()).correlation()
+                            : std::numeric_limits<double>::quiet_NaN());
+    return CalculationError::NONE;
+}
+
+// Тригонометрическая функция и её варианты для градусов и град.
+// Имена вариантов содержат '#', поэтому недоступны из текста выражения
+// и подставляются только компилятором по режиму углов
+#define DIRECT_TRIG(name, real, angle, complexF) \
+    { name, real, complexF, nullptr, nullptr }, \
+    { name "#deg", angle<DEGREES_HALF_TURN>, directAngle<complexF, DEGREES_HALF_TURN>, nullptr, nullptr }, \
+    { name "#grad", angle<GRADIANS_HALF_TURN>, directAngle<complexF, GRADIANS_HALF_TURN>, nullptr, nullptr }
+#define INVERSE_TRIG(name, real, angle, complexF) \
+    { name, real, complexF, nullptr, nullptr }, \
+    { name "#deg", angle<DEGREES_HALF_TURN>, inverseAngle<complexF, DEGREES_HALF_TURN>, nullptr, nullptr }, \
+    { name "#grad", angle<GRADIANS_HALF_TURN>, inverseAngle<complexF, GRADIANS_HALF_TURN>, nullptr, nullptr }
+
+// Таблицы упорядочены по имени (проверяется при компиляции) и целиком
+// инициализируются компилятором: создание калькулятора ничего не строит
+constexpr BuiltinFunction FUNCTIONS[] = {
+    { "abs", absReal, absComplex, nullptr, nullptr },
+    INVERSE_TRIG("acos", acosReal, acosAngle, acosComplex),
+    INVERSE_TRIG("arccos", acosReal, acosAngle, acosComplex),
+    INVERSE_TRIG("arcsin", asinReal, asinAngle, asinComplex),
+    INVERSE_TRIG("arctg", atanReal, atanAngle, atanComplex),
+    INVERSE_TRIG("asin", asinReal, asinAngle, asinComplex),
+    INVERSE_TRIG("atan", atanReal, atanAngle, atanComplex),
+    { "cos", trigCos, cosComplex, trigCosArray, complexCos },
+    { "cos#deg", cosAngle<DEGREES_HALF_TURN>, directAngle<cosComplex, DEGREES_HALF_TURN>, nullptr, nullptr },
+    { "cos#grad", cosAngle<GRADIANS_HALF_TURN>, directAngle<cosComplex, GRADIANS_HALF_TURN>, nullptr, nullptr },
+    { "cosh", coshReal, coshComplex, nullptr, nullptr },
+    DIRECT_TRIG("cot", trigCot, cotAngle, cotComplex),
+    DIRECT_TRIG("csc", trigCsc, cscAngle, cscComplex),
+    DIRECT_TRIG("ctg", trigCot, cotAngle, cotComplex),
+    { "exp", expReal, expComplex, nullptr, complexExp },
+    { "ln", lnReal, lnComplex, nullptr, complexLn },
+    { "log", logReal, logComplex, nullptr, complexLog10 },
+    DIRECT_TRIG("sec", trigSec, secAngle, secComplex),
+    { "sin", trigSin, sinComplex, trigSinArray, complexSin },
+    { "sin#deg", sinAngle<DEGREES_HALF_TURN>, directAngle<sinComplex, DEGREES_HALF_TURN>, nullptr, nullptr },
+    { "sin#grad", sinAngle<GRADIANS_HALF_TURN>, directAngle<sinComplex, GRADIANS_HALF_TURN>, nullptr, nullptr },
+    { "sinh", sinhReal, sinhComplex, nullptr, nullptr },
+    { "sqrt", sqrtReal, sqrtComplex, nullptr, complexSqrt },
+    DIRECT_TRIG("tan", trigTan, tanAngle, tanComplex),
+    { "tanh", tanhReal, tanhComplex, nullptr, nullptr },
+    DIRECT_TRIG("tg", trigTan, tanAngle, tanComplex)
+};
+
+#undef DIRECT_TRIG
+#undef INVERSE_TRIG
+
+constexpr BuiltinMatrixFunction MATRIX_FUNCTIONS[] = {
+    { "correlation", 2, correlationCall },
+    { "det", 1, determinantCall },
+    { "inv", 1, inverseCall },
+    { "matmul", 2, multiply },
+    { "max", 1, momentCall<maximumOf> },
+    { "mean", 1, momentCall<meanOf> },
+    { "median", 1, medianCall },
+    { "min", 1, momentCall<minimumOf> },
+    { "percentile", 2, percentileCall },
+    { "solve", 2, solve },
+    { "stddev", 1, momentCall<deviationOf> },
+    { "transpose", 1, transposeCall }
+};
+
+constexpr bool nameLess(const char* a, const char* b) {
+    return *a != *b ? static_cast<unsigned char>(*a) < static_cast<unsigned char>(*b)
+                    : *a != '\0' && nameLess(a + 1, b + 1);
+}
+
+template <typename Entry, size_t N>
+constexpr bool sortedByName(const Entry (&table)[N], size_t i = 1) {
+    return i >= N || (nameLess(table[i - 1].name, table[i].name) && sortedByName(table, i + 1));
+}
+
+static_assert(sortedByName(FUNCTIONS), "FUNCTIONS must be sorted by name");
+
+constexpr size_t nameLength(const char* name) {
+    return *name == '\0' ? 0 : 1 + nameLength(name + 1);
+}
+
+// Варианты для единиц углов (sin#deg) в грамматике не участвуют
+constexpr bool isAngleVariant(const char* name) {
+    return *name != '\0' && (*name == '#' || isAngleVariant(name + 1));
+}
+
+// Каждое имя таблицы без '#' есть в grammar::FUNCTION_NAMES, и их столько же
+constexpr size_t grammarNameCount(size_t i = 0) {
+    return i == sizeof(FUNCTIONS) / sizeof(FUNCTIONS[0]) ? 0
+         : isAngleVariant(FUNCTIONS[i].name) ? grammarNameCount(i + 1)
+         : grammar::findFunction(FUNCTIONS[i].name, nameLength(FUNCTIONS[i].name)) < 0 ? 1000
+         : 1 + grammarNameCount(i + 1);
+}
+
+static_assert(grammarNameCount() == grammar::FUNCTION_COUNT,
+              "FUNCTIONS and grammar::FUNCTION_NAMES must list the same real functions");
+static_assert(sortedByName(MATRIX_FUNCTIONS), "MATRIX_FUNCTIONS must be sorted by name");
+
+// Двоичный поиск по имени; nullptr, если имени нет
+template <typename Entry, size_t N>
+const Entry* findByName(const Entry (&table)[N], const std::string& name) {
+
+    const Entry* entry = std::lower_bound(table, table + N, name.c_str(), [](const Entry& e, const char* key) {
+        return std::strcmp(e.name, key) < 0;
+    });
+    return entry != table + N && name == entry->name ? entry : nullptr;
+}
+
+} // namespace
 
 ExpressionCalculator::ExpressionCalculator()
 {
-    functions["sin"] = [](double x) { return std::sin(x); };
-    functions["cos"] = [](double x) { return std::cos(x); };
-    functions["tan"] = [](double x) { return std::tan(x); };
-    functions["tg"] = [](double x) { return std::tan(x); }; // альтернативное обозначение
+    // Вызовы считаются по адресу варианта функции в таблице, имена нужны для отчёта
+    for (const BuiltinFunction& entry : FUNCTIONS) {
+        INSTRUMENT_REGISTER_FUNCTION(&entry.real, entry.name);
+        INSTRUMENT_REGISTER_FUNCTION(&entry.complex, entry.name);
+    }
+}
+
+const BuiltinFunction *ExpressionCalculator::findFunction(const std::string &name) {
+    return findByName(FUNCTIONS, name);
+}
+
+const BuiltinMatrixFunction *ExpressionCalculator::findMatrixFunction(const std::string &name) {
+    return findByName(MATRIX_FUNCTIONS, name);
+}
+
+void ExpressionCalculator::setAngleMode(AngleMode mode) {
+    angleMode = mode;
+}
+
+AngleMode ExpressionCalculator::getAngleMode() const {
+    return angleMode;
+}
+
+std::string ExpressionCalculator::angleVariant(const std::string &name, AngleMode mode) {
+
+    switch (mode) {
+    case ANGLE_DEGREES: return name + "#deg";
+    case ANGLE_GRADIANS: return name + "#grad";
+    default: return name;
+    }
+}
+
+// Есть ли в программе литералы матриц или матричные функции
+static bool hasMatrixOperations(const CompiledExpression &program) {
+
+    for (const CompiledExpression::Instruction& instruction : program.code) {
+        if (instruction.op == CompiledExpression::OP_HCAT || instruction.op == CompiledExpression::OP_VCAT
+                || instruction.op == CompiledExpression::OP_MATRIX_CALL) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Многочлен от одной вершины-аргумента, собранный из поддерева при компиляции
+struct PolynomialForm {
+    const ExpressionNode* base;     // аргумент; nullptr - поддерево постоянно
+    unsigned int degree;
+    bool power;                     // в поддереве есть '^'
+    double c[MAX_POLYNOMIAL_DEGREE + 1];
+    double zero[2];                 // значение поддерева как есть при аргументе +0 и -0
+};
+
+// Многочлен или дробь, которые вычисляются одной инструкцией OP_POLY
+struct PolynomialRegion {
+    PolynomialForm numerator;
+    PolynomialForm denominator;
+    bool rational;
+};
+
+static PolynomialForm polynomialAtom(const ExpressionNode *node) {
+
+    PolynomialForm form = PolynomialForm();
+    form.base = node;
+    form.degree = 1;
+    form.c[1] = 1.0;
+    form.zero[1] = -0.0;
+    return form;
+}
+
+static unsigned int polynomialTerms(const PolynomialForm &form) {
+
+    unsigned int terms = 0;
+    for (unsigned int i = 0; i <= form.degree; i++) {
+        terms += form.c[i] != 0;
+    }
+    return terms;
+}
+
+// Стоит ли вычислять многочлен отдельной схемой: есть степени через pow
+// или хотя бы три слагаемых; x*x и x + 1 короче обычным кодом
+static bool worthPolynomial(const PolynomialForm &form) {
+    return form.degree >= 2 && (form.power || polynomialTerms(form) >= 3);
+}
+
+// Форма операции op над формами a и b. Раскрываются только суммы одночленов,
+// произведения и степени одночленов и умножение суммы на положительную
+// константу: раскрытие (x - 1)^8 или (x + 1)(x - 1) потеряло бы точность
+// при взаимном уничтожении слагаемых, а x*(x + 1) или -2*(x^2 + x) - знак
+// нуля при x = -1. Коэффициенты - те же произведения и частные констант,
+// что при вычислении
+static bool combinePolynomials(char op, const PolynomialForm &a, const PolynomialForm &b,
+                               PolynomialForm &result) {
+
+    if (a.base && b.base && a.base != b.base) {
+        return false;
+    }
+    bool monomialA = polynomialTerms(a) <= 1;
+    bool monomialB = polynomialTerms(b) <= 1;
+    result = PolynomialForm();
+    result.base = a.base ? a.base : b.base;
+    result.power = a.power || b.power;
+
+    switch (op) {
+    case '+':
+    case '-':
+        result.degree = std::max(a.degree, b.degree);
+        for (unsigned int i = 0; i <= result.degree; i++) {
+            double x = i <= a.degree ? a.c[i] : 0.0;
+            double y = i <= b.degree ? b.c[i] : 0.0;
+            result.c[i] = op == '+' ? x + y : x - y;
+        }
+        break;
+    case '*':
+        if (a.degree + b.degree > MAX_POLYNOMIAL_DEGREE
+                || !(monomialA || (!b.base && b.c[0] > 0))
+                || !(monomialB || (!a.base && a.c[0] > 0))) {
+            return false;
+        }
+        result.degree = a.degree + b.degree;
+        for (unsigned int i = 0; i <= a.degree; i++) {
+            for (unsigned int j = 0; j <= b.degree; j++) {
+                if (a.c[i] != 0 && b.c[j] != 0) result.c[i + j] = a.c[i] * b.c[j];
+            }
+        }
+        break;
+    case '/':
+        if (b.base || b.c[0] == 0 || !(monomialA || b.c[0] > 0)) {
+            return false;
+        }
+        result.degree = a.degree;
+        for (unsigned int i = 0; i <= a.degree; i++) {
+            result.c[i] = a.c[i] / b.c[0];
+        }
+        break;
+    case '^': {
+        // Целая неотрицательная степень одночлена c x^k: pow(c, n) x^(k n)
+        double n = b.c[0];
+        if (b.base || n != std::floor(n) || n < 0 || n > MAX_POLYNOMIAL_DEGREE || !monomialA
+                || a.degree * n > MAX_POLYNOMIAL_DEGREE) {
+            return false;
+        }
+        result.degree = a.degree * static_cast<unsigned int>(n);
+        result.c[result.degree] = std::pow(a.c[a.degree], n);
+        result.power = true;
+        break;
+    }
+    default:
+        return false;
+    }
+
+    // Значения при нулевом аргументе - теми же операциями, что при вычислении,
+    // вместе со знаком нуля: многочлен в нуле берёт их из программы
+    for (int k = 0; k < 2; k++) {
+        switch (op) {
+        case '+': result.zero[k] = a.zero[k] + b.zero[k]; break;
+        case '-': result.zero[k] = a.zero[k] - b.zero[k]; break;
+        case '*': result.zero[k] = a.zero[k] * b.zero[k]; break;
+        case '/': result.zero[k] = a.zero[k] / b.zero[k]; break;
+        default: result.zero[k] = std::pow(a.zero[k], b.zero[k]); break;
+        }
+    }
+    for (unsigned int i = 0; i <= result.degree; i++) {
+        if (!std::isfinite(result.c[i])) return false;
+    }
+    // Сократившиеся старшие слагаемые (x^2 - x^2) понижают степень,
+    // но аргумент остаётся: его ошибки вычисления сохраняются
+    while (result.degree > 0 && result.c[result.degree] == 0) {
+        result.degree--;
+    }
+    return true;
+}
+
+// Последнее чтение каждой ячейки в общей нумерации Memo: ячейки
+// общих подвыражений, затем sin и cos пар sincos
+static std::vector<size_t> lastSlotReads(const CompiledExpression &program) {
+
+    std::vector<size_t> last(program.slotCount + 2 * program.sinCosSlots, 0);
+    for (size_t pc = 0; pc < program.code.size(); pc++) {
+        const CompiledExpression::Instruction& instruction = program.code[pc];
+        if (instruction.op == CompiledExpression::OP_LOAD) {
+            last[instruction.arg] = pc;
+        } else if (instruction.op == CompiledExpression::OP_SINCOS && !program.sinCos[instruction.arg].first) {
+            unsigned int slot = program.sinCos[instruction.arg].slot;
+            last[program.slotCount + slot] = last[program.slotCount + program.sinCosSlots + slot] = pc;
+        }
+    }
+    return last;
+}
+
+// Ячейки, которые подвыражение между OP_MEMO в begin и OP_MEMO_END в end
+// записывает, а программа читает после него
+static void memoSlots(const CompiledExpression &program, const std::vector<size_t> &lastRead,
+                      size_t begin, size_t end, std::vector<unsigned int> &slots) {
+
+    for (size_t pc = begin + 1; pc < end; pc++) {
+        const CompiledExpression::Instruction& instruction = program.code[pc];
+        if (instruction.op == CompiledExpression::OP_STORE && lastRead[instruction.arg] > end) {
+            slots.push_back(instruction.arg);
+        } else if (instruction.op == CompiledExpression::OP_SINCOS && program.sinCos[instruction.arg].first) {
+            unsigned int sine = static_cast<unsigned int>(program.slotCount + program.sinCos[instruction.arg].slot);
+            if (lastRead[sine] > end) {
+                slots.push_back(sine);
+                slots.push_back(sine + static_cast<unsigned int>(program.sinCosSlots));
+            }
+        }
+    }
+}
+
+// Переводит позицию фрагмента строки без пробелов в позицию в исходной строке
+static void mapToSource(const std::vector<size_t> &positions, size_t &offset, size_t &length) {
+
+    size_t start = positions[offset];
+    size_t end = length ? positions[offset + length - 1] + 1 : start;
+    offset = start;
+    length = end - start;
+}
+
+double ExpressionCalculator::calculate(const std::string &expression) {
+
+    double result;
+    CalculationError error;
+    if (!tryCalculate(expression, result, error)) {
+        throw std::runtime_error(error.message(expression));
+    }
+    return result;
+}
+
+std::complex<double> ExpressionCalculator::calculateComplex(const std::string &expression) {
+
+    CompiledExpression program = compile(expression);
+    CalculationError error;
+    std::complex<double> result = evaluateComplexRPN(program, nullptr, error);
+    if (!error.ok()) {
+        throw std::runtime_error(error.message(expression));
+    }
+    return result;
+}
+
+Matrix ExpressionCalculator::calculateMatrix(const std::string &expression) {
+
+    Matrix result;
+    CalculationError error;
+    if (!tryCalculateMatrix(expression, result, error)) {
+        throw std::runtime_error(error.message(expression));
+    }
+    return result;
+}
+
+bool ExpressionCalculator::tryCalculateMatrix(const std::string &expression, Matrix &result, CalculationError &error) {
+
+    CompiledExpression program;
+    if (!tryCompile(expression, std::vector<std::string>(), program, error)) {
+        return false;
+    }
+    result = evaluateMatrixRPN(program, nullptr, error);
+    return error.ok();
+}
+
+bool ExpressionCalculator::tryCalculate(const std::string &expression, double &result, CalculationError &error) {
+
+    // Компилируем в программу и вычисляем
+    CompiledExpression program;
+    if (!tryCompile(expression, std::vector<std::string>(), program, error)) {
+        return false;
+    }
+    result = evaluateRPN(program, nullptr, error);
+    return error.ok();
+}
+
+void ExpressionCalculator::calculateBatch(const std::vector<std::string> &expressions,
+                                          std::vector<double> &results,
+                                          std::vector<CalculationError> &errors) {
+
+    results.assign(expressions.size(), std::numeric_limits<double>::quiet_NaN());
+    errors.assign(expressions.size(), CalculationError());
+
+    // Программа переиспользуется между строками, чтобы не выделять память заново
+    CompiledExpression program;
+    const std::vector<std::string> noVariables;
+    for (size_t row = 0; row < expressions.size(); row++) {
+        if (tryCompile(expressions[row], noVariables, program, errors[row])) {
+            double value = evaluateRPN(program, nullptr, errors[row]);
+            if (errors[row].ok()) {
+                results[row] = value;
+            }
+        }
+    }
+}
+
+bool ExpressionCalculator::tryCalculateExact(const std::string &expression, ExactNumber &result,
+                                             CalculationError &error, const std::atomic<bool> *cancel) const {
+
+    // Сначала обычный разбор: ошибки синтаксиса те же и в том же порядке,
+    // что и в tryCalculate, а вычисление ниже получает правильную ОПН
+    ExpressionTree tree;
+    const ExpressionNode* root = nullptr;
+    const std::vector<std::string> noVariables;
+    if (!tryParse(expression, noVariables, tree, root, error)) {
+        return false;
+    }
+
+    std::vector<size_t> positions;
+    std::string cleaned = removeSpaces(expression, &positions);
+    positions.push_back(expression.size());
+    std::vector<Token> rpn;
+    if (!exactFragment(cleaned, 0, cleaned.length(), noVariables, rpn, error)
+            || !evaluateExactRPN(rpn, cleaned, noVariables, std::vector<ExactNumber>(), result, error, cancel)) {
+        mapToSource(positions, error.offset, error.length);
+        return false;
+    }
+    return true;
+}
+
+bool ExpressionCalculator::exactFragment(const std::string &expression, size_t begin, size_t length,
+                                         const std::vector<std::string> &variables, std::vector<Token> &rpn,
+                                         CalculationError &error) const {
+
+    rpn.clear();
+    if (!toRPN(expression.substr(begin, length), variables, rpn, error)) {
+        error.offset += begin;
+        return false;
+    }
+    for (Token& token : rpn) {
+        token.offset += begin;
+    }
+    return true;
+}
+
+bool ExpressionCalculator::evaluateExactRPN(const std::vector<Token> &rpn, const std::string &expression,
+                                            const std::vector<std::string> &variables,
+                                            const std::vector<ExactNumber> &values, ExactNumber &result,
+                                            CalculationError &error, const std::atomic<bool> *cancel) const {
+
+    const long double PI = 3.141592653589793238462643383279502884L;
+    const long double E = 2.718281828459045235360287471352662498L;
+
+    auto fail = [&](CalculationError::Code code, const Token& token) {
+        error.code = code;
+        error.offset = token.offset;
+        error.length = token.length;
+        return false;
+    };
+
+    // Стек проверен разбором в tryCalculateExact, здесь только значения
+    std::vector<ExactNumber> stack;
+    for (const Token& token : rpn) {
+        if (token.reduction) {
+            ExactNumber value;
+            if (!evaluateExactReduction(token, expression, variables, values, value, error, cancel)) {
+                return false;
+            }
+            stack.push_back(value);
+        } else if (isNumber(token.text)) {
+            // pi и e записаны в ОПН числами, но их токен короче записи
+            ExactNumber value;
+            if (token.length != token.text.length()) {
+                value = ExactNumber::approximate(token.text == grammar::PI_TEXT ? PI : E);
+            } else if (!ExactNumber::fromDecimal(token.text, value)) {
+                return fail(CalculationError::INVALID_EXPRESSION, token);
+            }
+            stack.push_back(value);
+        } else if (token.text.length() == 1 && isOperator(token.text[0])) {
+            if (stack.size() < 2) {
+                return fail(CalculationError::INVALID_EXPRESSION, token);
+            }
+            ExactNumber right = stack.back();
+            stack.pop_back();
+            ExactNumber& left = stack.back();
+            switch (token.text[0]) {
+            case '+': left = left + right; break;
+            case '-': left = left - right; break;
+            case '*': left = left * right; break;
+            case '/':
+                if (right.isZero()) {
+                    return fail(CalculationError::DIVISION_BY_ZERO, token);
+                }
+                left = left / right;
+                break;
+            default:
+                if (!ExactNumber::power(left, right, left)) {
+                    return fail(CalculationError::DIVISION_BY_ZERO, token);
+                }
+                break;
+            }
+        } else if (token.text == "," || token.text == ";") {
+            return fail(CalculationError::MATRIX_IN_SCALAR_MODE, token);
+        } else if (isFunction(token.text)) {
+            int index = grammar::findFunction(token.text.c_str(), token.text.length());
+            if (index < 0) {
+                // Матричные функции
+                return fail(CalculationError::MATRIX_IN_SCALAR_MODE, token);
+            }
+            if (stack.empty()) {
+                return fail(CalculationError::INVALID_FUNCTION_ARGUMENT, token);
+            }
+            stack.back() = ExactNumber::apply(grammar::FUNCTION_NAMES[index].function, angleMode, stack.back());
+        } else {
+            auto variable = std::find(variables.begin(), variables.end(), token.text);
+            if (variable != variables.end()) {
+                stack.push_back(values[variable - variables.begin()]);
+            } else if (token.text == "i") {
+                return fail(CalculationError::COMPLEX_IN_REAL_MODE, token);
+            } else {
+                return fail(CalculationError::UNKNOWN_FUNCTION, token);
+            }
+        }
+    }
+    if (stack.size() != 1) {
+        error.code = CalculationError::INVALID_EXPRESSION;
+        error.offset = rpn.empty() ? 0 : rpn.front().offset;
+        error.length = 0;
+        return false;
+    }
+    result = stack.back();
+    return true;
+}
+
+bool ExpressionCalculator::evaluateExactReduction(const Token &token, const std::string &expression,
+                                                  const std::vector<std::string> &variables,
+                                                  const std::vector<ExactNumber> &values, ExactNumber &result,
+                                                  CalculationError &error, const std::atomic<bool> *cancel) const {
+
+    std::vector<size_t> separators;
+    std::string name;
+    if (!reductionArguments(expression, token, separators, name, error)) {
+        return false;
+    }
+
+    // Сумма и произведение по точным пределам: связанная переменная
+    // пробегает lower, lower + 1, ... пока не больше upper
+    std::vector<Token> rpn;
+    ExactNumber lower, upper;
+    if (token.text != "integral") {
+        if (!exactFragment(expression, separators[1] + 1, separators[2] - separators[1] - 1, variables, rpn, error)
+                || !evaluateExactRPN(rpn, expression, variables, values, lower, error, cancel)
+                || !exactFragment(expression, separators[2] + 1, separators[3] - separators[2] - 1, variables, rpn, error)
+                || !evaluateExactRPN(rpn, expression, variables, values, upper, error, cancel)) {
+            return false;
+        }
+    }
+    if (lower.isExact() && upper.isExact() && token.text != "integral") {
+        ExactNumber span = upper - lower;
+        BigInteger terms = span.numerator().isNegative() ? BigInteger() : span.floor() + BigInteger(1);
+        int64_t count = 0;
+        if (terms.toInt64(count) && count <= static_cast<int64_t>(MAX_EXACT_TERMS)) {
+            std::vector<std::string> bodyVariables(1, name);
+            bodyVariables.insert(bodyVariables.end(), variables.begin(), variables.end());
+            std::vector<ExactNumber> bodyValues(1, lower);
+            bodyValues.insert(bodyValues.end(), values.begin(), values.end());
+            if (!exactFragment(expression, separators[3] + 1, separators[4] - separators[3] - 1,
+                               bodyVariables, rpn, error)) {
+                return false;
+            }
+            bool product = token.text == "prod";
+            result = ExactNumber(product ? 1 : 0);
+            for (int64_t k = 0; k < count; k++) {
+                if (cancel && cancel->load(std::memory_order_relaxed)) {
+                    error.code = CalculationError::CANCELLED;
+                    error.offset = token.offset;
+                    error.length = token.length;
+                    return false;
+                }
+                ExactNumber term;
+                if (!evaluateExactRPN(rpn, expression, bodyVariables, bodyValues, term, error, cancel)) {
+                    return false;
+                }
+                result = product ? result * term : result + term;
+                bodyValues[0] = bodyValues[0] + ExactNumber(1);
+            }
+            return true;
+        }
+    }
+
+    // Интеграл и длинные суммы - обычным вычислением конструкции целиком
+    std::string construct = expression.substr(token.offset, token.length);
+    std::vector<double> approximations;
+    for (const ExactNumber& value : values) {
+        approximations.push_back(static_cast<double>(value.toLongDouble()));
+    }
+    CompiledExpression program;
+    double value = 0;
+    if (!tryCompile(construct, variables, program, error)
+            || !tryEvaluate(program, approximations, value, error, cancel)) {
+        error.offset += token.offset;
+        return false;
+    }
+    result = ExactNumber::approximate(value);
+    return true;
+}
+
+bool ExpressionCalculator::checkParentheses(const std::string &expression, CalculationError &error) const {
+
+    INSTRUMENT_STAGE(STAGE_CHECK_PARENTHESES);
+    // Круглые и квадратные скобки должны быть вложены правильно
+    std::vector<size_t> open;
+    for (size_t i = 0; i < expression.length(); i++) {
+        if (expression[i] == '(' || expression[i] == '[') {
+            open.push_back(i);
+        } else if (expression[i] == ')' || expression[i] == ']') {
+            if (open.empty() || expression[open.back()] != (expression[i] == ')' ? '(' : '[')) {
+                error.code = CalculationError::UNBALANCED_PARENTHESES;
+                error.offset = i;
+                error.length = 1;
+                return false;
+            }
+            open.pop_back();
+        }
+    }
+    if (!open.empty()) {
+        // Указываем на последнюю незакрытую скобку
+        error.code = CalculationError::UNBALANCED_PARENTHESES;
+        error.offset = open.back();
+        error.length = 1;
+        return false;
+    }
+    return true;
+}
+
+CompiledExpression ExpressionCalculator::compile(const std::string &expression,
+                                                 const std::vector<std::string> &variables) const {
+
+    CompiledExpression program;
+    CalculationError error;
+    if (!tryCompile(expression, variables, program, error)) {
+        throw std::runtime_error(error.message(expression));
+    }
+    return program;
+}
+
+bool ExpressionCalculator::tryCompile(const std::string &expression,
+                                      const std::vector<std::string> &variables,
+                                      CompiledExpression &program, CalculationError &error) const {
+
+    ExpressionTree tree;
+    const ExpressionNode* root = nullptr;
+    if (!tryParse(expression, variables, tree, root, error)) {
+        return false;
+    }
+    lower(tree, root, variables, program);
+    return true;
+}
+
+bool ExpressionCalculator::tryParse(const std::string &expression,
+                                    const std::vector<std::string> &variables,
+                                    ExpressionTree &tree, const ExpressionNode *&root,
+                                    CalculationError &error) const {
+
+    // Дерево хранит варианты функций для своих единиц углов
+    if (tree.size() == 0) {
+        tree.angleMode = angleMode;
+    } else if (tree.angleMode != angleMode) {
+        throw std::invalid_argument("Angle mode mismatch");
+    }
+
+    std::vector<size_t> positions;
+    std::string cleaned = removeSpaces(expression, &positions);
+    positions.push_back(expression.size());
+    error = CalculationError();
+
+    // Проверяем баланс скобок и конвертируем в ОПН
+    if (!checkParentheses(cleaned, error)
+            || !parseFragment(cleaned, 0, cleaned.length(), variables, positions, tree, root, error)) {
+        mapToSource(positions, error.offset, error.length);
+        return false;
+    }
+    return true;
+}
+
+const size_t ExpressionCalculator::IncrementalParse::NOT_PLACED;
+
+void ExpressionCalculator::IncrementalParse::clear() {
+
+    source.clear();
+    positions.clear();
+    output.clear();
+    checkpoints.clear();
+    expressionTree.clear();
+    placed.clear();
+    parsed = false;
+    root = nullptr;
+    error = CalculationError();
+    reused = 0;
+}
+
+bool ExpressionCalculator::tryParseIncremental(const std::string &expression, IncrementalParse &state,
+                                               const ExpressionNode *&root, CalculationError &error) const {
+
+    // Узлы старых версий строки копятся в дереве, поэтому большое дерево
+    // строится заново; варианты функций зависят от единиц углов
+    if (state.expressionTree.angleMode != angleMode
+            || state.expressionTree.size() > IncrementalParse::MAX_TREE_NODES) {
+        state.clear();
+        state.expressionTree.angleMode = angleMode;
+    }
+    if (state.parsed && state.source == expression) {
+        state.reused = state.positions.size() - 1;
+        root = state.root;
+        error = state.error;
+        return error.ok();
+    }
+
+    std::vector<size_t> positions;
+    std::string cleaned = removeSpaces(expression, &positions);
+    positions.push_back(expression.size());
+
+    // Совпадающее начало строки в символах без пробелов. Токен мог смотреть
+    // на символ за собой (конец числа, скобка после имени), поэтому
+    // состояние годится, только если и этот символ не изменился
+    size_t same = 0;
+    while (same < expression.size() && same < state.source.size() && expression[same] == state.source[same]) {
+        same++;
+    }
+    size_t prefix = std::lower_bound(positions.begin(), positions.end() - 1, same) - positions.begin();
+    while (!state.checkpoints.empty() && state.checkpoints.back().rpn.position >= prefix
+           && state.checkpoints.back().rpn.position != 0) {
+        state.checkpoints.pop_back();
+    }
+    if (state.checkpoints.empty()) {
+        state.checkpoints.push_back(IncrementalParse::Checkpoint{RPNState(), 0, {}});
+    }
+
+    const IncrementalParse::Checkpoint& resume = state.checkpoints.back();
+    RPNState rpn = resume.rpn;
+    std::vector<const ExpressionNode*> stack = resume.stack;
+    state.output.resize(resume.outputSize);
+    state.reused = rpn.position;
+    state.source = expression;
+    state.positions.swap(positions);
+    error = CalculationError();
+
+    // Общие вершины хранят положение той версии строки, где они появились.
+    // Вершина токена получает его положение, если в этой версии она ещё не
+    // встречалась: ошибки вычисления указывают на текущую строку. Токены
+    // до resume не менялись, их вершины остаются на месте
+    for (size_t& index : state.placed) {
+        if (index != IncrementalParse::NOT_PLACED && index >= resume.outputSize) {
+            index = IncrementalParse::NOT_PLACED;
+        }
+    }
+    auto place = [&state, &stack](const Token& token, size_t index) {
+        const ExpressionNode* node = stack.back();
+        if (state.placed.size() <= node->id) {
+            state.placed.resize(node->id + 1, IncrementalParse::NOT_PLACED);
+        }
+        if (state.placed[node->id] == IncrementalParse::NOT_PLACED) {
+            size_t offset = token.offset, length = token.length;
+            mapToSource(state.positions, offset, length);
+            state.expressionTree.place(node, static_cast<unsigned int>(offset), static_cast<unsigned int>(length));
+            state.placed[node->id] = index;
+        }
+    };
+
+    // Дерево строится вслед за токенами, но его ошибка сообщается, только если
+    // вся строка переведена в ОПН, - в том же порядке, что и в tryParse
+    const std::vector<std::string> noVariables;
+    CalculationError treeError;
+    bool building = true;
+    bool ok = checkParentheses(cleaned, error);
+    {
+        INSTRUMENT_STAGE(STAGE_TO_RPN);
+        while (ok && rpn.position < cleaned.length()) {
+            size_t outputSize = state.output.size();
+            if (!toRPNStep(cleaned, noVariables, rpn, state.output, error)) {
+                ok = false;
+                break;
+            }
+            for (size_t k = outputSize; building && k < state.output.size(); k++) {
+                building = buildNode(state.output[k], cleaned, noVariables, state.positions,
+                                     state.expressionTree, stack, treeError);
+                if (building) {
+                    place(state.output[k], k);
+                }
+            }
+            if (building) {
+                state.checkpoints.push_back(IncrementalParse::Checkpoint{rpn, state.output.size(), stack});
+            }
+        }
+    }
+    if (ok && !building) {
+        error = treeError;
+        ok = false;
+    }
+
+    // Операторы, оставшиеся в стеке, выводятся из копии: следующий разбор
+    // продолжит с состояния после последнего токена
+    if (ok) {
+        std::vector<Token> rest;
+        finishRPN(rpn, rest);
+        for (size_t k = 0; ok && k < rest.size(); k++) {
+            ok = buildNode(rest[k], cleaned, noVariables, state.positions, state.expressionTree, stack, error);
+            if (ok) {
+                place(rest[k], state.output.size() + k);
+            }
+        }
+        if (ok && stack.size() != 1) {
+            error.code = CalculationError::INVALID_EXPRESSION;
+            error.offset = 0;
+            error.length = cleaned.length();
+            ok = false;
+        }
+    }
+    if (!ok) {
+        mapToSource(state.positions, error.offset, error.length);
+    }
+
+    root = ok ? stack.back() : nullptr;
+    state.parsed = true;
+    state.root = root;
+    state.error = error;
+    return ok;
+}
+
+bool ExpressionCalculator::parseFragment(const std::string &expression, size_t begin, size_t length,
+                                         const std::vector<std::string> &variables,
+                                         const std::vector<size_t> &positions,
+                                         ExpressionTree &tree, const ExpressionNode *&node,
+                                         CalculationError &error) const {
+
+    // Позиции токенов и ошибок фрагмента переводятся в позиции всей строки
+    std::vector<Token> rpn;
+    bool converted = begin == 0 && length == expression.length()
+            ? toRPN(expression, variables, rpn, error)
+            : toRPN(expression.substr(begin, length), variables, rpn, error);
+    if (!converted) {
+        error.offset += begin;
+        return false;
+    }
+    for (Token& token : rpn) {
+        token.offset += begin;
+    }
+    return buildTree(rpn, expression, variables, positions, begin, length, tree, node, error);
+}
+
+bool ExpressionCalculator::reductionArguments(const std::string &expression, const Token &token,
+                                              std::vector<size_t> &separators, std::string &name,
+                                              CalculationError &error) const {
+
+    // Аргументы между скобками конструкции, разделённые запятыми верхнего уровня
+    size_t open = token.offset + token.text.length();
+    size_t close = token.offset + token.length - 1;
+    separators.assign(1, open);
+    int depth = 0;
+    for (size_t i = open + 1; i < close; i++) {
+        if (expression[i] == '(' || expression[i] == '[') depth++;
+        else if (expression[i] == ')' || expression[i] == ']') depth--;
+        else if (expression[i] == ',' && depth == 0) separators.push_back(i);
+    }
+    separators.push_back(close);
+
+    if (separators.size() != 5) {
+        error.code = CalculationError::INVALID_FUNCTION_ARGUMENT;
+        error.offset = token.offset;
+        error.length = token.length;
+        return false;
+    }
+
+    // Первый аргумент - имя связанной переменной
+    size_t nameBegin = separators[0] + 1;
+    name = expression.substr(nameBegin, separators[1] - nameBegin);
+    bool valid = !name.empty() && isLetter(name[0]) && !isFunction(name) && !isReduction(name);
+    for (char c : name) {
+        valid = valid && grammar::isIdentifierChar(c);
+    }
+    if (!valid) {
+        error.code = CalculationError::INVALID_FUNCTION_ARGUMENT;
+        error.offset = name.empty() ? token.offset : nameBegin;
+        error.length = name.empty() ? token.length : name.length();
+        return false;
+    }
+    return true;
+}
+
+bool ExpressionCalculator::buildReduction(const std::string &expression, const Token &token,
+                                          const std::vector<std::string> &variables,
+                                          const std::vector<size_t> &positions,
+                                          ExpressionTree &tree, const ExpressionNode *&node,
+                                          CalculationError &error) const {
+
+    std::vector<size_t> separators;
+    std::string name;
+    if (!reductionArguments(expression, token, separators, name, error)) {
+        return false;
+    }
+
+    // Пределы зависят только от внешних переменных, тело - ещё и от связанной;
+    // она идёт первой и поэтому перекрывает внешнюю переменную с тем же именем
+    std::vector<std::string> bodyVariables(1, name);
+    bodyVariables.insert(bodyVariables.end(), variables.begin(), variables.end());
+    const ExpressionNode* lower = nullptr;
+    const ExpressionNode* upper = nullptr;
+    const ExpressionNode* body = nullptr;
+    if (!parseFragment(expression, separators[1] + 1, separators[2] - separators[1] - 1,
+                       variables, positions, tree, lower, error)
+            || !parseFragment(expression, separators[2] + 1, separators[3] - separators[2] - 1,
+                              variables, positions, tree, upper, error)
+            || !parseFragment(expression, separators[3] + 1, separators[4] - separators[3] - 1,
+                              bodyVariables, positions, tree, body, error)) {
+        return false;
+    }
+
+    size_t offset = token.offset, length = token.length;
+    mapToSource(positions, offset, length);
+    char kind = token.text == "sum" ? 's' : token.text == "prod" ? 'p' : 'i';
+    node = tree.reduction(kind, name, body, lower, upper,
+                          static_cast<unsigned int>(offset), static_cast<unsigned int>(length));
+    return true;
+}
+
+bool ExpressionCalculator::buildTree(const std::vector<Token> &rpn, const std::string &expression,
+                                     const std::vector<std::string> &variables, const std::vector<size_t> &positions,
+                                     size_t begin, size_t length,
+                                     ExpressionTree &tree, const ExpressionNode *&root,
+                                     CalculationError &error) const {
+
+    INSTRUMENT_STAGE(STAGE_BUILD_TREE);
+
+    // Стек поддеревьев вместо стека значений; попутно проверяем,
+    // что при вычислении стек не опустошается
+    std::vector<const ExpressionNode*> stack;
+
+    for (const Token& token : rpn) {
+        if (!buildNode(token, expression, variables, positions, tree, stack, error)) {
+            return false;
+        }
+    }
+
+    if (stack.size() != 1) {
+        // Лишние или недостающие операнды: указываем на всё выражение
+        error.code = CalculationError::INVALID_EXPRESSION;
+        error.offset = begin;
+        error.length = length;
+        return false;
+    }
+    root = stack.back();
+    return true;
+}
+
+bool ExpressionCalculator::buildNode(const Token &token, const std::string &expression,
+                                     const std::vector<std::string> &variables,
+                                     const std::vector<size_t> &positions, ExpressionTree &tree,
+                                     std::vector<const ExpressionNode*> &stack,
+                                     CalculationError &error) const {
+
+    if (token.reduction) {
+        const ExpressionNode* node = nullptr;
+        if (!buildReduction(expression, token, variables, positions, tree, node, error)) {
+            return false;
+        }
+        stack.push_back(node);
+        return true;
+    }
+
+    size_t offset = token.offset, tokenLength = token.length;
+    mapToSource(positions, offset, tokenLength);
+    unsigned int spanOffset = static_cast<unsigned int>(offset);
+    unsigned int spanLength = static_cast<unsigned int>(tokenLength);
+
+    if (isNumber(token.text)) {
+        stack.push_back(tree.constant(std::stod(token.text), spanOffset, spanLength));
+    } else if (token.text.length() == 1 && (isOperator(token.text[0]) || token.text[0] == ','
+                                            || token.text[0] == ';')) {
+        if (stack.size() < 2) {
+            error.code = CalculationError::INVALID_EXPRESSION;
+            error.offset = token.offset;
+            error.length = token.length;
+            return false;
+        }
+        const ExpressionNode* right = stack.back();
+        stack.pop_back();
+        stack.back() = tree.binary(token.text[0], stack.back(), right, spanOffset, spanLength);
+    } else if (isFunction(token.text)) {
+        if (stack.empty()) {
+            error.code = CalculationError::INVALID_FUNCTION_ARGUMENT;
+            error.offset = token.offset;
+            error.length = token.length;
+            return false;
+        }
+        // Перевод единиц углов встраивается в дерево выбором варианта функции
+        std::string name = token.text;
+        if (angleMode != ANGLE_RADIANS && isFunction(angleVariant(name, angleMode))) {
+            name = angleVariant(name, angleMode);
+        }
+        const BuiltinMatrixFunction* matrixFunction = findMatrixFunction(name);
+        if (matrixFunction && matrixFunction->arity == 2) {
+            if (stack.size() < 2) {
+                error.code = CalculationError::INVALID_FUNCTION_ARGUMENT;
+                error.offset = token.offset;
+                error.length = token.length;
+                return false;
+            }
+            const ExpressionNode* second = stack.back();
+            stack.pop_back();
+            stack.back() = tree.call(name, stack.back(), second, spanOffset, spanLength);
+        } else {
+            stack.back() = tree.call(name, stack.back(), spanOffset, spanLength);
+        }
+    } else if (std::find(variables.begin(), variables.end(), token.text) != variables.end()) {
+        stack.push_back(tree.variable(token.text, spanOffset, spanLength));
+    } else if (token.text == "i") {
+        stack.push_back(tree.imaginary(spanOffset, spanLength));
+    } else if (grammar::isNumberChar(token.text[0])) {
+        // Цифры и точки, не ставшие числом: 1.2.3, ..5
+        error.code = CalculationError::INVALID_EXPRESSION;
+        error.offset = token.offset;
+        error.length = token.length;
+        return false;
+    } else {
+        // Имя перед скобкой, не найденное среди функций
+        error.code = CalculationError::UNKNOWN_FUNCTION;
+        error.offset = token.offset;
+        error.length = token.length;
+        return false;
+    }
+    return true;
+}
+
+void ExpressionCalculator::lower(const ExpressionTree &tree, const ExpressionNode *root,
+                                 const std::vector<std::string> &variables,
+                                 CompiledExpression &program) const {
+
+    lower(tree, std::vector<const ExpressionNode*>(1, root), variables, program);
+}
+
+void ExpressionCalculator::lower(const ExpressionTree &tree, const std::vector<const ExpressionNode*> &roots,
+                                 const std::vector<std::string> &variables,
+                                 CompiledExpression &program) const {
+
+    INSTRUMENT_STAGE(STAGE_LOWERING);
+
+    program.code.clear();
+    program.spans.clear();
+    program.constants.clear();
+    program.functions.clear();
+    program.sinCos.clear();
+    program.reductions.clear();
+    program.polynomials.clear();
+    program.memos.clear();
+    program.memoIndices.clear();
+    program.sinCosSlots = 0;
+    program.slotCount = 0;
+    program.variables = variables;
+    program.maxStackDepth = 0;
+    program.outputCount = roots.size();
+    program.angleMode = tree.angleMode;
+
+    // Число ссылок на каждую вершину внутри выражений; корень,
+    // совпадающий с подвыражением другой формулы, тоже общий.
+    // Многочлен или дробь (region) вычисляется одной инструкцией,
+    // и из их вершин в программу попадает только аргумент
+    const int NONE = -1;
+    std::vector<unsigned int> uses(tree.size(), 0);
+    std::vector<const ExpressionNode*> reachable;
+    std::vector<int> region(tree.size(), NONE);
+    std::vector<PolynomialRegion> regions;
+    auto countUses = [&]() {
+        std::fill(uses.begin(), uses.end(), 0);
+        reachable.clear();
+        for (const ExpressionNode* root : roots) {
+            if (uses[root->id]++ == 0) {
+                reachable.push_back(root);
+            }
+        }
+        for (size_t k = 0; k < reachable.size(); k++) {
+            const ExpressionNode* node = reachable[k];
+            const ExpressionNode* children[2] = { node->left, node->right };
+            if (region[node->id] != NONE) {
+                children[0] = regions[region[node->id]].numerator.base;
+                children[1] = nullptr;
+            }
+            for (const ExpressionNode* child : children) {
+                if (child && uses[child->id]++ == 0) {
+                    reachable.push_back(child);
+                }
+            }
+        }
+    };
+    countUses();
+
+    // Формы многочленов снизу вверх: номера потомков меньше номера вершины
+    std::vector<const ExpressionNode*> ordered(reachable);
+    std::sort(ordered.begin(), ordered.end(),
+              [](const ExpressionNode* a, const ExpressionNode* b) { return a->id < b->id; });
+    std::vector<int> formIndex(tree.size(), NONE);
+    std::vector<PolynomialForm> forms;
+    auto formOf = [&](const ExpressionNode* node) {
+        return formIndex[node->id] != NONE ? forms[formIndex[node->id]] : polynomialAtom(node);
+    };
+    for (const ExpressionNode* node : ordered) {
+        PolynomialForm form = PolynomialForm();
+        if (node->kind == ExpressionNode::CONSTANT && std::isfinite(node->value)) {
+            form.c[0] = form.zero[0] = form.zero[1] = node->value;
+        } else if (node->kind != ExpressionNode::BINARY
+                   || !combinePolynomials(node->op, formOf(node->left), formOf(node->right), form)) {
+            form = polynomialAtom(node);
+            // Дробь p(x) / q(x) - только целиком, её нельзя продолжить как многочлен
+            if (node->kind == ExpressionNode::BINARY && node->op == '/') {
+                PolynomialRegion fraction = { formOf(node->left), formOf(node->right), true };
+                const ExpressionNode* base = fraction.denominator.base;
+                if (base && fraction.denominator.degree > 0
+                        && (!fraction.numerator.base || fraction.numerator.base == base)
+                        && (worthPolynomial(fraction.numerator) || worthPolynomial(fraction.denominator))) {
+                    fraction.numerator.base = base;
+                    region[node->id] = static_cast<int>(regions.size());
+                    regions.push_back(fraction);
+                }
+            }
+            continue;
+        }
+        formIndex[node->id] = static_cast<int>(forms.size());
+        forms.push_back(form);
+        if (form.base && worthPolynomial(form)) {
+            PolynomialRegion polynomial = { form, PolynomialForm(), false };
+            region[node->id] = static_cast<int>(regions.size());
+            regions.push_back(polynomial);
+        }
+    }
+    if (!regions.empty()) {
+        countUses();
+    }
+
+    // sin и cos одного аргумента: в DAG это вызовы с общей вершиной-аргументом
+    const std::string sinName = angleVariant("sin", tree.angleMode);
+    const std::string cosName = angleVariant("cos", tree.angleMode);
+    std::vector<int> pairSlot(tree.size(), NONE);
+    for (const ExpressionNode* node : reachable) {
+        if (node->kind != ExpressionNode::CALL || tree.functionName(node) != sinName) continue;
+        const ExpressionNode* partner = tree.findCall(cosName, node->left);
+        if (partner && uses[partner->id]) {
+            pairSlot[node->id] = pairSlot[partner->id] = static_cast<int>(program.sinCosSlots++);
+        }
+    }
+    std::vector<bool> pairStarted(program.sinCosSlots, false);
+
+    // Подвыражения для кэша (OP_MEMO): вершина, которая зависит не от всех
+    // переменных родителя (для корня - программы) и достаточно дорога, чтобы
+    // окупить сравнение переменных. Зависимости считаются по всему поддереву,
+    // тело sum/prod/integral - без своей связанной переменной
+    const unsigned int CALL_COST = 16, REDUCTION_COST = 1024, MEMO_MIN_COST = 16;
+    std::vector<bool> memoPoint(tree.size(), false);
+    std::vector<uint64_t> mask(tree.size(), 0);
+    if (!variables.empty() && variables.size() <= 64) {
+        auto bit = [&](const std::string& name) -> uint64_t {
+            auto it = std::find(variables.begin(), variables.end(), name);
+            return it == variables.end() ? 0 : uint64_t(1) << (it - variables.begin());
+        };
+        std::vector<const ExpressionNode*> subtree(reachable);
+        std::vector<bool> seen(tree.size(), false);
+        for (const ExpressionNode* node : subtree) {
+            seen[node->id] = true;
+        }
+        for (size_t k = 0; k < subtree.size(); k++) {
+            const ExpressionNode* children[3] = { subtree[k]->left, subtree[k]->right, subtree[k]->body };
+            for (const ExpressionNode* child : children) {
+                if (child && !seen[child->id]) {
+                    seen[child->id] = true;
+                    subtree.push_back(child);
+                }
+            }
+        }
+        std::sort(subtree.begin(), subtree.end(),
+                  [](const ExpressionNode* a, const ExpressionNode* b) { return a->id < b->id; });
+
+        std::vector<unsigned int> cost(tree.size(), 0);
+        for (const ExpressionNode* node : subtree) {
+            uint64_t dependencies = 0;
+            unsigned int nodeCost = 0;
+            for (const ExpressionNode* child : { node->left, node->right }) {
+                if (child) {
+                    dependencies |= mask[child->id];
+                    nodeCost += cost[child->id];
+                }
+            }
+            switch (node->kind) {
+            case ExpressionNode::VARIABLE: dependencies = bit(tree.variableName(node)); break;
+            case ExpressionNode::BINARY: nodeCost += node->op == '^' ? CALL_COST : node->op == '/' ? 2 : 1; break;
+            case ExpressionNode::CALL: nodeCost += CALL_COST; break;
+            case ExpressionNode::REDUCTION:
+                dependencies |= mask[node->body->id] & ~bit(tree.variableName(node));
+                nodeCost += REDUCTION_COST;
+                break;
+            default: break;
+            }
+            mask[node->id] = dependencies;
+            cost[node->id] = std::min(nodeCost, REDUCTION_COST * 1024);
+        }
+
+        auto consider = [&](const ExpressionNode* node, uint64_t parentMask) {
+            if (mask[node->id] != parentMask && cost[node->id] >= MEMO_MIN_COST
+                    && node->kind != ExpressionNode::CONSTANT && node->kind != ExpressionNode::VARIABLE) {
+                memoPoint[node->id] = true;
+            }
+        };
+        uint64_t allVariables = variables.size() == 64 ? ~uint64_t(0) : (uint64_t(1) << variables.size()) - 1;
+        for (const ExpressionNode* root : roots) {
+            consider(root, allVariables);
+        }
+        for (const ExpressionNode* node : reachable) {
+            if (region[node->id] != NONE) {
+                consider(regions[region[node->id]].numerator.base, mask[node->id]);
+            } else {
+                for (const ExpressionNode* child : { node->left, node->right }) {
+                    if (child) consider(child, mask[node->id]);
+                }
+            }
+        }
+    }
+    std::vector<int> memoIndex(tree.size(), NONE);
+    std::vector<uint64_t> memoMasks;
+
+    // Обход в обратном порядке без рекурсии: глубина выражения не ограничена
+    std::vector<int> valueSlot(tree.size(), NONE);
+    std::vector<int> constantIndex(tree.size(), NONE);
+    std::vector<std::pair<const ExpressionNode*, bool>> pending;
+    size_t depth = 0;
+
+    auto emit = [&](CompiledExpression::OpCode op, unsigned int arg, const ExpressionNode* node) {
+        CompiledExpression::Instruction instruction = { op, arg };
+        CompiledExpression::SourceSpan span = { node->offset, node->length };
+        program.code.push_back(instruction);
+        program.spans.push_back(span);
+    };
+
+    for (size_t output = 0; output < roots.size(); output++) {
+        pending.push_back(std::make_pair(roots[output], false));
+        while (!pending.empty()) {
+            const ExpressionNode* node = pending.back().first;
+            bool expanded = pending.back().second;
+            pending.pop_back();
+
+            if (!expanded) {
+                switch (node->kind) {
+                case ExpressionNode::CONSTANT:
+                    if (constantIndex[node->id] == NONE) {
+                        constantIndex[node->id] = static_cast<int>(program.constants.size());
+                        program.constants.push_back(node->value);
+                    }
+                    emit(CompiledExpression::OP_CONST, constantIndex[node->id], node);
+                    depth++;
+                    break;
+                case ExpressionNode::VARIABLE: {
+                    auto it = std::find(variables.begin(), variables.end(), tree.variableName(node));
+                    if (it == variables.end()) {
+                        throw std::invalid_argument("Unknown variable: " + tree.variableName(node));
+                    }
+                    emit(CompiledExpression::OP_VAR, static_cast<unsigned int>(it - variables.begin()), node);
+                    depth++;
+                    break;
+                }
+                case ExpressionNode::IMAGINARY:
+                    emit(CompiledExpression::OP_IMAG, 0, node);
+                    depth++;
+                    break;
+                default:
+                    if (valueSlot[node->id] != NONE) {
+                        // Подвыражение уже вычислено
+                        emit(CompiledExpression::OP_LOAD, valueSlot[node->id], node);
+                        depth++;
+                        break;
+                    }
+                    if (memoPoint[node->id]) {
+                        CompiledExpression::Memo memo = { 0, 0, 0, 0 };
+                        memoIndex[node->id] = static_cast<int>(program.memos.size());
+                        memoMasks.push_back(mask[node->id]);
+                        emit(CompiledExpression::OP_MEMO, static_cast<unsigned int>(program.memos.size()), node);
+                        program.memos.push_back(memo);
+                    }
+                    pending.push_back(std::make_pair(node, true));
+                    if (region[node->id] != NONE) {
+                        pending.push_back(std::make_pair(regions[region[node->id]].numerator.base, false));
+                    } else {
+                        if (node->right) pending.push_back(std::make_pair(node->right, false));
+                        pending.push_back(std::make_pair(node->left, false));
+                    }
+                    break;
+                }
+                program.maxStackDepth = std::max(program.maxStackDepth, depth);
+                continue;
+            }
+
+            if (region[node->id] != NONE) {
+                // Блоки подряд в constants: числитель, затем знаменатель
+                const PolynomialRegion& found = regions[region[node->id]];
+                CompiledExpression::Polynomial polynomial;
+                polynomial.first = static_cast<unsigned int>(program.constants.size());
+                polynomial.degree = found.numerator.degree;
+                polynomial.denominatorDegree = found.rational ? found.denominator.degree : 0;
+                polynomial.scheme = std::max(polynomial.degree, polynomial.denominatorDegree) >= 5
+                        ? CompiledExpression::Polynomial::ESTRIN : CompiledExpression::Polynomial::HORNER;
+                const PolynomialForm* parts[2] = { &found.numerator, found.rational ? &found.denominator : nullptr };
+                for (const PolynomialForm* part : parts) {
+                    if (!part) continue;
+                    program.constants.insert(program.constants.end(), part->c, part->c + part->degree + 1);
+                    program.constants.insert(program.constants.end(), part->zero, part->zero + 2);
+                }
+                emit(CompiledExpression::OP_POLY, static_cast<unsigned int>(program.polynomials.size()), node);
+                program.polynomials.push_back(polynomial);
+            } else if (node->kind == ExpressionNode::BINARY) {
+                switch (node->op) {
+                case '+': emit(CompiledExpression::OP_ADD, 0, node); break;
+                case '-': emit(CompiledExpression::OP_SUB, 0, node); break;
+                case '*': emit(CompiledExpression::OP_MUL, 0, node); break;
+                case '/': emit(CompiledExpression::OP_DIV, 0, node); break;
+                case ',': emit(CompiledExpression::OP_HCAT, 0, node); break;
+                case ';': emit(CompiledExpression::OP_VCAT, 0, node); break;
+                default: emit(CompiledExpression::OP_POW, 0, node); break;
+                }
+                depth--;
+            } else if (node->kind == ExpressionNode::REDUCTION) {
+                // Тело - отдельная программа, связанная переменная в ней первая
+                std::vector<std::string> bodyVariables(1, tree.variableName(node));
+                bodyVariables.insert(bodyVariables.end(), variables.begin(), variables.end());
+                std::shared_ptr<CompiledExpression> body = std::make_shared<CompiledExpression>();
+                lower(tree, node->body, bodyVariables, *body);
+
+                CompiledExpression::Reduction reduction;
+                reduction.kind = node->op == 's' ? CompiledExpression::Reduction::SUM
+                        : node->op == 'p' ? CompiledExpression::Reduction::PRODUCT
+                        : CompiledExpression::Reduction::INTEGRAL;
+                reduction.body = body;
+                emit(CompiledExpression::OP_REDUCE, static_cast<unsigned int>(program.reductions.size()), node);
+                program.reductions.push_back(reduction);
+                depth--;
+            } else if (pairSlot[node->id] != NONE) {
+                // Первый из пары вычисляет sin и cos сразу, второй берёт готовое
+                unsigned int slot = static_cast<unsigned int>(pairSlot[node->id]);
+                CompiledExpression::SinCosCall call = { slot, tree.functionName(node) == cosName, !pairStarted[slot] };
+                pairStarted[slot] = true;
+                emit(CompiledExpression::OP_SINCOS, static_cast<unsigned int>(program.sinCos.size()), node);
+                program.sinCos.push_back(call);
+            } else {
+                const std::string& name = tree.functionName(node);
+                auto it = std::find(program.functions.begin(), program.functions.end(), name);
+                emit(findMatrixFunction(name) ? CompiledExpression::OP_MATRIX_CALL : CompiledExpression::OP_CALL,
+                     static_cast<unsigned int>(it - program.functions.begin()), node);
+                if (it == program.functions.end()) {
+                    program.functions.push_back(name);
+                }
+                if (node->right) {
+                    depth--;
+                }
+            }
+
+            if (memoIndex[node->id] != NONE) {
+                program.memos[memoIndex[node->id]].end = static_cast<unsigned int>(program.code.size());
+                emit(CompiledExpression::OP_MEMO_END, static_cast<unsigned int>(memoIndex[node->id]), node);
+            }
+            if (uses[node->id] > 1) {
+                valueSlot[node->id] = static_cast<int>(program.slotCount++);
+                emit(CompiledExpression::OP_STORE, valueSlot[node->id], node);
+            }
+        }
+
+        if (roots.size() > 1) {
+            emit(CompiledExpression::OP_OUTPUT, static_cast<unsigned int>(output), roots[output]);
+            depth--;
+        }
+    }
+    resolveFunctions(program);
+
+    // Переменные каждого подвыражения кэша и ячейки, которые восстанавливаются
+    // при попадании: их записывает пропускаемый код, а читает код после него
+    if (!program.memos.empty()) {
+        std::vector<size_t> lastRead = lastSlotReads(program);
+        for (size_t pc = 0; pc < program.code.size(); pc++) {
+            if (program.code[pc].op != CompiledExpression::OP_MEMO) continue;
+            CompiledExpression::Memo& memo = program.memos[program.code[pc].arg];
+            memo.first = static_cast<unsigned int>(program.memoIndices.size());
+            for (unsigned int k = 0; k < variables.size(); k++) {
+                if (memoMasks[program.code[pc].arg] >> k & 1) {
+                    program.memoIndices.push_back(k);
+                }
+            }
+            memo.variableCount = static_cast<unsigned int>(program.memoIndices.size()) - memo.first;
+            memoSlots(program, lastRead, pc, memo.end, program.memoIndices);
+            memo.slotCount = static_cast<unsigned int>(program.memoIndices.size()) - memo.first - memo.variableCount;
+        }
+    }
+}
+
+CompiledExpression ExpressionCalculator::compileFused(const std::vector<std::string> &expressions,
+                                                      const std::vector<std::string> &variables) const {
+
+    CompiledExpression program;
+    CalculationError error;
+    size_t failed = 0;
+    if (!tryCompileFused(expressions, variables, program, error, failed)) {
+        throw std::runtime_error(error.message(expressions[failed]));
+    }
+    return program;
+}
+
+bool ExpressionCalculator::tryCompileFused(const std::vector<std::string> &expressions,
+                                           const std::vector<std::string> &variables,
+                                           CompiledExpression &program, CalculationError &error,
+                                           size_t &failedExpression) const {
+
+    // Все выражения разбираются в одно дерево, поэтому одинаковые
+    // подвыражения разных формул становятся одной вершиной
+    ExpressionTree tree;
+    std::vector<const ExpressionNode*> roots(expressions.size(), nullptr);
+    for (size_t k = 0; k < expressions.size(); k++) {
+        if (!tryParse(expressions[k], variables, tree, roots[k], error)) {
+            failedExpression = k;
+            return false;
+        }
+    }
+    lower(tree, roots, variables, program);
+    return true;
+}
+
+// Кратчайшая запись числа, которая читается обратно в то же значение
+static std::string formatNumber(double value) {
+
+    char buffer[32];
+    std::snprintf(buffer, sizeof(buffer), "%.15g", value);
+    if (std::strtod(buffer, nullptr) != value) {
+        std::snprintf(buffer, sizeof(buffer), "%.17g", value);
+    }
+    return buffer;
+}
+
+// Многочлен c[0..degree] от аргумента u, начиная со старшей степени
+static std::string formatPolynomial(const double *c, unsigned int degree) {
+
+    std::string text;
+    for (unsigned int i = degree + 1; i-- > 0;) {
+        if (c[i] == 0 && !(i == 0 && text.empty())) continue;
+        double magnitude = std::fabs(c[i]);
+        if (text.empty()) {
+            text = std::signbit(c[i]) ? "-" : "";
+        } else {
+            text += std::signbit(c[i]) ? " - " : " + ";
+        }
+        if (magnitude != 1 || i == 0) {
+            text += formatNumber(magnitude);
+            if (i > 0) text += "*";
+        }
+        if (i > 0) text += i == 1 ? "u" : "u^" + std::to_string(i);
+    }
+    return text;
+}
+
+static void dumpProgram(const CompiledExpression &program, const std::string &indent, std::string &text) {
 
-    functions["asin"] = [](double x) { return std::asin(x); };
-    functions["arcsin"] = [](double x) { return std::asin(x); };
-    functions["acos"] = [](double x) { return std::acos(x); };
-    functions["arccos"] = [](double x) { return std::acos(x); };
-    functions["atan"] = [](double x) { return std::atan(x); };
-    functions["arctg"] = [](double x) { return std::atan(x); };
+    static const char* const NAMES[] = {
+        "const", "var", "imag", "add", "sub", "mul", "div", "pow", "call", "sincos",
+        "store", "load", "output", "reduce", "hcat", "vcat", "mcall", "poly", "memo", "memoend"
+    };
+    static_assert(sizeof(NAMES) / sizeof(NAMES[0]) == CompiledExpression::OP_MEMO_END + 1,
+                  "every opcode needs a name");
+
+    for (size_t pc = 0; pc < program.code.size(); pc++) {
+        const CompiledExpression::Instruction& instruction = program.code[pc];
+        char head[64];
+        std::snprintf(head, sizeof(head), "%s%4zu  %-7s %u", indent.c_str(), pc, NAMES[instruction.op], instruction.arg);
+        std::string line = head;
+        const unsigned int arg = instruction.arg;
+        switch (instruction.op) {
+        case CompiledExpression::OP_CONST:
+            line += "  " + formatNumber(program.constants[arg]);
+            break;
+        case CompiledExpression::OP_VAR:
+            line += "  " + program.variables[arg];
+            break;
+        case CompiledExpression::OP_CALL:
+        case CompiledExpression::OP_MATRIX_CALL:
+            line += "  " + program.functions[arg];
+            break;
+        case CompiledExpression::OP_SINCOS: {
+            const CompiledExpression::SinCosCall& call = program.sinCos[arg];
+            line += std::string("  ") + (call.cosine ? "cos" : "sin") + ", pair " + std::to_string(call.slot)
+                    + (call.first ? ", computes both" : "");
+            break;
+        }
+        case CompiledExpression::OP_POLY: {
+            // u - вершина стека, аргумент многочлена
+            const CompiledExpression::Polynomial& polynomial = program.polynomials[arg];
+            const double* c = program.constants.data() + polynomial.first;
+            const char* scheme = polynomial.scheme == CompiledExpression::Polynomial::ESTRIN ? "Estrin" : "Horner";
+            if (polynomial.denominatorDegree) {
+                line += "  (" + formatPolynomial(c, polynomial.degree) + ") / ("
+                        + formatPolynomial(c + polynomial.degree + 3, polynomial.denominatorDegree)
+                        + "), rational, " + scheme + ", degree " + std::to_string(polynomial.degree)
+                        + "/" + std::to_string(polynomial.denominatorDegree);
+            } else {
+                line += "  " + formatPolynomial(c, polynomial.degree) + ", polynomial, " + scheme
+                        + ", degree " + std::to_string(polynomial.degree);
+            }
+            break;
+        }
+        case CompiledExpression::OP_MEMO: {
+            // Переменные, от которых зависит подвыражение, и восстанавливаемые ячейки
+            const CompiledExpression::Memo& memo = program.memos[arg];
+            line += memo.variableCount ? "  depends on " : "  constant";
+            for (unsigned int k = 0; k < memo.variableCount; k++) {
+                line += (k ? ", " : "") + program.variables[program.memoIndices[memo.first + k]];
+            }
+            line += ", until " + std::to_string(memo.end);
+            if (memo.slotCount) {
+                line += ", restores " + std::to_string(memo.slotCount) + " slots";
+            }
+            break;
+        }
+        case CompiledExpression::OP_REDUCE: {
+            const CompiledExpression::Reduction& reduction = program.reductions[arg];
+            line += reduction.kind == CompiledExpression::Reduction::SUM ? "  sum"
+                    : reduction.kind == CompiledExpression::Reduction::PRODUCT ? "  prod" : "  integral";
+            line += " over " + reduction.body->variables[0] + "\n";
+            text += line;
+            dumpProgram(*reduction.body, indent + "      ", text);
+            continue;
+        }
+        default:
+            break;
+        }
+        text += line + "\n";
+    }
+}
 
-    functions["sinh"] = [](double x) { return std::sinh(x); };
-    functions["cosh"] = [](double x) { return std::cosh(x); };
-    functions["tanh"] = [](double x) { return std::tanh(x); };
+void ExpressionCalculator::resolveFunctions(CompiledExpression &program) {
 
-    functions["log"] = [](double x) { return std::log10(x); };
-    functions["ln"] = [](double x) { return std::log(x); };
-    functions["exp"] = [](double x) { return std::exp(x); };
-    functions["sqrt"] = [](double x) { return std::sqrt(x); };
-    functions["abs"] = [](double x) { return std::abs(x); };
+    program.calls.clear();
+    for (const std::string& name : program.functions) {
+        program.calls.push_back(findFunction(name));
+    }
+    program.sinFunction = findFunction(angleVariant("sin", program.angleMode));
+    program.cosFunction = findFunction(angleVariant("cos", program.angleMode));
 }
 
-double ExpressionCalculator::calculate(const std::string &expression) {
+bool ExpressionCalculator::checkProgram(const CompiledExpression &program) {
+
+    const size_t size = program.code.size();
+    if (program.spans.size() != size || program.outputCount == 0
+            || program.angleMode < ANGLE_RADIANS || program.angleMode > ANGLE_GRADIANS
+            || program.maxStackDepth > size || program.slotCount > size || program.sinCosSlots > size
+            || program.sinFunction != findFunction(angleVariant("sin", program.angleMode))
+            || program.cosFunction != findFunction(angleVariant("cos", program.angleMode))) {
+        return false;
+    }
+    for (const CompiledExpression::SinCosCall& call : program.sinCos) {
+        if (call.slot >= program.sinCosSlots) return false;
+    }
+    for (const CompiledExpression::Memo& memo : program.memos) {
+        if (memo.first > program.memoIndices.size()
+                || program.memoIndices.size() - memo.first < size_t(memo.variableCount) + memo.slotCount) {
+            return false;
+        }
+        for (unsigned int k = 0; k < memo.variableCount + memo.slotCount; k++) {
+            unsigned int index = program.memoIndices[memo.first + k];
+            if (index >= (k < memo.variableCount ? program.variables.size()
+                                                  : program.slotCount + 2 * program.sinCosSlots)) {
+                return false;
+            }
+        }
+    }
 
-    std::string cleaned = removeSpaces(expression);
+    std::vector<bool> stored(program.slotCount, false);
+    std::vector<bool> sinCosStarted(program.sinCosSlots, false);
+    // Открытые подвыражения кэша: номер и глубина стека в начале
+    std::vector<bool> memoSeen(program.memos.size(), false);
+    std::vector<std::pair<unsigned int, size_t>> openMemos;
+    size_t depth = 0;
+    for (size_t pc = 0; pc < size; pc++) {
+        const CompiledExpression::Instruction& instruction = program.code[pc];
+        const unsigned int arg = instruction.arg;
+        // Сколько значений инструкция снимает со стека и сколько кладёт
+        size_t pops = 0, pushes = 1;
+        switch (instruction.op) {
+        case CompiledExpression::OP_CONST:
+            if (arg >= program.constants.size()) return false;
+            break;
+        case CompiledExpression::OP_VAR:
+            if (arg >= program.variables.size()) return false;
+            break;
+        case CompiledExpression::OP_IMAG:
+            break;
+        case CompiledExpression::OP_ADD:
+        case CompiledExpression::OP_SUB:
+        case CompiledExpression::OP_MUL:
+        case CompiledExpression::OP_DIV:
+        case CompiledExpression::OP_POW:
+        case CompiledExpression::OP_HCAT:
+        case CompiledExpression::OP_VCAT:
+            pops = 2;
+            break;
+        case CompiledExpression::OP_CALL:
+            if (arg >= program.functions.size() || !findFunction(program.functions[arg])
+                    || arg >= program.calls.size() || program.calls[arg] != findFunction(program.functions[arg])) {
+                return false;
+            }
+            pops = 1;
+            break;
+        case CompiledExpression::OP_POLY: {
+            if (arg >= program.polynomials.size()) return false;
+            // Блоки числителя и знаменателя целиком внутри constants
+            const CompiledExpression::Polynomial& polynomial = program.polynomials[arg];
+            if (polynomial.degree > MAX_POLYNOMIAL_DEGREE || polynomial.denominatorDegree > MAX_POLYNOMIAL_DEGREE
+                    || polynomial.scheme > CompiledExpression::Polynomial::ESTRIN
+                    || polynomial.first > program.constants.size()
+                    || program.constants.size() - polynomial.first
+                        < polynomial.degree + 3 + (polynomial.denominatorDegree ? polynomial.denominatorDegree + 3 : 0)) {
+                return false;
+            }
+            pops = 1;
+            break;
+        }
+        case CompiledExpression::OP_MATRIX_CALL: {
+            const BuiltinMatrixFunction* func = arg < program.functions.size()
+                    ? findMatrixFunction(program.functions[arg]) : nullptr;
+            if (!func) return false;
+            pops = func->arity;
+            break;
+        }
+        case CompiledExpression::OP_SINCOS: {
+            if (arg >= program.sinCos.size()) return false;
+            const CompiledExpression::SinCosCall& call = program.sinCos[arg];
+            // Первый вызов пары вычисляет оба значения, остальные их читают
+            if (call.first == sinCosStarted[call.slot]) return false;
+            sinCosStarted[call.slot] = true;
+            pops = 1;
+            break;
+        }
+        case CompiledExpression::OP_STORE:
+            if (arg >= program.slotCount) return false;
+            stored[arg] = true;
+            pops = 1;
+            break;
+        case CompiledExpression::OP_LOAD:
+            if (arg >= program.slotCount || !stored[arg]) return false;
+            break;
+        case CompiledExpression::OP_OUTPUT:
+            if (program.outputCount == 1 || arg >= program.outputCount || !openMemos.empty()) return false;
+            pops = 1;
+            pushes = 0;
+            break;
+        case CompiledExpression::OP_MEMO:
+            // При попадании в кэш код до OP_MEMO_END пропускается, а значение кладётся в стек
+            if (arg >= program.memos.size() || memoSeen[arg] || program.memos[arg].end <= pc
+                    || program.memos[arg].end >= size
+                    || program.code[program.memos[arg].end].op != CompiledExpression::OP_MEMO_END
+                    || program.code[program.memos[arg].end].arg != arg) {
+                return false;
+            }
+            memoSeen[arg] = true;
+            openMemos.push_back(std::make_pair(arg, depth));
+            pushes = 0;
+            break;
+        case CompiledExpression::OP_MEMO_END:
+            if (openMemos.empty() || openMemos.back().first != arg || program.memos[arg].end != pc
+                    || depth != openMemos.back().second + 1) {
+                return false;
+            }
+            openMemos.pop_back();
+            pushes = 0;
+            break;
+        case CompiledExpression::OP_REDUCE: {
+            if (arg >= program.reductions.size()) return false;
+            const CompiledExpression::Reduction& reduction = program.reductions[arg];
+            // Тело: связанная переменная и все переменные внешней программы
+            if (reduction.kind > CompiledExpression::Reduction::INTEGRAL || !reduction.body
+                    || reduction.body->outputCount != 1
+                    || reduction.body->variables.size() != program.variables.size() + 1
+                    || !checkProgram(*reduction.body)) {
+                return false;
+            }
+            pops = 2;
+            break;
+        }
+        default:
+            return false;
+        }
+        if (depth < pops) return false;
+        depth = depth - pops + pushes;
+        if (depth > program.maxStackDepth) return false;
+    }
+    if (depth != (program.outputCount == 1 ? 1 : 0) || !openMemos.empty()
+            || std::find(memoSeen.begin(), memoSeen.end(), false) != memoSeen.end()) {
+        return false;
+    }
 
-    // Проверяем баланс скобок
-    int balance = 0;
-    for (char c : cleaned) {
-        if (c == '(') balance++;
-        else if (c == ')') balance--;
-        if (balance < 0) {
-            throw std::runtime_error("Unbalanced parentheses");
+    // Ячейки, записанные в пропускаемом коде и нужные после него, должны
+    // восстанавливаться из кэша - иначе их прочтут незаписанными
+    std::vector<size_t> lastRead = lastSlotReads(program);
+    std::vector<unsigned int> slots;
+    for (size_t pc = 0; pc < size; pc++) {
+        if (program.code[pc].op != CompiledExpression::OP_MEMO) continue;
+        const CompiledExpression::Memo& memo = program.memos[program.code[pc].arg];
+        slots.clear();
+        memoSlots(program, lastRead, pc, memo.end, slots);
+        const unsigned int* listed = program.memoIndices.data() + memo.first + memo.variableCount;
+        if (slots.size() != memo.slotCount || !std::equal(slots.begin(), slots.end(), listed)) {
+            return false;
         }
     }
-    if (balance != 0) {
-        throw std::runtime_error("Unbalanced parentheses");
+    return true;
+}
+
+std::string ExpressionCalculator::dump(const CompiledExpression &program) {
+
+    std::string text;
+    dumpProgram(program, std::string(), text);
+    return text;
+}
+
+double ExpressionCalculator::evaluate(const CompiledExpression &program,
+                                      const std::vector<double> &values) const {
+
+    if (values.size() != program.variables.size()) {
+        throw std::invalid_argument("Variable count mismatch");
+    }
+    if (program.outputCount != 1) {
+        throw std::invalid_argument("Program has several outputs, use evaluateBatch");
+    }
+    CalculationError error;
+    double result = evaluateRPN(program, values.data(), error);
+    if (!error.ok()) {
+        throw std::runtime_error(error.message(std::string()));
+    }
+    return result;
+}
+
+bool ExpressionCalculator::tryEvaluate(const CompiledExpression &program, const std::vector<double> &values,
+                                       double &result, CalculationError &error,
+                                       const std::atomic<bool> *cancel) const {
+
+    if (values.size() != program.variables.size() || program.outputCount != 1) {
+        error.code = CalculationError::INVALID_EXPRESSION;
+        error.offset = 0;
+        error.length = 0;
+        return false;
+    }
+    error = CalculationError();
+    result = evaluateRPN(program, values.data(), error, cancel);
+    return error.ok();
+}
+
+bool ExpressionCalculator::tryEvaluate(const CompiledExpression &program, const std::vector<double> &values,
+                                       MemoCache &cache, double &result, CalculationError &error,
+                                       const std::atomic<bool> *cancel) const {
+
+    if (values.size() != program.variables.size() || program.outputCount != 1) {
+        error.code = CalculationError::INVALID_EXPRESSION;
+        error.offset = 0;
+        error.length = 0;
+        return false;
+    }
+    // Кэш другой программы начинается заново
+    if (cache.program != &program || cache.valid.size() != program.memos.size()
+            || cache.saved.size() != program.memoIndices.size()) {
+        cache.program = &program;
+        cache.valid.assign(program.memos.size(), 0);
+        cache.results.assign(program.memos.size(), 0.0);
+        cache.saved.assign(program.memoIndices.size(), 0.0);
     }
+    size_t hits = cache.hitCount, misses = cache.missCount;
+    error = CalculationError();
+    result = evaluateRPN(program, values.data(), error, cancel, &cache);
+    INSTRUMENT_MEMO(cache.hitCount - hits, cache.missCount - misses);
+    return error.ok();
+}
+
+void ExpressionCalculator::MemoCache::clear() {
+
+    program = nullptr;
+    valid.clear();
+    results.clear();
+    saved.clear();
+    hitCount = 0;
+    missCount = 0;
+}
 
-    // Конвертируем в ОПН и вычисляем
-    std::vector<std::string> rpn = toRPN(cleaned);
-    return evaluateRPN(rpn);
+std::complex<double> ExpressionCalculator::evaluateComplex(const CompiledExpression &program,
+                                                           const std::vector<std::complex<double>> &values) const {
+
+    if (values.size() != program.variables.size()) {
+        throw std::invalid_argument("Variable count mismatch");
+    }
+    if (program.outputCount != 1) {
+        throw std::invalid_argument("Program has several outputs, use evaluateBatch");
+    }
+    CalculationError error;
+    std::complex<double> result = evaluateComplexRPN(program, values.data(), error);
+    if (!error.ok()) {
+        throw std::runtime_error(error.message(std::string()));
+    }
+    return result;
 }
 
-std::string ExpressionCalculator::removeSpaces(const std::string &str) const{
+std::string ExpressionCalculator::removeSpaces(const std::string &str, std::vector<size_t> *positions) const{
 
+    INSTRUMENT_STAGE(STAGE_REMOVE_SPACES);
     std::string result;
-    for (char c : str) {
-        if (!std::isspace(c)) {
-            result += c;
+    for (size_t i = 0; i < str.length(); i++) {
+        if (!grammar::isSpace(str[i])) {
+            result += str[i];
+            if (positions) {
+                positions->push_back(i);
+            }
         }
     }
     return result;
 }
 
 bool ExpressionCalculator::isOperator(char c) const {
-    return c == '+' || c == '-' || c == '*' || c == '/' || c == '^';
+    return grammar::isOperator(c);
 }
 
-int ExpressionCalculator::getPrecedence(char op) {
-    if (op == '+' || op == '-') return 1;
-    if (op == '*' || op == '/') return 2;
-    if (op == '^') return 3;
-    return 0;
+int ExpressionCalculator::getPrecedence(char op) const {
+    return grammar::precedence(op);
 }
 
 double ExpressionCalculator::applyOperation(double a, double b, char op) const {
@@ -75,31 +1979,34 @@ double ExpressionCalculator::applyOperation(double a, double b, char op) const {
     case '+': return a + b;
     case '-': return a - b;
     case '*': return a * b;
-    case '/':
-        if (b == 0) {
-            throw std::runtime_error("Division by zero");
-        }
-        return a / b;
-    case '^': return std::pow(a, b);
-    default: throw std::runtime_error("Invalid operator");
+    case '/': return a / b;
+    default: return std::pow(a, b);
     }
 }
 
-double ExpressionCalculator::applyFunction(const std::string& func, double arg) const {
+std::complex<double> ExpressionCalculator::applyComplexOperation(std::complex<double> a,
+                                                                 std::complex<double> b, char op) const {
 
-    auto it = functions.find(func);
-    if (it != functions.end()) {
-        try {
-            return it->second(arg);
-        } catch (...) {
-            throw std::runtime_error("Error evaluating function " + func);
+    switch (op) {
+    case '+': return a + b;
+    case '-': return a - b;
+    case '*': return a * b;
+    case '/': return a / b;
+    default:
+        // Целая действительная степень без перехода через логарифм
+        if (b.imag() == 0.0 && b.real() == std::floor(b.real()) && std::abs(b.real()) <= 64) {
+            return integerPower(a, static_cast<int>(b.real()));
         }
+        return std::pow(a, b);
     }
-    throw std::runtime_error("Unknown function: " + func);
 }
 
 bool ExpressionCalculator::isFunction(const std::string &str) const {
-    return functions.find(str) != functions.end();
+    return findFunction(str) || findMatrixFunction(str);
+}
+
+bool ExpressionCalculator::isReduction(const std::string &str) const {
+    return grammar::isReduction(str.c_str(), str.length());
 }
 
 bool ExpressionCalculator::isNumber(const std::string &str) const {
@@ -111,131 +2018,1052 @@ bool ExpressionCalculator::isNumber(const std::string &str) const {
 }
 
 bool ExpressionCalculator::isLetter(char c) const {
-    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+    return grammar::isLetter(c);
+}
+
+bool ExpressionCalculator::toRPN(const std::string &expression,
+                                 const std::vector<std::string> &variables,
+                                 std::vector<Token> &output, CalculationError &error) const {
+
+    INSTRUMENT_STAGE(STAGE_TO_RPN);
+    RPNState state;
+    while (state.position < expression.length()) {
+        if (!toRPNStep(expression, variables, state, output, error)) {
+            return false;
+        }
+    }
+    finishRPN(state, output);
+
+    INSTRUMENT_TOKENS(output.size());
+    return true;
 }
 
-std::vector<std::string> ExpressionCalculator::toRPN(const std::string &expression) {
+bool ExpressionCalculator::toRPNStep(const std::string &expression,
+                                     const std::vector<std::string> &variables,
+                                     RPNState &state, std::vector<Token> &output,
+                                     CalculationError &error) const {
 
-    std::vector<std::string> output;
-    std::stack<std::string> operators;
+    std::vector<Token>& operators = state.operators;
+    // Открытые скобки: внутри [] запятая и точка с запятой - склейки матриц
+    std::vector<char>& brackets = state.brackets;
     std::string buffer;
+    size_t start = 0;
+    size_t i = state.position;
+    char c = expression[i];
 
-    for (size_t i = 0; i < expression.length(); i++) {
-        char c = expression[i];
-
-        // Если символ - цифра или точка, собираем число
-        if (std::isdigit(c) || c == '.') {
-            buffer += c;
-            // Если следующий символ не цифра и не точка, добавляем число в вывод
-            if (i + 1 == expression.length() ||
-                    (!std::isdigit(expression[i + 1]) && expression[i + 1] != '.')) {
-                output.push_back(buffer);
-                buffer.clear();
-            }
-        }
-        // Если символ - буква, собираем имя функции
-        else if (isLetter(c)) {
-            buffer += c;
-            // Если следующий символ не буква, проверяем, что мы собрали
-            if (i + 1 == expression.length() || !isLetter(expression[i + 1])) {
-                // Если после имени функции идет открывающая скобка, это функция
-                if (i + 1 < expression.length() && expression[i + 1] == '(') {
-                    operators.push(buffer);
+    // Если символ - цифра или точка, собираем число
+    if (grammar::isNumberChar(c)) {
+        start = i;
+        // Число кончается на символе, который не цифра и не точка
+        while (i + 1 < expression.length() && grammar::isNumberChar(expression[i + 1])) {
+            i++;
+        }
+        output.push_back(Token{expression.substr(start, i - start + 1), start, i - start + 1, false});
+    }
+    // Если символ - буква, собираем имя функции или переменной
+    // (после первой буквы допускаются цифры и подчеркивание: x1, A2)
+    else if (isLetter(c)) {
+        start = i;
+        buffer += c;
+        while (i + 1 < expression.length() && grammar::isIdentifierChar(expression[i + 1])) {
+            buffer += expression[++i];
+        }
+        // sum(k, a, b, f), prod(...), integral(x, a, b, f) - один операнд:
+        // аргументы разбираются отдельно при построении дерева
+        if (i + 1 < expression.length() && expression[i + 1] == '(' && isReduction(buffer)) {
+            size_t close = i + 1;
+            int depth = 0;
+            for (; close < expression.length(); close++) {
+                if (expression[close] == '(') depth++;
+                else if (expression[close] == ')' && --depth == 0) break;
+            }
+            if (close == expression.length()) {
+                error.code = CalculationError::UNBALANCED_PARENTHESES;
+                error.offset = i + 1;
+                error.length = 1;
+                return false;
+            }
+            output.push_back(Token{buffer, start, close - start + 1, true});
+            i = close;
+        }
+        // Если после имени функции идет открывающая скобка, это функция
+        else if (i + 1 < expression.length() && expression[i + 1] == '(') {
+            operators.push_back(Token{buffer, start, buffer.length(), false});
+        } else if (std::find(variables.begin(), variables.end(), buffer) != variables.end()) {
+            // Переменная скомпилированного выражения
+            output.push_back(Token{buffer, start, buffer.length(), false});
+        } else {
+            // Иначе это константа (например, pi, e, i)
+            if (buffer == "pi") {
+                output.push_back(Token{grammar::PI_TEXT, start, buffer.length(), false});
+            } else if (buffer == "e") {
+                output.push_back(Token{grammar::E_TEXT, start, buffer.length(), false});
+            } else if (buffer == "i") {
+                // Мнимая единица, допустима только в комплексном режиме
+                output.push_back(Token{buffer, start, buffer.length(), false});
+            } else {
+                error.code = CalculationError::UNKNOWN_IDENTIFIER;
+                error.offset = start;
+                error.length = buffer.length();
+                return false;
+            }
+        }
+    }
+    // Если символ - открывающая скобка
+    else if (c == '(' || c == '[') {
+        operators.push_back(Token{std::string(1, c), i, 1, false});
+        brackets.push_back(c);
+    }
+    // Конец литерала матрицы: выводим его склейки
+    else if (c == ']') {
+        while (!operators.empty() && operators.back().text != "[") {
+            output.push_back(operators.back());
+            operators.pop_back();
+        }
+        if (!operators.empty()) {
+            operators.pop_back();
+        }
+        if (!brackets.empty()) {
+            brackets.pop_back();
+        }
+    }
+    // Склейка элементов литерала: ',' связывает сильнее, чем ';',
+    // и обе слабее любого арифметического оператора
+    else if ((c == ',' || c == ';') && !brackets.empty() && brackets.back() == '[') {
+        while (!operators.empty() && operators.back().text != "[" &&
+               (c == ';' || operators.back().text != ";")) {
+            output.push_back(operators.back());
+            operators.pop_back();
+        }
+        operators.push_back(Token{std::string(1, c), i, 1, false});
+    }
+    // Если символ - закрывающая скобка
+    else if (c == ')') {
+        while (!operators.empty() && operators.back().text != "(") {
+            output.push_back(operators.back());
+            operators.pop_back();
+        }
+        if (!brackets.empty()) {
+            brackets.pop_back();
+        }
+        if (!operators.empty()) {
+            operators.pop_back(); // Удаляем открывающую скобку
+
+            // Если после удаления скобки на вершине стека функция, добавляем ее
+            if (!operators.empty() && isFunction(operators.back().text)) {
+                output.push_back(operators.back());
+                operators.pop_back();
+            }
+        }
+    }
+    // Если символ - оператор
+    else if (isOperator(c)) {
+        // Обрабатываем унарный минус
+        if (c == '-' && (i == 0 || grammar::opensOperand(expression[i - 1]))) {
+            output.push_back(Token{"0", i, 1, false});
+        }
+
+        while (!operators.empty() && operators.back().text != "(" &&
+               (isOperator(operators.back().text[0]) &&
+                getPrecedence(operators.back().text[0]) >= getPrecedence(c))) {
+            output.push_back(operators.back());
+            operators.pop_back();
+        }
+        operators.push_back(Token{std::string(1, c), i, 1, false});
+    }
+    // Если символ - запятая (разделитель аргументов функции)
+    else if (c == ',') {
+        while (!operators.empty() && operators.back().text != "(") {
+            output.push_back(operators.back());
+            operators.pop_back();
+        }
+    }
+    else {
+        // Многобайтовый символ UTF-8 указываем целиком
+        size_t length = 1;
+        while (i + length < expression.length() &&
+               (static_cast<unsigned char>(expression[i + length]) & 0xC0) == 0x80) {
+            length++;
+        }
+        error.code = CalculationError::UNEXPECTED_CHARACTER;
+        error.offset = i;
+        error.length = length;
+        return false;
+    }
+
+    state.position = i + 1;
+    return true;
+}
+
+void ExpressionCalculator::finishRPN(RPNState &state, std::vector<Token> &output) const {
+
+    // Добавляем оставшиеся операторы
+    while (!state.operators.empty()) {
+        output.push_back(state.operators.back());
+        state.operators.pop_back();
+    }
+}
+
+CalculationError::Code ExpressionCalculator::reduce(const CompiledExpression::Reduction &reduction,
+                                                    double lower, double upper, const double *values,
+                                                    const std::atomic<bool> *cancel, double &result) const {
+
+    // Больше слагаемых не вычислить за разумное время
+    const double MAX_TERMS = 1e10;
+
+    if (!std::isfinite(lower) || !std::isfinite(upper)) {
+        return CalculationError::INVALID_FUNCTION_ARGUMENT;
+    }
+    // Пакетное вычисление не работает с матрицами
+    if (hasMatrixOperations(*reduction.body)) {
+        return CalculationError::MATRIX_IN_SCALAR_MODE;
+    }
+
+    // Тело вычисляется пакетно: столбец связанной переменной меняется,
+    // внешние переменные постоянны. Пакет не сообщает об ошибках, деление
+    // на ноль даёт там inf или nan; такие слагаемые перевычисляются
+    // интерпретатором, и его деление на ноль - ошибка всей конструкции
+    const CompiledExpression& body = *reduction.body;
+    size_t outer = body.variables.size() - 1;
+    std::atomic<bool> divisionByZero(false);
+    BatchFunction f = [&](const double* x, double* y, size_t n) {
+        std::vector<double> constants(outer * n);
+        std::vector<const double*> columns(1, x);
+        for (size_t k = 0; k < outer; k++) {
+            std::fill(constants.begin() + k * n, constants.begin() + (k + 1) * n, values[k]);
+            columns.push_back(constants.data() + k * n);
+        }
+        evaluateBatch(body, columns, n, y, cancel);
+        for (size_t j = 0; j < n && !divisionByZero.load(std::memory_order_relaxed); j++) {
+            if (std::isfinite(y[j])) {
+                continue;
+            }
+            std::vector<double> point(1, x[j]);
+            point.insert(point.end(), values, values + outer);
+            CalculationError termError;
+            evaluateRPN(body, point.data(), termError, cancel);
+            if (termError.code == CalculationError::DIVISION_BY_ZERO) {
+                divisionByZero = true;
+            }
+        }
+    };
+
+    bool finished;
+    bool converged = true;
+    result = std::numeric_limits<double>::quiet_NaN();
+    if (reduction.kind == CompiledExpression::Reduction::INTEGRAL) {
+        IntegrationStatus status = integrate(f, lower, upper, cancel, result);
+        finished = status != INTEGRATION_CANCELLED;
+        converged = status != INTEGRATION_NO_CONVERGENCE;
+    } else {
+        // Связанная переменная пробегает lower, lower + 1, ... пока не больше upper
+        uint64_t count = 0;
+        if (upper >= lower) {
+            double terms = std::floor(upper - lower) + 1;
+            if (terms > MAX_TERMS) {
+                return CalculationError::INVALID_FUNCTION_ARGUMENT;
+            }
+            count = static_cast<uint64_t>(terms);
+        }
+        finished = reduceRange(f, lower, count, reduction.kind == CompiledExpression::Reduction::PRODUCT,
+                               cancel, result);
+    }
+
+    if (!finished) {
+        return CalculationError::CANCELLED;
+    }
+    if (divisionByZero) {
+        return CalculationError::DIVISION_BY_ZERO;
+    }
+    if (!converged) {
+        return CalculationError::NO_CONVERGENCE;
+    }
+    if (std::isnan(result)) {
+        return CalculationError::INVALID_FUNCTION_ARGUMENT;
+    }
+    return CalculationError::NONE;
+}
+
+double ExpressionCalculator::evaluateRPN(const CompiledExpression &program, const double *variables,
+                                         CalculationError &error, const std::atomic<bool> *cancel,
+                                         MemoCache *cache) const {
+
+    INSTRUMENT_STAGE(STAGE_EVALUATE);
+    INSTRUMENT_STACK_DEPTH(program.maxStackDepth);
+
+    // Глубина стека известна после компиляции, проверки переполнения не нужны;
+    // для обычных выражений стек размещается без обращения к куче
+    double local[64] = { 0.0 };
+    std::vector<double> heap;
+    double* values = local;
+    if (program.maxStackDepth > 64) {
+        heap.resize(program.maxStackDepth);
+        values = heap.data();
+    }
+    size_t top = 0;
+
+    // Ячейки общих подвыражений и совмещённых sin/cos
+    double localSlots[32];
+    std::vector<double> heapSlots;
+    double* slots = localSlots;
+    if (program.slotCount + 2 * program.sinCosSlots > 32) {
+        heapSlots.resize(program.slotCount + 2 * program.sinCosSlots);
+        slots = heapSlots.data();
+    }
+    double* slotSin = slots + program.slotCount;
+    double* slotCos = slotSin + program.sinCosSlots;
+
+    for (size_t pc = 0; pc < program.code.size(); pc++) {
+        const CompiledExpression::Instruction& instruction = program.code[pc];
+        switch (instruction.op) {
+        case CompiledExpression::OP_CONST:
+            values[top++] = program.constants[instruction.arg];
+            break;
+        case CompiledExpression::OP_VAR:
+            values[top++] = variables[instruction.arg];
+            break;
+        case CompiledExpression::OP_IMAG:
+            error.code = CalculationError::COMPLEX_IN_REAL_MODE;
+            error.offset = program.spans[pc].offset;
+            error.length = program.spans[pc].length;
+            return std::numeric_limits<double>::quiet_NaN();
+        case CompiledExpression::OP_ADD: top--; values[top - 1] = applyOperation(values[top - 1], values[top], '+'); break;
+        case CompiledExpression::OP_SUB: top--; values[top - 1] = applyOperation(values[top - 1], values[top], '-'); break;
+        case CompiledExpression::OP_MUL: top--; values[top - 1] = applyOperation(values[top - 1], values[top], '*'); break;
+        case CompiledExpression::OP_DIV:
+            top--;
+            if (values[top] == 0) {
+                error.code = CalculationError::DIVISION_BY_ZERO;
+                error.offset = program.spans[pc].offset;
+                error.length = program.spans[pc].length;
+                return std::numeric_limits<double>::quiet_NaN();
+            }
+            values[top - 1] = applyOperation(values[top - 1], values[top], '/');
+            break;
+        case CompiledExpression::OP_POW: top--; values[top - 1] = applyOperation(values[top - 1], values[top], '^'); break;
+        case CompiledExpression::OP_POLY: {
+            const CompiledExpression::Polynomial& polynomial = program.polynomials[instruction.arg];
+            const double* c = program.constants.data() + polynomial.first;
+            double x = values[top - 1];
+            values[top - 1] = polynomialValue(c, polynomial.degree, polynomial.scheme, x);
+            if (polynomial.denominatorDegree) {
+                double q = polynomialValue(c + polynomial.degree + 3, polynomial.denominatorDegree, polynomial.scheme, x);
+                if (q == 0) {
+                    error.code = CalculationError::DIVISION_BY_ZERO;
+                    error.offset = program.spans[pc].offset;
+                    error.length = program.spans[pc].length;
+                    return std::numeric_limits<double>::quiet_NaN();
+                }
+                values[top - 1] /= q;
+            }
+            break;
+        }
+        case CompiledExpression::OP_CALL: {
+            const BuiltinFunction* func = program.calls[instruction.arg];
+            INSTRUMENT_FUNCTION_CALLS(&func->real, 1);
+            values[top - 1] = func->real(values[top - 1]);
+            break;
+        }
+        case CompiledExpression::OP_SINCOS: {
+            const CompiledExpression::SinCosCall& call = program.sinCos[instruction.arg];
+            if (call.first) {
+                sinCosByMode(program.angleMode, values[top - 1], slotSin[call.slot], slotCos[call.slot]);
+            }
+            values[top - 1] = call.cosine ? slotCos[call.slot] : slotSin[call.slot];
+            break;
+        }
+        case CompiledExpression::OP_STORE:
+            slots[instruction.arg] = values[top - 1];
+            break;
+        case CompiledExpression::OP_LOAD:
+            values[top++] = slots[instruction.arg];
+            break;
+        case CompiledExpression::OP_OUTPUT:
+            // Не встречается: программы с несколькими выходами вычисляются пакетно
+            top--;
+            break;
+        case CompiledExpression::OP_MEMO:
+            if (cache) {
+                const CompiledExpression::Memo& memo = program.memos[instruction.arg];
+                const unsigned int* index = program.memoIndices.data() + memo.first;
+                double* saved = cache->saved.data() + memo.first;
+                // Переменные сравниваются побитово: -0 и 0 дают разные значения
+                bool hit = cache->valid[instruction.arg] != 0;
+                for (unsigned int k = 0; hit && k < memo.variableCount; k++) {
+                    hit = std::memcmp(saved + k, variables + index[k], sizeof(double)) == 0;
+                }
+                if (hit) {
+                    for (unsigned int k = memo.variableCount; k < memo.variableCount + memo.slotCount; k++) {
+                        slots[index[k]] = saved[k];
+                    }
+                    values[top++] = cache->results[instruction.arg];
+                    pc = memo.end;
+                    cache->hitCount++;
                 } else {
-                    // Иначе это константа (например, pi, e)
-                    if (buffer == "pi") {
-                        output.push_back("3.14159265358979323846");
-                    } else if (buffer == "e") {
-                        output.push_back("2.71828182845904523536");
-                    } else {
-                        throw std::runtime_error("Unknown identifier: " + buffer);
+                    // Значение сохраняется в OP_MEMO_END, если вычисление дойдёт до него без ошибки
+                    for (unsigned int k = 0; k < memo.variableCount; k++) {
+                        saved[k] = variables[index[k]];
                     }
+                    cache->valid[instruction.arg] = 0;
+                    cache->missCount++;
                 }
-                buffer.clear();
             }
+            break;
+        case CompiledExpression::OP_MEMO_END:
+            if (cache) {
+                const CompiledExpression::Memo& memo = program.memos[instruction.arg];
+                const unsigned int* index = program.memoIndices.data() + memo.first;
+                double* saved = cache->saved.data() + memo.first;
+                for (unsigned int k = memo.variableCount; k < memo.variableCount + memo.slotCount; k++) {
+                    saved[k] = slots[index[k]];
+                }
+                cache->results[instruction.arg] = values[top - 1];
+                cache->valid[instruction.arg] = 1;
+            }
+            break;
+        case CompiledExpression::OP_REDUCE: {
+            top--;
+            double value = 0.0;
+            CalculationError::Code code = reduce(program.reductions[instruction.arg], values[top - 1], values[top],
+                                                 variables, cancel, value);
+            if (code != CalculationError::NONE) {
+                error.code = code;
+                error.offset = program.spans[pc].offset;
+                error.length = program.spans[pc].length;
+                return std::numeric_limits<double>::quiet_NaN();
+            }
+            values[top - 1] = value;
+            break;
         }
-        // Если символ - открывающая скобка
-        else if (c == '(') {
-            operators.push(std::string(1, c));
+        case CompiledExpression::OP_HCAT:
+        case CompiledExpression::OP_VCAT:
+        case CompiledExpression::OP_MATRIX_CALL:
+            error.code = CalculationError::MATRIX_IN_SCALAR_MODE;
+            error.offset = program.spans[pc].offset;
+            error.length = program.spans[pc].length;
+            return std::numeric_limits<double>::quiet_NaN();
         }
-        // Если символ - закрывающая скобка
-        else if (c == ')') {
-            while (!operators.empty() && operators.top() != "(") {
-                output.push_back(operators.top());
-                operators.pop();
-            }
-            if (!operators.empty()) {
-                operators.pop(); // Удаляем открывающую скобку
+    }
+
+    return values[0];
+}
+
+std::complex<double> ExpressionCalculator::evaluateComplexRPN(const CompiledExpression &program,
+                                                              const std::complex<double> *variables,
+                                                              CalculationError &error) const {
 
-                // Если после удаления скобки на вершине стека функция, добавляем ее
-                if (!operators.empty() && isFunction(operators.top())) {
-                    output.push_back(operators.top());
-                    operators.pop();
+    INSTRUMENT_STAGE(STAGE_EVALUATE);
+    INSTRUMENT_STACK_DEPTH(program.maxStackDepth);
+
+    std::vector<std::complex<double>> values(program.maxStackDepth);
+    std::vector<std::complex<double>> slots(program.slotCount);
+    size_t top = 0;
+
+    for (size_t pc = 0; pc < program.code.size(); pc++) {
+        const CompiledExpression::Instruction& instruction = program.code[pc];
+        switch (instruction.op) {
+        case CompiledExpression::OP_CONST:
+            values[top++] = program.constants[instruction.arg];
+            break;
+        case CompiledExpression::OP_VAR:
+            values[top++] = variables[instruction.arg];
+            break;
+        case CompiledExpression::OP_IMAG:
+            values[top++] = std::complex<double>(0.0, 1.0);
+            break;
+        case CompiledExpression::OP_ADD: top--; values[top - 1] = applyComplexOperation(values[top - 1], values[top], '+'); break;
+        case CompiledExpression::OP_SUB: top--; values[top - 1] = applyComplexOperation(values[top - 1], values[top], '-'); break;
+        case CompiledExpression::OP_MUL: top--; values[top - 1] = applyComplexOperation(values[top - 1], values[top], '*'); break;
+        case CompiledExpression::OP_DIV:
+            top--;
+            if (values[top] == 0.0) {
+                error.code = CalculationError::DIVISION_BY_ZERO;
+                error.offset = program.spans[pc].offset;
+                error.length = program.spans[pc].length;
+                return std::complex<double>(std::numeric_limits<double>::quiet_NaN(), 0.0);
+            }
+            values[top - 1] = applyComplexOperation(values[top - 1], values[top], '/');
+            break;
+        case CompiledExpression::OP_POW: top--; values[top - 1] = applyComplexOperation(values[top - 1], values[top], '^'); break;
+        case CompiledExpression::OP_POLY: {
+            const CompiledExpression::Polynomial& polynomial = program.polynomials[instruction.arg];
+            const double* c = program.constants.data() + polynomial.first;
+            std::complex<double> z = values[top - 1];
+            values[top - 1] = polynomialValue(c, polynomial.degree, polynomial.scheme, z);
+            if (polynomial.denominatorDegree) {
+                std::complex<double> q = polynomialValue(c + polynomial.degree + 3, polynomial.denominatorDegree,
+                                                         polynomial.scheme, z);
+                if (q == 0.0) {
+                    error.code = CalculationError::DIVISION_BY_ZERO;
+                    error.offset = program.spans[pc].offset;
+                    error.length = program.spans[pc].length;
+                    return std::complex<double>(std::numeric_limits<double>::quiet_NaN(), 0.0);
                 }
+                values[top - 1] = applyComplexOperation(values[top - 1], q, '/');
             }
+            break;
+        }
+        case CompiledExpression::OP_CALL: {
+            const BuiltinFunction* func = program.calls[instruction.arg];
+            INSTRUMENT_FUNCTION_CALLS(&func->complex, 1);
+            values[top - 1] = func->complex(values[top - 1]);
+            break;
         }
-        // Если символ - оператор
-        else if (isOperator(c)) {
-            // Обрабатываем унарный минус
-            if (c == '-' && (i == 0 || expression[i - 1] == '(' ||
-                             isOperator(expression[i - 1]) || expression[i - 1] == ',')) {
-                output.push_back("0");
+        case CompiledExpression::OP_SINCOS: {
+            // В комплексном режиме sin и cos вычисляются по отдельности
+            const BuiltinFunction* func = program.sinCos[instruction.arg].cosine
+                    ? program.cosFunction : program.sinFunction;
+            values[top - 1] = func->complex(values[top - 1]);
+            break;
+        }
+        case CompiledExpression::OP_STORE:
+            slots[instruction.arg] = values[top - 1];
+            break;
+        case CompiledExpression::OP_LOAD:
+            values[top++] = slots[instruction.arg];
+            break;
+        case CompiledExpression::OP_OUTPUT:
+            // Не встречается: программы с несколькими выходами вычисляются пакетно
+            top--;
+            break;
+        case CompiledExpression::OP_MEMO:
+        case CompiledExpression::OP_MEMO_END:
+            // Кэш подвыражений - только для действительного вычисления
+            break;
+        case CompiledExpression::OP_REDUCE: {
+            // Тело вычисляется в действительных числах: пределы
+            // и внешние переменные должны быть действительными
+            top--;
+            std::vector<double> real(program.variables.size());
+            bool isReal = values[top - 1].imag() == 0.0 && values[top].imag() == 0.0;
+            for (size_t k = 0; k < real.size(); k++) {
+                real[k] = variables[k].real();
+                isReal = isReal && variables[k].imag() == 0.0;
+            }
+            double value = 0.0;
+            CalculationError::Code code = isReal
+                    ? reduce(program.reductions[instruction.arg], values[top - 1].real(), values[top].real(),
+                             real.data(), nullptr, value)
+                    : CalculationError::COMPLEX_IN_REAL_MODE;
+            if (code != CalculationError::NONE) {
+                error.code = code;
+                error.offset = program.spans[pc].offset;
+                error.length = program.spans[pc].length;
+                return std::complex<double>(std::numeric_limits<double>::quiet_NaN(), 0.0);
             }
+            values[top - 1] = value;
+            break;
+        }
+        case CompiledExpression::OP_HCAT:
+        case CompiledExpression::OP_VCAT:
+        case CompiledExpression::OP_MATRIX_CALL:
+            error.code = CalculationError::MATRIX_IN_SCALAR_MODE;
+            error.offset = program.spans[pc].offset;
+            error.length = program.spans[pc].length;
+            return std::complex<double>(std::numeric_limits<double>::quiet_NaN(), 0.0);
+        }
+    }
+
+    return values[0];
+}
+
+Matrix ExpressionCalculator::evaluateMatrix(const CompiledExpression &program,
+                                            const std::vector<Matrix> &values) const {
+
+    if (values.size() != program.variables.size()) {
+        throw std::invalid_argument("Variable count mismatch");
+    }
+    if (program.outputCount != 1) {
+        throw std::invalid_argument("Program has several outputs, use evaluateBatch");
+    }
+    CalculationError error;
+    Matrix result = evaluateMatrixRPN(program, values.data(), error);
+    if (!error.ok()) {
+        throw std::runtime_error(error.message(std::string()));
+    }
+    return result;
+}
+
+bool ExpressionCalculator::tryEvaluateMatrix(const CompiledExpression &program, const std::vector<Matrix> &values,
+                                             Matrix &result, CalculationError &error) const {
+
+    if (values.size() != program.variables.size() || program.outputCount != 1) {
+        error.code = CalculationError::INVALID_EXPRESSION;
+        error.offset = 0;
+        error.length = 0;
+        return false;
+    }
+    error = CalculationError();
+    result = evaluateMatrixRPN(program, values.data(), error);
+    return error.ok();
+}
+
+Matrix ExpressionCalculator::evaluateMatrixRPN(const CompiledExpression &program, const Matrix *variables,
+                                               CalculationError &error) const {
+
+    INSTRUMENT_STAGE(STAGE_EVALUATE);
+    INSTRUMENT_STACK_DEPTH(program.maxStackDepth);
 
-            while (!operators.empty() && operators.top() != "(" &&
-                   (isOperator(operators.top()[0]) &&
-                    getPrecedence(operators.top()[0]) >= getPrecedence(c))) {
-                output.push_back(operators.top());
-                operators.pop();
+    std::vector<Matrix> values(program.maxStackDepth);
+    std::vector<Matrix> slots(program.slotCount);
+    size_t top = 0;
+
+    auto fail = [&](CalculationError::Code code, size_t pc) {
+        error.code = code;
+        error.offset = program.spans[pc].offset;
+        error.length = program.spans[pc].length;
+        return Matrix::scalar(std::numeric_limits<double>::quiet_NaN());
+    };
+
+    for (size_t pc = 0; pc < program.code.size(); pc++) {
+        const CompiledExpression::Instruction& instruction = program.code[pc];
+        CalculationError::Code code = CalculationError::NONE;
+        switch (instruction.op) {
+        case CompiledExpression::OP_CONST:
+            values[top++] = Matrix::scalar(program.constants[instruction.arg]);
+            break;
+        case CompiledExpression::OP_VAR:
+            values[top++] = variables[instruction.arg];
+            break;
+        case CompiledExpression::OP_IMAG:
+            return fail(CalculationError::COMPLEX_IN_REAL_MODE, pc);
+        case CompiledExpression::OP_ADD: top--; code = elementwise(values[top - 1], values[top], '+', values[top - 1]); break;
+        case CompiledExpression::OP_SUB: top--; code = elementwise(values[top - 1], values[top], '-', values[top - 1]); break;
+        case CompiledExpression::OP_MUL: top--; code = elementwise(values[top - 1], values[top], '*', values[top - 1]); break;
+        case CompiledExpression::OP_DIV: top--; code = elementwise(values[top - 1], values[top], '/', values[top - 1]); break;
+        case CompiledExpression::OP_POW: top--; code = elementwise(values[top - 1], values[top], '^', values[top - 1]); break;
+        case CompiledExpression::OP_POLY: {
+            // Поэлементно, как операции, из которых собран многочлен
+            const CompiledExpression::Polynomial& polynomial = program.polynomials[instruction.arg];
+            const double* c = program.constants.data() + polynomial.first;
+            Matrix& m = values[top - 1];
+            if (polynomial.denominatorDegree) {
+                Matrix q = m;
+                polynomialArray(c + polynomial.degree + 3, polynomial.denominatorDegree, polynomial.scheme,
+                                m.data(), q.data(), m.size());
+                polynomialArray(c, polynomial.degree, polynomial.scheme, m.data(), m.data(), m.size());
+                code = elementwise(m, q, '/', m);
+            } else {
+                polynomialArray(c, polynomial.degree, polynomial.scheme, m.data(), m.data(), m.size());
+            }
+            break;
+        }
+        case CompiledExpression::OP_HCAT: top--; code = concatenate(values[top - 1], values[top], ',', values[top - 1]); break;
+        case CompiledExpression::OP_VCAT: top--; code = concatenate(values[top - 1], values[top], ';', values[top - 1]); break;
+        case CompiledExpression::OP_CALL:
+        case CompiledExpression::OP_SINCOS: {
+            // Обычные функции применяются к каждому элементу
+            const BuiltinFunction* func = instruction.op == CompiledExpression::OP_CALL
+                    ? program.calls[instruction.arg]
+                    : program.sinCos[instruction.arg].cosine ? program.cosFunction : program.sinFunction;
+            Matrix& m = values[top - 1];
+            INSTRUMENT_FUNCTION_CALLS(&func->real, m.size());
+            if (func->array) {
+                func->array(m.data(), m.data(), m.size());
+            } else {
+                for (size_t j = 0; j < m.size(); j++) {
+                    m.data()[j] = func->real(m.data()[j]);
+                }
+            }
+            break;
+        }
+        case CompiledExpression::OP_MATRIX_CALL: {
+            const BuiltinMatrixFunction* func = findMatrixFunction(program.functions[instruction.arg]);
+            if (func->arity == 2) {
+                top--;
+                code = func->apply(values[top - 1], values[top], values[top - 1]);
+            } else {
+                code = func->apply(values[top - 1], values[top - 1], values[top - 1]);
             }
-            operators.push(std::string(1, c));
+            break;
         }
-        // Если символ - запятая (разделитель аргументов функции)
-        else if (c == ',') {
-            while (!operators.empty() && operators.top() != "(") {
-                output.push_back(operators.top());
-                operators.pop();
+        case CompiledExpression::OP_STORE:
+            slots[instruction.arg] = values[top - 1];
+            break;
+        case CompiledExpression::OP_LOAD:
+            values[top++] = slots[instruction.arg];
+            break;
+        case CompiledExpression::OP_OUTPUT:
+            top--;
+            break;
+        case CompiledExpression::OP_MEMO:
+        case CompiledExpression::OP_MEMO_END:
+            break;
+        case CompiledExpression::OP_REDUCE: {
+            // Пределы и внешние переменные суммы должны быть числами
+            top--;
+            std::vector<double> scalars(program.variables.size());
+            bool scalar = values[top - 1].isScalar() && values[top].isScalar();
+            for (size_t k = 0; k < scalars.size(); k++) {
+                scalar = scalar && variables[k].isScalar();
+                scalars[k] = variables[k].data()[0];
             }
+            double value = 0.0;
+            code = scalar
+                    ? reduce(program.reductions[instruction.arg], values[top - 1].data()[0], values[top].data()[0],
+                             scalars.data(), nullptr, value)
+                    : CalculationError::DIMENSION_MISMATCH;
+            values[top - 1] = Matrix::scalar(value);
+            break;
+        }
+        }
+        if (code != CalculationError::NONE) {
+            return fail(code, pc);
         }
     }
 
-    // Добавляем оставшиеся операторы
-    while (!operators.empty()) {
-        output.push_back(operators.top());
-        operators.pop();
-    }
+    return values[0];
+}
 
-    return output;
+void ExpressionCalculator::evaluateBatch(const CompiledExpression &program,
+                                         const std::vector<const double*> &columns,
+                                         size_t count, double *out,
+                                         const std::atomic<bool> *cancel) const {
+
+    evaluateBatch(program, columns, count, std::vector<double*>(1, out), cancel);
 }
 
-double ExpressionCalculator::evaluateRPN(const std::vector<std::string> &rpn) const {
+void ExpressionCalculator::evaluateBatch(const CompiledExpression &program,
+                                         const std::vector<const double*> &columns,
+                                         size_t count, const std::vector<double*> &outputs,
+                                         const std::atomic<bool> *cancel) const {
+
+    if (columns.size() != program.variables.size()) {
+        throw std::invalid_argument("Variable count mismatch");
+    }
+    if (outputs.size() != program.outputCount) {
+        throw std::invalid_argument("Output count mismatch");
+    }
+
+    INSTRUMENT_STAGE(STAGE_EVALUATE_BATCH);
+    INSTRUMENT_STACK_DEPTH(program.maxStackDepth);
+
+    if (hasMatrixOperations(program)) {
+        for (double* output : outputs) {
+            std::fill(output, output + count, std::numeric_limits<double>::quiet_NaN());
+        }
+        return;
+    }
+
+    // Функции (включая варианты для градусов) найдены при компиляции,
+    // так что в цикле по точкам нет ни поиска, ни проверки режима углов
+    const std::vector<const BuiltinFunction*>& callTable = program.calls;
+
+    const size_t BLOCK = 256;
+    std::vector<double> stack(program.maxStackDepth * BLOCK);
+    std::vector<double> slots(2 * program.sinCosSlots * BLOCK);
+    std::vector<double> shared(program.slotCount * BLOCK);
+    std::vector<double> denominator(program.polynomials.empty() ? 0 : BLOCK);
 
-    std::stack<double> values;
+    for (size_t start = 0; start < count; start += BLOCK) {
+        size_t n = std::min(BLOCK, count - start);
+        size_t top = 0;
 
-    for (const std::string& token : rpn) {
-        if (isNumber(token)) {
-            values.push(std::stod(token));
-        } else if (token.length() == 1 && isOperator(token[0])) {
-            if (values.size() < 2) {
-                throw std::runtime_error("Invalid expression");
+        for (const CompiledExpression::Instruction& instruction : program.code) {
+            double* v = stack.data() + top * BLOCK;
+
+            switch (instruction.op) {
+            case CompiledExpression::OP_CONST:
+                std::fill(v, v + n, program.constants[instruction.arg]);
+                top++;
+                break;
+            case CompiledExpression::OP_VAR:
+                std::copy(columns[instruction.arg] + start, columns[instruction.arg] + start + n, v);
+                top++;
+                break;
+            case CompiledExpression::OP_IMAG:
+                std::fill(v, v + n, std::numeric_limits<double>::quiet_NaN());
+                top++;
+                break;
+            case CompiledExpression::OP_CALL: {
+                const BuiltinFunction* func = callTable[instruction.arg];
+                INSTRUMENT_FUNCTION_CALLS(&func->real, n);
+                v -= BLOCK;
+                if (func->array) {
+                    func->array(v, v, n);
+                } else {
+                    for (size_t j = 0; j < n; j++) {
+                        v[j] = func->real(v[j]);
+                    }
+                }
+                break;
+            }
+            case CompiledExpression::OP_SINCOS: {
+                const CompiledExpression::SinCosCall& call = program.sinCos[instruction.arg];
+                double* slotSin = slots.data() + 2 * call.slot * BLOCK;
+                double* slotCos = slotSin + BLOCK;
+                v -= BLOCK;
+                if (call.first) {
+                    if (program.angleMode == ANGLE_RADIANS) {
+                        trigSinCosArray(v, slotSin, slotCos, n);
+                    } else {
+                        for (size_t j = 0; j < n; j++) {
+                            sinCosByMode(program.angleMode, v[j], slotSin[j], slotCos[j]);
+                        }
+                    }
+                }
+                std::copy(call.cosine ? slotCos : slotSin, (call.cosine ? slotCos : slotSin) + n, v);
+                break;
+            }
+            case CompiledExpression::OP_STORE:
+                std::copy(v - BLOCK, v - BLOCK + n, shared.data() + instruction.arg * BLOCK);
+                break;
+            case CompiledExpression::OP_LOAD:
+                std::copy(shared.data() + instruction.arg * BLOCK, shared.data() + instruction.arg * BLOCK + n, v);
+                top++;
+                break;
+            case CompiledExpression::OP_OUTPUT:
+                // Результат очередной формулы уходит в свой выход, пока блок в кэше
+                std::copy(v - BLOCK, v - BLOCK + n, outputs[instruction.arg] + start);
+                top--;
+                break;
+            case CompiledExpression::OP_MEMO:
+            case CompiledExpression::OP_MEMO_END:
+                // Значения в блоке разные, кэш подвыражений не нужен
+                break;
+            case CompiledExpression::OP_POLY: {
+                const CompiledExpression::Polynomial& polynomial = program.polynomials[instruction.arg];
+                const double* c = program.constants.data() + polynomial.first;
+                v -= BLOCK;
+                if (polynomial.denominatorDegree) {
+                    double* q = denominator.data();
+                    polynomialArray(c + polynomial.degree + 3, polynomial.denominatorDegree, polynomial.scheme, v, q, n);
+                    polynomialArray(c, polynomial.degree, polynomial.scheme, v, v, n);
+                    size_t j = 0;
+                    for (; j + simd::width <= n; j += simd::width) simd::store(v + j, simd::load(v + j) / simd::load(q + j));
+                    for (; j < n; j++) v[j] /= q[j];
+                } else {
+                    polynomialArray(c, polynomial.degree, polynomial.scheme, v, v, n);
+                }
+                break;
+            }
+            case CompiledExpression::OP_REDUCE: {
+                // Каждая строка - своя сумма или интеграл; тело внутри вычисляется пакетно
+                double* lower = v - 2 * BLOCK;
+                const double* upper = v - BLOCK;
+                std::vector<double> row(program.variables.size());
+                for (size_t j = 0; j < n; j++) {
+                    for (size_t k = 0; k < row.size(); k++) {
+                        row[k] = columns[k][start + j];
+                    }
+                    // Деление на ноль в слагаемом - как 1/0 в пакете: остаётся
+                    // значение IEEE; остальные ошибки дают NaN
+                    double value = 0.0;
+                    CalculationError::Code code = reduce(program.reductions[instruction.arg], lower[j], upper[j],
+                                                         row.data(), cancel, value);
+                    if (code != CalculationError::NONE && code != CalculationError::DIVISION_BY_ZERO) {
+                        value = std::numeric_limits<double>::quiet_NaN();
+                    }
+                    lower[j] = value;
+                }
+                top--;
+                break;
+            }
+            default: {
+                double* a = v - 2 * BLOCK;
+                const double* b = v - BLOCK;
+                size_t j = 0;
+                switch (instruction.op) {
+                case CompiledExpression::OP_ADD:
+                    for (; j + simd::width <= n; j += simd::width) simd::store(a + j, simd::load(a + j) + simd::load(b + j));
+                    for (; j < n; j++) a[j] += b[j];
+                    break;
+                case CompiledExpression::OP_SUB:
+                    for (; j + simd::width <= n; j += simd::width) simd::store(a + j, simd::load(a + j) - simd::load(b + j));
+                    for (; j < n; j++) a[j] -= b[j];
+                    break;
+                case CompiledExpression::OP_MUL:
+                    for (; j + simd::width <= n; j += simd::width) simd::store(a + j, simd::load(a + j) * simd::load(b + j));
+                    for (; j < n; j++) a[j] *= b[j];
+                    break;
+                case CompiledExpression::OP_DIV:
+                    for (; j + simd::width <= n; j += simd::width) simd::store(a + j, simd::load(a + j) / simd::load(b + j));
+                    for (; j < n; j++) a[j] /= b[j];
+                    break;
+                default:
+                    for (; j < n; j++) a[j] = std::pow(a[j], b[j]);
+                    break;
+                }
+                top--;
+                break;
             }
-            double b = values.top(); values.pop();
-            double a = values.top(); values.pop();
-            values.push(applyOperation(a, b, token[0]));
-        } else if (isFunction(token)) {
-            if (values.empty()) {
-                throw std::runtime_error("Invalid expression for function " + token);
             }
-            double arg = values.top(); values.pop();
-            values.push(applyFunction(token, arg));
-        } else {
-            throw std::runtime_error("Invalid token: " + token);
         }
+
+        if (program.outputCount == 1) {
+            std::copy(stack.data(), stack.data() + n, outputs[0] + start);
+        }
+    }
+}
+
+void ExpressionCalculator::evaluateComplexBatch(const CompiledExpression &program,
+                                                const std::vector<const double*> &re,
+                                                const std::vector<const double*> &im,
+                                                size_t count, double *outRe, double *outIm) const {
+
+    if (re.size() != program.variables.size() || im.size() != program.variables.size()) {
+        throw std::invalid_argument("Variable count mismatch");
+    }
+    if (program.outputCount != 1) {
+        throw std::invalid_argument("Complex batch supports single-output programs only");
+    }
+
+    INSTRUMENT_STAGE(STAGE_EVALUATE_BATCH);
+    INSTRUMENT_STACK_DEPTH(program.maxStackDepth);
+
+    if (hasMatrixOperations(program)) {
+        std::fill(outRe, outRe + count, std::numeric_limits<double>::quiet_NaN());
+        std::fill(outIm, outIm + count, std::numeric_limits<double>::quiet_NaN());
+        return;
     }
 
-    if (values.size() != 1) {
-        throw std::runtime_error("Invalid expression");
+    // Функции найдены при компиляции; матричных здесь быть не может
+    const std::vector<const BuiltinFunction*>& callTable = program.calls;
+    for (size_t k = 0; k < callTable.size(); k++) {
+        if (!callTable[k]) {
+            throw std::runtime_error("Unknown function: " + program.functions[k]);
+        }
     }
 
-    return values.top();
+    // Стек из массивов: каждый уровень хранит блок значений в формате SoA.
+    // Блок помещается в кэш L1 вместе со всем стеком
+    const size_t BLOCK = 256;
+    std::vector<double> stackRe(program.maxStackDepth * BLOCK);
+    std::vector<double> stackIm(program.maxStackDepth * BLOCK);
+    std::vector<double> sharedRe(program.slotCount * BLOCK);
+    std::vector<double> sharedIm(program.slotCount * BLOCK);
+    std::vector<double> denominatorRe(program.polynomials.empty() ? 0 : BLOCK);
+    std::vector<double> denominatorIm(program.polynomials.empty() ? 0 : BLOCK);
+
+    for (size_t start = 0; start < count; start += BLOCK) {
+        size_t n = std::min(BLOCK, count - start);
+        size_t top = 0;
+
+        for (const CompiledExpression::Instruction& instruction : program.code) {
+            double* r = stackRe.data() + top * BLOCK;
+            double* m = stackIm.data() + top * BLOCK;
+
+            switch (instruction.op) {
+            case CompiledExpression::OP_CONST:
+                std::fill(r, r + n, program.constants[instruction.arg]);
+                std::fill(m, m + n, 0.0);
+                top++;
+                break;
+            case CompiledExpression::OP_VAR:
+                std::copy(re[instruction.arg] + start, re[instruction.arg] + start + n, r);
+                std::copy(im[instruction.arg] + start, im[instruction.arg] + start + n, m);
+                top++;
+                break;
+            case CompiledExpression::OP_IMAG:
+                std::fill(r, r + n, 0.0);
+                std::fill(m, m + n, 1.0);
+                top++;
+                break;
+            case CompiledExpression::OP_CALL:
+            case CompiledExpression::OP_SINCOS: {
+                const BuiltinFunction* func = instruction.op == CompiledExpression::OP_CALL
+                        ? callTable[instruction.arg]
+                        : program.sinCos[instruction.arg].cosine ? program.cosFunction : program.sinFunction;
+                INSTRUMENT_FUNCTION_CALLS(&func->complex, n);
+                r -= BLOCK;
+                m -= BLOCK;
+                if (func->complexArray) {
+                    func->complexArray(r, m, r, m, n);
+                } else {
+                    for (size_t j = 0; j < n; j++) {
+                        std::complex<double> z = func->complex(std::complex<double>(r[j], m[j]));
+                        r[j] = z.real();
+                        m[j] = z.imag();
+                    }
+                }
+                break;
+            }
+            case CompiledExpression::OP_STORE:
+                std::copy(r - BLOCK, r - BLOCK + n, sharedRe.data() + instruction.arg * BLOCK);
+                std::copy(m - BLOCK, m - BLOCK + n, sharedIm.data() + instruction.arg * BLOCK);
+                break;
+            case CompiledExpression::OP_LOAD:
+                std::copy(sharedRe.data() + instruction.arg * BLOCK, sharedRe.data() + instruction.arg * BLOCK + n, r);
+                std::copy(sharedIm.data() + instruction.arg * BLOCK, sharedIm.data() + instruction.arg * BLOCK + n, m);
+                top++;
+                break;
+            case CompiledExpression::OP_MEMO:
+            case CompiledExpression::OP_MEMO_END:
+                break;
+            case CompiledExpression::OP_POLY: {
+                const CompiledExpression::Polynomial& polynomial = program.polynomials[instruction.arg];
+                const double* c = program.constants.data() + polynomial.first;
+                r -= BLOCK;
+                m -= BLOCK;
+                if (polynomial.denominatorDegree) {
+                    double* qRe = denominatorRe.data();
+                    double* qIm = denominatorIm.data();
+                    polynomialComplexArray(c + polynomial.degree + 3, polynomial.denominatorDegree, polynomial.scheme,
+                                           r, m, qRe, qIm, n);
+                    polynomialComplexArray(c, polynomial.degree, polynomial.scheme, r, m, r, m, n);
+                    complexDiv(r, m, qRe, qIm, r, m, n);
+                } else {
+                    polynomialComplexArray(c, polynomial.degree, polynomial.scheme, r, m, r, m, n);
+                }
+                break;
+            }
+            case CompiledExpression::OP_REDUCE: {
+                // Как в evaluateComplexRPN: только действительные пределы и переменные
+                double* lowerRe = r - 2 * BLOCK;
+                double* lowerIm = m - 2 * BLOCK;
+                const double* upperRe = r - BLOCK;
+                const double* upperIm = m - BLOCK;
+                std::vector<double> row(program.variables.size());
+                for (size_t j = 0; j < n; j++) {
+                    bool isReal = lowerIm[j] == 0.0 && upperIm[j] == 0.0;
+                    for (size_t k = 0; k < row.size(); k++) {
+                        row[k] = re[k][start + j];
+                        isReal = isReal && im[k][start + j] == 0.0;
+                    }
+                    double value = std::numeric_limits<double>::quiet_NaN();
+                    CalculationError::Code code = isReal
+                            ? reduce(program.reductions[instruction.arg], lowerRe[j], upperRe[j], row.data(),
+                                     nullptr, value)
+                            : CalculationError::NONE;
+                    if (code != CalculationError::NONE && code != CalculationError::DIVISION_BY_ZERO) {
+                        value = std::numeric_limits<double>::quiet_NaN();
+                    }
+                    lowerRe[j] = value;
+                    lowerIm[j] = 0.0;
+                }
+                top--;
+                break;
+            }
+            default: {
+                // Бинарная операция: a = stack[top-2], b = stack[top-1]
+                double* aRe = r - 2 * BLOCK;
+                double* aIm = m - 2 * BLOCK;
+                const double* bRe = r - BLOCK;
+                const double* bIm = m - BLOCK;
+                switch (instruction.op) {
+                case CompiledExpression::OP_ADD: complexAdd(aRe, aIm, bRe, bIm, aRe, aIm, n); break;
+                case CompiledExpression::OP_SUB: complexSub(aRe, aIm, bRe, bIm, aRe, aIm, n); break;
+                case CompiledExpression::OP_MUL: complexMul(aRe, aIm, bRe, bIm, aRe, aIm, n); break;
+                case CompiledExpression::OP_DIV: complexDiv(aRe, aIm, bRe, bIm, aRe, aIm, n); break;
+                default:
+                    for (size_t j = 0; j < n; j++) {
+                        std::complex<double> b(bRe[j], bIm[j]);
+                        std::complex<double> z = (b.imag() == 0.0 && b.real() == std::floor(b.real()) &&
+                                                  std::abs(b.real()) <= 64)
+                                ? integerPower(std::complex<double>(aRe[j], aIm[j]), static_cast<int>(b.real()))
+                                : std::pow(std::complex<double>(aRe[j], aIm[j]), b);
+                        aRe[j] = z.real();
+                        aIm[j] = z.imag();
+                    }
+                    break;
+                }
+                top--;
+                break;
+            }
+            }
+        }
+
+        std::copy(stackRe.data(), stackRe.data() + n, outRe + start);
+        std::copy(stackIm.data(), stackIm.data() + n, outIm + start);
+    }
 }
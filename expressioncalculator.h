@@ -1,42 +1,339 @@
 #ifndef EXPRESSIONCALCULATOR_H
 #define EXPRESSIONCALCULATOR_H
 
+#include <atomic>
 #include <string>
 #include <stack>
 #include <cctype>
 #include <cmath>
+#include <complex>
 #include <sstream>
 #include <stdexcept>
 #include <vector>
 #include <map>
 #include <functional>
 
+#include "compiledexpression.h"
+#include "calculationerror.h"
+#include "expressiontree.h"
+#include "matrix.h"
+
+// Строки статических таблиц встроенных функций (expressioncalculator.cpp)
+struct BuiltinFunction;
+struct BuiltinMatrixFunction;
+class ExactNumber;
+
 class ExpressionCalculator
 {
-    std::map<std::string, std::function<double(double)>> functions;
+public:
+    // Состояние инкрементального разбора и кэш подвыражений (определены ниже)
+    class IncrementalParse;
+    class MemoCache;
+
+private:
+    // Единицы углов для вновь компилируемых выражений
+    AngleMode angleMode = ANGLE_RADIANS;
 private:
-    // Удаление пробелов из строки
-    std::string removeSpaces(const std::string&) const;
+    // Токен ОПН с положением в строке без пробелов
+    struct Token {
+        std::string text;
+        size_t offset;
+        size_t length;
+        bool reduction;     // sum/prod/integral: offset и length охватывают всю конструкцию
+    };
+
+    // Удаление пробелов из строки; positions получает исходные позиции символов
+    std::string removeSpaces(const std::string&, std::vector<size_t>* positions = nullptr) const;
+    // Проверка баланса скобок
+    bool checkParentheses(const std::string&, CalculationError&) const;
     // Проверка, является ли символ оператором
     bool isOperator(char ) const;
     // Получаем приоритет оператора
-    int getPrecedence(char );
-    // Применяем оператор к двум операндам
+    int getPrecedence(char ) const;
+    // Применяем оператор к двум операндам (деление на ноль проверяет вызывающий)
     double applyOperation(double , double , char ) const;
-    double applyFunction(const std::string&, double) const;
+    std::complex<double> applyComplexOperation(std::complex<double>, std::complex<double>, char) const;
     bool isFunction(const std::string &str) const;
+    // sum, prod, integral: разбираются как одна конструкция с четырьмя аргументами
+    bool isReduction(const std::string&) const;
+    // Имя варианта функции для заданных единиц углов (sin -> sin#deg)
+    static std::string angleVariant(const std::string&, AngleMode);
+    // Поиск во встроенных таблицах по имени; nullptr, если функции нет
+    static const BuiltinFunction* findFunction(const std::string&);
+    static const BuiltinMatrixFunction* findMatrixFunction(const std::string&);
     // Проверяем, является ли строка числом
     bool isNumber(const std::string&) const;
     bool isLetter(char) const;
+    // Состояние перевода в ОПН на границе токенов: следующий символ,
+    // стек операторов (вершина - последний) и открытые скобки
+    struct RPNState {
+        size_t position = 0;
+        std::vector<Token> operators;
+        std::vector<char> brackets;
+    };
+
     // Конвертируем выражение в обратную польскую нотацию (ОПН)
-    std::vector<std::string> toRPN(const std::string&);
-    // Вычисляем выражение в ОПН
-    double evaluateRPN(const std::vector<std::string>&) const;
+    bool toRPN(const std::string&, const std::vector<std::string>& variables,
+               std::vector<Token>& output, CalculationError&) const;
+    // Один токен с позиции state.position (число, имя или конструкция
+    // sum/prod/integral целиком, иначе один символ); position переходит
+    // за токен. Просмотр вперёд - не дальше символа position
+    bool toRPNStep(const std::string&, const std::vector<std::string>& variables,
+                   RPNState&, std::vector<Token>& output, CalculationError&) const;
+    // Вывод операторов, оставшихся в стеке в конце строки
+    void finishRPN(RPNState&, std::vector<Token>& output) const;
+    // Поддерево для одного токена ОПН на стеке поддеревьев
+    bool buildNode(const Token&, const std::string& expression,
+                   const std::vector<std::string>& variables, const std::vector<size_t>& positions,
+                   ExpressionTree&, std::vector<const ExpressionNode*>& stack, CalculationError&) const;
+    // Построение дерева из ОПН с теми же проверками, что и при вычислении стека.
+    // begin и length - фрагмент expression, из которого получена ОПН
+    bool buildTree(const std::vector<Token>&, const std::string& expression,
+                   const std::vector<std::string>& variables, const std::vector<size_t>& positions,
+                   size_t begin, size_t length,
+                   ExpressionTree&, const ExpressionNode*& root, CalculationError&) const;
+    // ОПН и дерево для фрагмента строки без пробелов (аргумента sum/prod/integral)
+    bool parseFragment(const std::string& expression, size_t begin, size_t length,
+                       const std::vector<std::string>& variables, const std::vector<size_t>& positions,
+                       ExpressionTree&, const ExpressionNode*& node, CalculationError&) const;
+    // Разделители аргументов конструкции sum/prod/integral (скобки и запятые,
+    // пять позиций) и имя связанной переменной
+    bool reductionArguments(const std::string& expression, const Token&,
+                            std::vector<size_t>& separators, std::string& name, CalculationError&) const;
+    bool buildReduction(const std::string& expression, const Token&,
+                        const std::vector<std::string>& variables, const std::vector<size_t>& positions,
+                        ExpressionTree&, const ExpressionNode*& node, CalculationError&) const;
+    // Сумма, произведение или интеграл тела по пределам lower, upper;
+    // values - значения переменных программы, в которую входит конструкция
+    CalculationError::Code reduce(const CompiledExpression::Reduction&, double lower, double upper,
+                                  const double* values, const std::atomic<bool>* cancel,
+                                  double& result) const;
+    // Вычисляем скомпилированное выражение; с cache - подвыражения OP_MEMO через кэш
+    double evaluateRPN(const CompiledExpression&, const double*, CalculationError&,
+                       const std::atomic<bool>* cancel = nullptr, MemoCache* cache = nullptr) const;
+    std::complex<double> evaluateComplexRPN(const CompiledExpression&, const std::complex<double>*,
+                                            CalculationError&) const;
+    Matrix evaluateMatrixRPN(const CompiledExpression&, const Matrix*, CalculationError&) const;
+    // Точный режим: ОПН фрагмента строки без пробелов (позиции токенов -
+    // в строке) и её вычисление над точными числами
+    bool exactFragment(const std::string& expression, size_t begin, size_t length,
+                       const std::vector<std::string>& variables, std::vector<Token>& rpn,
+                       CalculationError&) const;
+    bool evaluateExactRPN(const std::vector<Token>&, const std::string& expression,
+                          const std::vector<std::string>& variables, const std::vector<ExactNumber>& values,
+                          ExactNumber& result, CalculationError&, const std::atomic<bool>* cancel) const;
+    bool evaluateExactReduction(const Token&, const std::string& expression,
+                                const std::vector<std::string>& variables, const std::vector<ExactNumber>& values,
+                                ExactNumber& result, CalculationError&, const std::atomic<bool>* cancel) const;
 public:
     ExpressionCalculator();
 
+    void setAngleMode(AngleMode mode);
+    AngleMode getAngleMode() const;
+
     // Основная функция для вычисления выражения
     double calculate(const std::string&);
+    // Вычисление в комплексном режиме (sqrt(-1), ln(-2), константа i)
+    std::complex<double> calculateComplex(const std::string&);
+    // Матричный режим: литералы [1,2;3,4], поэлементные операции и функции
+    // с расширением размеров (матрица + число, строка * столбец),
+    // det, inv, transpose, matmul(A, B), solve(A, B) и статистика по всем
+    // элементам: mean, stddev, median, percentile(A, p), min, max,
+    // correlation(A, B)
+    Matrix calculateMatrix(const std::string&);
+    bool tryCalculateMatrix(const std::string&, Matrix& result, CalculationError& error);
+
+    // Вычисление без исключений: при ошибке возвращает false
+    // и заполняет error кодом и позицией ошибочного фрагмента
+    bool tryCalculate(const std::string&, double& result, CalculationError& error);
+
+    // Точный режим: числа и результаты + - * / и ^ с целым показателем -
+    // несократимые дроби длинных целых (1/3*3 = 1, 0.1 + 0.2 = 0.3).
+    // Иррациональная функция, pi, e и дробная степень дают приближённое
+    // значение long double, и дальше вычисление идёт приближённо.
+    // sum и prod с точными пределами до MAX_EXACT_TERMS слагаемых точны,
+    // integral и более длинные суммы вычисляются как в tryCalculate.
+    // Ошибки разбора те же, что у tryCalculate; cancel - как у tryEvaluate
+    static const size_t MAX_EXACT_TERMS = 100000;
+    bool tryCalculateExact(const std::string&, ExactNumber& result, CalculationError& error,
+                           const std::atomic<bool>* cancel = nullptr) const;
+
+    // Пакетное вычисление набора выражений: ошибки записываются построчно,
+    // результат ошибочной строки - NaN
+    void calculateBatch(const std::vector<std::string>& expressions,
+                        std::vector<double>& results,
+                        std::vector<CalculationError>& errors);
+
+    // Компиляция выражения с переменными в программу,
+    // которую можно многократно вычислять в любом режиме
+    // Компиляция не меняет состояние калькулятора и может выполняться
+    // из нескольких потоков одновременно
+    CompiledExpression compile(const std::string&, const std::vector<std::string>& variables = {}) const;
+    bool tryCompile(const std::string&, const std::vector<std::string>& variables,
+                    CompiledExpression& program, CalculationError& error) const;
+
+    // Разбор в дерево: структурно одинаковые поддеревья хранятся один раз,
+    // в том числе между разными выражениями, разобранными в одно дерево
+    bool tryParse(const std::string&, const std::vector<std::string>& variables,
+                  ExpressionTree& tree, const ExpressionNode*& root, CalculationError& error) const;
+    // Разбор строки, которая меняется понемногу (набор в окне калькулятора):
+    // токены, стек операторов и поддеревья неизменного начала строки берутся
+    // из прошлого разбора в state, заново читается только изменённый хвост.
+    // Результат и ошибки те же, что у tryParse без переменных, положения
+    // вершин - в текущей строке; root живёт в state.tree() до следующего вызова
+    bool tryParseIncremental(const std::string&, IncrementalParse& state,
+                             const ExpressionNode*& root, CalculationError& error) const;
+    // Перевод дерева в программу: общие подвыражения вычисляются один раз,
+    // sin и cos одного аргумента - одним sincos.
+    // variables должен содержать все переменные, входящие в выражение
+    void lower(const ExpressionTree&, const ExpressionNode* root,
+               const std::vector<std::string>& variables, CompiledExpression& program) const;
+    // Несколько корней - программа с несколькими выходами
+    void lower(const ExpressionTree&, const std::vector<const ExpressionNode*>& roots,
+               const std::vector<std::string>& variables, CompiledExpression& program) const;
+
+    // Совмещённая компиляция набора выражений над общими переменными:
+    // общие подвыражения разных формул вычисляются один раз, а все
+    // результаты получаются за один проход по блоку входных строк.
+    // При ошибке failedExpression - номер ошибочного выражения
+    CompiledExpression compileFused(const std::vector<std::string>& expressions,
+                                    const std::vector<std::string>& variables) const;
+    bool tryCompileFused(const std::vector<std::string>& expressions,
+                         const std::vector<std::string>& variables,
+                         CompiledExpression& program, CalculationError& error,
+                         size_t& failedExpression) const;
+
+    // Проверка программы, полученной не от компилятора (например, из файла):
+    // коды операций и номера в допустимых пределах, функции известны, стек
+    // не опустошается и не выходит за maxStackDepth, ячейки читаются после записи.
+    // Вычислять непроверенную программу из внешнего источника нельзя
+    static bool checkProgram(const CompiledExpression&);
+    // Заполнение calls, sinFunction и cosFunction по именам функций и режиму
+    // углов программы (без тел sum/prod/integral). Компилятор вызывает его
+    // сам; программу, собранную иначе, нужно разрешить перед checkProgram
+    static void resolveFunctions(CompiledExpression&);
+
+    // Текст программы для диагностики, инструкция в строке: операнды по именам,
+    // для OP_POLY - найденный многочлен или дробь от вершины стека u, схема
+    // и степень; тела sum/prod/integral - с отступом под своей инструкцией
+    static std::string dump(const CompiledExpression&);
+
+    double evaluate(const CompiledExpression&, const std::vector<double>& values = {}) const;
+    // Вычисление без исключений; позиция ошибки берётся из исходного выражения программы.
+    // Установленный флаг cancel прерывает sum/prod/integral с ошибкой CANCELLED
+    bool tryEvaluate(const CompiledExpression&, const std::vector<double>& values,
+                     double& result, CalculationError& error,
+                     const std::atomic<bool>* cancel = nullptr) const;
+    // То же с кэшем подвыражений, зависящих не от всех переменных (OP_MEMO):
+    // при переборе одной переменной остальная часть формулы берётся из кэша
+    bool tryEvaluate(const CompiledExpression&, const std::vector<double>& values, MemoCache& cache,
+                     double& result, CalculationError& error,
+                     const std::atomic<bool>* cancel = nullptr) const;
+    std::complex<double> evaluateComplex(const CompiledExpression&,
+                                         const std::vector<std::complex<double>>& values = {}) const;
+    Matrix evaluateMatrix(const CompiledExpression&, const std::vector<Matrix>& values = {}) const;
+    bool tryEvaluateMatrix(const CompiledExpression&, const std::vector<Matrix>& values,
+                           Matrix& result, CalculationError& error) const;
+
+    // Пакетное вычисление над столбцами значений переменных:
+    // columns[k][j] - j-е значение k-й переменной.
+    // Ошибки не выбрасываются, а дают inf/nan в результате (в том числе при отмене
+    // и для программ с матрицами)
+    void evaluateBatch(const CompiledExpression&,
+                       const std::vector<const double*>& columns,
+                       size_t count, double* out,
+                       const std::atomic<bool>* cancel = nullptr) const;
+    // То же для программы с несколькими выходами: outputs[k][j] - k-й результат j-й строки
+    void evaluateBatch(const CompiledExpression&,
+                       const std::vector<const double*>& columns,
+                       size_t count, const std::vector<double*>& outputs,
+                       const std::atomic<bool>* cancel = nullptr) const;
+
+    // Пакетное комплексное вычисление над сеткой значений в формате SoA:
+    // re[k][j], im[k][j] - j-е значение k-й переменной.
+    // Ошибки (деление на ноль, матрицы и т.п.) не выбрасываются, а дают inf/nan в результате.
+    // Арифметика, exp, ln, log, sqrt, sin и cos (в радианах) считаются над
+    // массивами (complexkernels.h) и могут отличаться от evaluateComplex
+    // на несколько ulp; остальные функции - поэлементно, как в evaluateComplex
+    void evaluateComplexBatch(const CompiledExpression&,
+                              const std::vector<const double*>& re,
+                              const std::vector<const double*>& im,
+                              size_t count, double* outRe, double* outIm) const;
+};
+
+// Состояние для tryParseIncremental. После каждого токена запоминаются
+// стек операторов и стек поддеревьев; следующий разбор продолжается с
+// последней такой точки, до которой строка не изменилась. Дерево общее для
+// всех версий строки, поэтому узел хранит положение в той версии, где он
+// появился впервые; позиции ошибок разбора относятся к текущей строке.
+// Дерево очищается, когда вырастает, и при смене единиц углов
+class ExpressionCalculator::IncrementalParse
+{
+public:
+    IncrementalParse() = default;
+
+    const ExpressionTree& tree() const { return expressionTree; }
+    // Символов строки без пробелов, взятых из прошлого разбора при последнем вызове
+    size_t reusedCharacters() const { return reused; }
+    void clear();
+
+private:
+    friend class ExpressionCalculator;
+
+    // Больше узлов - дерево строится заново
+    static const size_t MAX_TREE_NODES = 4096;
+
+    // Состояние после токена, кончающегося перед символом rpn.position
+    struct Checkpoint {
+        RPNState rpn;
+        size_t outputSize;
+        std::vector<const ExpressionNode*> stack;
+    };
+
+    std::string source;
+    std::vector<size_t> positions;
+    std::vector<Token> output;
+    // checkpoints[0] - начало строки
+    std::vector<Checkpoint> checkpoints;
+    ExpressionTree expressionTree;
+    // Для вершины (по id) - номер токена output, на место которого она
+    // перенесена в текущей версии строки; NOT_PLACED - ещё не встречалась
+    static const size_t NOT_PLACED = static_cast<size_t>(-1);
+    std::vector<size_t> placed;
+
+    // Результат для той же строки
+    bool parsed = false;
+    const ExpressionNode* root = nullptr;
+    CalculationError error;
+    size_t reused = 0;
+};
+
+// Кэш значений подвыражений OP_MEMO между вызовами tryEvaluate: подвыражение
+// вычисляется заново, только если изменилась (побитово) одна из его
+// переменных. Ошибка вычисления в кэш не попадает. Кэш относится к одной
+// программе и используется одним потоком; программу, изменённую на том же
+// месте в памяти, нужно вычислять после clear()
+class ExpressionCalculator::MemoCache
+{
+public:
+    MemoCache() = default;
+
+    void clear();
+    // Попадания и промахи с последнего clear()
+    size_t hits() const { return hitCount; }
+    size_t misses() const { return missCount; }
+
+private:
+    friend class ExpressionCalculator;
+
+    const CompiledExpression* program = nullptr;
+    // По подвыражениям: значение действительно и само значение
+    std::vector<unsigned char> valid;
+    std::vector<double> results;
+    // Параллельно program->memoIndices: значения переменных, затем ячеек
+    std::vector<double> saved;
+    size_t hitCount = 0;
+    size_t missCount = 0;
 };
 
 #endif // EXPRESSIONCALCULATOR_H
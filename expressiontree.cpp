@@ -0,0 +1,240 @@
+#include "expressiontree.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+
+bool ExpressionTree::Key::operator==(const Key &other) const {
+
+    return kind == other.kind && op == other.op && index == other.index
+            && bits == other.bits && left == other.left && right == other.right && body == other.body;
+}
+
+size_t ExpressionTree::KeyHash::operator()(const Key &key) const {
+
+    size_t hash = std::hash<unsigned long long>()(key.bits);
+    hash = hash * 31 + key.kind;
+    hash = hash * 31 + static_cast<unsigned char>(key.op);
+    hash = hash * 31 + key.index;
+    hash = hash * 31 + std::hash<const void*>()(key.left);
+    hash = hash * 31 + std::hash<const void*>()(key.right);
+    hash = hash * 31 + std::hash<const void*>()(key.body);
+    return hash;
+}
+
+ExpressionTree::ExpressionTree()
+    : count(0)
+{
+}
+
+void ExpressionTree::clear() {
+
+    chunks.clear();
+    count = 0;
+    nodes.clear();
+    variableNames.clear();
+    functionNames.clear();
+    variableIndices.clear();
+    functionIndices.clear();
+}
+
+void ExpressionTree::place(const ExpressionNode *node, unsigned int offset, unsigned int length) {
+
+    // Вершины выделены в арене дерева без const
+    ExpressionNode* mutableNode = const_cast<ExpressionNode*>(node);
+    mutableNode->offset = offset;
+    mutableNode->length = length;
+}
+
+const ExpressionNode* ExpressionTree::intern(const Key &key, double value, unsigned int offset, unsigned int length) {
+
+    auto it = nodes.find(key);
+    if (it != nodes.end()) {
+        return it->second;
+    }
+
+    if (count % CHUNK == 0) {
+        chunks.emplace_back(new ExpressionNode[CHUNK]);
+    }
+    ExpressionNode* node = &chunks.back()[count % CHUNK];
+    node->kind = key.kind;
+    node->op = key.op;
+    node->index = key.index;
+    node->value = value;
+    node->left = key.left;
+    node->right = key.right;
+    node->body = key.body;
+    node->offset = offset;
+    node->length = length;
+    node->id = static_cast<unsigned int>(count++);
+
+    nodes.emplace(key, node);
+    return node;
+}
+
+unsigned int ExpressionTree::nameIndex(std::vector<std::string> &names,
+                                       std::unordered_map<std::string, unsigned int> &indices,
+                                       const std::string &name) {
+
+    auto it = indices.find(name);
+    if (it != indices.end()) {
+        return it->second;
+    }
+    unsigned int index = static_cast<unsigned int>(names.size());
+    names.push_back(name);
+    indices.emplace(name, index);
+    return index;
+}
+
+const ExpressionNode* ExpressionTree::constant(double value, unsigned int offset, unsigned int length) {
+
+    Key key = { ExpressionNode::CONSTANT, 0, 0, 0, nullptr, nullptr, nullptr };
+    std::memcpy(&key.bits, &value, sizeof(value));
+    return intern(key, value, offset, length);
+}
+
+const ExpressionNode* ExpressionTree::variable(const std::string &name, unsigned int offset, unsigned int length) {
+
+    Key key = { ExpressionNode::VARIABLE, 0, nameIndex(variableNames, variableIndices, name), 0, nullptr, nullptr, nullptr };
+    return intern(key, 0.0, offset, length);
+}
+
+const ExpressionNode* ExpressionTree::imaginary(unsigned int offset, unsigned int length) {
+
+    Key key = { ExpressionNode::IMAGINARY, 0, 0, 0, nullptr, nullptr, nullptr };
+    return intern(key, 0.0, offset, length);
+}
+
+const ExpressionNode* ExpressionTree::binary(char op, const ExpressionNode *left, const ExpressionNode *right,
+                                             unsigned int offset, unsigned int length) {
+
+    // Свёртка констант: только операции, результат которых не зависит
+    // от режима вычислений и не требует сообщения об ошибке
+    if (left->kind == ExpressionNode::CONSTANT && right->kind == ExpressionNode::CONSTANT) {
+        switch (op) {
+        case '+': return constant(left->value + right->value, offset, length);
+        case '-': return constant(left->value - right->value, offset, length);
+        case '*': return constant(left->value * right->value, offset, length);
+        case '/':
+            if (right->value != 0) return constant(left->value / right->value, offset, length);
+            break;
+        default:
+            break;
+        }
+    }
+
+    Key key = { ExpressionNode::BINARY, op, 0, 0, left, right, nullptr };
+    return intern(key, 0.0, offset, length);
+}
+
+const ExpressionNode* ExpressionTree::call(const std::string &function, const ExpressionNode *argument,
+                                           unsigned int offset, unsigned int length) {
+
+    Key key = { ExpressionNode::CALL, 0, nameIndex(functionNames, functionIndices, function), 0, argument, nullptr, nullptr };
+    return intern(key, 0.0, offset, length);
+}
+
+const ExpressionNode* ExpressionTree::call(const std::string &function, const ExpressionNode *first,
+                                           const ExpressionNode *second, unsigned int offset, unsigned int length) {
+
+    Key key = { ExpressionNode::CALL, 0, nameIndex(functionNames, functionIndices, function), 0, first, second, nullptr };
+    return intern(key, 0.0, offset, length);
+}
+
+const ExpressionNode* ExpressionTree::reduction(char kind, const std::string &variable, const ExpressionNode *body,
+                                                const ExpressionNode *lower, const ExpressionNode *upper,
+                                                unsigned int offset, unsigned int length) {
+
+    Key key = { ExpressionNode::REDUCTION, kind, nameIndex(variableNames, variableIndices, variable), 0,
+                lower, upper, body };
+    return intern(key, 0.0, offset, length);
+}
+
+const ExpressionNode* ExpressionTree::findCall(const std::string &function, const ExpressionNode *argument) const {
+
+    auto name = functionIndices.find(function);
+    if (name == functionIndices.end()) {
+        return nullptr;
+    }
+    Key key = { ExpressionNode::CALL, 0, name->second, 0, argument, nullptr, nullptr };
+    auto it = nodes.find(key);
+    return it != nodes.end() ? it->second : nullptr;
+}
+
+// Приоритет вершины при печати: 4 - атом или вызов функции
+static int printPrecedence(const ExpressionNode *node) {
+
+    if (node->kind != ExpressionNode::BINARY) {
+        return node->kind == ExpressionNode::CONSTANT && node->value < 0 ? 0 : 4;
+    }
+    switch (node->op) {
+    case ',': case ';': return 4;   // литерал печатается в квадратных скобках
+    case '+': case '-': return 1;
+    case '*': case '/': return 2;
+    default: return 3;
+    }
+}
+
+std::string ExpressionTree::toString(const ExpressionNode *node) const {
+
+    switch (node->kind) {
+    case ExpressionNode::CONSTANT: {
+        // Кратчайшая запись, которая читается обратно в то же число
+        char text[32];
+        std::snprintf(text, sizeof(text), "%.15g", node->value);
+        if (std::strtod(text, nullptr) != node->value) {
+            std::snprintf(text, sizeof(text), "%.17g", node->value);
+        }
+        return text;
+    }
+    case ExpressionNode::VARIABLE:
+        return variableNames[node->index];
+    case ExpressionNode::IMAGINARY:
+        return "i";
+    case ExpressionNode::CALL: {
+        // Варианты для градусов печатаются под обычным именем
+        const std::string& name = functionNames[node->index];
+        std::string arguments = toString(node->left);
+        if (node->right) {
+            arguments += "," + toString(node->right);
+        }
+        return name.substr(0, name.find('#')) + "(" + arguments + ")";
+    }
+    case ExpressionNode::REDUCTION: {
+        const char* name = node->op == 's' ? "sum" : node->op == 'p' ? "prod" : "integral";
+        return std::string(name) + "(" + variableNames[node->index] + "," + toString(node->left) + ","
+                + toString(node->right) + "," + toString(node->body) + ")";
+    }
+    default:
+        break;
+    }
+
+    if (node->op == ',' || node->op == ';') {
+        // Склейки одного литерала печатаются внутри общих скобок;
+        // столбец внутри строки ([[1;2],3]) остаётся в своих
+        std::string parts[2];
+        const ExpressionNode* children[2] = { node->left, node->right };
+        for (int k = 0; k < 2; k++) {
+            parts[k] = toString(children[k]);
+            const ExpressionNode* child = children[k];
+            if (child->kind == ExpressionNode::BINARY && (child->op == ',' || (child->op == ';' && node->op == ';'))) {
+                parts[k] = parts[k].substr(1, parts[k].length() - 2);
+            }
+        }
+        return "[" + parts[0] + node->op + parts[1] + "]";
+    }
+
+    // Все операторы разбираются слева направо (включая ^), поэтому
+    // правый операнд того же приоритета берётся в скобки
+    int precedence = printPrecedence(node);
+    std::string left = toString(node->left);
+    std::string right = toString(node->right);
+    if (printPrecedence(node->left) < precedence) {
+        left = "(" + left + ")";
+    }
+    if (printPrecedence(node->right) <= precedence) {
+        right = "(" + right + ")";
+    }
+    return left + node->op + right;
+}
@@ -0,0 +1,119 @@
+#ifndef EXPRESSIONTREE_H
+#define EXPRESSIONTREE_H
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "compiledexpression.h"
+
+// Вершина дерева выражения. Вершины неизменяемы (кроме положения в строке,
+// см. ExpressionTree::place) и создаются только через ExpressionTree,
+// поэтому одинаковые поддеревья - это одна вершина
+struct ExpressionNode
+{
+    enum Kind : unsigned char {
+        CONSTANT,
+        VARIABLE,
+        IMAGINARY,
+        BINARY,
+        CALL,
+        REDUCTION
+    };
+
+    Kind kind;
+    char op;                        // '+', '-', '*', '/', '^', ',', ';' для BINARY; 's', 'p', 'i' для REDUCTION
+    unsigned int index;             // номер переменной или функции в таблицах дерева
+    double value;                   // значение CONSTANT
+    const ExpressionNode* left;     // левый операнд BINARY, аргумент CALL, нижний предел REDUCTION
+    const ExpressionNode* right;    // правый операнд BINARY, второй аргумент CALL, верхний предел REDUCTION
+    const ExpressionNode* body;     // тело REDUCTION; index - связанная переменная
+    unsigned int offset;            // токен первого вхождения в исходной строке
+    unsigned int length;
+    unsigned int id;                // порядковый номер вершины в дереве
+};
+
+// Дерево выражений с общими поддеревьями (hash-consing).
+// Вершины лежат в арене блоками и не перемещаются; структурно одинаковые
+// поддеревья - в том числе из разных выражений, разобранных в одно дерево, -
+// хранятся один раз, так что дерево на деле является DAG.
+// При построении сворачиваются +, -, * и деление на ненулевую константу
+// над константами: результат тот же, что дало бы вычисление
+class ExpressionTree
+{
+public:
+    ExpressionTree();
+
+    ExpressionTree(const ExpressionTree&) = delete;
+    ExpressionTree& operator=(const ExpressionTree&) = delete;
+
+    const ExpressionNode* constant(double value, unsigned int offset, unsigned int length);
+    const ExpressionNode* variable(const std::string& name, unsigned int offset, unsigned int length);
+    const ExpressionNode* imaginary(unsigned int offset, unsigned int length);
+    const ExpressionNode* binary(char op, const ExpressionNode* left, const ExpressionNode* right,
+                                 unsigned int offset, unsigned int length);
+    const ExpressionNode* call(const std::string& function, const ExpressionNode* argument,
+                               unsigned int offset, unsigned int length);
+    // Функция двух аргументов (matmul, solve)
+    const ExpressionNode* call(const std::string& function, const ExpressionNode* first,
+                               const ExpressionNode* second, unsigned int offset, unsigned int length);
+    // sum ('s'), prod ('p') или integral ('i') тела body по переменной variable
+    const ExpressionNode* reduction(char kind, const std::string& variable, const ExpressionNode* body,
+                                    const ExpressionNode* lower, const ExpressionNode* upper,
+                                    unsigned int offset, unsigned int length);
+
+    // Новое положение вершины в строке: инкрементальный разбор переносит
+    // вершины прежних версий строки на место их токена в текущей
+    void place(const ExpressionNode* node, unsigned int offset, unsigned int length);
+
+    // Поиск вызова без создания вершины; nullptr, если такого вызова нет
+    const ExpressionNode* findCall(const std::string& function, const ExpressionNode* argument) const;
+
+    const std::string& variableName(const ExpressionNode* node) const { return variableNames[node->index]; }
+    const std::string& functionName(const ExpressionNode* node) const { return functionNames[node->index]; }
+
+    // Число различных вершин
+    size_t size() const { return count; }
+    void clear();
+
+    // Единицы углов, в которых разобраны выражения дерева
+    AngleMode angleMode = ANGLE_RADIANS;
+
+    // Запись выражения с минимумом скобок
+    std::string toString(const ExpressionNode* node) const;
+
+private:
+    struct Key {
+        ExpressionNode::Kind kind;
+        char op;
+        unsigned int index;
+        unsigned long long bits;    // двоичное представление константы
+        const ExpressionNode* left;
+        const ExpressionNode* right;
+        const ExpressionNode* body;
+        bool operator==(const Key& other) const;
+    };
+
+    struct KeyHash {
+        size_t operator()(const Key& key) const;
+    };
+
+    const ExpressionNode* intern(const Key& key, double value, unsigned int offset, unsigned int length);
+    unsigned int nameIndex(std::vector<std::string>& names,
+                           std::unordered_map<std::string, unsigned int>& indices,
+                           const std::string& name);
+
+    static const size_t CHUNK = 256;
+    std::vector<std::unique_ptr<ExpressionNode[]>> chunks;
+    size_t count;
+    std::unordered_map<Key, const ExpressionNode*, KeyHash> nodes;
+
+    std::vector<std::string> variableNames;
+    std::vector<std::string> functionNames;
+    std::unordered_map<std::string, unsigned int> variableIndices;
+    std::unordered_map<std::string, unsigned int> functionIndices;
+};
+
+#endif // EXPRESSIONTREE_H
@@ -0,0 +1,627 @@
+// Дифференциальная проверка калькулятора: случайные выражения вычисляются
+// интерпретатором (tryCalculate, tryEvaluate), пакетно (evaluateBatch)
+// и в комплексном режиме, из нескольких потоков над общим калькулятором,
+// и сравниваются с эталоном из expressiongenerator. Вычисление с кэшем
+// подвыражений (MemoCache) и программы, прошедшие запись в CompiledLibrary
+// и загрузку, должны давать те же биты, что и исходная программа;
+// совмещённая программа выражения и его первого операнда - те же значения,
+// что эталон и отдельная программа операнда. Перед случайной частью
+// проверяются закреплённые особенности грамматики. Расхождения печатаются
+// вместе с минимизированным выражением, его программой и командой для повтора.
+
+#include "compiledlibrary.h"
+#include "expressioncalculator.h"
+#include "expressiongenerator.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+typedef std::chrono::steady_clock Clock;
+
+namespace {
+
+// Строк значений переменных на выражение: больше ширины векторных
+// ядер, чтобы пакетное вычисление прошло и по векторам, и по хвосту
+const size_t ROWS = 11;
+// Выражений в одной порции работы потока
+const uint64_t CHUNK = 256;
+
+struct Options {
+    uint64_t seed = 1;
+    uint64_t count = 1000000;
+    unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+    int maxDepth = 6;
+    long long replay = -1;
+    bool print = false;
+    size_t maxFailures = 10;
+    double tolerance = 1e-9;
+    // Комплексные функции и степень через exp(b ln a) точны хуже действительных
+    double complexTolerance = 1e-6;
+};
+
+struct Row {
+    double x;
+    double y;
+};
+
+// Значения переменных выражения index: чаще всего равномерные,
+// иногда особые (ноль - ради деления на ноль)
+std::vector<Row> makeRows(uint64_t seed, uint64_t index) {
+
+    static const double SPECIAL[] = { 0.0, 1.0, -1.0, 0.5, 2.0, -2.0 };
+    FuzzRandom random(~seed ^ (index * 0x9E3779B97F4A7C15ULL));
+    std::vector<Row> rows(ROWS);
+    for (Row& row : rows) {
+        row.x = random.below(4) == 0 ? SPECIAL[random.below(6)] : random.uniform(-4.0, 4.0);
+        row.y = random.below(4) == 0 ? SPECIAL[random.below(6)] : random.uniform(-4.0, 4.0);
+    }
+    return rows;
+}
+
+std::string format(double value) {
+
+    char buffer[64];
+    std::snprintf(buffer, sizeof(buffer), "%.17g", value);
+    return buffer;
+}
+
+std::string describeRow(const Row& row) {
+    return "x=" + format(row.x) + " y=" + format(row.y);
+}
+
+uint64_t mixHash(uint64_t h, uint64_t value) {
+
+    h ^= value + 0x9E3779B97F4A7C15ULL + (h << 6) + (h >> 2);
+    return h;
+}
+
+bool hasVariables(const std::string& text) {
+    return text.find_first_of("xyk") != std::string::npos;
+}
+
+// Одинаковый итог двух вычислений: побитово равные значения
+// или одна и та же ошибка в том же месте
+bool sameOutcome(bool ok, double value, const CalculationError& error,
+                 bool otherOk, double otherValue, const CalculationError& otherError) {
+
+    if (ok != otherOk) return false;
+    if (!ok) {
+        return error.code == otherError.code && error.offset == otherError.offset
+                && error.length == otherError.length;
+    }
+    return std::memcmp(&value, &otherValue, sizeof(value)) == 0;
+}
+
+// Выражение порции для проверки записи в CompiledLibrary: программа
+// и итоги её вычисления по строкам (tryEvaluate и evaluateBatch)
+struct LibraryCase {
+    uint64_t index = 0;
+    std::string text;
+    std::vector<Row> rows;
+    CompiledExpression program;
+    bool compiled = false;
+    std::vector<unsigned char> ok;
+    std::vector<double> values;
+    std::vector<CalculationError> errors;
+    std::vector<double> batch;
+};
+
+// Проверка одного выражения всеми способами вычисления. Пустая строка - совпало
+class Checker
+{
+    const ExpressionCalculator& shared;
+    // tryCalculate меняет состояние калькулятора: у каждого потока свой
+    ExpressionCalculator local;
+    double tolerance;
+    double complexTolerance;
+public:
+    size_t unstableRows = 0;
+    size_t checkedRows = 0;
+    size_t errorRows = 0;
+
+    Checker(const ExpressionCalculator& calculator, const Options& options)
+        : shared(calculator)
+        , tolerance(options.tolerance)
+        , complexTolerance(options.complexTolerance)
+    {}
+
+    // Программа выражения (с найденными многочленами) для отчёта о расхождении
+    std::string dump(const GeneratedNode& node) const {
+
+        CompiledExpression program;
+        CalculationError error;
+        std::string text = printExpression(node);
+        if (!shared.tryCompile(text, { "x", "y" }, program, error)) {
+            return "    compile: " + error.message(text) + "\n";
+        }
+        std::string listing = ExpressionCalculator::dump(program);
+        std::string indented;
+        for (size_t begin = 0; begin < listing.size();) {
+            size_t end = listing.find('\n', begin);
+            indented += "    " + listing.substr(begin, end - begin + 1);
+            begin = end + 1;
+        }
+        return indented;
+    }
+
+    // libraryCase получает программу и итоги вычисления для checkLibrary
+    std::string check(const GeneratedNode& node, const std::vector<Row>& rows, uint64_t* checksum = nullptr,
+                      LibraryCase* libraryCase = nullptr) {
+
+        std::string text = printExpression(node);
+        const std::vector<std::string> variables = { "x", "y" };
+        CompiledExpression program;
+        CalculationError error;
+        if (!shared.tryCompile(text, variables, program, error)) {
+            return "compile: " + error.message(text);
+        }
+        if (libraryCase) {
+            libraryCase->text = text;
+            libraryCase->rows = rows;
+            libraryCase->program = program;
+            libraryCase->compiled = true;
+        }
+
+        std::vector<ReferenceValue> references;
+        for (const Row& row : rows) {
+            references.push_back(referenceValue(node, row.x, row.y));
+        }
+
+        // Интерпретатор
+        for (size_t r = 0; r < rows.size(); r++) {
+            const ReferenceValue& reference = references[r];
+            double value = 0.0;
+            error = CalculationError();
+            bool ok = shared.tryEvaluate(program, { rows[r].x, rows[r].y }, value, error);
+            if (libraryCase) {
+                libraryCase->ok.push_back(ok);
+                libraryCase->values.push_back(value);
+                libraryCase->errors.push_back(error);
+            }
+            if (checksum) {
+                uint64_t bits;
+                std::memcpy(&bits, &value, sizeof(bits));
+                *checksum = mixHash(*checksum, ok ? bits : static_cast<uint64_t>(error.code));
+            }
+            if (!ok && (error.length == 0 || error.offset + error.length > text.size())) {
+                return "interpreter: error span " + std::to_string(error.offset) + "+"
+                        + std::to_string(error.length) + " outside expression, " + describeRow(rows[r]);
+            }
+            if (!reference.stable) {
+                unstableRows++;
+                continue;
+            }
+            checkedRows++;
+            if (reference.error != CalculationError::NONE) {
+                errorRows++;
+                if (ok || error.code != reference.error) {
+                    return "interpreter: " + describeRow(rows[r]) + " expected error "
+                            + std::to_string(reference.error) + ", got "
+                            + (ok ? format(value) : "error " + std::to_string(error.code));
+                }
+            } else if (!ok) {
+                return "interpreter: " + describeRow(rows[r]) + " expected " + format(reference.value)
+                        + ", got " + error.message(text);
+            } else if (!matchesReference(value, reference, tolerance)) {
+                return "interpreter: " + describeRow(rows[r]) + " expected " + format(reference.value)
+                        + ", got " + format(value);
+            }
+        }
+
+        // Кэш подвыражений: перебор x при y первой строки, затем перебор y
+        // при x первой строки - части, зависящие от одной переменной,
+        // берутся из кэша. Результат побитово как без кэша
+        ExpressionCalculator::MemoCache cache;
+        for (int sweep = 0; sweep < 2 && !program.memos.empty(); sweep++) {
+            for (size_t r = 0; r < rows.size(); r++) {
+                std::vector<double> values = sweep == 0 ? std::vector<double>{ rows[r].x, rows[0].y }
+                                                        : std::vector<double>{ rows[0].x, rows[r].y };
+                double plain = 0.0, cached = 0.0;
+                CalculationError plainError, cachedError;
+                bool plainOk = shared.tryEvaluate(program, values, plain, plainError);
+                bool cachedOk = shared.tryEvaluate(program, values, cache, cached, cachedError);
+                if (!sameOutcome(plainOk, plain, plainError, cachedOk, cached, cachedError)) {
+                    Row row = { values[0], values[1] };
+                    return "memo: " + describeRow(row) + " expected "
+                            + (plainOk ? format(plain) : plainError.message(text)) + ", got "
+                            + (cachedOk ? format(cached) : cachedError.message(text));
+                }
+            }
+        }
+
+        // Без переменных - ещё и разбор с вычислением за один вызов
+        if (!hasVariables(text) && references[0].stable) {
+            double value = 0.0;
+            error = CalculationError();
+            bool ok = local.tryCalculate(text, value, error);
+            bool expectedOk = references[0].error == CalculationError::NONE;
+            if (ok != expectedOk || (ok && !matchesReference(value, references[0], tolerance))) {
+                return "calculate: expected " + (expectedOk ? format(references[0].value) : "error")
+                        + ", got " + (ok ? format(value) : error.message(text));
+            }
+        }
+
+        // Пакет: ошибок нет, деление на ноль даёт inf/nan как в эталоне
+        std::vector<double> xs, ys, out(rows.size());
+        for (const Row& row : rows) {
+            xs.push_back(row.x);
+            ys.push_back(row.y);
+        }
+        shared.evaluateBatch(program, { xs.data(), ys.data() }, rows.size(), out.data());
+        if (libraryCase) {
+            libraryCase->batch = out;
+        }
+        for (size_t r = 0; r < rows.size(); r++) {
+            if (references[r].stable && !matchesReference(out[r], references[r], tolerance)) {
+                return "batch: " + describeRow(rows[r]) + " expected " + format(references[r].value)
+                        + ", got " + format(out[r]);
+            }
+        }
+
+        // Совмещённая программа выражения и его первого операнда: выход
+        // выражения сравнивается с эталоном, выход операнда - с отдельной
+        // программой операнда, а если биты разошлись (многочлены могут
+        // найтись по-разному) - с эталоном операнда
+        if ((node->kind == GeneratedExpression::BINARY || node->kind == GeneratedExpression::CALL
+                || node->kind == GeneratedExpression::NEGATE) && !node->children.empty()) {
+            const GeneratedNode& operand = node->children[0];
+            std::string operandText = printExpression(operand);
+            CompiledExpression fused, single;
+            size_t failed = 0;
+            if (!shared.tryCompileFused({ text, operandText }, variables, fused, error, failed)) {
+                return "fused compile: " + error.message(failed == 0 ? text : operandText);
+            }
+            if (!shared.tryCompile(operandText, variables, single, error)) {
+                return "operand compile: " + error.message(operandText);
+            }
+            std::vector<double> whole(rows.size()), part(rows.size()), separate(rows.size());
+            shared.evaluateBatch(fused, { xs.data(), ys.data() }, rows.size(), { whole.data(), part.data() });
+            shared.evaluateBatch(single, { xs.data(), ys.data() }, rows.size(), separate.data());
+            for (size_t r = 0; r < rows.size(); r++) {
+                if (references[r].stable && !matchesReference(whole[r], references[r], tolerance)) {
+                    return "fused: " + describeRow(rows[r]) + " expected " + format(references[r].value)
+                            + ", got " + format(whole[r]);
+                }
+                if (std::memcmp(&part[r], &separate[r], sizeof(double)) == 0) {
+                    continue;
+                }
+                ReferenceValue operandReference = referenceValue(operand, rows[r].x, rows[r].y);
+                if (operandReference.stable && !matchesReference(part[r], operandReference, tolerance)) {
+                    return "fused operand: " + describeRow(rows[r]) + " expected "
+                            + format(operandReference.value) + ", got " + format(part[r]);
+                }
+            }
+        }
+
+        // Комплексный режим там, где все промежуточные значения
+        // действительны и конечны
+        for (size_t r = 0; r < rows.size(); r++) {
+            const ReferenceValue& reference = references[r];
+            if (!reference.stable || !reference.finite || reference.error != CalculationError::NONE) {
+                continue;
+            }
+            std::complex<double> value;
+            try {
+                value = shared.evaluateComplex(program, { rows[r].x, rows[r].y });
+            } catch (const std::exception& e) {
+                return "complex: " + describeRow(rows[r]) + " threw " + e.what();
+            }
+            double scale = std::max(1.0, std::fabs(reference.value));
+            if (!matchesReference(value.real(), reference, complexTolerance)
+                    || !(std::fabs(value.imag()) <= complexTolerance * scale)) {
+                return "complex: " + describeRow(rows[r]) + " expected " + format(reference.value)
+                        + ", got " + format(value.real()) + "+" + format(value.imag()) + "i";
+            }
+        }
+        return std::string();
+    }
+
+    // Программы порции записываются в одну библиотеку по path и загружаются
+    // обратно: tryEvaluate и evaluateBatch загруженной программы побитово
+    // как у исходной (итоги исходной записаны check). Пустая строка - совпало
+    std::string checkLibrary(const std::vector<LibraryCase>& cases, const std::string& path) const {
+
+        std::vector<CompiledLibrary::Entry> entries;
+        std::vector<const LibraryCase*> compiled;
+        for (const LibraryCase& item : cases) {
+            // Выражение, на котором check остановился раньше, не проверяется
+            if (!item.compiled || item.ok.size() != item.rows.size() || item.batch.size() != item.rows.size()) {
+                continue;
+            }
+            CompiledLibrary::Entry entry;
+            entry.name = std::to_string(item.index);
+            entry.source = item.text;
+            entry.program = item.program;
+            entries.push_back(entry);
+            compiled.push_back(&item);
+        }
+        if (entries.empty()) {
+            return std::string();
+        }
+
+        std::string message;
+        CompiledLibrary library;
+        if (!CompiledLibrary::write(path, entries, message) || !library.open(path, message)) {
+            std::remove(path.c_str());
+            return "library: " + message;
+        }
+        std::string mismatch;
+        for (size_t i = 0; i < entries.size() && mismatch.empty(); i++) {
+            const LibraryCase& item = *compiled[i];
+            std::string where = "library: index " + entries[i].name + " " + item.text;
+            CompiledExpression loaded;
+            size_t index = library.find(entries[i].name);
+            if (index == library.size() || !library.load(index, loaded, message)) {
+                mismatch = where + ": load " + message;
+                break;
+            }
+            std::vector<double> xs, ys;
+            for (size_t r = 0; r < item.rows.size() && mismatch.empty(); r++) {
+                const Row& row = item.rows[r];
+                xs.push_back(row.x);
+                ys.push_back(row.y);
+                double value = 0.0;
+                CalculationError error;
+                bool ok = shared.tryEvaluate(loaded, { row.x, row.y }, value, error);
+                if (!sameOutcome(item.ok[r] != 0, item.values[r], item.errors[r], ok, value, error)) {
+                    mismatch = where + ", " + describeRow(row) + " expected "
+                            + (item.ok[r] ? format(item.values[r]) : item.errors[r].message(item.text))
+                            + ", got " + (ok ? format(value) : error.message(item.text));
+                }
+            }
+            if (!mismatch.empty()) {
+                break;
+            }
+            std::vector<double> out(item.rows.size());
+            shared.evaluateBatch(loaded, { xs.data(), ys.data() }, xs.size(), out.data());
+            if (std::memcmp(out.data(), item.batch.data(), out.size() * sizeof(double)) != 0) {
+                mismatch = "library batch: index " + entries[i].name + " " + item.text;
+            }
+        }
+        library.close();
+        std::remove(path.c_str());
+        return mismatch;
+    }
+};
+
+// Жадная минимизация: берём любое упрощение, на котором расхождение остаётся
+GeneratedNode minimize(GeneratedNode node, const std::vector<Row>& rows, Checker& checker) {
+
+    bool progress = true;
+    while (progress) {
+        progress = false;
+        size_t size = nodeCount(node);
+        size_t length = printExpression(node).size();
+        for (const GeneratedNode& candidate : shrinkCandidates(node)) {
+            size_t candidateSize = nodeCount(candidate);
+            if (candidateSize > size || (candidateSize == size && printExpression(candidate).size() >= length)) {
+                continue;
+            }
+            if (!checker.check(candidate, rows).empty()) {
+                node = candidate;
+                progress = true;
+                break;
+            }
+        }
+    }
+    return node;
+}
+
+// Первая строка, на которой выражение расходится (для минимизации по одной строке)
+std::vector<Row> failingRow(const GeneratedNode& node, const std::vector<Row>& rows, Checker& checker) {
+
+    for (const Row& row : rows) {
+        std::vector<Row> single(1, row);
+        if (!checker.check(node, single).empty()) {
+            return single;
+        }
+    }
+    return rows;
+}
+
+// Закреплённое поведение грамматики, на которое опираются пользователи
+struct GoldenCase {
+    const char* expression;
+    double value;
+    CalculationError::Code error;
+};
+
+const GoldenCase GOLDEN[] = {
+    { "2*-3", -3.0, CalculationError::NONE },          // унарный минус - это 0 - ...
+    { "-2^2", -4.0, CalculationError::NONE },
+    { "2^-1", 0.0, CalculationError::NONE },           // 2^0 - 1
+    { "2^(-1)", 0.5, CalculationError::NONE },
+    { "3--2", 1.0, CalculationError::NONE },
+    { "--2", -2.0, CalculationError::NONE },
+    { "2^3^2", 64.0, CalculationError::NONE },         // '^' левоассоциативен
+    { "8/4/2", 1.0, CalculationError::NONE },
+    { "2 3", 23.0, CalculationError::NONE },           // пробелы удаляются до разбора
+    { "2,", 2.0, CalculationError::NONE },             // ',' вне скобок закрывает выражение
+    { "pi", 3.14159265358979323846, CalculationError::NONE },
+    { "e^2", 7.389056098930650227, CalculationError::NONE },
+    { "sum(k,1,4,k)", 10.0, CalculationError::NONE },
+    { "sum(k,0.5,2,k)", 2.0, CalculationError::NONE },
+    { "prod(k,1,0,k)", 1.0, CalculationError::NONE },
+    { "sum(k,1,3,1/(k-2))", 0.0, CalculationError::DIVISION_BY_ZERO },    // как 1/0
+    { "sum(k,1,3,1/(1/(k-2)))", 0.0, CalculationError::NONE },              // слагаемые конечны
+    { "integral(x,-1,1,1/x)", 0.0, CalculationError::DIVISION_BY_ZERO },
+    { "integral(x,0,1,1/x)", 0.0, CalculationError::NO_CONVERGENCE },
+    { "sum(k,1,3,sqrt(-k))", 0.0, CalculationError::INVALID_FUNCTION_ARGUMENT },
+    { "1/(-0)", 0.0, CalculationError::DIVISION_BY_ZERO },
+    { "2e", 0.0, CalculationError::INVALID_EXPRESSION },
+    { "2pi", 0.0, CalculationError::INVALID_EXPRESSION },
+    { "(1,2)", 0.0, CalculationError::INVALID_EXPRESSION },
+    { "sin(1,2)", 0.0, CalculationError::INVALID_EXPRESSION },
+    { "(2)(3)", 0.0, CalculationError::INVALID_EXPRESSION },
+    { "1.5.2", 0.0, CalculationError::INVALID_EXPRESSION },
+    { "..5", 0.0, CalculationError::INVALID_EXPRESSION },
+    { "hypot(1,2)", 0.0, CalculationError::UNKNOWN_FUNCTION },
+    { "max(1,2)", 0.0, CalculationError::INVALID_EXPRESSION },
+    { "x", 0.0, CalculationError::UNKNOWN_IDENTIFIER },
+    { "sin-1", 0.0, CalculationError::UNKNOWN_IDENTIFIER }
+};
+
+bool checkGolden() {
+
+    ExpressionCalculator calculator;
+    bool passed = true;
+    for (const GoldenCase& golden : GOLDEN) {
+        double value = 0.0;
+        CalculationError error;
+        bool ok = calculator.tryCalculate(golden.expression, value, error);
+        bool matches = ok ? golden.error == CalculationError::NONE
+                            && (value == golden.value || std::fabs(value - golden.value) <= 1e-15 * std::fabs(golden.value))
+                          : error.code == golden.error;
+        if (!matches) {
+            std::cout << "golden: " << golden.expression << " expected "
+                      << (golden.error == CalculationError::NONE ? format(golden.value)
+                                                                 : "error " + std::to_string(golden.error))
+                      << ", got " << (ok ? format(value) : "error " + std::to_string(error.code)) << "\n";
+            passed = false;
+        }
+    }
+    return passed;
+}
+
+bool parseOptions(int argc, char* argv[], Options& options) {
+
+    for (int i = 1; i < argc; i++) {
+        std::string option = argv[i];
+        if (option == "--print") {
+            options.print = true;
+            continue;
+        }
+        if (i + 1 >= argc) return false;
+        std::string value = argv[++i];
+        if (option == "--seed") options.seed = std::strtoull(value.c_str(), nullptr, 10);
+        else if (option == "--count") options.count = std::strtoull(value.c_str(), nullptr, 10);
+        else if (option == "--threads") options.threads = std::max(1, std::atoi(value.c_str()));
+        else if (option == "--max-depth") options.maxDepth = std::max(1, std::atoi(value.c_str()));
+        else if (option == "--replay") options.replay = std::atoll(value.c_str());
+        else if (option == "--max-failures") options.maxFailures = std::max(1, std::atoi(value.c_str()));
+        else if (option == "--tolerance") options.tolerance = std::atof(value.c_str());
+        else if (option == "--complex-tolerance") options.complexTolerance = std::atof(value.c_str());
+        else return false;
+    }
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        std::cerr << "Usage: expression-differential [--seed N] [--count N] [--threads N] [--max-depth N]\n"
+                     "                               [--replay INDEX] [--max-failures N] [--tolerance X]\n"
+                     "                               [--complex-tolerance X] [--print]\n";
+        return 2;
+    }
+
+    // Выражения для начального корпуса парсерного фаззера
+    if (options.print) {
+        for (uint64_t i = 0; i < options.count; i++) {
+            std::cout << printExpression(generateExpression(options.seed, i, options.maxDepth)) << "\n";
+        }
+        return 0;
+    }
+
+    if (!checkGolden()) {
+        std::cout << "golden cases failed\n";
+        return 1;
+    }
+
+    const ExpressionCalculator shared;
+    uint64_t begin = options.replay >= 0 ? static_cast<uint64_t>(options.replay) : 0;
+    uint64_t end = options.replay >= 0 ? begin + 1 : options.count;
+
+    std::atomic<uint64_t> next(begin);
+    std::atomic<size_t> failures(0);
+    std::atomic<uint64_t> checksum(0);
+    std::atomic<size_t> checkedRows(0), unstableRows(0), errorRows(0);
+    std::mutex outputMutex;
+
+    std::atomic<unsigned> workerCount(0);
+    auto worker = [&]() {
+        Checker checker(shared, options);
+        uint64_t localChecksum = 0;
+        // Своя библиотека у каждого потока: одна запись на порцию
+        std::string libraryPath = "expression-differential-" + std::to_string(options.seed) + "-"
+                + std::to_string(workerCount++) + ".lib";
+        std::vector<LibraryCase> libraryCases;
+        for (uint64_t first = next.fetch_add(CHUNK); first < end && failures < options.maxFailures;
+             first = next.fetch_add(CHUNK)) {
+            libraryCases.clear();
+            for (uint64_t index = first; index < std::min(end, first + CHUNK); index++) {
+                GeneratedNode node = generateExpression(options.seed, index, options.maxDepth);
+                std::vector<Row> rows = makeRows(options.seed, index);
+                libraryCases.emplace_back();
+                libraryCases.back().index = index;
+                uint64_t hash = index;
+                std::string mismatch = checker.check(node, rows, &hash, &libraryCases.back());
+                // Сумма хешей не зависит от порядка: одинакова при любом числе потоков
+                localChecksum += hash;
+                if (options.replay >= 0 && mismatch.empty()) {
+                    std::lock_guard<std::mutex> lock(outputMutex);
+                    std::cout << "expression: " << printExpression(node) << "\nok\n";
+                }
+                if (mismatch.empty()) continue;
+
+                if (failures++ >= options.maxFailures) break;
+                std::vector<Row> single = failingRow(node, rows, checker);
+                GeneratedNode minimized = minimize(node, single, checker);
+                std::lock_guard<std::mutex> lock(outputMutex);
+                std::cout << "mismatch: seed " << options.seed << " index " << index << "\n"
+                          << "  expression: " << printExpression(node) << "\n"
+                          << "  " << mismatch << "\n"
+                          << "  minimized:  " << printExpression(minimized) << "\n"
+                          << "  " << checker.check(minimized, single) << "\n"
+                          << "  program:\n" << checker.dump(minimized)
+                          << "  replay: expression-differential --seed " << options.seed
+                          << " --max-depth " << options.maxDepth << " --replay " << index << "\n";
+            }
+            std::string mismatch = checker.checkLibrary(libraryCases, libraryPath);
+            if (!mismatch.empty() && failures++ < options.maxFailures) {
+                std::lock_guard<std::mutex> lock(outputMutex);
+                std::cout << "mismatch: seed " << options.seed << "\n  " << mismatch << "\n";
+            }
+        }
+        checksum += localChecksum;
+        checkedRows += checker.checkedRows;
+        unstableRows += checker.unstableRows;
+        errorRows += checker.errorRows;
+    };
+
+    Clock::time_point start = Clock::now();
+    std::vector<std::thread> pool;
+    for (unsigned i = 1; i < options.threads; i++) {
+        pool.emplace_back(worker);
+    }
+    worker();
+    for (std::thread& thread : pool) {
+        thread.join();
+    }
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    uint64_t expressions = std::min<uint64_t>(end, next.load()) - begin;
+    std::printf("expressions %llu, rows checked %zu (with errors %zu), unstable rows skipped %zu\n",
+                static_cast<unsigned long long>(expressions), checkedRows.load(), errorRows.load(),
+                unstableRows.load());
+    std::printf("threads %u, %.2f s, %.0f expressions/s, checksum %016llx\n", options.threads, seconds,
+                expressions / std::max(seconds, 1e-9), static_cast<unsigned long long>(checksum.load()));
+    if (failures > 0) {
+        std::printf("mismatches %zu\n", std::min(failures.load(), options.maxFailures));
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,510 @@
+#include "expressiongenerator.h"
+
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <string>
+
+namespace {
+
+typedef GeneratedExpression Node;
+
+// Значения констант pi и e в том виде, в каком их видит калькулятор
+const double PI = 3.14159265358979323846;
+const double E = 2.71828182845904523536;
+
+// Единица округления double
+const long double ROUNDING = 1.1102230246251565e-16L;
+// Во сколько раз фактическое расхождение может превышать оценку
+// погрешности первого порядка
+const long double ERROR_FACTOR = 64;
+// Аргумент ближе к краю области определения, чем EDGE_FACTOR оценок
+// погрешности, - результат может сменить вид (число, NaN, ошибка)
+const long double EDGE_FACTOR = 64;
+
+enum FunctionKind {
+    F_ABS, F_ACOS, F_ASIN, F_ATAN, F_COS, F_COSH, F_COT, F_CSC, F_EXP,
+    F_LN, F_LOG, F_SEC, F_SIN, F_SINH, F_SQRT, F_TAN, F_TANH
+};
+
+struct FunctionEntry {
+    const char* name;
+    FunctionKind kind;
+};
+
+// Все действительные функции калькулятора, включая синонимы
+const FunctionEntry FUNCTIONS[] = {
+    { "abs", F_ABS }, { "acos", F_ACOS }, { "arccos", F_ACOS }, { "arcsin", F_ASIN },
+    { "arctg", F_ATAN }, { "asin", F_ASIN }, { "atan", F_ATAN }, { "cos", F_COS },
+    { "cosh", F_COSH }, { "cot", F_COT }, { "csc", F_CSC }, { "ctg", F_COT },
+    { "exp", F_EXP }, { "ln", F_LN }, { "log", F_LOG }, { "sec", F_SEC },
+    { "sin", F_SIN }, { "sinh", F_SINH }, { "sqrt", F_SQRT }, { "tan", F_TAN },
+    { "tanh", F_TANH }, { "tg", F_TAN }
+};
+const int FUNCTION_COUNT = sizeof(FUNCTIONS) / sizeof(FUNCTIONS[0]);
+
+const char* const VARIABLE_NAMES[] = { "x", "y", "k" };
+
+// Значение и оценка его абсолютной погрешности при вычислении в double
+template <typename T>
+struct Estimate {
+    T value;
+    T error;
+};
+
+// Погрешность, внесённая в производную: ноль при точном аргументе,
+// даже если производная бесконечна (sqrt(0), 0^0.5)
+template <typename T>
+T propagate(T derivative, T error) {
+    return error == T(0) ? T(0) : std::fabs(derivative) * error;
+}
+
+// Функция и первая оценка погрешности: |f'(x)| * ошибка аргумента
+// плюс округление результата. edge - аргумент в пределах погрешности
+// от края области определения, где меняется сам вид результата
+template <typename T>
+Estimate<T> applyFunction(FunctionKind kind, Estimate<T> x, bool& edge) {
+
+    T v = x.value;
+    T margin = T(EDGE_FACTOR) * (x.error + T(ROUNDING) * std::fabs(v));
+    T y, derivative;
+    switch (kind) {
+    case F_ABS: y = std::abs(v); derivative = 1; break;
+    case F_ACOS:
+    case F_ASIN:
+        y = kind == F_ACOS ? std::acos(v) : std::asin(v);
+        derivative = T(1) / std::sqrt((T(1) - v) * (T(1) + v));
+        edge = edge || (margin > T(0) && std::fabs(T(1) - std::fabs(v)) <= margin);
+        break;
+    case F_ATAN: y = std::atan(v); derivative = T(1) / (T(1) + v * v); break;
+    case F_COS: y = std::cos(v); derivative = std::sin(v); break;
+    case F_COSH: y = std::cosh(v); derivative = std::sinh(v); break;
+    case F_COT: y = std::cos(v) / std::sin(v); derivative = T(1) / (std::sin(v) * std::sin(v)); break;
+    case F_CSC: y = T(1) / std::sin(v); derivative = y * std::cos(v) / std::sin(v); break;
+    case F_EXP: y = std::exp(v); derivative = y; break;
+    case F_LN:
+    case F_LOG:
+        y = kind == F_LN ? std::log(v) : std::log10(v);
+        derivative = T(1) / v;
+        edge = edge || (margin > T(0) && std::fabs(v) <= margin);
+        break;
+    case F_SEC: y = T(1) / std::cos(v); derivative = y * std::sin(v) / std::cos(v); break;
+    case F_SIN: y = std::sin(v); derivative = std::cos(v); break;
+    case F_SINH: y = std::sinh(v); derivative = std::cosh(v); break;
+    case F_SQRT:
+        y = std::sqrt(v);
+        derivative = T(0.5) / y;
+        edge = edge || (margin > T(0) && std::fabs(v) <= margin);
+        break;
+    case F_TAN: y = std::tan(v); derivative = T(1) + y * y; break;
+    default: y = std::tanh(v); derivative = T(1) - y * y; break;
+    }
+    // Тригонометрические функции: аргумент в пределах погрешности от
+    // нуля или полюса (sin или cos близки к нулю). Там результат -
+    // остаток после сокращения, и его относительная точность зависит
+    // от приведения аргумента, а за полюсом меняется знак или
+    // получается бесконечность (в комплексном режиме inf+nan*i)
+    bool sineZero = kind == F_SIN || kind == F_CSC || kind == F_TAN || kind == F_COT;
+    bool cosineZero = kind == F_COS || kind == F_SEC || kind == F_TAN || kind == F_COT;
+    if (margin > T(0) && ((sineZero && std::fabs(std::sin(v)) <= margin)
+                          || (cosineZero && std::fabs(std::cos(v)) <= margin))) {
+        edge = true;
+    }
+    Estimate<T> result = { y, propagate(derivative, x.error) + T(ROUNDING) * std::fabs(y) };
+    return result;
+}
+
+// Эталонное вычисление дерева в типе T. Ошибки интерпретатора
+// запоминаются, но вычисление продолжается по правилам IEEE, как
+// в пакетном режиме. Тело sum/prod вычисляется пакетно, без ошибок:
+// ошибка конструкции - деление на ноль в слагаемом, которое получилось
+// бесконечным или NaN (его перевычисляет интерпретатор), иначе NaN
+// в итоге свёртки.
+// Вместе со значением считается оценка погрешности double первого
+// порядка: так другая, тоже верно округляющая реализация функций
+// или другой порядок сложения не принимаются за расхождение
+template <typename T>
+class ReferenceEvaluator
+{
+public:
+    CalculationError::Code error = CalculationError::NONE;
+    bool finite = true;
+    bool edge = false;
+
+    Estimate<T> run(const Node& node, const T* variables) {
+
+        Estimate<T> result = compute(node, variables);
+        if (!std::isfinite(result.value)) finite = false;
+        // Субнормальное для double значение: его относительная точность
+        // потеряна, а другой порядок операций даёт вместо него ноль
+        if (result.value != T(0) && std::fabs(result.value) < T(std::numeric_limits<double>::min())) {
+            edge = true;
+        }
+        return result;
+    }
+
+private:
+    void fail(CalculationError::Code code) {
+        if (error == CalculationError::NONE) error = code;
+    }
+
+    static Estimate<T> exact(T value) {
+        Estimate<T> result = { value, T(0) };
+        return result;
+    }
+
+    Estimate<T> binary(char op, Estimate<T> a, Estimate<T> b) {
+
+        T y;
+        T spread;
+        switch (op) {
+        case '+': y = a.value + b.value; spread = a.error + b.error; break;
+        case '-': y = a.value - b.value; spread = a.error + b.error; break;
+        case '*': y = a.value * b.value; spread = propagate(b.value, a.error) + propagate(a.value, b.error); break;
+        case '/':
+            if (b.value == T(0)) fail(CalculationError::DIVISION_BY_ZERO);
+            // Делитель в пределах погрешности от нуля: ошибка деления может как быть, так и не быть
+            edge = edge || (b.error > T(0) && std::fabs(b.value) <= T(EDGE_FACTOR) * b.error);
+            y = a.value / b.value;
+            spread = propagate(T(1) / b.value, a.error) + propagate(y / b.value, b.error);
+            break;
+        default:
+            // Отрицательное основание в комплексном режиме - главная ветвь
+            // exp(b ln a), а дробная степень точна хуже действительной:
+            // с комплексным режимом сравниваются только целые показатели
+            if (!(b.value == std::floor(b.value) && std::fabs(b.value) <= T(64))) finite = false;
+            edge = edge || (a.error > T(0) && std::fabs(a.value) <= T(EDGE_FACTOR) * a.error);
+            // Отрицательное основание и показатель в пределах погрешности
+            // от целого: степень может быть как числом, так и NaN
+            edge = edge || (a.value < T(0) && b.error > T(0)
+                            && std::fabs(b.value - std::floor(b.value + T(0.5))) <= T(EDGE_FACTOR) * b.error);
+            y = std::pow(a.value, b.value);
+            spread = propagate(b.value * std::pow(a.value, b.value - T(1)), a.error)
+                    + propagate(y * std::log(std::fabs(a.value)), b.error);
+            break;
+        }
+        Estimate<T> result = { y, spread + T(ROUNDING) * std::fabs(y) };
+        return result;
+    }
+
+    Estimate<T> compute(const Node& node, const T* variables) {
+
+        switch (node.kind) {
+        case Node::NUMBER: return exact(T(node.number));
+        case Node::VARIABLE: return exact(variables[node.index]);
+        case Node::PI: return exact(T(PI));
+        case Node::E: return exact(T(E));
+        case Node::NEGATE: return binary('-', exact(T(0)), run(*node.children[0], variables));
+        case Node::CALL: return applyFunction(FUNCTIONS[node.index].kind, run(*node.children[0], variables), edge);
+        case Node::BINARY: {
+            Estimate<T> a = run(*node.children[0], variables);
+            Estimate<T> b = run(*node.children[1], variables);
+            return binary(node.op, a, b);
+        }
+        default:
+            break;
+        }
+
+        // sum/prod: k пробегает lower, lower + 1, ... пока не больше upper
+        T lower = run(*node.children[0], variables).value;
+        T upper = run(*node.children[1], variables).value;
+        if (!std::isfinite(lower) || !std::isfinite(upper)) {
+            fail(CalculationError::INVALID_FUNCTION_ARGUMENT);
+            return exact(std::numeric_limits<T>::quiet_NaN());
+        }
+        bool product = node.index == 1;
+        Estimate<T> result = exact(product ? T(1) : T(0));
+        long terms = upper >= lower ? static_cast<long>(std::floor(upper - lower)) + 1 : 0;
+        T bound[3] = { variables[0], variables[1], T(0) };
+        bool divisionByZero = false;
+        for (long i = 0; i < terms; i++) {
+            bound[2] = lower + T(i);
+            // Слагаемое - отдельное вычисление со своей первой ошибкой
+            ReferenceEvaluator term;
+            Estimate<T> value = term.run(*node.children[2], bound);
+            finite = finite && term.finite;
+            edge = edge || term.edge;
+            if (!std::isfinite(value.value) && term.error == CalculationError::DIVISION_BY_ZERO) {
+                divisionByZero = true;
+            }
+            result = binary(product ? '*' : '+', result, value);
+        }
+        if (divisionByZero) {
+            fail(CalculationError::DIVISION_BY_ZERO);
+        } else if (std::isnan(result.value)) {
+            fail(CalculationError::INVALID_FUNCTION_ARGUMENT);
+        }
+        return result;
+    }
+};
+
+int classify(long double value) {
+    if (std::isnan(value)) return 0;
+    if (std::isinf(value)) return value > 0 ? 1 : 2;
+    return 3;
+}
+
+int precedence(const Node& node) {
+
+    if (node.kind != Node::BINARY) return 4;
+    if (node.op == '+' || node.op == '-') return 1;
+    if (node.op == '*' || node.op == '/') return 2;
+    return 3;
+}
+
+GeneratedNode makeNumber(const std::string& text) {
+
+    std::shared_ptr<Node> node = std::make_shared<Node>();
+    node->kind = Node::NUMBER;
+    node->index = 0;
+    node->op = 0;
+    node->text = text;
+    node->number = std::stod(text);
+    return node;
+}
+
+bool usesBoundVariable(const Node& node) {
+
+    if (node.kind == Node::VARIABLE) return node.index == 2;
+    for (const GeneratedNode& child : node.children) {
+        if (usesBoundVariable(*child)) return true;
+    }
+    return false;
+}
+
+class Generator
+{
+    FuzzRandom& random;
+public:
+    explicit Generator(FuzzRandom& source) : random(source) {}
+
+    GeneratedNode number() {
+
+        std::string text;
+        uint32_t shape = random.below(10);
+        if (shape < 4) {
+            text = std::to_string(random.below(10));
+        } else if (shape < 5) {
+            text = std::to_string(10 + random.below(991));
+        } else {
+            // Дробная часть из одной-трёх цифр: 2.5, 0.125, 3.07
+            text = std::to_string(random.below(5)) + ".";
+            uint32_t digits = 1 + random.below(3);
+            for (uint32_t i = 0; i < digits; i++) {
+                text += static_cast<char>('0' + random.below(10));
+            }
+        }
+        return makeNumber(text);
+    }
+
+    GeneratedNode leaf(bool inBody) {
+
+        uint32_t choice = random.below(100);
+        if (choice < 45) return number();
+        std::shared_ptr<Node> node = std::make_shared<Node>();
+        node->index = 0;
+        node->op = 0;
+        node->number = 0.0;
+        if (choice < 88) {
+            node->kind = Node::VARIABLE;
+            node->index = static_cast<int>(random.below(inBody ? 3 : 2));
+        } else {
+            node->kind = choice < 94 ? Node::PI : Node::E;
+        }
+        return node;
+    }
+
+    GeneratedNode generate(int depth, bool inBody) {
+
+        if (depth <= 0 || random.below(100) < 20) {
+            return leaf(inBody);
+        }
+        std::shared_ptr<Node> node = std::make_shared<Node>();
+        node->index = 0;
+        node->op = 0;
+        node->number = 0.0;
+        uint32_t choice = random.below(100);
+        if (choice < 52) {
+            static const char OPERATORS[] = { '+', '+', '-', '-', '*', '*', '/', '/', '^' };
+            node->kind = Node::BINARY;
+            node->op = OPERATORS[random.below(sizeof(OPERATORS))];
+            node->children.push_back(generate(depth - 1, inBody));
+            // Показатель степени чаще всего небольшой, иначе почти всё переполняется
+            node->children.push_back(node->op == '^' && random.below(3) != 0
+                                     ? makeNumber(std::to_string(random.below(5)))
+                                     : generate(depth - 1, inBody));
+        } else if (choice < 64) {
+            node->kind = Node::NEGATE;
+            node->children.push_back(generate(depth - 1, inBody));
+        } else if (choice < 94 || inBody) {
+            node->kind = Node::CALL;
+            node->index = static_cast<int>(random.below(FUNCTION_COUNT));
+            node->children.push_back(generate(depth - 1, inBody));
+        } else {
+            // Пределы - целые числа, иногда в обратном порядке (пустой диапазон)
+            node->kind = Node::REDUCTION;
+            node->index = static_cast<int>(random.below(2));
+            int lower = static_cast<int>(random.below(5)) - 1;
+            int upper = lower + static_cast<int>(random.below(7)) - 1;
+            for (int bound : { lower, upper }) {
+                GeneratedNode value = makeNumber(std::to_string(std::abs(bound)));
+                if (bound < 0) {
+                    std::shared_ptr<Node> negate = std::make_shared<Node>();
+                    negate->kind = Node::NEGATE;
+                    negate->index = 0;
+                    negate->op = 0;
+                    negate->number = 0.0;
+                    negate->children.push_back(value);
+                    value = negate;
+                }
+                node->children.push_back(value);
+            }
+            node->children.push_back(generate(depth - 1, true));
+        }
+        return node;
+    }
+};
+
+// Все варианты дерева, в которых одно поддерево упрощено
+void collectCandidates(const GeneratedNode& node, std::vector<GeneratedNode>& out) {
+
+    // Замена самого узла ребёнком или числом
+    for (size_t i = 0; i < node->children.size(); i++) {
+        bool body = node->kind == Node::REDUCTION && i == 2;
+        if (!body || !usesBoundVariable(*node->children[i])) {
+            out.push_back(node->children[i]);
+        }
+    }
+    if (node->kind == Node::NUMBER) {
+        std::string integer = node->text.substr(0, node->text.find('.'));
+        if (integer != node->text) out.push_back(makeNumber(integer));
+        if (node->text != "1" && node->text != "0") out.push_back(makeNumber("1"));
+    } else {
+        out.push_back(makeNumber("0"));
+        out.push_back(makeNumber("1"));
+    }
+
+    // Упрощение внутри одного из детей
+    for (size_t i = 0; i < node->children.size(); i++) {
+        std::vector<GeneratedNode> inner;
+        collectCandidates(node->children[i], inner);
+        for (const GeneratedNode& child : inner) {
+            std::shared_ptr<Node> copy = std::make_shared<Node>(*node);
+            copy->children[i] = child;
+            out.push_back(copy);
+        }
+    }
+}
+
+} // namespace
+
+uint64_t FuzzRandom::next() {
+
+    uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+uint32_t FuzzRandom::below(uint32_t n) {
+    return static_cast<uint32_t>((next() >> 32) * n >> 32);
+}
+
+double FuzzRandom::uniform(double low, double high) {
+    return low + (high - low) * (static_cast<double>(next() >> 11) * (1.0 / 9007199254740992.0));
+}
+
+GeneratedNode generateExpression(uint64_t seed, uint64_t index, int maxDepth) {
+
+    // Поток номера index не зависит от того, какие номера генерировались раньше
+    FuzzRandom mixer(seed);
+    FuzzRandom random(mixer.next() ^ (index * 0xD1B54A32D192ED03ULL));
+    Generator generator(random);
+    return generator.generate(maxDepth, false);
+}
+
+std::string printExpression(const GeneratedNode& node) {
+
+    switch (node->kind) {
+    case Node::NUMBER: return node->text;
+    case Node::VARIABLE: return VARIABLE_NAMES[node->index];
+    case Node::PI: return "pi";
+    case Node::E: return "e";
+    case Node::NEGATE: {
+        // Унарный минус после '(' разбирается как 0 - ...: сумму нужно заключить в скобки
+        std::string operand = printExpression(node->children[0]);
+        if (precedence(*node->children[0]) == 1) operand = "(" + operand + ")";
+        return "(-" + operand + ")";
+    }
+    case Node::CALL:
+        return std::string(FUNCTIONS[node->index].name) + "(" + printExpression(node->children[0]) + ")";
+    case Node::REDUCTION:
+        return std::string(node->index == 1 ? "prod" : "sum") + "(k," + printExpression(node->children[0])
+                + "," + printExpression(node->children[1]) + "," + printExpression(node->children[2]) + ")";
+    default:
+        break;
+    }
+
+    // Все операторы, включая '^', левоассоциативны: правый операнд того же
+    // приоритета заключается в скобки, чтобы порядок округлений совпал с деревом
+    int own = precedence(*node);
+    std::string left = printExpression(node->children[0]);
+    std::string right = printExpression(node->children[1]);
+    if (precedence(*node->children[0]) < own) left = "(" + left + ")";
+    if (precedence(*node->children[1]) <= own) right = "(" + right + ")";
+    return left + node->op + right;
+}
+
+size_t nodeCount(const GeneratedNode& node) {
+
+    size_t count = 1;
+    for (const GeneratedNode& child : node->children) {
+        count += nodeCount(child);
+    }
+    return count;
+}
+
+ReferenceValue referenceValue(const GeneratedNode& node, double x, double y) {
+
+    ReferenceEvaluator<double> fast;
+    ReferenceEvaluator<long double> precise;
+    double variables[3] = { x, y, 0.0 };
+    long double preciseVariables[3] = { x, y, 0.0L };
+
+    ReferenceValue reference;
+    reference.value = fast.run(*node, variables).value;
+    Estimate<long double> estimate = precise.run(*node, preciseVariables);
+    reference.precise = estimate.value;
+    reference.bound = estimate.error;
+    reference.error = fast.error;
+    reference.finite = fast.finite && precise.finite;
+
+    // Погрешность double должна укладываться в оценку; иначе первое
+    // приближение не годится (сильная нелинейность) и сравнивать нечего
+    long double difference = std::fabs(static_cast<long double>(reference.value) - reference.precise);
+    reference.stable = fast.error == precise.error
+            && !precise.edge
+            && classify(reference.value) == classify(reference.precise)
+            && (!std::isfinite(reference.precise)
+                || (std::isfinite(reference.bound) && difference <= ERROR_FACTOR * reference.bound));
+    return reference;
+}
+
+bool matchesReference(double got, const ReferenceValue& reference, double tolerance) {
+
+    if (classify(got) != classify(reference.precise)) {
+        return false;
+    }
+    if (!std::isfinite(got)) {
+        return true;
+    }
+    long double slack = tolerance * std::fabs(reference.precise) + ERROR_FACTOR * reference.bound;
+    return std::fabs(got - reference.precise) <= slack;
+}
+
+std::vector<GeneratedNode> shrinkCandidates(const GeneratedNode& node) {
+
+    std::vector<GeneratedNode> candidates;
+    collectCandidates(node, candidates);
+    return candidates;
+}
@@ -0,0 +1,85 @@
+#ifndef EXPRESSIONGENERATOR_H
+#define EXPRESSIONGENERATOR_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "calculationerror.h"
+
+// Случайные выражения для дифференциальной проверки калькулятора:
+// дерево, его запись в синтаксисе калькулятора и эталонное значение,
+// посчитанное независимо от разбора в ОПН. Запись однозначна: скобки
+// расставляются так, чтобы порядок операций совпадал с деревом при
+// любых особенностях грамматики (левая ассоциативность '^', унарный
+// минус через "0 -"). Переменные: x, y и k - связанная переменная sum/prod.
+
+// Генератор псевдослучайных чисел splitmix64: одинаковая
+// последовательность на любой платформе и в любой библиотеке
+class FuzzRandom
+{
+    uint64_t state;
+public:
+    explicit FuzzRandom(uint64_t seed) : state(seed) {}
+
+    uint64_t next();
+    // Равномерно в [0, n)
+    uint32_t below(uint32_t n);
+    // Равномерно в [low, high)
+    double uniform(double low, double high);
+};
+
+struct GeneratedExpression;
+typedef std::shared_ptr<const GeneratedExpression> GeneratedNode;
+
+struct GeneratedExpression
+{
+    enum Kind {
+        NUMBER,
+        VARIABLE,   // index: 0 - x, 1 - y, 2 - k
+        PI,
+        E,
+        NEGATE,     // записывается как (-a) и вычисляется как 0 - a
+        BINARY,
+        CALL,       // index - номер функции в таблице генератора
+        REDUCTION   // index: 0 - sum, 1 - prod; дети: нижний предел, верхний, тело
+    };
+
+    Kind kind;
+    int index;
+    char op;                // BINARY: + - * / ^
+    double number;          // NUMBER: значение text
+    std::string text;       // NUMBER: запись числа
+    std::vector<GeneratedNode> children;
+};
+
+// Выражение номер index серии seed; одинаковые (seed, index) дают одинаковое выражение
+GeneratedNode generateExpression(uint64_t seed, uint64_t index, int maxDepth);
+
+std::string printExpression(const GeneratedNode&);
+size_t nodeCount(const GeneratedNode&);
+
+// Эталон для одной строки значений переменных
+struct ReferenceValue {
+    double value;               // вычисление в double по правилам движка (IEEE, без ошибок)
+    long double precise;        // то же в long double
+    long double bound;          // оценка погрешности вычисления в double (первого порядка)
+    CalculationError::Code error;   // первая ошибка интерпретатора в порядке вычисления
+    bool stable;                // double укладывается в оценку, аргументы не у края области
+                                // определения: сравнивать имеет смысл
+    bool finite;                // промежуточные значения конечны, показатели степеней
+                                // целые: сравнимо с комплексным режимом
+};
+
+ReferenceValue referenceValue(const GeneratedNode&, double x, double y);
+
+// Значение движка совпадает с эталоном с точностью до относительной
+// погрешности tolerance плюс оценки погрешности округления
+bool matchesReference(double got, const ReferenceValue&, double tolerance);
+
+// Упрощения для минимизации: поддерево заменяется ребёнком или числом,
+// число - более коротким. Каждый вариант - корректное выражение
+std::vector<GeneratedNode> shrinkCandidates(const GeneratedNode&);
+
+#endif // EXPRESSIONGENERATOR_H
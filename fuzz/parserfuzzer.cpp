@@ -0,0 +1,97 @@
+// Цель libFuzzer для разбора выражений: произвольные байты компилируются
+// с переменными x и y. Разбор не должен падать, позиция ошибки должна
+// лежать внутри строки, а скомпилированная программа - проходить checkProgram
+// и давать одинаковый результат в интерпретаторе и в пакетном режиме.
+// Нарушение - abort(), который libFuzzer сохраняет как падение
+// с воспроизводящим входом.
+//
+// С PARSER_FUZZER_STANDALONE собирается обычная программа, прогоняющая
+// файлы из командной строки (повтор найденных входов без clang).
+
+#include "expressioncalculator.h"
+
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+namespace {
+
+bool sameResult(double interpreter, double batch) {
+
+    if (std::isnan(interpreter) || std::isnan(batch)) {
+        return std::isnan(interpreter) && std::isnan(batch);
+    }
+    if (std::isinf(interpreter) || std::isinf(batch)) {
+        return interpreter == batch;
+    }
+    // Векторные ядра пакетного режима могут отличаться на несколько ulp
+    return std::fabs(interpreter - batch) <= 1e-12 * std::max(1.0, std::fabs(interpreter));
+}
+
+} // namespace
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    static const ExpressionCalculator calculator;
+    static ExpressionCalculator matrixCalculator;
+
+    std::string text(reinterpret_cast<const char*>(data), size);
+    CompiledExpression program;
+    CalculationError error;
+    if (!calculator.tryCompile(text, { "x", "y" }, program, error)) {
+        if (error.ok() || error.offset + error.length > size) {
+            std::abort();
+        }
+        error.message(text);
+        return 0;
+    }
+    // Проверка загружаемых программ не должна отвергать результат компилятора
+    if (!ExpressionCalculator::checkProgram(program)) {
+        std::abort();
+    }
+
+    // sum/prod/integral с большими пределами вычисляются долго:
+    // для них проверяется только разбор
+    if (!program.reductions.empty()) {
+        return 0;
+    }
+
+    double x = 0.5, y = -1.25;
+    double value = 0.0, batch = 0.0;
+    bool ok = calculator.tryEvaluate(program, { x, y }, value, error);
+    if (!ok && (error.offset + error.length > size)) {
+        std::abort();
+    }
+    calculator.evaluateBatch(program, { &x, &y }, 1, &batch);
+    if (ok && !sameResult(value, batch)) {
+        std::abort();
+    }
+
+    // Тот же текст в матричном режиме (литералы [1,2;3,4]) тоже не должен падать
+    Matrix matrix;
+    if (!matrixCalculator.tryCalculateMatrix(text, matrix, error) && error.offset + error.length > size) {
+        std::abort();
+    }
+    return 0;
+}
+
+#ifdef PARSER_FUZZER_STANDALONE
+
+#include <fstream>
+#include <iostream>
+#include <iterator>
+
+int main(int argc, char *argv[])
+{
+    for (int i = 1; i < argc; i++) {
+        std::ifstream file(argv[i], std::ios::binary);
+        std::string input((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        LLVMFuzzerTestOneInput(reinterpret_cast<const uint8_t*>(input.data()), input.size());
+        std::cout << argv[i] << ": ok\n";
+    }
+    return 0;
+}
+
+#endif
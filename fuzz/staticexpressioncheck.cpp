@@ -0,0 +1,132 @@
+// Проверка staticexpression.h (нужен C++14): формулы CALC_EXPRESSION
+// вычисляются на сетке значений переменных и сравниваются с tryEvaluate
+// калькулятора, ошибки constexpr-разбора - с ошибками tryCompile на тех же
+// строках. Часть проверок - static_assert: при расхождении программа
+// не компилируется. Код возврата 1, если хоть одна проверка не прошла.
+
+#include "expressioncalculator.h"
+#include "staticexpression.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace {
+
+using compiletime::compile;
+
+// Разбор во время компиляции: ошибки и их смещения - как у калькулятора
+static_assert(compile<32>("2*(x+1", "x").error == CalculationError::UNBALANCED_PARENTHESES
+              && compile<32>("2*(x+1", "x").errorOffset == 2, "unbalanced parenthesis");
+static_assert(compile<32>("1.5.2", "").error == CalculationError::INVALID_EXPRESSION, "malformed number");
+static_assert(compile<32>("foo(x)", "x").error == CalculationError::UNKNOWN_FUNCTION, "unknown function");
+static_assert(compile<32>("x+z", "x").error == CalculationError::UNKNOWN_IDENTIFIER
+              && compile<32>("x+z", "x").errorOffset == 2, "unknown identifier");
+static_assert(compile<32>("x*", "x").error == CalculationError::INVALID_EXPRESSION, "missing operand");
+static_assert(compile<32>("det([1,2;3,4])", "").limitation == compiletime::MATRIX, "matrix");
+static_assert(compile<32>("2*i", "").limitation == compiletime::IMAGINARY, "imaginary unit");
+static_assert(compile<64>("12345678901234567890.5", "").limitation == compiletime::LONG_NUMBER, "long number");
+
+// Числа и переменные
+static_assert(compile<32>("0.125", "").ok() && compile<32>("0.125", "").count == 1
+              && compile<32>("0.125", "").tokens[0].value == 0.125, "number");
+static_assert(compile<32>("y - x", "x, y").variableCount == 2
+              && compile<32>("y - x", "x, y").tokens[0].index == 1, "variable order");
+
+const double X[] = { -7.5, -2.0, -1.0, -0.3, 0.0, 0.25, 1.0, 2.0, 3.75, 100.0 };
+const double Y[] = { -3.0, -0.5, 0.0, 0.5, 1.0, 2.5 };
+
+// Совпадение с точностью до округления: калькулятор может свернуть константы
+// или переставить операции многочлена; ошибка калькулятора - inf/nan здесь
+bool close(double expected, double got) {
+
+    if (!std::isfinite(expected) || !std::isfinite(got)) {
+        return std::isnan(expected) ? std::isnan(got) : expected == got;
+    }
+    double scale = std::max(1.0, std::max(std::fabs(expected), std::fabs(got)));
+    return std::fabs(expected - got) <= 1e-12 * scale;
+}
+
+int failures = 0;
+
+template <class Expression>
+void check(const Expression& expression) {
+
+    static_assert(Expression::VARIABLE_COUNT == 2, "checked expressions use x and y");
+
+    ExpressionCalculator calculator;
+    CompiledExpression program;
+    CalculationError error;
+    if (!calculator.tryCompile(expression.source(), { "x", "y" }, program, error)) {
+        std::printf("%s: calculator error %s\n", expression.source(), error.message(expression.source()).c_str());
+        failures++;
+        return;
+    }
+    for (double x : X) {
+        for (double y : Y) {
+            double expected;
+            bool ok = calculator.tryEvaluate(program, { x, y }, expected, error);
+            double got = expression(x, y);
+            if (ok ? !close(expected, got) : std::isfinite(got)) {
+                std::printf("%s at x = %.17g, y = %.17g: ", expression.source(), x, y);
+                if (ok) std::printf("calculator %.17g, CALC_EXPRESSION %.17g\n", expected, got);
+                else std::printf("calculator %s, CALC_EXPRESSION %.17g\n",
+                                 error.message(expression.source()).c_str(), got);
+                failures++;
+            }
+        }
+    }
+}
+
+#define CHECK_EXPRESSION(text) check(CALC_EXPRESSION(text, x, y))
+
+// Ошибки constexpr-разбора, вызванного во время выполнения, против tryCompile
+void checkError(const char* text) {
+
+    ExpressionCalculator calculator;
+    CompiledExpression program;
+    CalculationError error;
+    bool ok = calculator.tryCompile(text, { "x", "y" }, program, error);
+    const compiletime::Program<128> parsed = compile<128>(text, "x, y");
+    if (ok != parsed.ok() || (!ok && (error.code != parsed.error || error.offset != parsed.errorOffset))) {
+        std::printf("%s: calculator %s at %zu, CALC_EXPRESSION %d at %zu\n", text,
+                    ok ? "ok" : error.message(text).c_str(), ok ? size_t(0) : error.offset,
+                    static_cast<int>(parsed.error), parsed.errorOffset);
+        failures++;
+    }
+}
+
+} // namespace
+
+int main()
+{
+    CHECK_EXPRESSION("x + y");
+    CHECK_EXPRESSION("x - y - 1");
+    CHECK_EXPRESSION("2*x*y/3");
+    CHECK_EXPRESSION("x / y");
+    CHECK_EXPRESSION("x^2 + 3*x - y^3");
+    CHECK_EXPRESSION("2^3^2 + x");
+    CHECK_EXPRESSION("-x^2 + -(y - 1)");
+    CHECK_EXPRESSION("pi*x^2/4 + e");
+    CHECK_EXPRESSION("exp(-x^2/2)/sqrt(2*pi) + y");
+    CHECK_EXPRESSION("sin(x)*cos(y) + tan(x/3)");
+    CHECK_EXPRESSION("sec(x) + csc(y) - cot(x + y)");
+    CHECK_EXPRESSION("ln(y) + log(x)");
+    CHECK_EXPRESSION("sqrt(x) * abs(y)");
+    CHECK_EXPRESSION("asin(y/3) + acos(y/3) + atan(x)");
+    CHECK_EXPRESSION("sinh(y) - cosh(y) + tanh(x)");
+    CHECK_EXPRESSION("((x + 1)*(x - 1))/(y*y + 1)");
+
+    const char* const ERRORS[] = {
+        "1.5.2", "..5", "2*(x+1", "x+)", "foo(x)", "z + 1", "x +", "x y", "sin()",
+        "x $ 2", "(", "()", "2**x", "sin", "1e5", "x + y)"
+    };
+    for (const char* text : ERRORS) {
+        checkError(text);
+    }
+
+    std::printf("%s\n", failures ? "mismatches found" : "CALC_EXPRESSION matches the calculator");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,178 @@
+// Точность тригонометрического ядра против libm: sin, cos, tan, sec,
+// csc и cot на случайных аргументах из каждой области приведения
+// (без приведения, Коди-Уэйт, Пейн-Хэнек) и рядом с кратными pi/2,
+// где приведение теряет больше всего разрядов. Эталон - sinl/cosl/tanl
+// в long double, погрешность - в ulp точного значения, округлённого
+// до double. Векторные sin и cos проверяются на тех же аргументах.
+// Код возврата 1, если хоть одна погрешность больше заявленной
+// в trigcore.h.
+
+#include "trigcore.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+// Границы областей - как в trigcore.cpp
+const double PI_4 = 0.78539816339744830962;
+const double MEDIUM_LIMIT = 1647099.0;
+
+struct Range {
+    const char* name;
+    double lower;
+    double upper;
+    bool nearMultiples;     // кратные pi/2 и соседние числа вместо log-равномерных
+};
+
+const Range RANGES[] = {
+    { "|x| < pi/4", 1e-12, PI_4, false },
+    { "Cody-Waite", PI_4, MEDIUM_LIMIT, false },
+    { "Payne-Hanek", MEDIUM_LIMIT, 1e308, false },
+    { "k*pi/2, Cody-Waite", PI_4, MEDIUM_LIMIT, true },
+    { "k*pi/2, Payne-Hanek", MEDIUM_LIMIT, 1e300, true }
+};
+
+enum Function { SIN, COS, TAN, SEC, CSC, COT, FUNCTION_COUNT };
+
+const char* const NAMES[] = { "sin", "cos", "tan", "sec", "csc", "cot" };
+// Заявленные границы; векторные sin и cos - как скалярные
+const double BOUND[] = { 1.0, 1.0, 2.5, 2.0, 2.0, 2.5 };
+
+double scalar(Function f, double x) {
+
+    switch (f) {
+    case SIN: return trigSin(x);
+    case COS: return trigCos(x);
+    case TAN: return trigTan(x);
+    case SEC: return trigSec(x);
+    case CSC: return trigCsc(x);
+    default: return trigCot(x);
+    }
+}
+
+long double reference(Function f, double x) {
+
+    long double v = x;
+    switch (f) {
+    case SIN: return sinl(v);
+    case COS: return cosl(v);
+    case TAN: return tanl(v);
+    case SEC: return 1.0L / cosl(v);
+    case CSC: return 1.0L / sinl(v);
+    default: return cosl(v) / sinl(v);
+    }
+}
+
+// Расхождение в ulp эталона, округлённого до double
+double ulpError(double got, long double expected) {
+
+    double rounded = static_cast<double>(expected);
+    if (!std::isfinite(rounded)) {
+        return got == rounded ? 0.0 : HUGE_VAL;
+    }
+    int exponent;
+    std::frexp(rounded, &exponent);
+    long double ulp = std::ldexp(1.0L, std::max(exponent - 53, -1074));
+    return static_cast<double>(std::fabs(got - expected) / ulp);
+}
+
+// Аргументы области: log-равномерные по модулю со случайным знаком
+// или ближайшие к k*pi/2 числа и их соседи на несколько ulp
+std::vector<double> arguments(const Range& range, size_t count, std::mt19937_64& random) {
+
+    std::vector<double> x(count);
+    std::uniform_real_distribution<double> exponent(std::log(range.lower), std::log(range.upper));
+    std::uniform_int_distribution<int> neighbour(-4, 4);
+    const long double PIO2 = 1.57079632679489661923132169163975144L;
+    for (size_t i = 0; i < count; i++) {
+        double v = std::exp(exponent(random));
+        if (range.nearMultiples) {
+            long double k = std::floor(static_cast<long double>(v) / PIO2);
+            v = static_cast<double>(k * PIO2);
+            for (int step = neighbour(random); step != 0; step += step > 0 ? -1 : 1) {
+                v = std::nextafter(v, step > 0 ? HUGE_VAL : 0.0);
+            }
+            v = std::max(v, range.lower);
+        }
+        x[i] = random() & 1 ? -v : v;
+    }
+    return x;
+}
+
+struct Worst {
+    double ulp = 0.0;
+    double x = 0.0;
+
+    void add(double error, double argument) {
+        if (error > ulp) {
+            ulp = error;
+            x = argument;
+        }
+    }
+};
+
+bool report(const char* function, const char* kernel, const Range& range, const Worst& worst, double bound) {
+
+    bool ok = worst.ulp <= bound;
+    std::printf("%-4s %-7s %-20s %8.3f ulp (bound %.1f)  x = %.17g%s\n", function, kernel, range.name,
+                worst.ulp, bound, worst.x, ok ? "" : "  EXCEEDED");
+    return ok;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    size_t count = 200000;
+    uint64_t seed = 1;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string option = argv[i];
+        std::string value = argv[i + 1];
+        if (option == "--count") count = static_cast<size_t>(std::max(1LL, std::atoll(value.c_str())));
+        else if (option == "--seed") seed = std::strtoull(value.c_str(), nullptr, 10);
+        else {
+            std::cerr << "Usage: trig-accuracy [--count N] [--seed N]\n";
+            return 1;
+        }
+    }
+
+    std::mt19937_64 random(seed);
+    bool ok = true;
+    for (const Range& range : RANGES) {
+        std::vector<double> x = arguments(range, count, random);
+
+        for (int f = 0; f < FUNCTION_COUNT; f++) {
+            Worst worst;
+            for (double v : x) {
+                worst.add(ulpError(scalar(static_cast<Function>(f), v), reference(static_cast<Function>(f), v)), v);
+            }
+            ok = report(NAMES[f], "scalar", range, worst, BOUND[f]) && ok;
+        }
+
+        // Векторные варианты: отдельные sin и cos и оба за одно приведение.
+        // Выше 2^19 * pi/2 дорожки уходят на скалярный путь
+        std::vector<double> s(count), c(count), s2(count), c2(count);
+        trigSinArray(x.data(), s.data(), count);
+        trigCosArray(x.data(), c.data(), count);
+        trigSinCosArray(x.data(), s2.data(), c2.data(), count);
+        Worst sinWorst, cosWorst;
+        for (size_t i = 0; i < count; i++) {
+            long double sinExpected = sinl(x[i]);
+            long double cosExpected = cosl(x[i]);
+            sinWorst.add(std::max(ulpError(s[i], sinExpected), ulpError(s2[i], sinExpected)), x[i]);
+            cosWorst.add(std::max(ulpError(c[i], cosExpected), ulpError(c2[i], cosExpected)), x[i]);
+        }
+        ok = report("sin", "vector", range, sinWorst, BOUND[SIN]) && ok;
+        ok = report("cos", "vector", range, cosWorst, BOUND[COS]) && ok;
+    }
+    std::printf("%s\n", ok ? "all within bounds" : "bounds exceeded");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,16 @@
+# Точность тригонометрического ядра (скалярного и векторного) против libm
+TEMPLATE = app
+TARGET = trig-accuracy
+
+CONFIG += console c++11 thread
+CONFIG -= app_bundle qt
+
+INCLUDEPATH += ..
+
+SOURCES += \
+    ../trigcore.cpp \
+    trigaccuracy.cpp
+
+HEADERS += \
+    ../simd.h \
+    ../trigcore.h
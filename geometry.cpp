@@ -0,0 +1,738 @@
+#include "geometry.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <thread>
+
+namespace {
+
+// Точная арифметика разложений (Shewchuk): число представляется суммой
+// неперекрывающихся double по возрастанию модуля, знак - у старшего
+typedef std::vector<double> Expansion;
+
+inline void twoSum(double a, double b, double &sum, double &error) {
+
+    sum = a + b;
+    double bVirtual = sum - a;
+    double aVirtual = sum - bVirtual;
+    error = (a - aVirtual) + (b - bVirtual);
+}
+
+inline void twoProduct(double a, double b, double &product, double &error) {
+
+    product = a * b;
+    error = std::fma(a, b, -product);
+}
+
+// e + b с отбрасыванием нулевых слагаемых
+Expansion grow(const Expansion &e, double b) {
+
+    Expansion h;
+    h.reserve(e.size() + 1);
+    double q = b;
+    for (double component : e) {
+        double error;
+        twoSum(q, component, q, error);
+        if (error != 0.0) {
+            h.push_back(error);
+        }
+    }
+    if (q != 0.0 || h.empty()) {
+        h.push_back(q);
+    }
+    return h;
+}
+
+Expansion add(Expansion e, const Expansion &f) {
+
+    for (double component : f) {
+        e = grow(e, component);
+    }
+    return e;
+}
+
+Expansion negate(Expansion e) {
+
+    for (double& component : e) {
+        component = -component;
+    }
+    return e;
+}
+
+Expansion multiply(const Expansion &e, const Expansion &f) {
+
+    Expansion result(1, 0.0);
+    for (double a : e) {
+        for (double b : f) {
+            double product, error;
+            twoProduct(a, b, product, error);
+            result = grow(grow(result, error), product);
+        }
+    }
+    return result;
+}
+
+// Точная разность a - b
+Expansion difference(double a, double b) {
+
+    double sum, error;
+    twoSum(a, -b, sum, error);
+    return error != 0.0 ? Expansion{ error, sum } : Expansion{ sum };
+}
+
+double sign(const Expansion &e) {
+    return e.back() > 0.0 ? 1.0 : e.back() < 0.0 ? -1.0 : 0.0;
+}
+
+// Границы погрешности быстрого вычисления (Shewchuk, "Adaptive Precision
+// Floating-Point Arithmetic and Fast Robust Geometric Predicates")
+const double EPSILON = std::numeric_limits<double>::epsilon() / 2;
+const double ORIENT_BOUND = (3.0 + 16.0 * EPSILON) * EPSILON;
+const double INCIRCLE_BOUND = (10.0 + 96.0 * EPSILON) * EPSILON;
+
+double orientExact(const Point2D &a, const Point2D &b, const Point2D &c) {
+
+    Expansion left = multiply(difference(a.x, c.x), difference(b.y, c.y));
+    Expansion right = multiply(difference(a.y, c.y), difference(b.x, c.x));
+    return sign(add(left, negate(right)));
+}
+
+double incircleExact(const Point2D &a, const Point2D &b, const Point2D &c, const Point2D &d) {
+
+    Expansion adx = difference(a.x, d.x), ady = difference(a.y, d.y);
+    Expansion bdx = difference(b.x, d.x), bdy = difference(b.y, d.y);
+    Expansion cdx = difference(c.x, d.x), cdy = difference(c.y, d.y);
+
+    Expansion aLift = add(multiply(adx, adx), multiply(ady, ady));
+    Expansion bLift = add(multiply(bdx, bdx), multiply(bdy, bdy));
+    Expansion cLift = add(multiply(cdx, cdx), multiply(cdy, cdy));
+
+    Expansion bc = add(multiply(bdx, cdy), negate(multiply(bdy, cdx)));
+    Expansion ca = add(multiply(cdx, ady), negate(multiply(cdy, adx)));
+    Expansion ab = add(multiply(adx, bdy), negate(multiply(ady, bdx)));
+
+    Expansion det = add(add(multiply(aLift, bc), multiply(bLift, ca)), multiply(cLift, ab));
+    return sign(det);
+}
+
+// Псевдоугол направления (dx, dy) в [0, 1), растёт против часовой стрелки
+inline double pseudoAngle(double dx, double dy) {
+
+    if (dx == 0.0 && dy == 0.0) {
+        return 0.0;
+    }
+    double p = dx / (std::fabs(dx) + std::fabs(dy));
+    return (dy > 0.0 ? 3.0 - p : 1.0 + p) / 4.0;
+}
+
+inline double squaredDistance(const Point2D &a, const Point2D &b) {
+
+    double dx = a.x - b.x;
+    double dy = a.y - b.y;
+    return dx * dx + dy * dy;
+}
+
+// Квадрат радиуса описанной окружности (inf для вырожденного треугольника)
+double circumradius(const Point2D &a, const Point2D &b, const Point2D &c) {
+
+    double dx = b.x - a.x, dy = b.y - a.y;
+    double ex = c.x - a.x, ey = c.y - a.y;
+    double bl = dx * dx + dy * dy;
+    double cl = ex * ex + ey * ey;
+    double d = 0.5 / (dx * ey - dy * ex);
+    double x = (ey * bl - dy * cl) * d;
+    double y = (dx * cl - ex * bl) * d;
+    double r = x * x + y * y;
+    return std::isfinite(r) && bl > 0.0 && cl > 0.0 ? r : std::numeric_limits<double>::infinity();
+}
+
+Point2D circumcenter(const Point2D &a, const Point2D &b, const Point2D &c) {
+
+    double dx = b.x - a.x, dy = b.y - a.y;
+    double ex = c.x - a.x, ey = c.y - a.y;
+    double bl = dx * dx + dy * dy;
+    double cl = ex * ex + ey * ey;
+    double d = 0.5 / (dx * ey - dy * ex);
+    Point2D center = { a.x + (ey * bl - dy * cl) * d, a.y + (dx * cl - ex * bl) * d };
+    return center;
+}
+
+// Построение триангуляции Делоне вставкой точек снаружи текущей оболочки
+class DelaunayBuilder
+{
+public:
+    DelaunayBuilder(const std::vector<Point2D> &input, Triangulation &result)
+        : points(input)
+        , triangles(result.triangles)
+        , halfedges(result.halfedges)
+        , hullOut(result.hull)
+    {
+    }
+
+    bool build();
+
+private:
+    uint32_t addTriangle(uint32_t i0, uint32_t i1, uint32_t i2, int32_t a, int32_t b, int32_t c);
+    void link(int32_t a, int32_t b);
+    int32_t legalize(int32_t a);
+    size_t hashKey(const Point2D &p) const;
+
+    const std::vector<Point2D>& points;
+    std::vector<uint32_t>& triangles;
+    std::vector<int32_t>& halfedges;
+    std::vector<uint32_t>& hullOut;
+
+    // Оболочка - двусвязный список против часовой стрелки;
+    // hullTri[i] - полуребро оболочки, выходящее из i
+    std::vector<uint32_t> hullPrev;
+    std::vector<uint32_t> hullNext;
+    std::vector<int32_t> hullTri;
+    std::vector<int64_t> hullHash;
+    uint32_t hullStart = 0;
+    Point2D center = { 0.0, 0.0 };
+    std::vector<int32_t> stack;
+};
+
+uint32_t DelaunayBuilder::addTriangle(uint32_t i0, uint32_t i1, uint32_t i2, int32_t a, int32_t b, int32_t c) {
+
+    uint32_t t = static_cast<uint32_t>(triangles.size());
+    triangles.push_back(i0);
+    triangles.push_back(i1);
+    triangles.push_back(i2);
+    halfedges.resize(t + 3);
+    link(t, a);
+    link(t + 1, b);
+    link(t + 2, c);
+    return t;
+}
+
+void DelaunayBuilder::link(int32_t a, int32_t b) {
+
+    halfedges[a] = b;
+    if (b != -1) {
+        halfedges[b] = a;
+    }
+}
+
+size_t DelaunayBuilder::hashKey(const Point2D &p) const {
+
+    size_t size = hullHash.size();
+    return static_cast<size_t>(std::floor(pseudoAngle(p.x - center.x, p.y - center.y) * size)) % size;
+}
+
+// Переворачивает рёбра, нарушающие условие Делоне, начиная с полуребра a.
+// Возвращает полуребро, которое после переворотов занимает место
+// ребра, предшествующего a в его треугольнике
+int32_t DelaunayBuilder::legalize(int32_t a) {
+
+    size_t depth = 0;
+    int32_t ar = 0;
+
+    while (true) {
+        int32_t b = halfedges[a];
+        int32_t a0 = a - a % 3;
+        ar = a0 + (a + 2) % 3;
+
+        if (b == -1) {
+            if (depth == 0) break;
+            a = stack[--depth];
+            continue;
+        }
+
+        int32_t b0 = b - b % 3;
+        int32_t al = a0 + (a + 1) % 3;
+        int32_t bl = b0 + (b + 2) % 3;
+
+        uint32_t p0 = triangles[ar];
+        uint32_t pr = triangles[a];
+        uint32_t pl = triangles[al];
+        uint32_t p1 = triangles[bl];
+
+        // (p0, pr, pl) - треугольник a против часовой стрелки, p1 - вершина напротив
+        if (incircle(points[p0], points[pr], points[pl], points[p1]) > 0.0) {
+            triangles[a] = p1;
+            triangles[b] = p0;
+
+            int32_t hbl = halfedges[bl];
+            if (hbl == -1) {
+                // Перевёрнутое ребро лежало на оболочке с другой стороны
+                uint32_t e = hullStart;
+                do {
+                    if (hullTri[e] == bl) {
+                        hullTri[e] = a;
+                        break;
+                    }
+                    e = hullPrev[e];
+                } while (e != hullStart);
+            }
+            link(a, hbl);
+            link(b, halfedges[ar]);
+            link(ar, bl);
+
+            int32_t br = b0 + (b + 1) % 3;
+            if (depth < stack.size()) {
+                stack[depth] = br;
+            } else {
+                stack.push_back(br);
+            }
+            depth++;
+        } else {
+            if (depth == 0) break;
+            a = stack[--depth];
+        }
+    }
+    return ar;
+}
+
+bool DelaunayBuilder::build() {
+
+    size_t n = points.size();
+    triangles.clear();
+    halfedges.clear();
+    hullOut.clear();
+    if (n < 3 || n > static_cast<size_t>(std::numeric_limits<int32_t>::max() / 6)) {
+        return false;
+    }
+
+    double minX = points[0].x, maxX = minX, minY = points[0].y, maxY = minY;
+    for (const Point2D& p : points) {
+        minX = std::min(minX, p.x);
+        maxX = std::max(maxX, p.x);
+        minY = std::min(minY, p.y);
+        maxY = std::max(maxY, p.y);
+    }
+    Point2D middle = { 0.5 * (minX + maxX), 0.5 * (minY + maxY) };
+
+    // Начальный треугольник: точка у центра, ближайшая к ней и та,
+    // что даёт наименьшую описанную окружность
+    uint32_t i0 = 0, i1 = 0, i2 = 0;
+    double best = std::numeric_limits<double>::infinity();
+    for (uint32_t i = 0; i < n; i++) {
+        double d = squaredDistance(middle, points[i]);
+        if (d < best) {
+            i0 = i;
+            best = d;
+        }
+    }
+    best = std::numeric_limits<double>::infinity();
+    for (uint32_t i = 0; i < n; i++) {
+        double d = squaredDistance(points[i0], points[i]);
+        if (d > 0.0 && d < best) {
+            i1 = i;
+            best = d;
+        }
+    }
+    best = std::numeric_limits<double>::infinity();
+    for (uint32_t i = 0; i < n; i++) {
+        if (i == i0 || i == i1) continue;
+        double r = circumradius(points[i0], points[i1], points[i]);
+        if (r < best) {
+            i2 = i;
+            best = r;
+        }
+    }
+    if (best == std::numeric_limits<double>::infinity() || orient2d(points[i0], points[i1], points[i2]) == 0.0) {
+        // Все точки на одной прямой
+        return false;
+    }
+    if (orient2d(points[i0], points[i1], points[i2]) < 0.0) {
+        std::swap(i1, i2);
+    }
+    center = circumcenter(points[i0], points[i1], points[i2]);
+
+    // Точки по удалению от центра начальной окружности: каждая следующая
+    // лежит вне уже построенной оболочки
+    std::vector<double> distances(n);
+    for (size_t i = 0; i < n; i++) {
+        distances[i] = squaredDistance(points[i], center);
+    }
+    std::vector<uint32_t> order(n);
+    std::iota(order.begin(), order.end(), 0u);
+    std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+        return distances[a] < distances[b];
+    });
+
+    size_t hashSize = static_cast<size_t>(std::ceil(std::sqrt(static_cast<double>(n))));
+    hullPrev.assign(n, 0);
+    hullNext.assign(n, 0);
+    hullTri.assign(n, -1);
+    hullHash.assign(hashSize, -1);
+
+    size_t maxTriangles = 2 * n - 5;
+    triangles.reserve(maxTriangles * 3);
+    halfedges.reserve(maxTriangles * 3);
+
+    hullStart = i0;
+    hullNext[i0] = hullPrev[i2] = i1;
+    hullNext[i1] = hullPrev[i0] = i2;
+    hullNext[i2] = hullPrev[i1] = i0;
+    hullTri[i0] = 0;
+    hullTri[i1] = 1;
+    hullTri[i2] = 2;
+    hullHash[hashKey(points[i0])] = i0;
+    hullHash[hashKey(points[i1])] = i1;
+    hullHash[hashKey(points[i2])] = i2;
+    addTriangle(i0, i1, i2, -1, -1, -1);
+
+    const Point2D* previous = nullptr;
+    for (uint32_t i : order) {
+        const Point2D& p = points[i];
+
+        // Совпадающие точки идут подряд
+        if (previous && previous->x == p.x && previous->y == p.y) continue;
+        previous = &p;
+        if (i == i0 || i == i1 || i == i2) continue;
+
+        // Вершина оболочки рядом по углу, от неё - к первому видимому ребру
+        size_t key = hashKey(p);
+        int64_t start = 0;
+        for (size_t j = 0; j < hashSize; j++) {
+            start = hullHash[(key + j) % hashSize];
+            if (start != -1 && static_cast<uint32_t>(start) != hullNext[start]) break;
+        }
+        start = hullPrev[start];
+        uint32_t e = static_cast<uint32_t>(start);
+        uint32_t q;
+        bool visible = true;
+        while (q = hullNext[e], orient2d(points[e], points[q], p) >= 0.0) {
+            e = q;
+            if (e == start) {
+                visible = false;
+                break;
+            }
+        }
+        if (!visible) {
+            // Точка совпадает с уже вставленной
+            continue;
+        }
+
+        // Первый треугольник на видимом ребре e -> next
+        uint32_t t = addTriangle(e, i, hullNext[e], -1, -1, hullTri[e]);
+        hullTri[i] = legalize(t + 2);
+        hullTri[e] = t;
+
+        // Обход оболочки вперёд
+        uint32_t next = hullNext[e];
+        while (q = hullNext[next], orient2d(points[next], points[q], p) < 0.0) {
+            t = addTriangle(next, i, q, hullTri[i], -1, hullTri[next]);
+            hullTri[i] = legalize(t + 2);
+            hullNext[next] = next;  // вершина ушла внутрь
+            next = q;
+        }
+
+        // И назад, если видимое ребро было первым проверенным
+        if (e == start) {
+            while (q = hullPrev[e], orient2d(points[q], points[e], p) < 0.0) {
+                t = addTriangle(q, i, e, -1, hullTri[e], hullTri[q]);
+                legalize(t + 2);
+                hullTri[q] = t;
+                hullNext[e] = e;
+                e = q;
+            }
+        }
+
+        hullStart = hullPrev[i] = e;
+        hullNext[e] = hullPrev[next] = i;
+        hullNext[i] = next;
+        hullHash[hashKey(p)] = i;
+        hullHash[hashKey(points[e])] = e;
+    }
+
+    uint32_t e = hullStart;
+    do {
+        hullOut.push_back(e);
+        e = hullNext[e];
+    } while (e != hullStart);
+    return true;
+}
+
+// Номер горизонтальной полосы для координаты y
+inline size_t bandOf(double y, double minY, double bandHeight, size_t bands) {
+
+    double k = (y - minY) / bandHeight;
+    return k <= 0.0 ? 0 : std::min(bands - 1, static_cast<size_t>(k));
+}
+
+} // namespace
+
+double orient2d(const Point2D &a, const Point2D &b, const Point2D &c) {
+
+    double left = (a.x - c.x) * (b.y - c.y);
+    double right = (a.y - c.y) * (b.x - c.x);
+    double det = left - right;
+
+    // Слагаемые разных знаков - знак разности определён
+    double sum;
+    if (left > 0.0) {
+        if (right <= 0.0) return det;
+        sum = left + right;
+    } else if (left < 0.0) {
+        if (right >= 0.0) return det;
+        sum = -left - right;
+    } else {
+        return det;
+    }
+    if (std::fabs(det) >= ORIENT_BOUND * sum) {
+        return det;
+    }
+    return orientExact(a, b, c);
+}
+
+double incircle(const Point2D &a, const Point2D &b, const Point2D &c, const Point2D &d) {
+
+    double adx = a.x - d.x, ady = a.y - d.y;
+    double bdx = b.x - d.x, bdy = b.y - d.y;
+    double cdx = c.x - d.x, cdy = c.y - d.y;
+
+    double bdxcdy = bdx * cdy, cdxbdy = cdx * bdy;
+    double aLift = adx * adx + ady * ady;
+    double cdxady = cdx * ady, adxcdy = adx * cdy;
+    double bLift = bdx * bdx + bdy * bdy;
+    double adxbdy = adx * bdy, bdxady = bdx * ady;
+    double cLift = cdx * cdx + cdy * cdy;
+
+    double det = aLift * (bdxcdy - cdxbdy) + bLift * (cdxady - adxcdy) + cLift * (adxbdy - bdxady);
+    double permanent = (std::fabs(bdxcdy) + std::fabs(cdxbdy)) * aLift
+            + (std::fabs(cdxady) + std::fabs(adxcdy)) * bLift
+            + (std::fabs(adxbdy) + std::fabs(bdxady)) * cLift;
+    if (std::fabs(det) > INCIRCLE_BOUND * permanent) {
+        return det;
+    }
+    return incircleExact(a, b, c, d);
+}
+
+std::vector<uint32_t> convexHull(const std::vector<Point2D> &points) {
+
+    size_t n = points.size();
+    std::vector<uint32_t> hull;
+    if (n == 0) {
+        return hull;
+    }
+
+    // Крайние точки по восьми направлениям против часовой стрелки (слева,
+    // слева снизу, снизу, ...); точки строго внутри их восьмиугольника
+    // в оболочку не входят (Akl-Toussaint)
+    uint32_t octagon[8] = {};
+    double best[8];
+    for (int k = 0; k < 8; k++) best[k] = std::numeric_limits<double>::infinity();
+    for (uint32_t i = 0; i < n; i++) {
+        const Point2D& p = points[i];
+        const double keys[8] = { p.x, p.x + p.y, p.y, p.y - p.x, -p.x, -p.x - p.y, -p.y, p.x - p.y };
+        for (int k = 0; k < 8; k++) {
+            if (keys[k] < best[k]) {
+                best[k] = keys[k];
+                octagon[k] = i;
+            }
+        }
+    }
+
+    std::vector<uint32_t> candidates;
+    for (uint32_t i = 0; i < n; i++) {
+        bool inside = true;
+        for (int k = 0; k < 8 && inside; k++) {
+            inside = orient2d(points[octagon[k]], points[octagon[(k + 1) % 8]], points[i]) > 0.0;
+        }
+        if (!inside) {
+            candidates.push_back(i);
+        }
+    }
+
+    std::sort(candidates.begin(), candidates.end(), [&](uint32_t a, uint32_t b) {
+        return points[a].x < points[b].x || (points[a].x == points[b].x && points[a].y < points[b].y);
+    });
+    candidates.erase(std::unique(candidates.begin(), candidates.end(), [&](uint32_t a, uint32_t b) {
+        return points[a].x == points[b].x && points[a].y == points[b].y;
+    }), candidates.end());
+    if (candidates.size() < 3) {
+        return candidates;
+    }
+
+    // Нижняя цепь слева направо, затем верхняя справа налево
+    hull.resize(2 * candidates.size());
+    size_t k = 0;
+    for (size_t i = 0; i < candidates.size(); i++) {
+        while (k >= 2 && orient2d(points[hull[k - 2]], points[hull[k - 1]], points[candidates[i]]) <= 0.0) k--;
+        hull[k++] = candidates[i];
+    }
+    for (size_t i = candidates.size() - 1, lower = k + 1; i-- > 0;) {
+        while (k >= lower && orient2d(points[hull[k - 2]], points[hull[k - 1]], points[candidates[i]]) <= 0.0) k--;
+        hull[k++] = candidates[i];
+    }
+    hull.resize(k - 1);
+    return hull;
+}
+
+bool delaunay(const std::vector<Point2D> &points, Triangulation &result) {
+
+    DelaunayBuilder builder(points, result);
+    return builder.build();
+}
+
+double polygonArea(const std::vector<Point2D> &polygon) {
+
+    // Координаты относительно первой вершины: меньше потеря точности
+    // для многоугольника, удалённого от начала координат
+    double sum = 0.0;
+    for (size_t i = 1; i + 1 < polygon.size(); i++) {
+        double ax = polygon[i].x - polygon[0].x, ay = polygon[i].y - polygon[0].y;
+        double bx = polygon[i + 1].x - polygon[0].x, by = polygon[i + 1].y - polygon[0].y;
+        sum += ax * by - ay * bx;
+    }
+    return 0.5 * sum;
+}
+
+Point2D polygonCentroid(const std::vector<Point2D> &polygon) {
+
+    Point2D centroid = { 0.0, 0.0 };
+    if (polygon.empty()) {
+        return centroid;
+    }
+
+    double area = 0.0, cx = 0.0, cy = 0.0;
+    for (size_t i = 1; i + 1 < polygon.size(); i++) {
+        double ax = polygon[i].x - polygon[0].x, ay = polygon[i].y - polygon[0].y;
+        double bx = polygon[i + 1].x - polygon[0].x, by = polygon[i + 1].y - polygon[0].y;
+        double cross = ax * by - ay * bx;
+        area += cross;
+        cx += (ax + bx) * cross;
+        cy += (ay + by) * cross;
+    }
+    if (area == 0.0) {
+        for (const Point2D& p : polygon) {
+            centroid.x += p.x;
+            centroid.y += p.y;
+        }
+        centroid.x /= polygon.size();
+        centroid.y /= polygon.size();
+        return centroid;
+    }
+    centroid.x = polygon[0].x + cx / (3.0 * area);
+    centroid.y = polygon[0].y + cy / (3.0 * area);
+    return centroid;
+}
+
+PolygonLocator::PolygonLocator(const std::vector<Point2D> &polygon)
+    : vertices(polygon)
+    , minY(0.0)
+    , maxY(0.0)
+    , bandHeight(1.0)
+{
+    size_t n = vertices.size();
+    if (n < 3) {
+        bandStart.assign(2, 0);
+        return;
+    }
+
+    minY = vertices[0].y;
+    maxY = minY;
+    for (const Point2D& p : vertices) {
+        minY = std::min(minY, p.y);
+        maxY = std::max(maxY, p.y);
+    }
+
+    // Число полос: как можно больше, но так, чтобы рёбра, пересекающие
+    // много полос, не давали больше 8 записей на ребро в среднем
+    size_t bands = std::max<size_t>(1, n);
+    while (true) {
+        bandHeight = maxY > minY ? (maxY - minY) / bands : 1.0;
+        size_t total = 0;
+        for (size_t i = 0; i < n; i++) {
+            const Point2D& a = vertices[i];
+            const Point2D& b = vertices[(i + 1) % n];
+            total += bandOf(std::max(a.y, b.y), minY, bandHeight, bands)
+                    - bandOf(std::min(a.y, b.y), minY, bandHeight, bands) + 1;
+        }
+        if (total <= 8 * n || bands == 1) break;
+        bands /= 2;
+    }
+
+    // Подсчёт и раскладка рёбер по полосам
+    bandStart.assign(bands + 1, 0);
+    for (size_t i = 0; i < n; i++) {
+        const Point2D& a = vertices[i];
+        const Point2D& b = vertices[(i + 1) % n];
+        size_t low = bandOf(std::min(a.y, b.y), minY, bandHeight, bands);
+        size_t high = bandOf(std::max(a.y, b.y), minY, bandHeight, bands);
+        for (size_t k = low; k <= high; k++) bandStart[k + 1]++;
+    }
+    for (size_t k = 0; k < bands; k++) {
+        bandStart[k + 1] += bandStart[k];
+    }
+    edges.resize(bandStart[bands]);
+    std::vector<uint32_t> fill(bandStart.begin(), bandStart.end() - 1);
+    for (size_t i = 0; i < n; i++) {
+        const Point2D& a = vertices[i];
+        const Point2D& b = vertices[(i + 1) % n];
+        size_t low = bandOf(std::min(a.y, b.y), minY, bandHeight, bands);
+        size_t high = bandOf(std::max(a.y, b.y), minY, bandHeight, bands);
+        for (size_t k = low; k <= high; k++) edges[fill[k]++] = static_cast<uint32_t>(i);
+    }
+}
+
+PolygonLocator::Location PolygonLocator::locate(const Point2D &point) const {
+
+    size_t bands = bandStart.size() - 1;
+    size_t n = vertices.size();
+    if (n < 3) {
+        return OUTSIDE;
+    }
+    if (point.y < minY || point.y > maxY) {
+        return OUTSIDE;
+    }
+
+    // Луч вправо от точки; ребро считается по полуоткрытому правилу,
+    // сторона определяется точным orient2d. Рёбра, которые не достают
+    // до точки по y или лежат левее неё, отсеиваются сравнениями
+    bool inside = false;
+    size_t band = bandOf(point.y, minY, bandHeight, bands);
+    for (uint32_t k = bandStart[band]; k < bandStart[band + 1]; k++) {
+        uint32_t i = edges[k];
+        const Point2D& a = vertices[i];
+        const Point2D& b = vertices[i + 1 == n ? 0 : i + 1];
+        if ((a.y < point.y && b.y < point.y) || (a.y > point.y && b.y > point.y)
+                || (a.x < point.x && b.x < point.x)) {
+            continue;
+        }
+        double side = orient2d(a, b, point);
+        if (side == 0.0 && std::min(a.x, b.x) <= point.x && point.x <= std::max(a.x, b.x)) {
+            return BOUNDARY;
+        }
+        if (a.y <= point.y && b.y > point.y && side > 0.0) {
+            inside = !inside;
+        } else if (b.y <= point.y && a.y > point.y && side < 0.0) {
+            inside = !inside;
+        }
+    }
+    return inside ? INSIDE : OUTSIDE;
+}
+
+void PolygonLocator::locate(const Point2D *points, size_t count, Location *result) const {
+
+    const size_t PARALLEL_COUNT = 1 << 16;
+    size_t threads = std::max(1u, std::thread::hardware_concurrency());
+    if (count < PARALLEL_COUNT || threads == 1) {
+        for (size_t i = 0; i < count; i++) {
+            result[i] = locate(points[i]);
+        }
+        return;
+    }
+
+    size_t stripe = (count + threads - 1) / threads;
+    std::vector<std::thread> pool;
+    for (size_t begin = stripe; begin < count; begin += stripe) {
+        size_t end = std::min(count, begin + stripe);
+        pool.emplace_back([this, points, result, begin, end]() {
+            for (size_t i = begin; i < end; i++) {
+                result[i] = locate(points[i]);
+            }
+        });
+    }
+    for (size_t i = 0; i < std::min(count, stripe); i++) {
+        result[i] = locate(points[i]);
+    }
+    for (std::thread& thread : pool) {
+        thread.join();
+    }
+}
@@ -0,0 +1,83 @@
+#ifndef GEOMETRY_H
+#define GEOMETRY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Вычислительное ядро вкладки геометрии: наборы точек, выпуклая оболочка,
+// триангуляция Делоне, площадь и центр масс многоугольника, принадлежность
+// точки многоугольнику. Без Qt, чтобы ядро можно было использовать и проверять
+// отдельно от интерфейса. Ось y направлена вверх: "против часовой" - как на бумаге.
+
+struct Point2D {
+    double x;
+    double y;
+};
+
+// Знак ориентации тройки: > 0 - поворот a -> b -> c против часовой стрелки,
+// < 0 - по часовой, 0 - точки на одной прямой.
+// Знак точный: при малом |det| значение пересчитывается в точной арифметике
+double orient2d(const Point2D& a, const Point2D& b, const Point2D& c);
+
+// > 0, если d строго внутри окружности через a, b, c (a, b, c против часовой),
+// < 0 - снаружи, 0 - на окружности. Знак точный, как у orient2d
+double incircle(const Point2D& a, const Point2D& b, const Point2D& c, const Point2D& d);
+
+// Выпуклая оболочка: номера вершин против часовой стрелки, без точек
+// на сторонах. Монотонные цепи Эндрю, точки внутри восьмиугольника
+// из крайних точек отбрасываются до сортировки. O(n log n)
+std::vector<uint32_t> convexHull(const std::vector<Point2D>& points);
+
+// Триангуляция Делоне в виде полурёбер: треугольник t - вершины
+// triangles[3t], triangles[3t + 1], triangles[3t + 2] против часовой стрелки,
+// halfedges[e] - парное полуребро соседнего треугольника или -1 на границе,
+// hull - выпуклая оболочка против часовой стрелки
+struct Triangulation {
+    std::vector<uint32_t> triangles;
+    std::vector<int32_t> halfedges;
+    std::vector<uint32_t> hull;
+
+    size_t triangleCount() const { return triangles.size() / 3; }
+};
+
+// Вставка точек в порядке удаления от начального треугольника с обходом
+// оболочки и переворотом рёбер (как в delaunator), ожидаемо O(n log n).
+// Совпадающие точки пропускаются. Возвращает false, если точек меньше
+// трёх или все они на одной прямой
+bool delaunay(const std::vector<Point2D>& points, Triangulation& result);
+
+// Ориентированная площадь (> 0 для обхода против часовой) и центр масс
+// многоугольника. Для вырожденного многоугольника центр - среднее вершин
+double polygonArea(const std::vector<Point2D>& polygon);
+Point2D polygonCentroid(const std::vector<Point2D>& polygon);
+
+// Принадлежность точек многоугольнику (правило чётности пересечений).
+// Рёбра раскладываются по горизонтальным полосам, так что запрос
+// проверяет только рёбра своей полосы
+class PolygonLocator
+{
+public:
+    enum Location {
+        OUTSIDE,
+        INSIDE,
+        BOUNDARY
+    };
+
+    explicit PolygonLocator(const std::vector<Point2D>& polygon);
+
+    Location locate(const Point2D& point) const;
+    // Пакетный запрос; большие пакеты делятся между потоками
+    void locate(const Point2D* points, size_t count, Location* result) const;
+
+private:
+    std::vector<Point2D> vertices;
+    double minY;
+    double maxY;
+    double bandHeight;
+    // Рёбра полосы k: edges[bandStart[k] .. bandStart[k + 1]), номер ребра - номер начальной вершины
+    std::vector<uint32_t> bandStart;
+    std::vector<uint32_t> edges;
+};
+
+#endif // GEOMETRY_H
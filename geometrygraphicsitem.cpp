@@ -0,0 +1,259 @@
+#include "geometrygraphicsitem.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// Меньше этого числа пикселей на ячейку или ребро детали не различимы
+const double DETAIL_PIXELS = 2.0;
+// Линии и точки передаются в QPainter порциями
+const size_t DRAW_CHUNK = 4096;
+
+QPen cosmeticPen(const QColor& color, double width) {
+
+    QPen pen(color, width);
+    pen.setCosmetic(true);
+    return pen;
+}
+
+} // namespace
+
+GeometryGraphicsItem::GeometryGraphicsItem(const std::vector<Point2D> &points)
+    : gridSize(1)
+    , cellWidth(1.0)
+    , cellHeight(1.0)
+    , meanEdgeLength(0.0)
+    , hasMarker(false)
+{
+    setFlag(QGraphicsItem::ItemUsesExtendedStyleOption);
+
+    scenePoints.reserve(points.size());
+    for (const Point2D& p : points) {
+        scenePoints.push_back(toScene(p));
+    }
+    if (scenePoints.empty()) {
+        pointStart.assign(2, 0);
+        edgeStart.assign(2, 0);
+        return;
+    }
+
+    double minX = scenePoints[0].x(), maxX = minX;
+    double minY = scenePoints[0].y(), maxY = minY;
+    for (const QPointF& p : scenePoints) {
+        minX = std::min(minX, p.x());
+        maxX = std::max(maxX, p.x());
+        minY = std::min(minY, p.y());
+        maxY = std::max(maxY, p.y());
+    }
+    bounds = QRectF(QPointF(minX, minY), QPointF(maxX, maxY));
+
+    // Около четырёх точек на ячейку
+    gridSize = std::max(1, std::min(1024, static_cast<int>(std::sqrt(scenePoints.size() / 4.0))));
+    cellWidth = std::max(bounds.width(), 1e-300) / gridSize;
+    cellHeight = std::max(bounds.height(), 1e-300) / gridSize;
+
+    size_t cells = static_cast<size_t>(gridSize) * gridSize;
+    pointStart.assign(cells + 1, 0);
+    std::vector<uint32_t> cellOf(scenePoints.size());
+    for (size_t i = 0; i < scenePoints.size(); i++) {
+        cellOf[i] = cellY(scenePoints[i].y()) * gridSize + cellX(scenePoints[i].x());
+        pointStart[cellOf[i] + 1]++;
+    }
+    for (size_t c = 0; c < cells; c++) {
+        pointStart[c + 1] += pointStart[c];
+    }
+    pointIndex.resize(scenePoints.size());
+    std::vector<uint32_t> fill(pointStart.begin(), pointStart.end() - 1);
+    for (size_t i = 0; i < scenePoints.size(); i++) {
+        pointIndex[fill[cellOf[i]]++] = static_cast<uint32_t>(i);
+    }
+    edgeStart.assign(cells + 1, 0);
+}
+
+int GeometryGraphicsItem::cellX(double x) const {
+
+    double k = std::floor((x - bounds.left()) / cellWidth);
+    return k <= 0.0 ? 0 : k >= gridSize ? gridSize - 1 : static_cast<int>(k);
+}
+
+int GeometryGraphicsItem::cellY(double y) const {
+
+    double k = std::floor((y - bounds.top()) / cellHeight);
+    return k <= 0.0 ? 0 : k >= gridSize ? gridSize - 1 : static_cast<int>(k);
+}
+
+void GeometryGraphicsItem::cellRange(const QRectF &rect, int &x0, int &y0, int &x1, int &y1) const {
+
+    x0 = cellX(rect.left());
+    x1 = cellX(rect.right());
+    y0 = cellY(rect.top());
+    y1 = cellY(rect.bottom());
+}
+
+void GeometryGraphicsItem::setEdges(const std::vector<uint32_t> &edges) {
+
+    size_t cells = static_cast<size_t>(gridSize) * gridSize;
+    edgeStart.assign(cells + 1, 0);
+    cellEdges.clear();
+    longEdges.clear();
+
+    double total = 0.0;
+    std::vector<uint32_t> cellOf;
+    cellOf.reserve(edges.size() / 2);
+    for (size_t e = 0; e + 1 < edges.size(); e += 2) {
+        const QPointF& a = scenePoints[edges[e]];
+        const QPointF& b = scenePoints[edges[e + 1]];
+        total += std::hypot(b.x() - a.x(), b.y() - a.y());
+        if (std::fabs(b.x() - a.x()) <= cellWidth && std::fabs(b.y() - a.y()) <= cellHeight) {
+            uint32_t c = cellY(a.y()) * gridSize + cellX(a.x());
+            cellOf.push_back(c);
+            edgeStart[c + 1]++;
+        } else {
+            cellOf.push_back(UINT32_MAX);
+            longEdges.push_back(edges[e]);
+            longEdges.push_back(edges[e + 1]);
+        }
+    }
+    meanEdgeLength = edges.size() >= 2 ? total / (edges.size() / 2) : 0.0;
+
+    for (size_t c = 0; c < cells; c++) {
+        edgeStart[c + 1] += edgeStart[c];
+    }
+    cellEdges.resize(2 * edgeStart[cells]);
+    std::vector<uint32_t> fill(edgeStart.begin(), edgeStart.end() - 1);
+    for (size_t e = 0; e < cellOf.size(); e++) {
+        if (cellOf[e] == UINT32_MAX) continue;
+        uint32_t slot = fill[cellOf[e]]++;
+        cellEdges[2 * slot] = edges[2 * e];
+        cellEdges[2 * slot + 1] = edges[2 * e + 1];
+    }
+    update();
+}
+
+void GeometryGraphicsItem::setOutline(const std::vector<uint32_t> &indices) {
+
+    outline.clear();
+    outline.reserve(static_cast<int>(indices.size()));
+    for (uint32_t i : indices) {
+        outline << scenePoints[i];
+    }
+    update();
+}
+
+void GeometryGraphicsItem::setMarker(const Point2D &point, const QColor &color) {
+
+    prepareGeometryChange();
+    hasMarker = true;
+    marker = toScene(point);
+    markerColor = color;
+}
+
+void GeometryGraphicsItem::clearMarker() {
+
+    prepareGeometryChange();
+    hasMarker = false;
+}
+
+QRectF GeometryGraphicsItem::boundingRect() const {
+
+    // Точки и линии рисуются косметическим пером: запас в единицах
+    // сцены не нужен, видимость на краях обеспечивает пересечение с exposedRect
+    QRectF rect = bounds;
+    if (hasMarker) {
+        rect = rect.united(QRectF(marker, marker));
+    }
+    return rect;
+}
+
+void GeometryGraphicsItem::paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget) {
+    Q_UNUSED(widget);
+
+    if (scenePoints.empty()) {
+        return;
+    }
+    double pixels = option->levelOfDetailFromTransform(painter->worldTransform());
+    QRectF exposed = option->exposedRect;
+    int x0, y0, x1, y1;
+    cellRange(exposed, x0, y0, x1, y1);
+
+    // Контур с заливкой - один вызов
+    if (outline.size() >= 2) {
+        painter->setPen(cosmeticPen(QColor(25, 118, 210), 2.0));
+        painter->setBrush(QColor(25, 118, 210, 40));
+        painter->drawPolygon(outline);
+    }
+
+    // Внутренние рёбра - только если их можно различить
+    if (meanEdgeLength * pixels >= DETAIL_PIXELS) {
+        painter->setPen(cosmeticPen(QColor(90, 90, 90), 1.0));
+        std::vector<QLineF> lines;
+        lines.reserve(DRAW_CHUNK);
+        auto flush = [&]() {
+            painter->drawLines(lines.data(), static_cast<int>(lines.size()));
+            lines.clear();
+        };
+
+        // Короткое ребро может начинаться в соседней ячейке
+        int ex0 = std::max(0, x0 - 1), ey0 = std::max(0, y0 - 1);
+        int ex1 = std::min(gridSize - 1, x1 + 1), ey1 = std::min(gridSize - 1, y1 + 1);
+        for (int cy = ey0; cy <= ey1; cy++) {
+            for (int cx = ex0; cx <= ex1; cx++) {
+                size_t c = static_cast<size_t>(cy) * gridSize + cx;
+                for (uint32_t k = edgeStart[c]; k < edgeStart[c + 1]; k++) {
+                    lines.push_back(QLineF(scenePoints[cellEdges[2 * k]], scenePoints[cellEdges[2 * k + 1]]));
+                    if (lines.size() == DRAW_CHUNK) flush();
+                }
+            }
+        }
+        for (size_t k = 0; k + 1 < longEdges.size(); k += 2) {
+            const QPointF& a = scenePoints[longEdges[k]];
+            const QPointF& b = scenePoints[longEdges[k + 1]];
+            QRectF box = QRectF(a, b).normalized();
+            if (box.right() < exposed.left() || box.left() > exposed.right()
+                    || box.bottom() < exposed.top() || box.top() > exposed.bottom()) {
+                continue;
+            }
+            lines.push_back(QLineF(a, b));
+            if (lines.size() == DRAW_CHUNK) flush();
+        }
+        if (!lines.empty()) flush();
+    }
+
+    // Точки: при мелком масштабе - одна точка на блок ячеек размером
+    // не меньше DETAIL_PIXELS, иначе все точки видимых ячеек
+    std::vector<QPointF> batch;
+    batch.reserve(DRAW_CHUNK);
+    double cellPixels = std::min(cellWidth, cellHeight) * pixels;
+    int step = cellPixels >= DETAIL_PIXELS ? 1 : static_cast<int>(std::ceil(DETAIL_PIXELS / cellPixels));
+    painter->setPen(cosmeticPen(QColor(211, 47, 47), step == 1 && cellPixels >= 4 * DETAIL_PIXELS ? 4.0 : 2.0));
+    for (int by = y0; by <= y1; by += step) {
+        for (int bx = x0; bx <= x1; bx += step) {
+            for (int cy = by; cy < std::min(by + step, y1 + 1); cy++) {
+                for (int cx = bx; cx < std::min(bx + step, x1 + 1); cx++) {
+                    size_t c = static_cast<size_t>(cy) * gridSize + cx;
+                    uint32_t end = step == 1 ? pointStart[c + 1] : std::min(pointStart[c + 1], pointStart[c] + 1);
+                    for (uint32_t k = pointStart[c]; k < end; k++) {
+                        batch.push_back(scenePoints[pointIndex[k]]);
+                    }
+                    if (step > 1 && end > pointStart[c]) {
+                        cy = by + step;  // блок уже представлен точкой
+                        break;
+                    }
+                }
+            }
+            if (batch.size() >= DRAW_CHUNK) {
+                painter->drawPoints(batch.data(), static_cast<int>(batch.size()));
+                batch.clear();
+            }
+        }
+    }
+    if (!batch.empty()) {
+        painter->drawPoints(batch.data(), static_cast<int>(batch.size()));
+    }
+
+    if (hasMarker) {
+        painter->setPen(cosmeticPen(markerColor, 10.0));
+        painter->drawPoint(marker);
+    }
+}
@@ -0,0 +1,70 @@
+#ifndef GEOMETRYGRAPHICSITEM_H
+#define GEOMETRYGRAPHICSITEM_H
+
+#include "geometry.h"
+
+#include <QGraphicsItem>
+#include <QPainter>
+#include <QPen>
+#include <QPointF>
+#include <QRectF>
+#include <QStyleOptionGraphicsItem>
+
+#include <vector>
+
+// Один элемент сцены на весь набор точек вкладки геометрии: точки, рёбра
+// триангуляции и контур (оболочка или многоугольник). Точки и рёбра
+// разложены по равномерной сетке ячеек, так что отрисовка перебирает
+// только ячейки видимой области. При мелком масштабе ячейка рисуется
+// одной точкой, а внутренние рёбра не рисуются.
+// Ось y модели направлена вверх, в сцене - вниз: y меняет знак
+class GeometryGraphicsItem : public QGraphicsItem
+{
+public:
+    explicit GeometryGraphicsItem(const std::vector<Point2D>& points);
+
+    // Рёбра - пары номеров точек
+    void setEdges(const std::vector<uint32_t>& edges);
+    // Замкнутый контур по номерам точек
+    void setOutline(const std::vector<uint32_t>& outline);
+    // Отметка точки запроса (координаты модели)
+    void setMarker(const Point2D& point, const QColor& color);
+    void clearMarker();
+
+    static QPointF toScene(const Point2D& point) { return QPointF(point.x, -point.y); }
+    static Point2D fromScene(const QPointF& point) { Point2D p = { point.x(), -point.y() }; return p; }
+
+    QRectF boundingRect() const override;
+    void paint(QPainter* painter, const QStyleOptionGraphicsItem* option, QWidget* widget = nullptr) override;
+
+private:
+    // Диапазон ячеек, пересекающих прямоугольник сцены
+    void cellRange(const QRectF& rect, int& x0, int& y0, int& x1, int& y1) const;
+    int cellX(double x) const;
+    int cellY(double y) const;
+
+    std::vector<QPointF> scenePoints;
+    QRectF bounds;
+
+    // Сетка gridSize x gridSize: точки ячейки c - pointIndex[pointStart[c] .. pointStart[c + 1])
+    int gridSize;
+    double cellWidth;
+    double cellHeight;
+    std::vector<uint32_t> pointStart;
+    std::vector<uint32_t> pointIndex;
+
+    // Рёбра - пары номеров точек. Короткие (не длиннее ячейки) разложены
+    // по ячейке первого конца, длинные проверяются отдельно по габаритам
+    std::vector<uint32_t> edgeStart;
+    std::vector<uint32_t> cellEdges;
+    std::vector<uint32_t> longEdges;
+    double meanEdgeLength;
+
+    QPolygonF outline;
+
+    bool hasMarker;
+    QPointF marker;
+    QColor markerColor;
+};
+
+#endif // GEOMETRYGRAPHICSITEM_H
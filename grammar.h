@@ -0,0 +1,128 @@
+#ifndef GRAMMAR_H
+#define GRAMMAR_H
+
+#include <cstddef>
+
+// Лексика языка выражений: классы символов, приоритеты операторов,
+// правило унарного минуса, именованные константы и имена действительных
+// функций. Одно определение для разбора во время выполнения
+// (ExpressionCalculator::toRPN) и во время компиляции (staticexpression.h),
+// поэтому всё constexpr в стиле C++11.
+
+// Значения констант: запись числа в ОПН и значение double берутся отсюда же
+#define GRAMMAR_PI 3.14159265358979323846
+#define GRAMMAR_E 2.71828182845904523536
+#define GRAMMAR_STRINGIZE_TEXT(value) #value
+#define GRAMMAR_STRINGIZE(value) GRAMMAR_STRINGIZE_TEXT(value)
+
+namespace grammar {
+
+constexpr double PI = GRAMMAR_PI;
+constexpr double E = GRAMMAR_E;
+constexpr const char* PI_TEXT = GRAMMAR_STRINGIZE(GRAMMAR_PI);
+constexpr const char* E_TEXT = GRAMMAR_STRINGIZE(GRAMMAR_E);
+
+constexpr bool isOperator(char c) {
+    return c == '+' || c == '-' || c == '*' || c == '/' || c == '^';
+}
+
+// Приоритет бинарного оператора. Все операторы левоассоциативны,
+// в том числе '^': 2^3^2 = (2^3)^2
+constexpr int precedence(char op) {
+    return op == '+' || op == '-' ? 1
+         : op == '*' || op == '/' ? 2
+         : op == '^' ? 3 : 0;
+}
+
+constexpr bool isDigit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+// Символы числа: цифры и точка, без показателя степени
+constexpr bool isNumberChar(char c) {
+    return isDigit(c) || c == '.';
+}
+
+constexpr bool isLetter(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+// Имя начинается с буквы, дальше допускаются цифры и подчёркивание: x1, A_2
+constexpr bool isIdentifierChar(char c) {
+    return isLetter(c) || isDigit(c) || c == '_';
+}
+
+// Пробельные символы удаляются до разбора (как std::isspace в локали "C")
+constexpr bool isSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\v' || c == '\f' || c == '\r';
+}
+
+// Минус после начала выражения, '(', '[', оператора, ',' или ';' - унарный:
+// перед ним подставляется операнд 0, и дальше это обычный бинарный минус.
+// Поэтому 2*-3 = 2*0 - 3 = -3, а 2^-1 = 2^0 - 1 = 0
+constexpr bool opensOperand(char previous) {
+    return previous == '(' || previous == '[' || isOperator(previous) || previous == ',' || previous == ';';
+}
+
+// Действительные встроенные функции (таблица калькулятора проверяется
+// на совпадение имён при компиляции expressioncalculator.cpp)
+enum Function {
+    FUNCTION_ABS, FUNCTION_ACOS, FUNCTION_ASIN, FUNCTION_ATAN, FUNCTION_COS, FUNCTION_COSH,
+    FUNCTION_COT, FUNCTION_CSC, FUNCTION_EXP, FUNCTION_LN, FUNCTION_LOG, FUNCTION_SEC,
+    FUNCTION_SIN, FUNCTION_SINH, FUNCTION_SQRT, FUNCTION_TAN, FUNCTION_TANH
+};
+
+struct FunctionName {
+    const char* name;
+    Function function;
+};
+
+// Упорядочены по имени, синонимы - отдельные строки
+constexpr FunctionName FUNCTION_NAMES[] = {
+    { "abs", FUNCTION_ABS },
+    { "acos", FUNCTION_ACOS },
+    { "arccos", FUNCTION_ACOS },
+    { "arcsin", FUNCTION_ASIN },
+    { "arctg", FUNCTION_ATAN },
+    { "asin", FUNCTION_ASIN },
+    { "atan", FUNCTION_ATAN },
+    { "cos", FUNCTION_COS },
+    { "cosh", FUNCTION_COSH },
+    { "cot", FUNCTION_COT },
+    { "csc", FUNCTION_CSC },
+    { "ctg", FUNCTION_COT },
+    { "exp", FUNCTION_EXP },
+    { "ln", FUNCTION_LN },
+    { "log", FUNCTION_LOG },
+    { "sec", FUNCTION_SEC },
+    { "sin", FUNCTION_SIN },
+    { "sinh", FUNCTION_SINH },
+    { "sqrt", FUNCTION_SQRT },
+    { "tan", FUNCTION_TAN },
+    { "tanh", FUNCTION_TANH },
+    { "tg", FUNCTION_TAN }
+};
+
+constexpr size_t FUNCTION_COUNT = sizeof(FUNCTION_NAMES) / sizeof(FUNCTION_NAMES[0]);
+
+// Имя name совпадает с фрагментом text длины length
+constexpr bool sameName(const char* name, const char* text, size_t length) {
+    return length == 0 ? *name == '\0'
+                       : *name == *text && sameName(name + 1, text + 1, length - 1);
+}
+
+// Номер строки FUNCTION_NAMES или -1
+constexpr int findFunction(const char* text, size_t length, size_t i = 0) {
+    return i == FUNCTION_COUNT ? -1
+         : sameName(FUNCTION_NAMES[i].name, text, length) ? static_cast<int>(i)
+         : findFunction(text, length, i + 1);
+}
+
+// sum(k, a, b, f), prod(...), integral(x, a, b, f) - одна конструкция с четырьмя аргументами
+constexpr bool isReduction(const char* text, size_t length) {
+    return sameName("sum", text, length) || sameName("prod", text, length) || sameName("integral", text, length);
+}
+
+} // namespace grammar
+
+#endif // GRAMMAR_H
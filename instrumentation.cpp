@@ -0,0 +1,340 @@
+#include "instrumentation.h"
+
+#ifdef CALC_INSTRUMENTATION
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <mutex>
+#include <new>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#elif defined(_M_X64) || defined(_M_IX86)
+#include <intrin.h>
+#endif
+
+namespace {
+
+// Размер таблицы вызовов функций в блоке потока (открытая адресация)
+const size_t FUNCTION_SLOTS = 256;
+
+struct FunctionSlot {
+    std::atomic<const void*> function;
+    std::atomic<uint64_t> count;
+};
+
+// Блок счётчиков одного потока. Пишет только владелец, поэтому
+// вместо fetch_add достаточно load + store; читатели видят
+// согласованные по отдельности значения без блокировок
+struct ThreadCounters {
+    std::atomic<uint64_t> stageCycles[Instrumentation::STAGE_COUNT];
+    std::atomic<uint64_t> stageCalls[Instrumentation::STAGE_COUNT];
+    std::atomic<uint64_t> stageAllocations[Instrumentation::STAGE_COUNT];
+    std::atomic<uint64_t> tokens;
+    std::atomic<uint64_t> stackHighWater;
+    std::atomic<uint64_t> memoHits;
+    std::atomic<uint64_t> memoMisses;
+    std::atomic<uint64_t> otherFunctionCalls;   // таблица переполнена
+    FunctionSlot functions[FUNCTION_SLOTS];
+    ThreadCounters* next;
+};
+
+inline void add(std::atomic<uint64_t> &counter, uint64_t value) {
+    counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+// Список блоков всех потоков; блоки не освобождаются,
+// чтобы счётчики завершившихся потоков остались в сумме
+std::atomic<ThreadCounters*> allCounters(nullptr);
+
+thread_local ThreadCounters* localCounters = nullptr;
+thread_local Instrumentation::Stage currentStage = Instrumentation::STAGE_NONE;
+
+ThreadCounters& counters() {
+
+    if (!localCounters) {
+        // malloc, а не new: operator new сам обращается к счётчикам
+        void* memory = std::malloc(sizeof(ThreadCounters));
+        ThreadCounters* block = static_cast<ThreadCounters*>(memory);
+        for (size_t i = 0; i < Instrumentation::STAGE_COUNT; i++) {
+            new (&block->stageCycles[i]) std::atomic<uint64_t>(0);
+            new (&block->stageCalls[i]) std::atomic<uint64_t>(0);
+            new (&block->stageAllocations[i]) std::atomic<uint64_t>(0);
+        }
+        new (&block->tokens) std::atomic<uint64_t>(0);
+        new (&block->stackHighWater) std::atomic<uint64_t>(0);
+        new (&block->memoHits) std::atomic<uint64_t>(0);
+        new (&block->memoMisses) std::atomic<uint64_t>(0);
+        new (&block->otherFunctionCalls) std::atomic<uint64_t>(0);
+        for (size_t i = 0; i < FUNCTION_SLOTS; i++) {
+            new (&block->functions[i].function) std::atomic<const void*>(nullptr);
+            new (&block->functions[i].count) std::atomic<uint64_t>(0);
+        }
+
+        block->next = allCounters.load();
+        while (!allCounters.compare_exchange_weak(block->next, block)) {
+        }
+        localCounters = block;
+    }
+    return *localCounters;
+}
+
+std::mutex& registryMutex() {
+    static std::mutex mutex;
+    return mutex;
+}
+
+std::map<const void*, std::string>& registry() {
+    static std::map<const void*, std::string> names;
+    return names;
+}
+
+void appendNumber(std::string &text, uint64_t value) {
+    text += std::to_string(static_cast<unsigned long long>(value));
+}
+
+} // namespace
+
+const char* Instrumentation::stageName(Stage stage) {
+
+    switch (stage) {
+    case STAGE_REMOVE_SPACES: return "remove_spaces";
+    case STAGE_CHECK_PARENTHESES: return "check_parentheses";
+    case STAGE_TO_RPN: return "to_rpn";
+    case STAGE_BUILD_TREE: return "build_tree";
+    case STAGE_LOWERING: return "lowering";
+    case STAGE_EVALUATE: return "evaluate";
+    case STAGE_EVALUATE_BATCH: return "evaluate_batch";
+    default: return "none";
+    }
+}
+
+uint64_t Instrumentation::cycles() {
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+    return __rdtsc();
+#else
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+}
+
+void Instrumentation::addStage(Stage stage, uint64_t cycles) {
+
+    ThreadCounters& local = counters();
+    add(local.stageCycles[stage], cycles);
+    add(local.stageCalls[stage], 1);
+}
+
+void Instrumentation::addTokens(uint64_t count) {
+    add(counters().tokens, count);
+}
+
+void Instrumentation::recordStackDepth(uint64_t depth) {
+
+    ThreadCounters& local = counters();
+    if (depth > local.stackHighWater.load(std::memory_order_relaxed)) {
+        local.stackHighWater.store(depth, std::memory_order_relaxed);
+    }
+}
+
+void Instrumentation::addMemoLookups(uint64_t hits, uint64_t misses) {
+
+    ThreadCounters& local = counters();
+    add(local.memoHits, hits);
+    add(local.memoMisses, misses);
+}
+
+void Instrumentation::addFunctionCalls(const void *function, uint64_t count) {
+
+    ThreadCounters& local = counters();
+    size_t slot = (reinterpret_cast<uintptr_t>(function) >> 4) % FUNCTION_SLOTS;
+    for (size_t probe = 0; probe < FUNCTION_SLOTS; probe++) {
+        FunctionSlot& entry = local.functions[(slot + probe) % FUNCTION_SLOTS];
+        const void* key = entry.function.load(std::memory_order_relaxed);
+        if (key == function) {
+            add(entry.count, count);
+            return;
+        }
+        if (!key) {
+            // Сначала счётчик, потом ключ: читатель не увидит чужой счётчик
+            entry.count.store(count, std::memory_order_relaxed);
+            entry.function.store(function, std::memory_order_release);
+            return;
+        }
+    }
+    add(local.otherFunctionCalls, count);
+}
+
+void Instrumentation::noteAllocation() {
+
+    if (currentStage != STAGE_NONE) {
+        add(counters().stageAllocations[currentStage], 1);
+    }
+}
+
+void Instrumentation::registerFunction(const void *function, const std::string &name) {
+
+    std::lock_guard<std::mutex> lock(registryMutex());
+    registry()[function] = name;
+}
+
+Instrumentation::Snapshot Instrumentation::snapshot() {
+
+    Snapshot result;
+    std::map<std::string, uint64_t> functionCalls;
+    uint64_t otherCalls = 0;
+
+    std::lock_guard<std::mutex> lock(registryMutex());
+    for (ThreadCounters* block = allCounters.load(); block; block = block->next) {
+        result.threads++;
+        for (size_t i = 0; i < STAGE_COUNT; i++) {
+            result.stageCycles[i] += block->stageCycles[i].load(std::memory_order_relaxed);
+            result.stageCalls[i] += block->stageCalls[i].load(std::memory_order_relaxed);
+            result.stageAllocations[i] += block->stageAllocations[i].load(std::memory_order_relaxed);
+        }
+        result.tokens += block->tokens.load(std::memory_order_relaxed);
+        result.stackHighWater = std::max(result.stackHighWater,
+                                         block->stackHighWater.load(std::memory_order_relaxed));
+        result.memoHits += block->memoHits.load(std::memory_order_relaxed);
+        result.memoMisses += block->memoMisses.load(std::memory_order_relaxed);
+        otherCalls += block->otherFunctionCalls.load(std::memory_order_relaxed);
+
+        for (size_t i = 0; i < FUNCTION_SLOTS; i++) {
+            const void* key = block->functions[i].function.load(std::memory_order_acquire);
+            if (!key) continue;
+            uint64_t count = block->functions[i].count.load(std::memory_order_relaxed);
+            auto name = registry().find(key);
+            if (name != registry().end()) {
+                functionCalls[name->second] += count;
+            } else {
+                otherCalls += count;
+            }
+        }
+    }
+
+    result.functionCalls.assign(functionCalls.begin(), functionCalls.end());
+    if (otherCalls) {
+        result.functionCalls.push_back(std::make_pair(std::string("other"), otherCalls));
+    }
+    return result;
+}
+
+std::string Instrumentation::toJson(const Snapshot &snapshot) {
+
+    std::string text = "{\"threads\":";
+    appendNumber(text, snapshot.threads);
+    text += ",\"stages\":{";
+    for (size_t i = 0; i < STAGE_COUNT; i++) {
+        if (i) text += ',';
+        text += '"';
+        text += stageName(static_cast<Stage>(i));
+        text += "\":{\"calls\":";
+        appendNumber(text, snapshot.stageCalls[i]);
+        text += ",\"cycles\":";
+        appendNumber(text, snapshot.stageCycles[i]);
+        text += ",\"allocations\":";
+        appendNumber(text, snapshot.stageAllocations[i]);
+        text += '}';
+    }
+    text += "},\"tokens\":";
+    appendNumber(text, snapshot.tokens);
+    text += ",\"stack_high_water\":";
+    appendNumber(text, snapshot.stackHighWater);
+    text += ",\"memo\":{\"hits\":";
+    appendNumber(text, snapshot.memoHits);
+    text += ",\"misses\":";
+    appendNumber(text, snapshot.memoMisses);
+    text += "},\"function_calls\":{";
+    for (size_t i = 0; i < snapshot.functionCalls.size(); i++) {
+        // Имена функций состоят из букв, цифр и '#', экранирование не нужно
+        if (i) text += ',';
+        text += '"';
+        text += snapshot.functionCalls[i].first;
+        text += "\":";
+        appendNumber(text, snapshot.functionCalls[i].second);
+    }
+    text += "}}";
+    return text;
+}
+
+std::string Instrumentation::toPrometheus(const Snapshot &snapshot) {
+
+    std::string text;
+    const char* stageMetrics[3][2] = {
+        { "calc_stage_calls_total", "Number of times the stage ran" },
+        { "calc_stage_cycles_total", "CPU cycles spent in the stage" },
+        { "calc_stage_allocations_total", "Heap allocations made inside the stage" }
+    };
+    const uint64_t* stageValues[3] = { snapshot.stageCalls, snapshot.stageCycles, snapshot.stageAllocations };
+
+    for (size_t metric = 0; metric < 3; metric++) {
+        text += std::string("# HELP ") + stageMetrics[metric][0] + " " + stageMetrics[metric][1] + "\n";
+        text += std::string("# TYPE ") + stageMetrics[metric][0] + " counter\n";
+        for (size_t i = 0; i < STAGE_COUNT; i++) {
+            text += std::string(stageMetrics[metric][0]) + "{stage=\"" + stageName(static_cast<Stage>(i)) + "\"} ";
+            appendNumber(text, stageValues[metric][i]);
+            text += '\n';
+        }
+    }
+
+    text += "# HELP calc_tokens_total Tokens produced by toRPN\n# TYPE calc_tokens_total counter\ncalc_tokens_total ";
+    appendNumber(text, snapshot.tokens);
+    text += "\n# HELP calc_stack_high_water Deepest evaluation stack\n# TYPE calc_stack_high_water gauge\ncalc_stack_high_water ";
+    appendNumber(text, snapshot.stackHighWater);
+    text += "\n# HELP calc_memo_hits_total Subexpressions taken from a MemoCache\n"
+            "# TYPE calc_memo_hits_total counter\ncalc_memo_hits_total ";
+    appendNumber(text, snapshot.memoHits);
+    text += "\n# HELP calc_memo_misses_total Subexpressions recomputed with a MemoCache\n"
+            "# TYPE calc_memo_misses_total counter\ncalc_memo_misses_total ";
+    appendNumber(text, snapshot.memoMisses);
+    text += "\n# HELP calc_threads Threads that touched the calculator\n# TYPE calc_threads gauge\ncalc_threads ";
+    appendNumber(text, snapshot.threads);
+    text += "\n# HELP calc_function_calls_total Calls per entry of the functions table\n"
+            "# TYPE calc_function_calls_total counter\n";
+    for (const auto& entry : snapshot.functionCalls) {
+        text += "calc_function_calls_total{function=\"" + entry.first + "\"} ";
+        appendNumber(text, entry.second);
+        text += '\n';
+    }
+    return text;
+}
+
+Instrumentation::ScopedStage::ScopedStage(Stage stage)
+    : stage(stage)
+    , previous(currentStage)
+    , start(Instrumentation::cycles())
+{
+    currentStage = stage;
+}
+
+Instrumentation::ScopedStage::~ScopedStage() {
+
+    Instrumentation::addStage(stage, Instrumentation::cycles() - start);
+    currentStage = previous;
+}
+
+// Подсчёт выделений памяти: глобальный operator new заменяется
+// только в сборке с инструментированием
+void* operator new(std::size_t size) {
+
+    Instrumentation::noteAllocation();
+    void* memory = std::malloc(size ? size : 1);
+    if (!memory) throw std::bad_alloc();
+    return memory;
+}
+
+// noinline: иначе GCC, встроив delete в код контейнеров этого файла,
+// ошибочно сообщает о free() для памяти из new
+#if defined(__GNUC__)
+__attribute__((noinline))
+#endif
+void operator delete(void* memory) noexcept {
+    std::free(memory);
+}
+
+#endif // CALC_INSTRUMENTATION
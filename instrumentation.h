@@ -0,0 +1,103 @@
+#ifndef INSTRUMENTATION_H
+#define INSTRUMENTATION_H
+
+// Счётчики горячего пути ExpressionCalculator: такты по этапам
+// (removeSpaces, проверка скобок, toRPN, построение дерева, сборка программы,
+// вычисление),
+// число токенов, максимальная глубина стека, вызовы каждой функции
+// из таблицы встроенных функций, выделения памяти по этапам и попадания
+// в кэш подвыражений (ExpressionCalculator::MemoCache).
+//
+// Включается при сборке: DEFINES += CALC_INSTRUMENTATION.
+// Без этого макросы ниже пустые и не стоят ничего.
+//
+// Каждый поток пишет только в свой блок счётчиков (атомарные
+// load/store без блокировок), снимок суммирует блоки всех потоков.
+
+#ifdef CALC_INSTRUMENTATION
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+class Instrumentation
+{
+public:
+    enum Stage {
+        STAGE_REMOVE_SPACES,
+        STAGE_CHECK_PARENTHESES,
+        STAGE_TO_RPN,
+        STAGE_BUILD_TREE,
+        STAGE_LOWERING,
+        STAGE_EVALUATE,
+        STAGE_EVALUATE_BATCH,
+        STAGE_COUNT,
+        STAGE_NONE = STAGE_COUNT
+    };
+
+    struct Snapshot {
+        uint64_t threads = 0;
+        uint64_t stageCycles[STAGE_COUNT] = {};
+        uint64_t stageCalls[STAGE_COUNT] = {};
+        uint64_t stageAllocations[STAGE_COUNT] = {};
+        uint64_t tokens = 0;
+        uint64_t stackHighWater = 0;
+        uint64_t memoHits = 0;
+        uint64_t memoMisses = 0;
+        std::vector<std::pair<std::string, uint64_t>> functionCalls;  // по имени функции
+    };
+
+    static const char* stageName(Stage stage);
+
+    // Такты процессора (rdtsc) или наносекунды, если rdtsc недоступен
+    static uint64_t cycles();
+
+    static void addStage(Stage stage, uint64_t cycles);
+    static void addTokens(uint64_t count);
+    static void recordStackDepth(uint64_t depth);
+    static void addMemoLookups(uint64_t hits, uint64_t misses);
+    static void addFunctionCalls(const void* function, uint64_t count);
+    static void noteAllocation();
+
+    // Имя для вызовов, учтённых по адресу функции
+    static void registerFunction(const void* function, const std::string& name);
+
+    static Snapshot snapshot();
+    static std::string toJson(const Snapshot& snapshot);
+    static std::string toPrometheus(const Snapshot& snapshot);
+
+    // Замер этапа: такты и выделения памяти внутри области видимости
+    class ScopedStage
+    {
+    public:
+        explicit ScopedStage(Stage stage);
+        ~ScopedStage();
+
+    private:
+        Stage stage;
+        Stage previous;
+        uint64_t start;
+    };
+};
+
+#define INSTRUMENT_STAGE(stage) \
+    Instrumentation::ScopedStage instrumentedStage(Instrumentation::stage)
+#define INSTRUMENT_TOKENS(count) Instrumentation::addTokens(count)
+#define INSTRUMENT_STACK_DEPTH(depth) Instrumentation::recordStackDepth(depth)
+#define INSTRUMENT_MEMO(hits, misses) Instrumentation::addMemoLookups(hits, misses)
+#define INSTRUMENT_FUNCTION_CALLS(function, count) Instrumentation::addFunctionCalls(function, count)
+#define INSTRUMENT_REGISTER_FUNCTION(function, name) Instrumentation::registerFunction(function, name)
+
+#else
+
+#define INSTRUMENT_STAGE(stage) ((void)0)
+#define INSTRUMENT_TOKENS(count) ((void)0)
+#define INSTRUMENT_STACK_DEPTH(depth) ((void)0)
+#define INSTRUMENT_MEMO(hits, misses) ((void)sizeof(hits), (void)sizeof(misses))
+#define INSTRUMENT_FUNCTION_CALLS(function, count) ((void)sizeof(function))
+#define INSTRUMENT_REGISTER_FUNCTION(function, name) ((void)sizeof(function), (void)sizeof(name))
+
+#endif // CALC_INSTRUMENTATION
+
+#endif // INSTRUMENTATION_H
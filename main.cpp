@@ -1,5 +1,6 @@
 #include <QApplication>
 #include "mainwindow.h"
+#include "startuptrace.h"
 
 #include <iostream>
 using namespace std;
@@ -11,10 +12,25 @@ double evaluateExpression(const std::string& expression) {
 
 int main(int argc, char *argv[])
 {
+    StartupTrace::start();
 
     QApplication a(argc, argv);
+
+    // --startup-trace печатает этапы запуска, --startup-budget MS
+    // дополнительно завершает приложение с кодом 1 при превышении бюджета
+    QStringList arguments = a.arguments();
+    int budget = arguments.indexOf("--startup-budget");
+    if (budget >= 0 && budget + 1 < arguments.size()) {
+        StartupTrace::enable(arguments[budget + 1].toDouble());
+    } else if (arguments.contains("--startup-trace")) {
+        StartupTrace::enable();
+    }
+    StartupTrace::mark("application");
+
     MainWindow w;
+    StartupTrace::watch(&w);
     w.show();
+    StartupTrace::mark("show");
     return a.exec();
 
 //     Примеры использования
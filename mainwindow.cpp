@@ -1,11 +1,50 @@
 #include "mainwindow.h"
 #include "ui_mainwindow.h"
+#include "ui_trigtab.h"
+#include "startuptrace.h"
+#include "exactnumber.h"
+#include "geometrygraphicsitem.h"
+#include "spreadsheetmodel.h"
+#include "trianglebatchitem.h"
+
+#include <QElapsedTimer>
+#include <QFileDialog>
+#include <QGraphicsScene>
+#include <QGraphicsView>
+#include <QHBoxLayout>
+#include <QHeaderView>
+#include <QMouseEvent>
+#include <QRegularExpression>
+#include <QTableView>
+#include <QWheelEvent>
+#include <QtConcurrent>
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <random>
 
 MainWindow::MainWindow(QWidget *parent)
     : QMainWindow(parent)
     , ui(new Ui::MainWindow)
+    , trigUi(nullptr)
+    , geometryView(nullptr)
+    , geometryScene(nullptr)
+    , geometryPointsEdit(nullptr)
+    , geometryModeCombo(nullptr)
+    , geometryRandomCount(nullptr)
+    , geometryInfoLabel(nullptr)
+    , geometryItem(nullptr)
+    , geometryWatcher(nullptr)
+    , spreadsheetModel(nullptr)
+    , spreadsheetInfoLabel(nullptr)
+    , exactModeBox(nullptr)
+    , calculationCancelled(false)
+    , calculationTarget(TARGET_MAIN)
+    , calculationRow(-1)
 {
     ui->setupUi(this);
+    StartupTrace::mark("setupUi");
     QFont f("Arial", 14, QFont::Bold);
     ui->browser->setFont(f);
 
@@ -82,32 +121,72 @@ MainWindow::MainWindow(QWidget *parent)
         });
     }
 
-    // Настройка таймера для отложенного перерасчета
-    updateTimer = new QTimer();
-    updateTimer->setSingleShot(true);
-    connect(updateTimer, &QTimer::timeout, this, &MainWindow::onUpdateTimerTimeout);
+    // Содержимое вкладок тригонометрии и геометрии создаётся
+    // при первом переходе на них, а не до первой отрисовки окна
+    connect(ui->tabWidget, &QTabWidget::currentChanged, this, &MainWindow::onTabActivated);
+    onTabActivated(ui->tabWidget->currentIndex());
 
     // Подключаем сигналы истории
     connect(ui->historyList, &QListWidget::itemChanged, this, &MainWindow::onHistoryItemChanged);
     connect(ui->historyList, &QListWidget::itemDoubleClicked,this, &MainWindow::onHistoryItemDoubleClicked);
     connect(ui->historyEdit, &QLineEdit::textChanged,this, &MainWindow::onHistoryEditTextChanged);
+    connect(ui->historyEdit, &QLineEdit::returnPressed, [this]() { calculateEditedExpression(true); });
 
     connect(ui->pbtn_clear_history, &QPushButton::clicked, this, &MainWindow::clearHistory);
     connect(ui->pbtn_use_history, &QPushButton::clicked, this, &MainWindow::useHistoryItem);
     connect(ui->historyList, &QListWidget::itemDoubleClicked, this, &MainWindow::useHistoryItem);
     connect(ui->pbtn_recalculate, &QPushButton::clicked,this, &MainWindow::recalculateHistoryItem);
 
+    calculationWatcher = new QFutureWatcher<BackgroundResult>(this);
+    connect(calculationWatcher, &QFutureWatcher<BackgroundResult>::finished,
+            this, &MainWindow::finishBackgroundCalculation);
+    distributionWatcher = new QFutureWatcher<DistributionResult>(this);
+    connect(distributionWatcher, &QFutureWatcher<DistributionResult>::finished,
+            this, &MainWindow::finishEditedDistribution);
+
+    exactModeBox = new QCheckBox("Точно", this);
+    exactModeBox->setToolTip("Точные дроби: 1/3*3 = 1, 0.1 + 0.2 = 0.3; "
+                             "после иррациональных функций - приближённо");
+    ui->statusbar->addPermanentWidget(exactModeBox);
+
+#ifdef CALC_INSTRUMENTATION
+    setupDiagnostics();
+#endif
+    StartupTrace::mark("main window");
 }
 
 MainWindow::~MainWindow(){
 
-    delete updateTimer;
+    // Фоновое вычисление обращается к calculator: дожидаемся его завершения
+    calculationCancelled = true;
+    calculationWatcher->waitForFinished();
+    distributionWatcher->waitForFinished();
+    if (geometryWatcher) {
+        geometryWatcher->waitForFinished();
+    }
+    delete trigUi;
     delete ui;
 }
 
+void MainWindow::onTabActivated(int index){
+
+    QWidget* page = ui->tabWidget->widget(index);
+    if (page == ui->tab_trigonometry && !trigUi) {
+        setupTrigTab();
+        StartupTrace::mark("trigonometry tab");
+    } else if (page == ui->tab_geometry && !geometryView) {
+        setupGeometryTab();
+        StartupTrace::mark("geometry tab");
+    } else if (page == ui->tab_spreadsheet && !spreadsheetModel) {
+        setupSpreadsheetTab();
+        StartupTrace::mark("spreadsheet tab");
+    }
+}
+
 void MainWindow::onBtnClearClicked(){
     text_buffer.clear();
     ui->browser->setText(text_buffer);
+    updatePreview();
 }
 
 void MainWindow::onBtnDotClicked(){
@@ -153,12 +232,14 @@ void MainWindow::onBtnDotClicked(){
         }
 
         ui->browser->setText(text_buffer);
+        updatePreview();
 }
 
 void MainWindow::onBtnBackspaceClicked(){
     if (!text_buffer.isEmpty()) {
         text_buffer.chop(1);
         ui->browser->setText(text_buffer);
+        updatePreview();
         updateStatusBar("Удален последний символ");
     }
 }
@@ -185,9 +266,21 @@ void MainWindow::keyPressEvent(QKeyEvent *e){
     case Qt::Key_Equal:{ calculateResult(); break; }
     case Qt::Key_ParenLeft:{ appendOperator("("); break; }
     case Qt::Key_ParenRight:{ appendOperator(")"); break; }
-    case Qt::Key_Period:
-    case Qt::Key_Comma:{ onBtnDotClicked(); break; }
+    case Qt::Key_Period:{ onBtnDotClicked(); break; }
+    case Qt::Key_Comma:{
+        // Внутри литерала матрицы запятая разделяет элементы строки
+        if (text_buffer.count('[') > text_buffer.count(']')) {
+            appendOperator(",");
+        } else {
+            onBtnDotClicked();
+        }
+        break;
+    }
+    case Qt::Key_BracketLeft:{ appendOperator("["); break; }
+    case Qt::Key_BracketRight:{ appendOperator("]"); break; }
+    case Qt::Key_Semicolon:{ appendOperator(";"); break; }
     case Qt::Key_Backspace:{ onBtnBackspaceClicked(); break; }
+    case Qt::Key_Escape:{ cancelCalculation(); break; }
     case Qt::Key_P:{
          if (e->modifiers() & Qt::ControlModifier) {
              appendFunction("pi");
@@ -205,11 +298,13 @@ void MainWindow::appendDigit(int digit){
 
     text_buffer += QString::number(digit);
     ui->browser->setText(text_buffer);
+    updatePreview();
 }
 
 void MainWindow::appendOperator(const QString &op){
     text_buffer += op;
     ui->browser->setText(text_buffer);
+    updatePreview();
 }
 
 void MainWindow::appendFunction(const QString &func){
@@ -220,34 +315,808 @@ void MainWindow::appendFunction(const QString &func){
         text_buffer += func;
     }
     ui->browser->setText(text_buffer);
+    updatePreview();
 }
 
 void MainWindow::calculateResult(){
 
-    try {
-        std::string expression = text_buffer.toStdString();
-        double result = calculator.calculate(expression);
+    if (calculationRunning()) {
+        updateStatusBar("Идёт вычисление, Esc - отмена");
+        return;
+    }
+
+    std::string expression = text_buffer.toStdString();
+    CompiledExpression program;
+    CalculationError error;
+    double result = 0.0;
+    QString exactText;
+
+    if (calculator.tryCompile(expression, std::vector<std::string>(), program, error)) {
+        if (!program.reductions.empty()) {
+            // sum, prod и integral могут считаться долго: окно не блокируем
+            startBackgroundCalculation(expression, program);
+            return;
+        }
+        ExactNumber exact;
+        if (!exactMode()) {
+            calculator.tryEvaluate(program, std::vector<double>(), result, error);
+        } else if (calculator.tryCalculateExact(expression, exact, error)) {
+            result = static_cast<double>(exact.toLongDouble());
+            exactText = QString::fromStdString(exact.toString());
+        }
+    }
+    if (error.code == CalculationError::MATRIX_IN_SCALAR_MODE) {
+        showMatrixResult(expression);
+        return;
+    }
+    showCalculationResult(expression, result, error, exactText);
+}
+
+bool MainWindow::exactMode() const {
+    return exactModeBox && exactModeBox->isChecked();
+}
 
+void MainWindow::updatePreview(){
+
+    // Разбирается только изменённый хвост строки, поэтому результат
+    // обновляется при каждом нажатии без задержки
+    const ExpressionNode* root = nullptr;
+    CalculationError error;
+    double result = 0.0;
+    if (!calculator.tryParseIncremental(text_buffer.toStdString(), previewParse, root, error)) {
+        ui->previewLabel->clear();
+        return;
+    }
+    calculator.lower(previewParse.tree(), root, std::vector<std::string>(), previewProgram);
+    if (!previewProgram.reductions.empty()) {
+        // sum, prod и integral могут считаться долго - только по "="
+        ui->previewLabel->setText("= ...");
+        return;
+    }
+    // Ошибки и матрицы не показываются: они видны после "=". Точный
+    // режим разбирал бы всю строку заново, поэтому дробь тоже только по "="
+    if (!calculator.tryEvaluate(previewProgram, std::vector<double>(), result, error)) {
+        ui->previewLabel->clear();
+        return;
+    }
+    QString text = QString::number(result, 'g', 12);
+    ui->previewLabel->setText(text == text_buffer.trimmed() ? QString() : "= " + text);
+}
+
+void MainWindow::showMatrixResult(const std::string &expression){
+
+    // Матрица в историю не попадает: там хранятся числа. Число - результат
+    // статистики по массиву (mean([1,2,3])) - показывается как обычно
+    Matrix result;
+    CalculationError error;
+    if (calculator.tryCalculateMatrix(expression, result, error) && result.isScalar()) {
+        showCalculationResult(expression, result(0, 0), error);
+    } else if (error.ok()) {
+        text_buffer = QString::fromStdString(result.toString());
+        ui->browser->setText(text_buffer);
+        ui->previewLabel->clear();
+        updateStatusBar(QString("Матрица %1 x %2").arg(result.rows()).arg(result.cols()));
+    } else {
+        ui->browser->setHtml(formatCalculationError(expression, error));
+        updateStatusBar("Ошибка вычисления");
+    }
+}
+
+void MainWindow::showCalculationResult(const std::string &expression, double result, const CalculationError &error,
+                                       const QString &resultText){
+
+    if (error.ok()) {
         // Сохраняем в историю
-        addToHistory(text_buffer, result);
+        addToHistory(QString::fromStdString(expression), result, resultText);
 
         // Показываем результат
-        text_buffer = QString::number(result, 'g', 12);
+        text_buffer = resultText.isEmpty() ? QString::number(result, 'g', 12) : resultText;
         ui->browser->setText(text_buffer);
+        ui->previewLabel->clear();
         updateStatusBar("Вычислено успешно");
-    } catch (const std::exception& e) {
-        ui->browser->setText("Ошибка: " + QString(e.what()));
+    } else {
+        // Подсвечиваем ошибочный фрагмент прямо в выражении
+        ui->browser->setHtml(formatCalculationError(expression, error));
         updateStatusBar("Ошибка вычисления");
     }
 }
 
+void MainWindow::startBackgroundCalculation(const std::string &expression, const CompiledExpression &program,
+                                            CalculationTarget target){
+
+    calculationExpression = expression;
+    calculationTarget = target;
+    calculationCancelled = false;
+
+    // Программа и калькулятор копируются в задачу: точный режим разбирает
+    // выражение заново и читает режим углов, а его меняют в потоке интерфейса
+    const ExpressionCalculator engine = calculator;
+    std::atomic<bool>* cancel = &calculationCancelled;
+    bool exact = target == TARGET_MAIN && exactMode();
+    calculationWatcher->setFuture(QtConcurrent::run([engine, program, cancel, exact, expression]() {
+        BackgroundResult result = { 0.0, CalculationError() };
+        ExactNumber value;
+        if (!exact) {
+            engine.tryEvaluate(program, std::vector<double>(), result.value, result.error, cancel);
+        } else if (engine.tryCalculateExact(expression, value, result.error, cancel)) {
+            result.value = static_cast<double>(value.toLongDouble());
+            result.exactText = QString::fromStdString(value.toString());
+        }
+        return result;
+    }));
+    updateStatusBar("Вычисление... (Esc - отмена)");
+}
+
+void MainWindow::finishBackgroundCalculation(){
+
+    BackgroundResult result = calculationWatcher->result();
+    // Поле истории изменили или элемент удалили, пока шло вычисление
+    bool stale = (calculationTarget == TARGET_HISTORY_EDIT
+                  && ui->historyEdit->text().trimmed().toStdString() != calculationExpression)
+            || (calculationTarget == TARGET_HISTORY_ITEM
+                && (calculationRow < 0 || calculationRow >= historyData.size()
+                    || historyData[calculationRow].expression.toStdString() != calculationExpression));
+    if (result.error.code == CalculationError::CANCELLED) {
+        if (calculationTarget == TARGET_MAIN) {
+            ui->browser->setText(text_buffer);
+        } else if (calculationTarget == TARGET_HISTORY_EDIT && !stale) {
+            ui->historyResultBrowser->setText("Вычисление отменено, Enter - заново");
+            ui->historyResultBrowser->setStyleSheet(
+                "QTextBrowser { color: #a0a0a0; }"
+            );
+        }
+        updateStatusBar("Вычисление отменено");
+        return;
+    }
+    if (stale) {
+        return;
+    }
+    switch (calculationTarget) {
+    case TARGET_MAIN:
+        if (result.error.code == CalculationError::MATRIX_IN_SCALAR_MODE) {
+            showMatrixResult(calculationExpression);
+            return;
+        }
+        showCalculationResult(calculationExpression, result.value, result.error, result.exactText);
+        break;
+    case TARGET_TRIG:
+        showTrigResult(calculationExpression, result.value, result.error);
+        break;
+    case TARGET_HISTORY_EDIT:
+        showEditedResult(calculationExpression, result.value, result.error);
+        updateStatusBar(result.error.ok() ? "Вычислено успешно" : "Ошибка вычисления");
+        break;
+    case TARGET_HISTORY_ITEM:
+        showRecalculatedItem(calculationRow, result.value, result.error);
+        break;
+    }
+}
+
+bool MainWindow::calculationRunning() const {
+    return calculationWatcher->isRunning() || distributionWatcher->isRunning();
+}
+
+void MainWindow::cancelCalculation(){
+
+    if (calculationRunning()) {
+        calculationCancelled = true;
+        updateStatusBar("Отмена вычисления...");
+    }
+}
+
+void MainWindow::setupTrigTab(){
+
+    trigUi = new Ui::TrigTab;
+    trigUi->setupUi(ui->tab_trigonometry);
+
+    // Режим углов: порядок пунктов combo_angle_mode совпадает с AngleMode
+    trigUi->combo_angle_mode->setCurrentIndex(calculator.getAngleMode());
+    connect(trigUi->combo_angle_mode, QOverload<int>::of(&QComboBox::currentIndexChanged), [this](int index) {
+        calculator.setAngleMode(static_cast<AngleMode>(index));
+        if (spreadsheetModel) {
+            spreadsheetModel->angleModeChanged();
+        }
+        // Разбор предпросмотра начнётся заново с новыми вариантами функций
+        updatePreview();
+        updateStatusBar("Режим углов: " + trigUi->combo_angle_mode->itemText(index));
+    });
+    connect(trigUi->pbtn_trig_deg, &QPushButton::clicked, [this]() {
+        trigUi->combo_angle_mode->setCurrentIndex(ANGLE_DEGREES);
+    });
+    connect(trigUi->pbtn_trig_rad, &QPushButton::clicked, [this]() {
+        trigUi->combo_angle_mode->setCurrentIndex(ANGLE_RADIANS);
+    });
+
+    QVector<QPair<QPushButton*, QString>> trig_functions = {
+        {trigUi->pbtn_trig_sin, "sin("},
+        {trigUi->pbtn_trig_cos, "cos("},
+        {trigUi->pbtn_trig_tan, "tan("},
+        {trigUi->pbtn_trig_cot, "cot("},
+        {trigUi->pbtn_trig_sec, "sec("},
+        {trigUi->pbtn_trig_csc, "csc("},
+        {trigUi->pbtn_trig_asin, "asin("},
+        {trigUi->pbtn_trig_acos, "acos("},
+        {trigUi->pbtn_trig_atan, "atan("},
+        {trigUi->pbtn_trig_sinh, "sinh("},
+        {trigUi->pbtn_trig_cosh, "cosh("},
+        {trigUi->pbtn_trig_tanh, "tanh("},
+        {trigUi->pbtn_trig_pi, "pi"},
+        {trigUi->pbtn_trig_e, "e"},
+        {trigUi->pbtn_trig_pi2, "(pi/2)"},
+        {trigUi->pbtn_trig_pi4, "(pi/4)"},
+        {trigUi->pbtn_trig_pi6, "(pi/6)"},
+        {trigUi->pbtn_trig_2pi, "(2*pi)"}
+    };
+
+    for (const auto& item : trig_functions) {
+        connect(item.first, &QPushButton::clicked, [this, text = item.second]() {
+            appendTrig(text);
+        });
+    }
+
+    // Стандартные углы вставляются в текущих единицах
+    QVector<QPair<QPushButton*, int>> trig_angles = {
+        {trigUi->pbtn_trig_0deg, 0},
+        {trigUi->pbtn_trig_30deg, 30},
+        {trigUi->pbtn_trig_45deg, 45},
+        {trigUi->pbtn_trig_60deg, 60},
+        {trigUi->pbtn_trig_90deg, 90},
+        {trigUi->pbtn_trig_180deg, 180},
+        {trigUi->pbtn_trig_deg180, 180}
+    };
+
+    for (const auto& item : trig_angles) {
+        connect(item.first, &QPushButton::clicked, [this, degrees = item.second]() {
+            appendTrig(angleText(degrees));
+        });
+    }
+
+    connect(trigUi->pbtn_trig_clear, &QPushButton::clicked, [this]() {
+        trig_buffer.clear();
+        trigUi->trig_browser->setText(trig_buffer);
+    });
+    connect(trigUi->pbtn_trig_backspace, &QPushButton::clicked, [this]() {
+        trig_buffer.chop(1);
+        trigUi->trig_browser->setText(trig_buffer);
+    });
+    connect(trigUi->pbtn_trig_equal, &QPushButton::clicked, this, &MainWindow::calculateTrigResult);
+}
+
+void MainWindow::appendTrig(const QString &text){
+    trig_buffer += text;
+    trigUi->trig_browser->setText(trig_buffer);
+}
+
+static int greatestCommonDivisor(int a, int b) {
+    while (b) {
+        int t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+// Запись угла, заданного в градусах, в текущих единицах калькулятора
+QString MainWindow::angleText(int degrees) const {
+
+    switch (calculator.getAngleMode()) {
+    case ANGLE_DEGREES:
+        return QString::number(degrees);
+    case ANGLE_GRADIANS: {
+        // 1 градус = 10/9 града; дробь оставляем точной
+        int numerator = degrees * 10;
+        if (numerator % 9 == 0) {
+            return QString::number(numerator / 9);
+        }
+        int divisor = greatestCommonDivisor(numerator, 9);
+        return QString("(%1/%2)").arg(numerator / divisor).arg(9 / divisor);
+    }
+    default: {
+        if (degrees == 0) return "0";
+        if (degrees == 180) return "pi";
+        int divisor = greatestCommonDivisor(degrees, 180);
+        QString text = degrees / divisor == 1 ? "pi" : QString("%1*pi").arg(degrees / divisor);
+        return QString("(%1/%2)").arg(text).arg(180 / divisor);
+    }
+    }
+}
+
+void MainWindow::calculateTrigResult(){
+
+    if (calculationRunning()) {
+        updateStatusBar("Идёт вычисление, Esc - отмена");
+        return;
+    }
+
+    std::string expression = trig_buffer.toStdString();
+    double result = 0.0;
+    CalculationError error;
+    CompiledExpression program;
+
+    if (calculator.tryCompile(expression, std::vector<std::string>(), program, error)) {
+        if (!program.reductions.empty()) {
+            startBackgroundCalculation(expression, program, TARGET_TRIG);
+            return;
+        }
+        calculator.tryEvaluate(program, std::vector<double>(), result, error);
+    }
+    showTrigResult(expression, result, error);
+}
+
+void MainWindow::showTrigResult(const std::string &expression, double result, const CalculationError &error){
+
+    if (error.ok()) {
+        QString text = QString::fromStdString(expression);
+        addToHistory(text, result);
+        trigUi->trig_info_browser->setText(text + " = " + QString::number(result, 'g', 15)
+                                       + " (" + trigUi->combo_angle_mode->currentText() + ")");
+        trig_buffer = QString::number(result, 'g', 12);
+        trigUi->trig_browser->setText(trig_buffer);
+        updateStatusBar("Вычислено успешно");
+    } else {
+        trigUi->trig_browser->setHtml(formatCalculationError(expression, error));
+        updateStatusBar("Ошибка вычисления");
+    }
+}
+
+void MainWindow::setupGeometryTab(){
+
+    geometryScene = new QGraphicsScene(this);
+    geometryView = new QGraphicsView(geometryScene, ui->tab_geometry);
+    geometryView->setRenderHint(QPainter::Antialiasing);
+    geometryView->setDragMode(QGraphicsView::ScrollHandDrag);
+    geometryView->setTransformationAnchor(QGraphicsView::AnchorUnderMouse);
+    geometryView->viewport()->installEventFilter(this);
+
+    geometryPointsEdit = new QPlainTextEdit(ui->tab_geometry);
+    geometryPointsEdit->setPlaceholderText("x y - по точке в строке\na b c или a=5 b=8 A=30 - треугольник");
+    geometryModeCombo = new QComboBox(ui->tab_geometry);
+    // Порядок пунктов совпадает с GeometryMode
+    geometryModeCombo->addItems({"Выпуклая оболочка", "Триангуляция Делоне", "Многоугольник",
+                                 "Треугольники по сторонам"});
+    geometryRandomCount = new QSpinBox(ui->tab_geometry);
+    geometryRandomCount->setRange(3, 1000000);
+    geometryRandomCount->setValue(1000);
+    QPushButton* randomButton = new QPushButton("Случайные точки", ui->tab_geometry);
+    QPushButton* buildButton = new QPushButton("Построить", ui->tab_geometry);
+    QPushButton* clearButton = new QPushButton("Очистить", ui->tab_geometry);
+    geometryInfoLabel = new QLabel(ui->tab_geometry);
+    geometryInfoLabel->setWordWrap(true);
+    geometryInfoLabel->setAlignment(Qt::AlignLeft | Qt::AlignTop);
+
+    QHBoxLayout* randomRow = new QHBoxLayout;
+    randomRow->addWidget(geometryRandomCount);
+    randomRow->addWidget(randomButton);
+    QHBoxLayout* buttonRow = new QHBoxLayout;
+    buttonRow->addWidget(buildButton);
+    buttonRow->addWidget(clearButton);
+
+    QGridLayout* layout = new QGridLayout(ui->tab_geometry);
+    layout->addWidget(geometryPointsEdit, 0, 0);
+    layout->addWidget(geometryModeCombo, 1, 0);
+    layout->addLayout(randomRow, 2, 0);
+    layout->addLayout(buttonRow, 3, 0);
+    layout->addWidget(geometryInfoLabel, 4, 0);
+    layout->addWidget(geometryView, 0, 1, 5, 1);
+    layout->setColumnStretch(1, 1);
+    layout->setRowStretch(4, 1);
+
+    geometryWatcher = new QFutureWatcher<GeometryResult>(this);
+    connect(geometryWatcher, &QFutureWatcher<GeometryResult>::finished,
+            this, &MainWindow::finishGeometryCalculation);
+
+    connect(geometryModeCombo, QOverload<int>::of(&QComboBox::currentIndexChanged), [this](int) {
+        updateShapeSettings();
+    });
+    connect(geometryPointsEdit, &QPlainTextEdit::textChanged, [this]() {
+        // Введённые вручную данные заменяют случайный набор
+        if (!geometryPointsEdit->toPlainText().trimmed().isEmpty()) {
+            generatedPoints.clear();
+            generatedTriangles.clear();
+        }
+    });
+    connect(randomButton, &QPushButton::clicked, this, &MainWindow::generateRandomInput);
+    connect(buildButton, &QPushButton::clicked, this, &MainWindow::updateShapeSettings);
+    connect(clearButton, &QPushButton::clicked, this, &MainWindow::clearPointInputs);
+}
+
+// Точки из поля ввода: по паре чисел в строке, разделители - пробелы,
+// запятые или точки с запятой. Строки без пары чисел пропускаются
+QVector<QPointF> MainWindow::getPointsFromInputs() const {
+
+    QVector<QPointF> points;
+    if (!geometryPointsEdit) {
+        return points;
+    }
+    const QStringList lines = geometryPointsEdit->toPlainText().split('\n');
+    for (const QString& line : lines) {
+        QStringList parts = line.split(QRegularExpression("[\\s,;]+"), Qt::SkipEmptyParts);
+        if (parts.size() < 2) continue;
+        bool okX = false, okY = false;
+        double x = parts[0].toDouble(&okX);
+        double y = parts[1].toDouble(&okY);
+        if (okX && okY && std::isfinite(x) && std::isfinite(y)) {
+            points.append(QPointF(x, y));
+        }
+    }
+    return points;
+}
+
+// Треугольники из поля ввода: по три длины сторон в строке или три
+// известных элемента вида "a=5 b=8 A=30" (строчные - стороны, заглавные -
+// противолежащие углы в градусах). Для неоднозначного SSA добавляются оба
+// решения. Строки, из которых треугольник не складывается, пропускаются
+std::vector<Triangle> MainWindow::getTrianglesFromInputs() const {
+
+    std::vector<Triangle> triangles;
+    if (!geometryPointsEdit) {
+        return triangles;
+    }
+    const QStringList lines = geometryPointsEdit->toPlainText().split('\n');
+    for (const QString& line : lines) {
+        QStringList parts = line.split(QRegularExpression("[\\s,;]+"), Qt::SkipEmptyParts);
+        if (parts.size() < 3) continue;
+
+        TriangleSpec spec;
+        for (int k = 0; k < 3; k++) {
+            spec.sides[k] = TRIANGLE_UNKNOWN;
+            spec.angles[k] = TRIANGLE_UNKNOWN;
+        }
+        bool valid = true;
+        for (int k = 0; k < parts.size() && valid; k++) {
+            QStringList pair = parts[k].split('=');
+            bool ok = false;
+            double value = pair.last().toDouble(&ok);
+            valid = ok && (pair.size() == 1 ? k < 3 : pair.size() == 2 && pair[0].size() == 1);
+            if (!valid) break;
+            if (pair.size() == 1) {
+                spec.sides[k] = value;
+                continue;
+            }
+            QChar name = pair[0][0];
+            if (name >= 'a' && name <= 'c') {
+                spec.sides[name.unicode() - 'a'] = value;
+            } else if (name >= 'A' && name <= 'C') {
+                spec.angles[name.unicode() - 'A'] = value * (3.14159265358979323846 / 180.0);
+            } else {
+                valid = false;
+            }
+        }
+        if (!valid) continue;
+        try {
+            std::vector<Triangle> solutions = Triangle::solve(spec);
+            triangles.insert(triangles.end(), solutions.begin(), solutions.end());
+        } catch (const std::invalid_argument&) {
+        }
+    }
+    return triangles;
+}
+
+void MainWindow::generateRandomInput(){
+
+    std::mt19937_64 random(std::random_device{}());
+    size_t count = geometryRandomCount->value();
+    QString placeholder;
+    if (geometryModeCombo->currentIndex() == GEOMETRY_TRIANGLES) {
+        // Третья сторона строго между |a - b| и a + b
+        std::uniform_real_distribution<double> side(1.0, 10.0);
+        std::uniform_real_distribution<double> share(0.05, 0.95);
+        generatedTriangles.clear();
+        generatedTriangles.reserve(count);
+        while (generatedTriangles.size() < count) {
+            double a = side(random), b = side(random);
+            double low = std::fabs(a - b);
+            try {
+                generatedTriangles.push_back(Triangle(a, b, low + (a + b - low) * share(random)));
+            } catch (const std::invalid_argument&) {
+            }
+        }
+        placeholder = QString("%1 случайных треугольников").arg(count);
+    } else {
+        std::uniform_real_distribution<double> coordinate(0.0, 100.0);
+        generatedPoints.resize(count);
+        for (Point2D& p : generatedPoints) {
+            p.x = coordinate(random);
+            p.y = coordinate(random);
+        }
+        placeholder = QString("%1 случайных точек").arg(count);
+    }
+    // Большой набор в поле ввода не выводится: текст только замедлит окно
+    geometryPointsEdit->blockSignals(true);
+    geometryPointsEdit->clear();
+    geometryPointsEdit->blockSignals(false);
+    geometryPointsEdit->setPlaceholderText(placeholder);
+    updateShapeSettings();
+}
+
+// Треугольники по сторонам раскладываются сеткой и рисуются одним элементом
+void MainWindow::showTriangleBatch(){
+
+    std::vector<Triangle> triangles = getTrianglesFromInputs();
+    if (triangles.empty()) {
+        triangles = generatedTriangles;
+    }
+    if (triangles.empty()) {
+        updateStatusBar("Нет треугольников: введите по три стороны в строке");
+        return;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+
+    double longest = 0.0, area = 0.0;
+    for (const Triangle& triangle : triangles) {
+        longest = std::max({ longest, triangle.getSideA(), triangle.getSideB(), triangle.getSideC() });
+        area += triangle.area();
+    }
+    const double scale = 40.0 / longest;        // самая длинная сторона - 40 единиц сцены
+    const double cell = 50.0;
+    const size_t columns = static_cast<size_t>(std::ceil(std::sqrt(static_cast<double>(triangles.size()))));
+
+    TriangleBatchItem* batch = new TriangleBatchItem;
+    // Стили по типу треугольника: равносторонний, равнобедренный, прямоугольный, разносторонний
+    QPen pen(QColor(33, 33, 33), 1.0);
+    pen.setCosmetic(true);
+    const int equilateral = batch->addStyle(pen, QColor(255, 213, 79));
+    const int isosceles = batch->addStyle(pen, QColor(129, 199, 132));
+    const int right = batch->addStyle(pen, QColor(100, 181, 246));
+    const int scalene = batch->addStyle(pen, QColor(224, 224, 224));
+    batch->reserve(triangles.size());
+    for (size_t i = 0; i < triangles.size(); i++) {
+        std::string type = triangles[i].type();
+        int style = type == "Equilateral" ? equilateral : type == "Isosceles" ? isosceles
+                  : type == "Right" ? right : scalene;
+        QPointF position((i % columns) * cell + 5.0, (i / columns) * cell + 5.0);
+        batch->addTriangle(triangles[i], position, scale, style);
+    }
+
+    geometryScene->clear();
+    geometryItem = nullptr;
+    geometryLocator.reset();
+    geometryScene->addItem(batch);
+    geometryScene->setSceneRect(batch->boundingRect());
+    geometryView->fitInView(geometryScene->sceneRect(), Qt::KeepAspectRatio);
+
+    geometrySummary = QString("Треугольников: %1\nСуммарная площадь: %2\nВремя: %3 мс")
+            .arg(triangles.size()).arg(area, 0, 'g', 10).arg(timer.nsecsElapsed() / 1e6, 0, 'f', 1);
+    geometryInfoLabel->setText(geometrySummary);
+    updateStatusBar("Построено");
+}
+
+// Построение для выбранного режима по текущим точкам; вычисление в фоне
+void MainWindow::updateShapeSettings(){
+
+    if (!geometryWatcher || geometryWatcher->isRunning()) {
+        return;
+    }
+    GeometryMode mode = static_cast<GeometryMode>(geometryModeCombo->currentIndex());
+    if (mode == GEOMETRY_TRIANGLES) {
+        showTriangleBatch();
+        return;
+    }
+
+    std::vector<Point2D> points;
+    const QVector<QPointF> input = getPointsFromInputs();
+    if (!input.isEmpty()) {
+        for (const QPointF& p : input) {
+            points.push_back({ p.x(), p.y() });
+        }
+    } else {
+        points = generatedPoints;
+    }
+    if (points.empty()) {
+        updateStatusBar("Нет точек для построения");
+        return;
+    }
+
+    geometryWatcher->setFuture(QtConcurrent::run([mode, points]() {
+        GeometryResult result;
+        result.points = points;
+        result.area = 0.0;
+        result.centroid = { 0.0, 0.0 };
+
+        QElapsedTimer timer;
+        timer.start();
+        if (mode == GEOMETRY_POLYGON) {
+            result.outline.resize(points.size());
+            std::iota(result.outline.begin(), result.outline.end(), 0u);
+        } else if (mode == GEOMETRY_HULL) {
+            result.outline = convexHull(points);
+        } else {
+            Triangulation triangulation;
+            if (!delaunay(points, triangulation)) {
+                result.error = "Триангуляция невозможна: меньше трёх точек или все на одной прямой";
+                result.outline = convexHull(points);
+            }
+            // Каждое ребро один раз: граничное или с меньшим номером из пары
+            for (size_t e = 0; e < triangulation.halfedges.size(); e++) {
+                if (triangulation.halfedges[e] < static_cast<int32_t>(e)) {
+                    result.edges.push_back(triangulation.triangles[e]);
+                    result.edges.push_back(triangulation.triangles[e % 3 == 2 ? e - 2 : e + 1]);
+                }
+            }
+            if (result.error.isEmpty()) {
+                result.outline = triangulation.hull;
+            }
+        }
+
+        std::vector<Point2D> polygon;
+        polygon.reserve(result.outline.size());
+        for (uint32_t i : result.outline) {
+            polygon.push_back(points[i]);
+        }
+        result.area = polygonArea(polygon);
+        result.centroid = polygonCentroid(polygon);
+        result.locator = std::make_shared<PolygonLocator>(polygon);
+        result.milliseconds = timer.nsecsElapsed() / 1e6;
+        return result;
+    }));
+    updateStatusBar("Построение...");
+}
+
+void MainWindow::finishGeometryCalculation(){
+
+    GeometryResult result = geometryWatcher->result();
+
+    geometryScene->clear();
+    geometryItem = new GeometryGraphicsItem(result.points);
+    geometryItem->setEdges(result.edges);
+    geometryItem->setOutline(result.outline);
+    geometryScene->addItem(geometryItem);
+    geometryLocator = result.locator;
+
+    QRectF rect = geometryItem->boundingRect();
+    geometryScene->setSceneRect(rect.adjusted(-rect.width() * 0.05 - 1, -rect.height() * 0.05 - 1,
+                                              rect.width() * 0.05 + 1, rect.height() * 0.05 + 1));
+    geometryView->fitInView(geometryScene->sceneRect(), Qt::KeepAspectRatio);
+
+    geometrySummary = QString("Точек: %1\nВершин контура: %2").arg(result.points.size()).arg(result.outline.size());
+    if (!result.edges.empty()) {
+        geometrySummary += QString("\nРёбер триангуляции: %1").arg(result.edges.size() / 2);
+    }
+    geometrySummary += QString("\nПлощадь: %1\nЦентр масс: (%2; %3)\nВремя: %4 мс")
+            .arg(std::fabs(result.area), 0, 'g', 10)
+            .arg(result.centroid.x, 0, 'g', 8).arg(result.centroid.y, 0, 'g', 8)
+            .arg(result.milliseconds, 0, 'f', 1);
+    if (!result.error.isEmpty()) {
+        geometrySummary += "\n" + result.error;
+    }
+    geometryInfoLabel->setText(geometrySummary + "\n\nЩелчок по области - проверка точки");
+    updateStatusBar(result.error.isEmpty() ? "Построено" : "Построено с ошибкой");
+}
+
+void MainWindow::clearPointInputs(){
+
+    if (geometryWatcher->isRunning()) {
+        // Результат всё равно придёт и заполнит сцену
+        updateStatusBar("Дождитесь окончания построения");
+        return;
+    }
+    geometryPointsEdit->clear();
+    geometryPointsEdit->setPlaceholderText("x y - по точке в строке\na b c или a=5 b=8 A=30 - треугольник");
+    generatedPoints.clear();
+    generatedTriangles.clear();
+    geometryScene->clear();
+    geometryItem = nullptr;
+    geometryLocator.reset();
+    geometrySummary.clear();
+    geometryInfoLabel->clear();
+}
+
+void MainWindow::locateGeometryPoint(const QPointF &scenePoint){
+
+    if (!geometryItem || !geometryLocator) {
+        return;
+    }
+    Point2D point = GeometryGraphicsItem::fromScene(scenePoint);
+    QString where;
+    QColor color;
+    switch (geometryLocator->locate(point)) {
+    case PolygonLocator::INSIDE: where = "внутри"; color = QColor(56, 142, 60); break;
+    case PolygonLocator::BOUNDARY: where = "на границе"; color = QColor(245, 124, 0); break;
+    default: where = "снаружи"; color = QColor(97, 97, 97); break;
+    }
+    geometryItem->setMarker(point, color);
+    geometryInfoLabel->setText(geometrySummary + QString("\n\nТочка (%1; %2): %3 контура")
+                               .arg(point.x, 0, 'g', 6).arg(point.y, 0, 'g', 6).arg(where));
+}
+
+void MainWindow::setupSpreadsheetTab(){
+
+    spreadsheetModel = new SpreadsheetModel(calculator, this);
+    QTableView* view = new QTableView(ui->tab_spreadsheet);
+    view->setModel(spreadsheetModel);
+    // Размеры строк и столбцов одинаковые: заголовки не перебирают
+    // миллион секций, представление запрашивает только видимые ячейки
+    view->horizontalHeader()->setSectionResizeMode(QHeaderView::Fixed);
+    view->verticalHeader()->setSectionResizeMode(QHeaderView::Fixed);
+    view->verticalHeader()->setDefaultSectionSize(view->fontMetrics().height() + 6);
+
+    QPushButton* importButton = new QPushButton("Импорт CSV", ui->tab_spreadsheet);
+    spreadsheetInfoLabel = new QLabel(ui->tab_spreadsheet);
+
+    QHBoxLayout* toolbar = new QHBoxLayout;
+    toolbar->addWidget(importButton);
+    toolbar->addWidget(spreadsheetInfoLabel, 1);
+    QGridLayout* layout = new QGridLayout(ui->tab_spreadsheet);
+    layout->addLayout(toolbar, 0, 0);
+    layout->addWidget(view, 1, 0);
+    layout->setRowStretch(1, 1);
+
+    connect(spreadsheetModel, &SpreadsheetModel::recalculated,
+            [this](const Spreadsheet::RecalculationStats& stats, double milliseconds) {
+        QString text = QString("Пересчитано формул: %1, уровней: %2, %3 мс")
+                .arg(stats.formulas).arg(stats.levels).arg(milliseconds, 0, 'f', 1);
+        if (stats.cycles) {
+            text += QString(", в циклах: %1").arg(stats.cycles);
+        }
+        spreadsheetInfoLabel->setText(text);
+    });
+    // Загрузка в выделенную ячейку (или в A1)
+    connect(importButton, &QPushButton::clicked, [this, view]() {
+        QString path = QFileDialog::getOpenFileName(this, "Импорт CSV", QString(),
+                                                    "CSV (*.csv *.tsv *.txt);;Все файлы (*)");
+        if (path.isEmpty()) {
+            return;
+        }
+        QModelIndex current = view->currentIndex();
+        QString error;
+        if (!spreadsheetModel->importCsv(path, current.isValid() ? current.row() : 0,
+                                         current.isValid() ? current.column() : 0, error)) {
+            updateStatusBar(error);
+        }
+    });
+}
+
+bool MainWindow::eventFilter(QObject *watched, QEvent *event){
+
+    if (geometryView && watched == geometryView->viewport()) {
+        if (event->type() == QEvent::Wheel) {
+            double factor = std::pow(1.0015, static_cast<QWheelEvent*>(event)->angleDelta().y());
+            geometryView->scale(factor, factor);
+            return true;
+        }
+        // Щелчок без перетаскивания - запрос точки; перетаскивание сдвигает вид
+        if (event->type() == QEvent::MouseButtonPress) {
+            geometryPressPosition = static_cast<QMouseEvent*>(event)->pos();
+        } else if (event->type() == QEvent::MouseButtonRelease) {
+            QPoint position = static_cast<QMouseEvent*>(event)->pos();
+            if ((position - geometryPressPosition).manhattanLength() < 4) {
+                locateGeometryPoint(geometryView->mapToScene(position));
+            }
+        }
+    }
+    return QMainWindow::eventFilter(watched, event);
+}
+
+// Выражение с подсвеченным ошибочным фрагментом и текст ошибки
+QString MainWindow::formatCalculationError(const std::string& expression, const CalculationError& error) const {
+
+    // Смещения ошибки заданы в байтах UTF-8
+    size_t offset = std::min(error.offset, expression.size());
+    size_t length = std::min(error.length, expression.size() - offset);
+    QString before = QString::fromStdString(expression.substr(0, offset)).toHtmlEscaped();
+    QString fragment = QString::fromStdString(expression.substr(offset, length)).toHtmlEscaped();
+    QString after = QString::fromStdString(expression.substr(offset + length)).toHtmlEscaped();
+
+    if (fragment.isEmpty()) {
+        // Ошибка в конце выражения: показываем место вставки
+        fragment = "&nbsp;";
+    }
+
+    return QString("%1<span style=\"background-color: #d32f2f; color: #ffffff;\">%2</span>%3"
+                   "<br><span style=\"color: #ff5555; font-size: 10pt;\">Ошибка: %4</span>")
+            .arg(before, fragment, after,
+                 QString::fromStdString(error.message(expression)).toHtmlEscaped());
+}
+
 // Добавьте новые функции управления историей:
-void MainWindow::addToHistory(const QString& expression, double result) {
+void MainWindow::addToHistory(const QString& expression, double result, const QString& resultText) {
     // Форматируем запись
     HistoryItem item;
     item.expression = expression;
     item.result = result;
-    item.originalText = formatHistoryItem(expression, result);
+    item.originalText = formatHistoryItem(expression, result, resultText);
 
     // Добавляем в начало
     historyData.prepend(item);
@@ -281,42 +1150,209 @@ void MainWindow::updateHistoryDisplay() {
 
 // Обработчик изменения текста в поле редактирования
 void MainWindow::onHistoryEditTextChanged(const QString& text) {
-    // Запускаем отложенный перерасчет
-    updateTimer->start(UPDATE_DELAY_MS);
-}
-
-
-
-// Таймер для отложенного перерасчета
-void MainWindow::onUpdateTimerTimeout() {
+    // Разбор инкрементальный, поэтому пересчитываем сразу
     calculateEditedExpression();
 }
 
 // Перерасчет отредактированного выражения
-void MainWindow::calculateEditedExpression() {
+void MainWindow::calculateEditedExpression(bool withReductions) {
     QString expression = ui->historyEdit->text().trimmed();
 
+    // Вычисление или испытания для прежней записи больше не нужны
+    if ((distributionWatcher->isRunning() && expression.toStdString() != distributionText)
+            || (calculationWatcher->isRunning() && calculationTarget == TARGET_HISTORY_EDIT
+                && expression.toStdString() != calculationExpression)) {
+        calculationCancelled = true;
+    }
+
     if (expression.isEmpty()) {
         ui->historyResultBrowser->setText("");
         return;
     }
 
-    try {
-        double result = calculator.calculate(expression.toStdString());
+    double result = 0.0;
+    CalculationError error;
+
+    // Объявления переменных после ';' (вне скобок литералов матриц)
+    std::string text = expression.toStdString();
+    std::string formula;
+    std::vector<std::string> names;
+    std::vector<Distribution> inputs;
+    if (!parseMonteCarlo(calculator, text, formula, names, inputs, error)) {
+        ui->historyResultBrowser->setHtml(formatCalculationError(text, error));
+        ui->historyResultBrowser->setStyleSheet(
+            "QTextBrowser { color: #ff5555; }"
+        );
+        return;
+    }
+    if (!names.empty()) {
+        calculateEditedDistribution(text, formula, names, inputs, withReductions);
+        return;
+    }
+
+    const ExpressionNode* root = nullptr;
+    bool ok = calculator.tryParseIncremental(text, historyParse, root, error);
+    if (ok) {
+        CompiledExpression program;
+        calculator.lower(historyParse.tree(), root, std::vector<std::string>(), program);
+        if (!program.reductions.empty()) {
+            if (!withReductions) {
+                ui->historyResultBrowser->setText("Enter - вычислить");
+                ui->historyResultBrowser->setStyleSheet(
+                    "QTextBrowser { color: #a0a0a0; }"
+                );
+            } else if (calculationRunning()) {
+                updateStatusBar("Идёт вычисление, Esc - отмена");
+            } else if (!calculator.tryCompile(text, std::vector<std::string>(), program, error)) {
+                showEditedResult(text, result, error);
+            } else {
+                // Программа полного разбора: ошибка в фоне показывается по её позициям
+                startBackgroundCalculation(text, program, TARGET_HISTORY_EDIT);
+                ui->historyResultBrowser->setText("Вычисление... (Esc - отмена)");
+                ui->historyResultBrowser->setStyleSheet(
+                    "QTextBrowser { color: #a0a0a0; }"
+                );
+            }
+            return;
+        }
+        // Разбор переносит общие вершины на места в текущей строке,
+        // так что ошибка вычисления указывает на неё без полного разбора
+        ok = calculator.tryEvaluate(program, std::vector<double>(), result, error);
+    }
+    if (ok) {
+        error = CalculationError();
+    }
+    showEditedResult(text, result, error);
+}
+
+void MainWindow::showEditedResult(const std::string& expression, double result, const CalculationError& error) {
+    if (error.ok()) {
         ui->historyResultBrowser->setText(QString::number(result, 'g', 12));
         ui->historyResultBrowser->setStyleSheet(
             "QTextBrowser { color: #00ff00; }"
         );
-    } catch (const std::exception& e) {
-        ui->historyResultBrowser->setText("Ошибка: " + QString(e.what()));
+    } else {
+        ui->historyResultBrowser->setHtml(formatCalculationError(expression, error));
         ui->historyResultBrowser->setStyleSheet(
             "QTextBrowser { color: #ff5555; }"
         );
     }
 }
 
+void MainWindow::calculateEditedDistribution(const std::string& text, const std::string& expression,
+                                             const std::vector<std::string>& names,
+                                             const std::vector<Distribution>& inputs, bool run) {
+    CompiledExpression program;
+    CalculationError error;
+    bool ok = calculator.tryCompile(expression, names, program, error);
+    bool random = std::any_of(inputs.begin(), inputs.end(), [](const Distribution& input) {
+        return input.kind != Distribution::FIXED;
+    });
+
+    if (ok && !random) {
+        // Только постоянные значения: одно вычисление
+        std::vector<double> values;
+        for (const Distribution& input : inputs) {
+            values.push_back(input.a);
+        }
+        double value = 0.0;
+        if (calculator.tryEvaluate(program, values, value, error)) {
+            ui->historyResultBrowser->setText(QString::number(value, 'g', 12));
+            ui->historyResultBrowser->setStyleSheet(
+                "QTextBrowser { color: #00ff00; }"
+            );
+            return;
+        }
+        ok = false;
+    }
+    if (ok && !run) {
+        ui->historyResultBrowser->setText(QString("Enter - распределение по %1 испытаниям").arg(MONTE_CARLO_SAMPLES));
+        ui->historyResultBrowser->setStyleSheet(
+            "QTextBrowser { color: #a0a0a0; }"
+        );
+        return;
+    }
+    if (!ok) {
+        showEditedDistribution(text, false, MonteCarloResult(), error);
+        return;
+    }
+    if (calculationRunning()) {
+        updateStatusBar("Идёт вычисление, Esc - отмена");
+        return;
+    }
+
+    // Миллион испытаний - заметное время: окно не блокируем.
+    // Ядро и seed постоянные: при повторном Enter результат тот же
+    distributionText = text;
+    calculationCancelled = false;
+    const ExpressionCalculator* engine = &calculator;
+    std::atomic<bool>* cancel = &calculationCancelled;
+    uint64_t samples = MONTE_CARLO_SAMPLES;
+    uint64_t seed = MONTE_CARLO_SEED;
+    distributionWatcher->setFuture(QtConcurrent::run([engine, program, inputs, samples, seed, cancel]() {
+        DistributionResult result;
+        result.ok = runMonteCarlo(*engine, program, inputs, samples, seed, 0, cancel, result.result, result.error);
+        return result;
+    }));
+    ui->historyResultBrowser->setText("Вычисление... (Esc - отмена)");
+    ui->historyResultBrowser->setStyleSheet(
+        "QTextBrowser { color: #a0a0a0; }"
+    );
+    updateStatusBar("Вычисление... (Esc - отмена)");
+}
+
+void MainWindow::finishEditedDistribution() {
+
+    DistributionResult result = distributionWatcher->result();
+    // Запись изменили, пока шли испытания: результат устарел
+    if (ui->historyEdit->text().trimmed().toStdString() != distributionText) {
+        return;
+    }
+    if (result.error.code == CalculationError::CANCELLED) {
+        ui->historyResultBrowser->setText("Вычисление отменено, Enter - заново");
+        ui->historyResultBrowser->setStyleSheet(
+            "QTextBrowser { color: #a0a0a0; }"
+        );
+        updateStatusBar("Вычисление отменено");
+        return;
+    }
+    showEditedDistribution(distributionText, result.ok, result.result, result.error);
+    updateStatusBar(result.ok ? "Вычислено успешно" : "Ошибка вычисления");
+}
+
+void MainWindow::showEditedDistribution(const std::string& text, bool ok, const MonteCarloResult& result,
+                                        CalculationError error) {
+    if (!ok) {
+        if (error.ok()) {
+            error.code = CalculationError::INVALID_EXPRESSION;
+        }
+        ui->historyResultBrowser->setHtml(formatCalculationError(text, error));
+        ui->historyResultBrowser->setStyleSheet(
+            "QTextBrowser { color: #ff5555; }"
+        );
+        return;
+    }
+
+    QString summary = QString("%1 ± %2<br><span style=\"font-size: 10pt;\">медиана %3, 95%: [%4, %5]")
+            .arg(result.moments.mean, 0, 'g', 8)
+            .arg(result.moments.standardDeviation(), 0, 'g', 3)
+            .arg(result.quantiles.quantile(0.5), 0, 'g', 8)
+            .arg(result.quantiles.quantile(0.025), 0, 'g', 8)
+            .arg(result.quantiles.quantile(0.975), 0, 'g', 8);
+    if (result.nonFinite) {
+        summary += QString(", без значения: %1 из %2").arg(result.nonFinite).arg(result.samples);
+    }
+    ui->historyResultBrowser->setHtml(summary + "</span>");
+    ui->historyResultBrowser->setStyleSheet(
+        "QTextBrowser { color: #00ff00; }"
+    );
+}
+
 // Форматирование элемента истории
-QString MainWindow::formatHistoryItem(const QString& expression, double result) const {
+QString MainWindow::formatHistoryItem(const QString& expression, double result, const QString& resultText) const {
+    if (!resultText.isEmpty()) {
+        return QString("%1 = %2").arg(expression, resultText);
+    }
     return QString("%1 = %2").arg(expression).arg(result, 0, 'g', 12);
 }
 
@@ -336,6 +1372,7 @@ void MainWindow::useHistoryItem() {
         if (row >= 0 && row < historyData.size()) {
             text_buffer = historyData[row].expression;
             ui->browser->setText(text_buffer);
+            updatePreview();
             updateStatusBar("Выражение загружено из истории");
         }
     }
@@ -347,29 +1384,49 @@ void MainWindow::recalculateHistoryItem() {
     if (item) {
         int row = ui->historyList->row(item);
         if (row >= 0 && row < historyData.size()) {
-            try {
-                double result = calculator.calculate(historyData[row].expression.toStdString());
-                historyData[row].result = result;
-                historyData[row].originalText = formatHistoryItem(historyData[row].expression, result);
-
-                // Обновляем отображение
-                item->setText(historyData[row].originalText);
-                ui->historyResultBrowser->setText(QString::number(result, 'g', 12));
-                ui->historyResultBrowser->setStyleSheet(
-                    "QTextBrowser { color: #00ff00; }"
-                );
-
-                updateStatusBar("Выражение пересчитано");
-            } catch (const std::exception& e) {
-                ui->historyResultBrowser->setText("Ошибка: " + QString(e.what()));
-                ui->historyResultBrowser->setStyleSheet(
-                    "QTextBrowser { color: #ff5555; }"
-                );
+            if (calculationRunning()) {
+                updateStatusBar("Идёт вычисление, Esc - отмена");
+                return;
+            }
+            std::string expression = historyData[row].expression.toStdString();
+            double result = 0.0;
+            CalculationError error;
+            CompiledExpression program;
+            if (calculator.tryCompile(expression, std::vector<std::string>(), program, error)) {
+                if (!program.reductions.empty()) {
+                    calculationRow = row;
+                    startBackgroundCalculation(expression, program, TARGET_HISTORY_ITEM);
+                    return;
+                }
+                calculator.tryEvaluate(program, std::vector<double>(), result, error);
             }
+            showRecalculatedItem(row, result, error);
         }
     }
 }
 
+void MainWindow::showRecalculatedItem(int row, double result, const CalculationError& error) {
+    if (error.ok()) {
+        historyData[row].result = result;
+        historyData[row].originalText = formatHistoryItem(historyData[row].expression, result);
+
+        // Обновляем отображение
+        ui->historyList->item(row)->setText(historyData[row].originalText);
+        ui->historyResultBrowser->setText(QString::number(result, 'g', 12));
+        ui->historyResultBrowser->setStyleSheet(
+            "QTextBrowser { color: #00ff00; }"
+        );
+
+        updateStatusBar("Выражение пересчитано");
+    } else {
+        ui->historyResultBrowser->setHtml(formatCalculationError(historyData[row].expression.toStdString(), error));
+        ui->historyResultBrowser->setStyleSheet(
+            "QTextBrowser { color: #ff5555; }"
+        );
+        updateStatusBar("Ошибка вычисления");
+    }
+}
+
 // Двойной клик по элементу истории
 void MainWindow::onHistoryItemDoubleClicked(QListWidgetItem* item) {
     if (!item) return;
@@ -420,6 +1477,60 @@ void MainWindow::updateStatusBar(const QString& message){
     ui->statusbar->showMessage(message, 3000); // Показываем 3 секунды
 }
 
+#ifdef CALC_INSTRUMENTATION
+void MainWindow::setupDiagnostics(){
+
+    diagnosticsLabel = new QLabel(this);
+    diagnosticsLabel->setStyleSheet("color: #808080; font-size: 9pt;");
+    ui->statusbar->addPermanentWidget(diagnosticsLabel);
+
+    // Счётчики обновляются раз в полсекунды
+    diagnosticsTimer = new QTimer(this);
+    connect(diagnosticsTimer, &QTimer::timeout, this, &MainWindow::updateDiagnostics);
+    diagnosticsTimer->start(500);
+    updateDiagnostics();
+}
+
+void MainWindow::updateDiagnostics(){
+
+    Instrumentation::Snapshot snapshot = Instrumentation::snapshot();
+
+    // Коротко в строке состояния: средние такты разбора и вычисления
+    uint64_t parseCycles = 0, parseCalls = snapshot.stageCalls[Instrumentation::STAGE_TO_RPN];
+    for (int stage = Instrumentation::STAGE_REMOVE_SPACES; stage <= Instrumentation::STAGE_LOWERING; stage++) {
+        parseCycles += snapshot.stageCycles[stage];
+    }
+    uint64_t evaluateCalls = snapshot.stageCalls[Instrumentation::STAGE_EVALUATE];
+    uint64_t evaluateCycles = snapshot.stageCycles[Instrumentation::STAGE_EVALUATE];
+    diagnosticsLabel->setText(QString("разбор: %1 тактов, вычисление: %2 тактов, токенов: %3, стек: %4")
+                              .arg(parseCalls ? parseCycles / parseCalls : 0)
+                              .arg(evaluateCalls ? evaluateCycles / evaluateCalls : 0)
+                              .arg(snapshot.tokens)
+                              .arg(snapshot.stackHighWater));
+
+    // Подробно во всплывающей подсказке: этапы и вызовы функций
+    QString details = "<table><tr><th align=left>Этап</th><th>Вызовов</th><th>Тактов</th><th>Выделений</th></tr>";
+    for (int stage = 0; stage < Instrumentation::STAGE_COUNT; stage++) {
+        details += QString("<tr><td>%1</td><td align=right>%2</td><td align=right>%3</td><td align=right>%4</td></tr>")
+                .arg(Instrumentation::stageName(static_cast<Instrumentation::Stage>(stage)))
+                .arg(snapshot.stageCalls[stage])
+                .arg(snapshot.stageCycles[stage])
+                .arg(snapshot.stageAllocations[stage]);
+    }
+    details += "</table><br>Вызовы функций:";
+    for (const auto& entry : snapshot.functionCalls) {
+        details += QString("<br>%1: %2").arg(QString::fromStdString(entry.first)).arg(entry.second);
+    }
+    uint64_t memoLookups = snapshot.memoHits + snapshot.memoMisses;
+    details += QString("<br>Кэш подвыражений: %1 попаданий из %2 (%3%)")
+            .arg(snapshot.memoHits)
+            .arg(memoLookups)
+            .arg(memoLookups ? 100.0 * snapshot.memoHits / memoLookups : 0.0, 0, 'f', 1);
+    details += QString("<br>Потоков: %1").arg(snapshot.threads);
+    diagnosticsLabel->setToolTip(details);
+}
+#endif
+
 
 
 
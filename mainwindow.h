@@ -14,13 +14,27 @@
 #include <QCheckBox>
 #include <QColorDialog>
 #include <QSpinBox>
+#include <QFutureWatcher>
+#include <QGraphicsScene>
+#include <QGraphicsView>
+#include <QComboBox>
+#include <QPlainTextEdit>
+#include <atomic>
+#include <memory>
 #include <stdexcept>
 
 #include "expressioncalculator.h"
+#include "geometry.h"
+#include "instrumentation.h"
+#include "montecarlo.h"
+#include "triangle.h"
+
+class GeometryGraphicsItem;
+class SpreadsheetModel;
 
 
 QT_BEGIN_NAMESPACE
-namespace Ui { class MainWindow; }
+namespace Ui { class MainWindow; class TrigTab; }
 QT_END_NAMESPACE
 
 const int BTN_0 = 0;
@@ -49,38 +63,146 @@ public slots:
     void onBtnBackspaceClicked();
     void onHistoryItemChanged(QListWidgetItem*);
     void onHistoryItemDoubleClicked(QListWidgetItem*);
-    void onUpdateTimerTimeout();
     void onHistoryEditTextChanged(const QString&);
 
 protected:
    virtual void keyPressEvent(QKeyEvent *);
+   // Масштаб колесом и запрос точки щелчком в области геометрии
+   bool eventFilter(QObject*, QEvent*) override;
 
 private:
     void appendDigit(int);
     void appendOperator(const QString &);
     void appendFunction(const QString &);
     void calculateResult();
+    // Предварительный результат под выражением, пересчитывается при каждом изменении
+    void updatePreview();
+    // resultText - запись результата точного режима вместо числа
+    void showCalculationResult(const std::string&, double, const CalculationError&,
+                               const QString& resultText = QString());
+    void showMatrixResult(const std::string&);
+    QString formatCalculationError(const std::string&, const CalculationError&) const;
     void updateStatusBar(const QString&);
     // ... существующие переменные ...
-    void addToHistory(const QString&, double);
+    void addToHistory(const QString&, double, const QString& resultText = QString());
     void clearHistory();
     void useHistoryItem();
     void startDelayedCalculation();
     void onHistoryTextChanged(const QString&);
-    QString formatHistoryItem(const QString&, double) const;
-    void calculateEditedExpression();
+    QString formatHistoryItem(const QString&, double, const QString& resultText = QString()) const;
+    // sum, prod и integral в поле редактирования истории вычисляются только по Enter
+    void calculateEditedExpression(bool withReductions = false);
+    // "выражение; x ~ N(1.2, 0.01); ..." - распределение результата
+    // методом Монте-Карло, тоже по Enter
+    void calculateEditedDistribution(const std::string&, const std::string& expression,
+                                     const std::vector<std::string>& names,
+                                     const std::vector<Distribution>& inputs, bool run);
+    void showEditedDistribution(const std::string&, bool ok, const MonteCarloResult&, CalculationError);
     void editHistoryItem(int);
     void updateHistoryDisplay();
     void recalculateHistoryItem();
 
+    // Вкладки, кроме основной, создаются при первом переходе на них
+    void onTabActivated(int);
+
+    // Вкладка тригонометрии
+    void setupTrigTab();
+    void appendTrig(const QString&);
+    void calculateTrigResult();
+    QString angleText(int) const;
+
 
      // Методы для геометрии
      void setupGeometryTab();
      void updateShapeSettings();
      void clearPointInputs();
      QVector<QPointF> getPointsFromInputs() const;
+     std::vector<Triangle> getTrianglesFromInputs() const;
+     void generateRandomInput();
+     void finishGeometryCalculation();
+     void showTriangleBatch();
+     void locateGeometryPoint(const QPointF&);
+
+    // Вкладка таблицы
+    void setupSpreadsheetTab();
+
+    // Построение по точкам выполняется в фоне
+    enum GeometryMode {
+        GEOMETRY_HULL,
+        GEOMETRY_DELAUNAY,
+        GEOMETRY_POLYGON,
+        GEOMETRY_TRIANGLES      // треугольники по трём сторонам, одним TriangleBatchItem
+    };
+    struct GeometryResult {
+        std::vector<Point2D> points;
+        std::vector<uint32_t> outline;      // номера вершин контура
+        std::vector<uint32_t> edges;        // пары номеров, рёбра триангуляции
+        double area;
+        Point2D centroid;
+        double milliseconds;
+        std::shared_ptr<PolygonLocator> locator;
+        QString error;
+    };
+
+    // Выражения с sum, prod и integral вычисляются в фоне; Esc отменяет
+    struct BackgroundResult {
+        double value;
+        CalculationError error;
+        QString exactText;      // результат точного режима
+    };
+    // Куда выводится результат фонового вычисления
+    enum CalculationTarget {
+        TARGET_MAIN,            // основное поле, с точным режимом
+        TARGET_TRIG,            // вкладка тригонометрии
+        TARGET_HISTORY_EDIT,    // поле редактирования истории
+        TARGET_HISTORY_ITEM     // пересчёт элемента истории calculationRow
+    };
+    void startBackgroundCalculation(const std::string&, const CompiledExpression&,
+                                    CalculationTarget target = TARGET_MAIN);
+    // Идёт фоновое вычисление или испытания Монте-Карло
+    bool calculationRunning() const;
+    void showTrigResult(const std::string&, double, const CalculationError&);
+    void showEditedResult(const std::string&, double, const CalculationError&);
+    void showRecalculatedItem(int row, double, const CalculationError&);
+    // Флажок "Точно" в строке состояния: дроби вместо double
+    bool exactMode() const;
+    void finishBackgroundCalculation();
+    void cancelCalculation();
+
+    // Испытания Монте-Карло тоже идут в фоне с тем же флажком отмены
+    struct DistributionResult {
+        bool ok;
+        MonteCarloResult result;
+        CalculationError error;
+    };
+    void finishEditedDistribution();
+
+#ifdef CALC_INSTRUMENTATION
+    // Панель диагностики в строке состояния
+    void setupDiagnostics();
+    void updateDiagnostics();
+    QLabel* diagnosticsLabel;
+    QTimer* diagnosticsTimer;
+#endif
 
     Ui::MainWindow *ui;
+    Ui::TrigTab *trigUi;                // nullptr, пока вкладка не открыта
+    QGraphicsView* geometryView;        // то же для вкладки геометрии
+    QGraphicsScene* geometryScene;
+    QPlainTextEdit* geometryPointsEdit;
+    QComboBox* geometryModeCombo;
+    QSpinBox* geometryRandomCount;
+    QLabel* geometryInfoLabel;
+    GeometryGraphicsItem* geometryItem;
+    QFutureWatcher<GeometryResult>* geometryWatcher;
+    std::vector<Point2D> generatedPoints;      // случайный набор, не выводится в поле ввода
+    std::vector<Triangle> generatedTriangles;
+    std::shared_ptr<PolygonLocator> geometryLocator;   // контур для запросов принадлежности
+    QString geometrySummary;
+    QPoint geometryPressPosition;
+    SpreadsheetModel* spreadsheetModel;     // nullptr, пока вкладка таблицы не открыта
+    QLabel* spreadsheetInfoLabel;
+    QCheckBox* exactModeBox;
 
     struct HistoryItem {
         QString expression;
@@ -89,12 +211,25 @@ private:
     };
 
     QVector<HistoryItem> historyData;
-    QTimer* updateTimer; // Таймер для отложенного перерасчета
     QString text_buffer;
+    QString trig_buffer;
     ExpressionCalculator calculator;
+    // Разбор продолжается с неизменного начала строки
+    ExpressionCalculator::IncrementalParse previewParse;
+    ExpressionCalculator::IncrementalParse historyParse;
+    CompiledExpression previewProgram;
+    QFutureWatcher<BackgroundResult>* calculationWatcher;
+    std::atomic<bool> calculationCancelled;
+    std::string calculationExpression;
+    CalculationTarget calculationTarget;
+    int calculationRow;
+    QFutureWatcher<DistributionResult>* distributionWatcher;
+    std::string distributionText;       // запись, для которой идут испытания
     // Добавьте константы для истории
     const int MAX_HISTORY_ITEMS = 20;
-    const int UPDATE_DELAY_MS = 500; // Задержка перед перерасчетом в мс
+    // Испытаний Монте-Карло в поле редактирования истории
+    const int MONTE_CARLO_SAMPLES = 1000000;
+    const uint64_t MONTE_CARLO_SEED = 1;
 
 };
 #endif // MAINWINDOW_H
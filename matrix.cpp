@@ -0,0 +1,193 @@
+#include "matrix.h"
+#include "matrixkernels.h"
+#include "simd.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+Matrix::Matrix()
+    : rowCount(1)
+    , columnCount(1)
+    , values(1, 0.0)
+{
+}
+
+Matrix::Matrix(size_t rows, size_t cols, double value)
+    : rowCount(rows)
+    , columnCount(cols)
+    , values(rows * cols, value)
+{
+}
+
+Matrix Matrix::scalar(double value) {
+    return Matrix(1, 1, value);
+}
+
+Matrix Matrix::identity(size_t n) {
+
+    Matrix result(n, n);
+    for (size_t i = 0; i < n; i++) {
+        result(i, i) = 1.0;
+    }
+    return result;
+}
+
+std::string Matrix::toString(int precision) const {
+
+    char text[32];
+    std::string result = isScalar() ? "" : "[";
+    for (size_t i = 0; i < rowCount; i++) {
+        if (i) result += ';';
+        for (size_t j = 0; j < columnCount; j++) {
+            if (j) result += ',';
+            std::snprintf(text, sizeof(text), "%.*g", precision, (*this)(i, j));
+            result += text;
+        }
+    }
+    return isScalar() ? result : result + "]";
+}
+
+static double applyElement(double a, double b, char op) {
+
+    switch (op) {
+    case '+': return a + b;
+    case '-': return a - b;
+    case '*': return a * b;
+    case '/': return a / b;
+    default: return std::pow(a, b);
+    }
+}
+
+CalculationError::Code elementwise(const Matrix &a, const Matrix &b, char op, Matrix &result) {
+
+    bool rowsMatch = a.rows() == b.rows() || a.rows() == 1 || b.rows() == 1;
+    bool colsMatch = a.cols() == b.cols() || a.cols() == 1 || b.cols() == 1;
+    if (!rowsMatch || !colsMatch) {
+        return CalculationError::DIMENSION_MISMATCH;
+    }
+    if (op == '/' && std::find(b.data(), b.data() + b.size(), 0.0) != b.data() + b.size()) {
+        return CalculationError::DIVISION_BY_ZERO;
+    }
+
+    size_t rows = std::max(a.rows(), b.rows());
+    size_t cols = std::max(a.cols(), b.cols());
+    Matrix out(rows, cols);
+
+    if (a.rows() == b.rows() && a.cols() == b.cols() && op != '^') {
+        // Одинаковые размеры: один векторный проход по всем элементам
+        const double* x = a.data();
+        const double* y = b.data();
+        double* z = out.data();
+        size_t n = out.size();
+        size_t j = 0;
+        switch (op) {
+        case '+': for (; j + simd::width <= n; j += simd::width) simd::store(z + j, simd::load(x + j) + simd::load(y + j)); break;
+        case '-': for (; j + simd::width <= n; j += simd::width) simd::store(z + j, simd::load(x + j) - simd::load(y + j)); break;
+        case '*': for (; j + simd::width <= n; j += simd::width) simd::store(z + j, simd::load(x + j) * simd::load(y + j)); break;
+        default: for (; j + simd::width <= n; j += simd::width) simd::store(z + j, simd::load(x + j) / simd::load(y + j)); break;
+        }
+        for (; j < n; j++) {
+            z[j] = applyElement(x[j], y[j], op);
+        }
+    } else {
+        for (size_t i = 0; i < rows; i++) {
+            size_t ia = a.rows() == 1 ? 0 : i;
+            size_t ib = b.rows() == 1 ? 0 : i;
+            for (size_t j = 0; j < cols; j++) {
+                out(i, j) = applyElement(a(ia, a.cols() == 1 ? 0 : j), b(ib, b.cols() == 1 ? 0 : j), op);
+            }
+        }
+    }
+
+    result = out;
+    return CalculationError::NONE;
+}
+
+CalculationError::Code concatenate(const Matrix &a, const Matrix &b, char op, Matrix &result) {
+
+    if (op == ',') {
+        if (a.rows() != b.rows()) {
+            return CalculationError::DIMENSION_MISMATCH;
+        }
+        Matrix out(a.rows(), a.cols() + b.cols());
+        for (size_t i = 0; i < a.rows(); i++) {
+            std::copy(a.data() + i * a.cols(), a.data() + (i + 1) * a.cols(), out.data() + i * out.cols());
+            std::copy(b.data() + i * b.cols(), b.data() + (i + 1) * b.cols(), out.data() + i * out.cols() + a.cols());
+        }
+        result = out;
+    } else {
+        if (a.cols() != b.cols()) {
+            return CalculationError::DIMENSION_MISMATCH;
+        }
+        Matrix out(a.rows() + b.rows(), a.cols());
+        std::copy(a.data(), a.data() + a.size(), out.data());
+        std::copy(b.data(), b.data() + b.size(), out.data() + a.size());
+        result = out;
+    }
+    return CalculationError::NONE;
+}
+
+CalculationError::Code multiply(const Matrix &a, const Matrix &b, Matrix &result) {
+
+    if (a.cols() != b.rows()) {
+        return CalculationError::DIMENSION_MISMATCH;
+    }
+    Matrix out(a.rows(), b.cols());
+    matrixMultiply(a.data(), b.data(), out.data(), a.rows(), a.cols(), b.cols());
+    result = out;
+    return CalculationError::NONE;
+}
+
+CalculationError::Code determinant(const Matrix &a, Matrix &result) {
+
+    if (a.rows() != a.cols()) {
+        return CalculationError::DIMENSION_MISMATCH;
+    }
+    Matrix lu = a;
+    std::vector<size_t> pivots(a.rows());
+    int sign = 1;
+    if (!luDecompose(lu.data(), lu.rows(), pivots.data(), sign)) {
+        result = Matrix::scalar(0.0);
+        return CalculationError::NONE;
+    }
+    double value = sign;
+    for (size_t i = 0; i < lu.rows(); i++) {
+        value *= lu(i, i);
+    }
+    result = Matrix::scalar(value);
+    return CalculationError::NONE;
+}
+
+CalculationError::Code inverse(const Matrix &a, Matrix &result) {
+    return solve(a, Matrix::identity(a.rows()), result);
+}
+
+CalculationError::Code solve(const Matrix &a, const Matrix &b, Matrix &result) {
+
+    if (a.rows() != a.cols() || b.rows() != a.rows()) {
+        return CalculationError::DIMENSION_MISMATCH;
+    }
+    Matrix lu = a;
+    std::vector<size_t> pivots(a.rows());
+    int sign = 1;
+    if (!luDecompose(lu.data(), lu.rows(), pivots.data(), sign)) {
+        return CalculationError::SINGULAR_MATRIX;
+    }
+    Matrix x = b;
+    luSolve(lu.data(), pivots.data(), lu.rows(), x.data(), x.cols());
+    result = x;
+    return CalculationError::NONE;
+}
+
+CalculationError::Code transpose(const Matrix &a, Matrix &result) {
+
+    Matrix out(a.cols(), a.rows());
+    for (size_t i = 0; i < a.rows(); i++) {
+        for (size_t j = 0; j < a.cols(); j++) {
+            out(j, i) = a(i, j);
+        }
+    }
+    result = out;
+    return CalculationError::NONE;
+}
@@ -0,0 +1,55 @@
+#ifndef MATRIX_H
+#define MATRIX_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "calculationerror.h"
+
+// Значение матричного режима калькулятора: матрица rows x cols,
+// элементы хранятся по строкам. Число - матрица 1 x 1
+class Matrix
+{
+public:
+    Matrix();
+    Matrix(size_t rows, size_t cols, double value = 0.0);
+
+    static Matrix scalar(double value);
+    static Matrix identity(size_t n);
+
+    size_t rows() const { return rowCount; }
+    size_t cols() const { return columnCount; }
+    size_t size() const { return values.size(); }
+    bool isScalar() const { return rowCount == 1 && columnCount == 1; }
+
+    double& operator()(size_t row, size_t col) { return values[row * columnCount + col]; }
+    double operator()(size_t row, size_t col) const { return values[row * columnCount + col]; }
+    double* data() { return values.data(); }
+    const double* data() const { return values.data(); }
+
+    // Запись литералом [1,2;3,4], которую калькулятор читает обратно
+    std::string toString(int precision = 12) const;
+
+private:
+    size_t rowCount;
+    size_t columnCount;
+    std::vector<double> values;
+};
+
+// Поэлементная операция '+', '-', '*', '/', '^' с расширением размеров:
+// по каждому измерению размеры совпадают или один из них равен 1
+CalculationError::Code elementwise(const Matrix& a, const Matrix& b, char op, Matrix& result);
+
+// Склейка по горизонтали (',' в литерале) и по вертикали (';')
+CalculationError::Code concatenate(const Matrix& a, const Matrix& b, char op, Matrix& result);
+
+// Матричное произведение, определитель, обратная матрица,
+// решение системы A X = B и транспонирование
+CalculationError::Code multiply(const Matrix& a, const Matrix& b, Matrix& result);
+CalculationError::Code determinant(const Matrix& a, Matrix& result);
+CalculationError::Code inverse(const Matrix& a, Matrix& result);
+CalculationError::Code solve(const Matrix& a, const Matrix& b, Matrix& result);
+CalculationError::Code transpose(const Matrix& a, Matrix& result);
+
+#endif // MATRIX_H
@@ -0,0 +1,263 @@
+#include "matrixkernels.h"
+#include "simd.h"
+
+#include <algorithm>
+#include <cmath>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace {
+
+// Размер микроблока C, который целиком живёт в регистрах
+const size_t MR = 4;
+const size_t NR = 2 * simd::width;
+// Блоки упаковки: панель A (MC x KC) - в L2, полоса панели B (KC x NR) - в L1
+const size_t MC = 64;
+const size_t KC = 256;
+const size_t NC = 2048;
+// Меньшие произведения (m * n * k) считаются в одном потоке
+const double PARALLEL_WORK = 2e6;
+// Ширина блока столбцов LU-разложения
+const size_t LU_BLOCK = 64;
+
+// Копия блока A (mc x kc) панелями по MR строк: в панели элементы
+// идут по столбцам, недостающие строки заполнены нулями
+void packA(size_t mc, size_t kc, double alpha, const double *a, size_t lda, double *packed) {
+
+    for (size_t i = 0; i < mc; i += MR) {
+        size_t rows = std::min(MR, mc - i);
+        for (size_t p = 0; p < kc; p++) {
+            for (size_t r = 0; r < MR; r++) {
+                *packed++ = r < rows ? alpha * a[(i + r) * lda + p] : 0.0;
+            }
+        }
+    }
+}
+
+// Копия блока B (kc x nc) панелями по NR столбцов
+void packB(size_t kc, size_t nc, const double *b, size_t ldb, double *packed) {
+
+    for (size_t j = 0; j < nc; j += NR) {
+        size_t columns = std::min(NR, nc - j);
+        for (size_t p = 0; p < kc; p++) {
+            const double* row = b + p * ldb + j;
+            for (size_t c = 0; c < NR; c++) {
+                *packed++ = c < columns ? row[c] : 0.0;
+            }
+        }
+    }
+}
+
+// C[0..rows, 0..columns) += Ap * Bp для одной пары панелей
+void microKernel(size_t kc, const double *ap, const double *bp, double *c, size_t ldc,
+                 size_t rows, size_t columns) {
+
+    simd::vdouble acc[MR][2];
+    for (size_t r = 0; r < MR; r++) {
+        acc[r][0] = simd::set1(0.0);
+        acc[r][1] = simd::set1(0.0);
+    }
+
+    for (size_t p = 0; p < kc; p++) {
+        simd::vdouble b0 = simd::load(bp);
+        simd::vdouble b1 = simd::load(bp + simd::width);
+        for (size_t r = 0; r < MR; r++) {
+            simd::vdouble a = simd::set1(ap[r]);
+            acc[r][0] = simd::fma(a, b0, acc[r][0]);
+            acc[r][1] = simd::fma(a, b1, acc[r][1]);
+        }
+        ap += MR;
+        bp += NR;
+    }
+
+    if (rows == MR && columns == NR) {
+        for (size_t r = 0; r < MR; r++) {
+            double* row = c + r * ldc;
+            simd::store(row, simd::load(row) + acc[r][0]);
+            simd::store(row + simd::width, simd::load(row + simd::width) + acc[r][1]);
+        }
+        return;
+    }
+
+    // Край матрицы: складываем через временный блок
+    double block[MR * NR];
+    for (size_t r = 0; r < MR; r++) {
+        simd::store(block + r * NR, acc[r][0]);
+        simd::store(block + r * NR + simd::width, acc[r][1]);
+    }
+    for (size_t r = 0; r < rows; r++) {
+        for (size_t j = 0; j < columns; j++) {
+            c[r * ldc + j] += block[r * NR + j];
+        }
+    }
+}
+
+void gemmSerial(size_t m, size_t n, size_t k, double alpha,
+                const double *a, size_t lda, const double *b, size_t ldb,
+                double *c, size_t ldc) {
+
+    // Буферы упаковки по размеру самых больших блоков этого произведения
+    size_t depth = std::min(KC, k);
+    std::vector<double> packedA((std::min(MC, m) + MR - 1) / MR * MR * depth);
+    std::vector<double> packedB((std::min(NC, n) + NR - 1) / NR * NR * depth);
+
+    for (size_t jc = 0; jc < n; jc += NC) {
+        size_t nc = std::min(NC, n - jc);
+        for (size_t pc = 0; pc < k; pc += KC) {
+            size_t kc = std::min(KC, k - pc);
+            packB(kc, nc, b + pc * ldb + jc, ldb, packedB.data());
+
+            for (size_t ic = 0; ic < m; ic += MC) {
+                size_t mc = std::min(MC, m - ic);
+                packA(mc, kc, alpha, a + ic * lda + pc, lda, packedA.data());
+
+                for (size_t jr = 0; jr < nc; jr += NR) {
+                    for (size_t ir = 0; ir < mc; ir += MR) {
+                        microKernel(kc, packedA.data() + ir * kc, packedB.data() + jr * kc,
+                                    c + (ic + ir) * ldc + jc + jr, ldc,
+                                    std::min(MR, mc - ir), std::min(NR, nc - jr));
+                    }
+                }
+            }
+        }
+    }
+}
+
+// Вычитание кратного строки: y -= alpha * x
+void subtractScaled(double *y, const double *x, double alpha, size_t n) {
+
+    simd::vdouble factor = simd::set1(alpha);
+    size_t j = 0;
+    for (; j + simd::width <= n; j += simd::width) {
+        simd::store(y + j, simd::load(y + j) - factor * simd::load(x + j));
+    }
+    for (; j < n; j++) {
+        y[j] -= alpha * x[j];
+    }
+}
+
+} // namespace
+
+void gemm(size_t m, size_t n, size_t k, double alpha,
+          const double *a, size_t lda, const double *b, size_t ldb,
+          double *c, size_t ldc) {
+
+    if (m == 0 || n == 0 || k == 0) {
+        return;
+    }
+
+    // Полосы строк C независимы: каждый поток упаковывает свои панели
+    size_t threads = std::max(1u, std::thread::hardware_concurrency());
+    double work = static_cast<double>(m) * n * k;
+    if (threads == 1 || work < PARALLEL_WORK || m < 2 * MR) {
+        gemmSerial(m, n, k, alpha, a, lda, b, ldb, c, ldc);
+        return;
+    }
+
+    threads = std::min(threads, m / MR);
+    size_t stripe = ((m + threads - 1) / threads + MR - 1) / MR * MR;
+    std::vector<std::thread> pool;
+    for (size_t row = stripe; row < m; row += stripe) {
+        size_t rows = std::min(stripe, m - row);
+        pool.emplace_back(gemmSerial, rows, n, k, alpha, a + row * lda, lda, b, ldb, c + row * ldc, ldc);
+    }
+    gemmSerial(std::min(stripe, m), n, k, alpha, a, lda, b, ldb, c, ldc);
+    for (std::thread& thread : pool) {
+        thread.join();
+    }
+}
+
+void matrixMultiply(const double *a, const double *b, double *c, size_t m, size_t k, size_t n) {
+
+    std::fill(c, c + m * n, 0.0);
+    gemm(m, n, k, 1.0, a, k, b, n, c, n);
+}
+
+void matrixMultiplyNaive(const double *a, const double *b, double *c, size_t m, size_t k, size_t n) {
+
+    for (size_t i = 0; i < m; i++) {
+        for (size_t j = 0; j < n; j++) {
+            double sum = 0.0;
+            for (size_t p = 0; p < k; p++) {
+                sum += a[i * k + p] * b[p * n + j];
+            }
+            c[i * n + j] = sum;
+        }
+    }
+}
+
+bool luDecompose(double *a, size_t n, size_t *pivots, int &sign) {
+
+    sign = 1;
+    for (size_t k0 = 0; k0 < n; k0 += LU_BLOCK) {
+        size_t kb = std::min(LU_BLOCK, n - k0);
+        size_t end = k0 + kb;
+
+        // Разложение панели столбцов [k0, end) по всем строкам ниже k0;
+        // перестановка строк применяется сразу ко всей матрице
+        for (size_t k = k0; k < end; k++) {
+            size_t pivot = k;
+            for (size_t i = k + 1; i < n; i++) {
+                if (std::fabs(a[i * n + k]) > std::fabs(a[pivot * n + k])) {
+                    pivot = i;
+                }
+            }
+            pivots[k] = pivot;
+            if (a[pivot * n + k] == 0.0) {
+                return false;
+            }
+            if (pivot != k) {
+                std::swap_ranges(a + k * n, a + (k + 1) * n, a + pivot * n);
+                sign = -sign;
+            }
+
+            const double* pivotRow = a + k * n;
+            for (size_t i = k + 1; i < n; i++) {
+                double* row = a + i * n;
+                row[k] /= pivotRow[k];
+                subtractScaled(row + k + 1, pivotRow + k + 1, row[k], end - k - 1);
+            }
+        }
+
+        if (end == n) {
+            break;
+        }
+
+        // U12 = L11^-1 A12: прямая подстановка в строках панели
+        for (size_t k = k0; k < end; k++) {
+            for (size_t i = k + 1; i < end; i++) {
+                subtractScaled(a + i * n + end, a + k * n + end, a[i * n + k], n - end);
+            }
+        }
+
+        // A22 -= L21 * U12 - основная работа, блочное умножение
+        gemm(n - end, n - end, kb, -1.0, a + end * n + k0, n, a + k0 * n + end, n, a + end * n + end, n);
+    }
+    return true;
+}
+
+void luSolve(const double *lu, const size_t *pivots, size_t n, double *b, size_t columns) {
+
+    for (size_t k = 0; k < n; k++) {
+        if (pivots[k] != k) {
+            std::swap_ranges(b + k * columns, b + (k + 1) * columns, b + pivots[k] * columns);
+        }
+    }
+    // L y = P b
+    for (size_t i = 0; i < n; i++) {
+        for (size_t k = 0; k < i; k++) {
+            subtractScaled(b + i * columns, b + k * columns, lu[i * n + k], columns);
+        }
+    }
+    // U x = y
+    for (size_t i = n; i-- > 0;) {
+        for (size_t k = i + 1; k < n; k++) {
+            subtractScaled(b + i * columns, b + k * columns, lu[i * n + k], columns);
+        }
+        double diagonal = lu[i * n + i];
+        for (size_t j = 0; j < columns; j++) {
+            b[i * columns + j] /= diagonal;
+        }
+    }
+}
@@ -0,0 +1,31 @@
+#ifndef MATRIXKERNELS_H
+#define MATRIXKERNELS_H
+
+#include <cstddef>
+
+// Ядра линейной алгебры в стиле BLAS для матриц, хранящихся по строкам;
+// ld* - шаг между строками (leading dimension).
+
+// C += alpha * A * B, A - m x k, B - k x n.
+// Блочное умножение: панели B и A упаковываются так, чтобы векторное
+// микроядро 4 x (2 * simd::width) читало их подряд из кэша.
+// Большие произведения делятся по строкам C между потоками
+void gemm(size_t m, size_t n, size_t k, double alpha,
+          const double* a, size_t lda, const double* b, size_t ldb,
+          double* c, size_t ldc);
+
+// C = A * B для плотных матриц без шага
+void matrixMultiply(const double* a, const double* b, double* c, size_t m, size_t k, size_t n);
+// Простое тройное умножение (для проверки и сравнения в бенчмарке)
+void matrixMultiplyNaive(const double* a, const double* b, double* c, size_t m, size_t k, size_t n);
+
+// LU-разложение n x n на месте с выбором ведущего элемента по столбцу:
+// PA = LU, L с единичной диагональю. pivots[i] - строка, переставленная с i-й,
+// sign - знак перестановки. Блоки по столбцам, обновление остатка - через gemm.
+// Возвращает false для вырожденной матрицы
+bool luDecompose(double* a, size_t n, size_t* pivots, int& sign);
+
+// Решение LU X = P B на месте; b - n x columns по строкам
+void luSolve(const double* lu, const size_t* pivots, size_t n, double* b, size_t columns);
+
+#endif // MATRIXKERNELS_H
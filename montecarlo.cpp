@@ -0,0 +1,413 @@
+#include "montecarlo.h"
+
+#include "expressioncalculator.h"
+#include "trigcore.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace {
+
+// Испытаний в блоке. Размер фиксирован: от него зависит порядок
+// объединения статистики, а значит и результат
+const size_t BLOCK_SIZE = 16384;
+
+// Пар испытаний за один вызов генератора: раунды Philox идут
+// по массивам дорожек, и компилятор векторизует умножения 32 x 32 -> 64
+const size_t PHILOX_LANES = 64;
+
+const double TWO_PI = 6.28318530717958647692;
+
+// Philox4x32-10 (Salmon, Moraes, Dror, Shaw, 2011) над дорожками в формате SoA:
+// счётчик (c0, c1, c2, c3) каждой дорожки заменяется случайными словами
+void philox(uint32_t key0, uint32_t key1, uint32_t* c0, uint32_t* c1, uint32_t* c2, uint32_t* c3, size_t n) {
+
+    const uint64_t M0 = 0xD2511F53u;
+    const uint64_t M1 = 0xCD9E8D57u;
+    for (int round = 0; round < 10; round++) {
+        for (size_t j = 0; j < n; j++) {
+            uint64_t p0 = M0 * c0[j];
+            uint64_t p1 = M1 * c2[j];
+            uint32_t x0 = static_cast<uint32_t>(p1 >> 32) ^ c1[j] ^ key0;
+            uint32_t x2 = static_cast<uint32_t>(p0 >> 32) ^ c3[j] ^ key1;
+            c1[j] = static_cast<uint32_t>(p1);
+            c3[j] = static_cast<uint32_t>(p0);
+            c0[j] = x0;
+            c2[j] = x2;
+        }
+        key0 += 0x9E3779B9u;
+        key1 += 0xBB67AE85u;
+    }
+}
+
+// 53 старших бита двух слов - число строго внутри (0, 1)
+inline double unitInterval(uint32_t high, uint32_t low) {
+
+    uint64_t bits = (static_cast<uint64_t>(high) << 32 | low) >> 11;
+    return (bits + 0.5) * (1.0 / 9007199254740992.0);
+}
+
+// Пары значений распределения из пар равномерных чисел u1[j], u2[j].
+// Нормальное - Бокс-Мюллер: sin и cos одного угла одним приведением
+// по массиву дорожек (trigSinCosArray)
+void transform(const Distribution& d, const double* u1, const double* u2,
+               double* v0, double* v1, size_t n) {
+
+    switch (d.kind) {
+    case Distribution::NORMAL:
+    case Distribution::LOGNORMAL: {
+        double angle[PHILOX_LANES], sine[PHILOX_LANES], cosine[PHILOX_LANES];
+        for (size_t j = 0; j < n; j++) {
+            angle[j] = TWO_PI * u2[j];
+        }
+        trigSinCosArray(angle, sine, cosine, n);
+        for (size_t j = 0; j < n; j++) {
+            double r = d.b * std::sqrt(-2.0 * std::log(u1[j]));
+            v0[j] = d.a + r * cosine[j];
+            v1[j] = d.a + r * sine[j];
+        }
+        if (d.kind == Distribution::LOGNORMAL) {
+            for (size_t j = 0; j < n; j++) {
+                v0[j] = std::exp(v0[j]);
+                v1[j] = std::exp(v1[j]);
+            }
+        }
+        break;
+    }
+    case Distribution::UNIFORM:
+        for (size_t j = 0; j < n; j++) {
+            v0[j] = d.a + (d.b - d.a) * u1[j];
+            v1[j] = d.a + (d.b - d.a) * u2[j];
+        }
+        break;
+    case Distribution::TRIANGULAR: {
+        // Обратная функция распределения
+        double width = d.b - d.a;
+        double split = width > 0.0 ? (d.c - d.a) / width : 0.0;
+        auto inverse = [&](double u) {
+            return u < split ? d.a + std::sqrt(u * width * (d.c - d.a))
+                             : d.b - std::sqrt((1.0 - u) * width * (d.b - d.c));
+        };
+        for (size_t j = 0; j < n; j++) {
+            v0[j] = inverse(u1[j]);
+            v1[j] = inverse(u2[j]);
+        }
+        break;
+    }
+    case Distribution::FIXED:
+        std::fill(v0, v0 + n, d.a);
+        std::fill(v1, v1 + n, d.a);
+        break;
+    }
+}
+
+// Состояние одного блока испытаний
+struct BlockStatistics {
+    uint64_t samples = 0;
+    RunningMoments moments;
+    QuantileSketch quantiles;
+};
+
+std::string trimmed(const std::string& text, size_t& begin, size_t& end) {
+
+    while (begin < end && std::isspace(static_cast<unsigned char>(text[begin]))) begin++;
+    while (end > begin && std::isspace(static_cast<unsigned char>(text[end - 1]))) end--;
+    return text.substr(begin, end - begin);
+}
+
+// Конец части text от begin до разделителя separator вне скобок
+size_t findSeparator(const std::string& text, size_t begin, size_t end, char separator) {
+
+    int depth = 0;
+    for (size_t i = begin; i < end; i++) {
+        char c = text[i];
+        if (c == separator && depth == 0) return i;
+        if (c == '(' || c == '[') depth++;
+        else if (c == ')' || c == ']') depth--;
+    }
+    return end;
+}
+
+CalculationError invalidDistribution(size_t begin, size_t end) {
+
+    CalculationError error;
+    error.code = CalculationError::INVALID_DISTRIBUTION;
+    error.offset = begin;
+    error.length = end - begin;
+    return error;
+}
+
+// Постоянное выражение text[begin, end) с ошибкой в координатах text
+bool constantValue(const ExpressionCalculator& calculator, const std::string& text,
+                   size_t begin, size_t end, double& value, CalculationError& error) {
+
+    std::string fragment = trimmed(text, begin, end);
+    CompiledExpression program;
+    if (!calculator.tryCompile(fragment, std::vector<std::string>(), program, error)
+            || !calculator.tryEvaluate(program, std::vector<double>(), value, error)) {
+        error.offset += begin;
+        return false;
+    }
+    if (!std::isfinite(value)) {
+        error = invalidDistribution(begin, end);
+        return false;
+    }
+    return true;
+}
+
+bool parseDistribution(const ExpressionCalculator& calculator, const std::string& text,
+                       size_t begin, size_t end, Distribution& distribution, CalculationError& error) {
+
+    trimmed(text, begin, end);
+    error = invalidDistribution(begin, end);
+    size_t open = text.find('(', begin);
+    if (open >= end || text[end - 1] != ')') {
+        return false;
+    }
+    size_t nameBegin = begin, nameEnd = open;
+    std::string name = trimmed(text, nameBegin, nameEnd);
+    static const struct { const char* name; Distribution::Kind kind; size_t arguments; } KINDS[] = {
+        { "N", Distribution::NORMAL, 2 },
+        { "U", Distribution::UNIFORM, 2 },
+        { "T", Distribution::TRIANGULAR, 3 },
+        { "LN", Distribution::LOGNORMAL, 2 }
+    };
+    size_t expected = 0;
+    for (const auto& kind : KINDS) {
+        if (name == kind.name) {
+            distribution.kind = kind.kind;
+            expected = kind.arguments;
+        }
+    }
+    if (expected == 0) {
+        error = invalidDistribution(nameBegin, nameEnd);
+        return false;
+    }
+
+    // Аргументы - постоянные выражения через ','
+    double arguments[3] = { 0.0, 0.0, 0.0 };
+    size_t count = 0;
+    size_t argumentsEnd = end - 1;
+    if (findSeparator(text, open + 1, argumentsEnd, ')') != argumentsEnd) {
+        return false;
+    }
+    for (size_t position = open + 1; position <= argumentsEnd; count++) {
+        size_t comma = findSeparator(text, position, argumentsEnd, ',');
+        if (count == expected
+                || !constantValue(calculator, text, position, comma, arguments[count], error)) {
+            if (count == expected) error = invalidDistribution(begin, end);
+            return false;
+        }
+        position = comma + 1;
+    }
+    if (count != expected) {
+        error = invalidDistribution(begin, end);
+        return false;
+    }
+
+    distribution.a = arguments[0];
+    distribution.b = arguments[1];
+    if (distribution.kind == Distribution::TRIANGULAR) {
+        // T(a, c, b): мода вторым аргументом
+        distribution.c = arguments[1];
+        distribution.b = arguments[2];
+    }
+    bool valid = true;
+    switch (distribution.kind) {
+    case Distribution::NORMAL:
+    case Distribution::LOGNORMAL:
+        valid = distribution.b >= 0.0;
+        break;
+    case Distribution::UNIFORM:
+        valid = distribution.a <= distribution.b;
+        break;
+    case Distribution::TRIANGULAR:
+        valid = distribution.a <= distribution.c && distribution.c <= distribution.b;
+        break;
+    case Distribution::FIXED:
+        break;
+    }
+    if (!valid) {
+        error = invalidDistribution(begin, end);
+        return false;
+    }
+    error = CalculationError();
+    return true;
+}
+
+} // namespace
+
+bool parseMonteCarlo(const ExpressionCalculator &calculator, const std::string &text,
+                     std::string &expression, std::vector<std::string> &names,
+                     std::vector<Distribution> &inputs, CalculationError &error) {
+
+    names.clear();
+    inputs.clear();
+    error = CalculationError();
+    size_t end = findSeparator(text, 0, text.size(), ';');
+    // Выражение остаётся в начале строки, и смещения его ошибок совпадают
+    expression = text.substr(0, end);
+
+    while (end < text.size()) {
+        size_t begin = end + 1;
+        end = findSeparator(text, begin, text.size(), ';');
+
+        size_t equals = findSeparator(text, begin, end, '=');
+        size_t tilde = findSeparator(text, begin, end, '~');
+        size_t split = std::min(equals, tilde);
+        if (split == end) {
+            error = invalidDistribution(begin, end);
+            trimmed(text, error.offset, end);
+            error.length = end - error.offset;
+            return false;
+        }
+
+        size_t nameBegin = begin, nameEnd = split;
+        std::string name = trimmed(text, nameBegin, nameEnd);
+        bool identifier = !name.empty() && (std::isalpha(static_cast<unsigned char>(name[0])) || name[0] == '_');
+        for (char c : name) {
+            identifier = identifier && (std::isalnum(static_cast<unsigned char>(c)) || c == '_');
+        }
+        if (!identifier || std::find(names.begin(), names.end(), name) != names.end()) {
+            error = invalidDistribution(nameBegin, nameEnd);
+            if (nameBegin == nameEnd) error.length = split + 1 - nameBegin;
+            return false;
+        }
+
+        Distribution distribution;
+        if (split == equals) {
+            if (!constantValue(calculator, text, split + 1, end, distribution.a, error)) {
+                return false;
+            }
+        } else if (!parseDistribution(calculator, text, split + 1, end, distribution, error)) {
+            return false;
+        }
+        names.push_back(name);
+        inputs.push_back(distribution);
+    }
+    return true;
+}
+
+void sampleDistribution(const Distribution &distribution, uint64_t seed, unsigned int variable,
+                        uint64_t first, size_t count, double *out) {
+
+    if (distribution.kind == Distribution::FIXED) {
+        std::fill(out, out + count, distribution.a);
+        return;
+    }
+    if (count == 0) {
+        return;
+    }
+
+    // Испытания 2p и 2p + 1 берут значения из одного счётчика (p, variable)
+    uint64_t last = first + count - 1;
+    uint32_t c0[PHILOX_LANES], c1[PHILOX_LANES], c2[PHILOX_LANES], c3[PHILOX_LANES];
+    for (uint64_t pair = first / 2; pair <= last / 2; pair += PHILOX_LANES) {
+        size_t lanes = static_cast<size_t>(std::min<uint64_t>(PHILOX_LANES, last / 2 - pair + 1));
+        for (size_t j = 0; j < lanes; j++) {
+            c0[j] = static_cast<uint32_t>(pair + j);
+            c1[j] = static_cast<uint32_t>((pair + j) >> 32);
+            c2[j] = variable;
+            c3[j] = 0;
+        }
+        philox(static_cast<uint32_t>(seed), static_cast<uint32_t>(seed >> 32), c0, c1, c2, c3, lanes);
+        double u1[PHILOX_LANES], u2[PHILOX_LANES], v0[PHILOX_LANES], v1[PHILOX_LANES];
+        for (size_t j = 0; j < lanes; j++) {
+            u1[j] = unitInterval(c1[j], c0[j]);
+            u2[j] = unitInterval(c3[j], c2[j]);
+        }
+        transform(distribution, u1, u2, v0, v1, lanes);
+        for (size_t j = 0; j < lanes; j++) {
+            uint64_t sample = 2 * (pair + j);
+            if (sample >= first) {
+                out[sample - first] = v0[j];
+            }
+            if (sample + 1 <= last) {
+                out[sample + 1 - first] = v1[j];
+            }
+        }
+    }
+}
+
+bool runMonteCarlo(const ExpressionCalculator &calculator, const CompiledExpression &program,
+                   const std::vector<Distribution> &inputs, uint64_t samples, uint64_t seed,
+                   unsigned int threads, const std::atomic<bool> *cancel,
+                   MonteCarloResult &result, CalculationError &error) {
+
+    result = MonteCarloResult();
+    error = CalculationError();
+    if (inputs.size() != program.variables.size() || program.outputCount != 1) {
+        error.code = CalculationError::INVALID_EXPRESSION;
+        return false;
+    }
+
+    size_t blocks = static_cast<size_t>((samples + BLOCK_SIZE - 1) / BLOCK_SIZE);
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    threads = static_cast<unsigned int>(std::min<size_t>(threads, std::max<size_t>(blocks, 1)));
+
+    // Готовые блоки объединяются строго по порядку номеров: блок, который
+    // закончился раньше предыдущих, ждёт в pending
+    std::vector<std::unique_ptr<BlockStatistics>> pending(blocks);
+    size_t nextMerged = 0;
+    std::mutex mergeMutex;
+    std::atomic<size_t> next(0);
+    std::atomic<bool> stopped(false);
+
+    auto worker = [&]() {
+        std::vector<std::vector<double>> columns(inputs.size(), std::vector<double>(BLOCK_SIZE));
+        std::vector<const double*> pointers;
+        for (const std::vector<double>& column : columns) {
+            pointers.push_back(column.data());
+        }
+        std::vector<double> values(BLOCK_SIZE);
+        for (size_t block = next++; block < blocks && !stopped.load(); block = next++) {
+            uint64_t first = static_cast<uint64_t>(block) * BLOCK_SIZE;
+            size_t count = static_cast<size_t>(std::min<uint64_t>(BLOCK_SIZE, samples - first));
+            for (size_t k = 0; k < inputs.size(); k++) {
+                sampleDistribution(inputs[k], seed, static_cast<unsigned int>(k), first, count, columns[k].data());
+            }
+            calculator.evaluateBatch(program, pointers, count, values.data(), cancel);
+            if (cancel && cancel->load()) {
+                stopped = true;
+                break;
+            }
+
+            std::unique_ptr<BlockStatistics> statistics(new BlockStatistics());
+            statistics->samples = count;
+            statistics->moments.add(values.data(), count);
+            statistics->quantiles.add(values.data(), count);
+
+            std::lock_guard<std::mutex> lock(mergeMutex);
+            pending[block] = std::move(statistics);
+            while (nextMerged < blocks && pending[nextMerged]) {
+                const BlockStatistics& ready = *pending[nextMerged];
+                result.samples += ready.samples;
+                result.nonFinite += ready.samples - ready.moments.count;
+                result.moments.merge(ready.moments);
+                result.quantiles.merge(ready.quantiles);
+                pending[nextMerged++].reset();
+            }
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (unsigned int i = 1; i < threads; i++) {
+        pool.emplace_back(worker);
+    }
+    worker();
+    for (std::thread& thread : pool) {
+        thread.join();
+    }
+    if (stopped) {
+        result = MonteCarloResult();
+        error.code = CalculationError::CANCELLED;
+        return false;
+    }
+    return true;
+}
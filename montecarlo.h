@@ -0,0 +1,73 @@
+#ifndef MONTECARLO_H
+#define MONTECARLO_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "calculationerror.h"
+#include "compiledexpression.h"
+#include "statistics.h"
+
+class ExpressionCalculator;
+
+// Распространение неопределённости методом Монте-Карло: переменные
+// выражения задаются распределениями, выражение вычисляется пакетами
+// на случайных значениях, результат - среднее, отклонение и квантили.
+//
+//     x*y^2 + sin(z); x ~ N(1.2, 0.01); y ~ U(2, 3); z = pi/4
+//
+// Случайные числа - счётчиковый генератор Philox4x32-10: значение
+// переменной v в испытании j зависит только от (seed, v, j), поэтому
+// испытания можно считать в любом порядке и в любом числе потоков.
+// Испытания делятся на блоки фиксированного размера, статистика блоков
+// объединяется по порядку номеров, и результат при данном seed
+// одинаков побитово при любом числе потоков.
+
+// Распределение входной величины
+struct Distribution
+{
+    enum Kind : unsigned char {
+        FIXED,          // a = значение
+        NORMAL,         // N(a, b): среднее a, стандартное отклонение b
+        UNIFORM,        // U(a, b) на [a, b)
+        TRIANGULAR,     // T(a, c, b): от a до b с модой c
+        LOGNORMAL       // LN(a, b): exp от N(a, b)
+    };
+
+    Kind kind = FIXED;
+    double a = 0.0;
+    double b = 0.0;
+    double c = 0.0;
+};
+
+struct MonteCarloResult
+{
+    uint64_t samples = 0;
+    uint64_t nonFinite = 0;     // испытания с inf/nan (ошибка вычисления)
+    RunningMoments moments;     // по конечным результатам
+    QuantileSketch quantiles;
+};
+
+// Разбор записи "выражение; имя ~ N(1, 0.1); имя = 2; ...". ';' внутри
+// скобок (литералы матриц) не делит запись. Параметры распределений
+// и значения - постоянные выражения. Ошибки - со смещением в text
+bool parseMonteCarlo(const ExpressionCalculator& calculator, const std::string& text,
+                     std::string& expression, std::vector<std::string>& names,
+                     std::vector<Distribution>& inputs, CalculationError& error);
+
+// Значения распределения переменной variable для испытаний first..first+count-1
+void sampleDistribution(const Distribution& distribution, uint64_t seed, unsigned int variable,
+                        uint64_t first, size_t count, double* out);
+
+// samples испытаний программы, inputs - распределения её переменных
+// по порядку. threads = 0 - по числу ядер. false и error - число
+// распределений не совпадает с переменными, несколько выходов или отмена
+bool runMonteCarlo(const ExpressionCalculator& calculator, const CompiledExpression& program,
+                   const std::vector<Distribution>& inputs, uint64_t samples, uint64_t seed,
+                   unsigned int threads, const std::atomic<bool>* cancel,
+                   MonteCarloResult& result, CalculationError& error);
+
+#endif // MONTECARLO_H
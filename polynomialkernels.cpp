@@ -0,0 +1,189 @@
+#include "polynomialkernels.h"
+#include "simd.h"
+
+#include <cmath>
+
+namespace {
+
+// Умножение со сложением для одной дорожки. Без аппаратного FMA std::fma
+// медленная программная эмуляция, поэтому тогда - обычные a * b + c,
+// как и в simd::fma: скалярный хвост совпадает с векторной частью
+inline double multiplyAdd(double a, double b, double c) {
+#if defined(__FMA__)
+    return std::fma(a, b, c);
+#else
+    return a * b + c;
+#endif
+}
+
+inline simd::vdouble multiplyAdd(simd::vdouble a, simd::vdouble b, simd::vdouble c) {
+    return simd::fma(a, b, c);
+}
+
+inline double broadcast(double c, double) { return c; }
+inline simd::vdouble broadcast(double c, simd::vdouble) { return simd::set1(c); }
+
+// Комплексное значение из дорожек L (double или simd::vdouble)
+template <typename L>
+struct ComplexLanes {
+    L re;
+    L im;
+};
+
+template <typename L>
+inline ComplexLanes<L> multiply(ComplexLanes<L> a, ComplexLanes<L> b) {
+    return { a.re * b.re - a.im * b.im, a.re * b.im + a.im * b.re };
+}
+
+template <typename L>
+inline ComplexLanes<L> multiplyAdd(ComplexLanes<L> a, ComplexLanes<L> b, ComplexLanes<L> c) {
+    ComplexLanes<L> p = multiply(a, b);
+    return { p.re + c.re, p.im + c.im };
+}
+
+template <typename L>
+inline ComplexLanes<L> broadcast(double c, ComplexLanes<L> x) {
+    return { broadcast(c, x.re), broadcast(0.0, x.re) };
+}
+
+inline double multiply(double a, double b) { return a * b; }
+inline simd::vdouble multiply(simd::vdouble a, simd::vdouble b) { return a * b; }
+
+// a * b + c без сложения с нулевым коэффициентом: (-0)^3 остаётся -0, как у pow
+template <typename T>
+inline T multiplyAdd(T a, T b, double c) {
+    return c != 0 ? multiplyAdd(a, b, broadcast(c, a)) : multiply(a, b);
+}
+
+// Горнер: degree умножений подряд, каждое ждёт предыдущее
+template <typename T>
+T horner(const double* c, unsigned int degree, T x) {
+
+    T r = broadcast(c[degree], x);
+    for (unsigned int i = degree; i-- > 0;) {
+        r = multiplyAdd(r, x, c[i]);
+    }
+    return r;
+}
+
+// Эстрин: пары c[2k] + c[2k+1] x, затем пары пар с x^2, x^4, ... -
+// глубина цепочки log2(degree), соседние умножения независимы.
+// Блок из одних нулевых коэффициентов пропускается: иначе 0 * inf
+// дал бы nan там, где схема Горнера даёт бесконечность, а прибавление
+// нулевого младшего блока потеряло бы знак нуля
+template <typename T>
+T estrin(const double* c, unsigned int degree, T x) {
+
+    T terms[MAX_POLYNOMIAL_DEGREE / 2 + 1];
+    bool nonzero[MAX_POLYNOMIAL_DEGREE / 2 + 1];
+    unsigned int count = 0;
+    for (unsigned int k = 0; k <= degree; k += 2) {
+        bool odd = k + 1 <= degree && c[k + 1] != 0;
+        terms[count] = odd ? multiplyAdd(broadcast(c[k + 1], x), x, c[k]) : broadcast(c[k], x);
+        nonzero[count] = odd || c[k] != 0;
+        count++;
+    }
+    T power = x;
+    while (count > 1) {
+        power = multiply(power, power);
+        unsigned int next = 0;
+        for (unsigned int k = 0; k < count; k += 2) {
+            if (k + 1 < count && nonzero[k + 1]) {
+                terms[next] = nonzero[k] ? multiplyAdd(terms[k + 1], power, terms[k]) : multiply(terms[k + 1], power);
+                nonzero[next] = true;
+            } else {
+                terms[next] = terms[k];
+                nonzero[next] = nonzero[k];
+            }
+            next++;
+        }
+        count = next;
+    }
+    return terms[0];
+}
+
+template <typename T>
+inline T evaluate(const double* c, unsigned int degree, CompiledExpression::Polynomial::Scheme scheme, T x) {
+    return scheme == CompiledExpression::Polynomial::ESTRIN ? estrin(c, degree, x) : horner(c, degree, x);
+}
+
+// Сумма нескольких слагаемых: её точный ноль - это +0. Произведение
+// одночлена сохраняет знак, как pow и умножения исходной формулы
+bool isSum(const double* c, unsigned int degree) {
+
+    unsigned int terms = 0;
+    for (unsigned int i = 0; i <= degree; i++) {
+        terms += c[i] != 0;
+    }
+    return terms > 1;
+}
+
+} // namespace
+
+double polynomialValue(const double* c, unsigned int degree,
+                       CompiledExpression::Polynomial::Scheme scheme, double x) {
+
+    if (x == 0) {
+        return c[degree + 1 + std::signbit(x)];
+    }
+    double r = evaluate(c, degree, scheme, x);
+    return isSum(c, degree) ? r + 0.0 : r;
+}
+
+std::complex<double> polynomialValue(const double* c, unsigned int degree,
+                                     CompiledExpression::Polynomial::Scheme scheme, std::complex<double> x) {
+
+    ComplexLanes<double> z = { x.real(), x.imag() };
+    ComplexLanes<double> r = evaluate(c, degree, scheme, z);
+    return std::complex<double>(r.re, r.im);
+}
+
+void polynomialArray(const double* c, unsigned int degree,
+                     CompiledExpression::Polynomial::Scheme scheme,
+                     const double* x, double* out, size_t n) {
+
+    const simd::vdouble zero = simd::set1(0.0);
+    const bool sum = isSum(c, degree);
+    size_t i = 0;
+    for (; i + simd::width <= n; i += simd::width) {
+        simd::vdouble v = simd::load(x + i);
+        simd::vdouble r = evaluate(c, degree, scheme, v);
+        if (sum) {
+            r = r + zero;
+        }
+        if (simd::any(simd::eq(v, zero))) {
+            // Редкий случай: дорожки с нулевым аргументом - по одной
+            double lanes[simd::width];
+            simd::store(lanes, v);
+            simd::store(out + i, r);
+            for (int k = 0; k < simd::width; k++) {
+                if (lanes[k] == 0) out[i + k] = c[degree + 1 + std::signbit(lanes[k])];
+            }
+        } else {
+            simd::store(out + i, r);
+        }
+    }
+    for (; i < n; i++) {
+        out[i] = polynomialValue(c, degree, scheme, x[i]);
+    }
+}
+
+void polynomialComplexArray(const double* c, unsigned int degree,
+                            CompiledExpression::Polynomial::Scheme scheme,
+                            const double* xRe, const double* xIm,
+                            double* outRe, double* outIm, size_t n) {
+
+    size_t i = 0;
+    for (; i + simd::width <= n; i += simd::width) {
+        ComplexLanes<simd::vdouble> z = { simd::load(xRe + i), simd::load(xIm + i) };
+        ComplexLanes<simd::vdouble> r = evaluate(c, degree, scheme, z);
+        simd::store(outRe + i, r.re);
+        simd::store(outIm + i, r.im);
+    }
+    for (; i < n; i++) {
+        ComplexLanes<double> z = { xRe[i], xIm[i] };
+        ComplexLanes<double> r = evaluate(c, degree, scheme, z);
+        outRe[i] = r.re;
+        outIm[i] = r.im;
+    }
+}
@@ -0,0 +1,38 @@
+#ifndef POLYNOMIALKERNELS_H
+#define POLYNOMIALKERNELS_H
+
+#include <complex>
+#include <cstddef>
+
+#include "compiledexpression.h"
+
+// Вычисление многочленов, найденных компилятором (CompiledExpression::Polynomial).
+// c - блок из constants: коэффициенты c[0..degree] от младшего к старшему,
+// затем значения исходного подвыражения при аргументе +0 и -0. Обе схемы
+// используют умножение со сложением (FMA, если процессор его поддерживает)
+// и дают одинаковый результат в скалярном и векторном вариантах, так что
+// интерпретатор и пакетное вычисление не расходятся.
+//
+// Действительный вариант сохраняет знак нуля исходной формулы: в нуле
+// значение берётся из блока, а ноль от взаимного уничтожения слагаемых
+// равен +0, как у суммы. Комплексный вариант вычисляет только схему
+
+// Наибольшая степень, которую компилятор сворачивает в OP_POLY
+const unsigned int MAX_POLYNOMIAL_DEGREE = 16;
+
+double polynomialValue(const double* c, unsigned int degree,
+                       CompiledExpression::Polynomial::Scheme scheme, double x);
+std::complex<double> polynomialValue(const double* c, unsigned int degree,
+                                     CompiledExpression::Polynomial::Scheme scheme, std::complex<double> x);
+
+// Поэлементно над массивом; out можно записывать на место x
+void polynomialArray(const double* c, unsigned int degree,
+                     CompiledExpression::Polynomial::Scheme scheme,
+                     const double* x, double* out, size_t n);
+// То же для комплексного массива в формате SoA
+void polynomialComplexArray(const double* c, unsigned int degree,
+                            CompiledExpression::Polynomial::Scheme scheme,
+                            const double* xRe, const double* xIm,
+                            double* outRe, double* outIm, size_t n);
+
+#endif // POLYNOMIALKERNELS_H
@@ -0,0 +1,312 @@
+#include "reductionkernels.h"
+#include "simd.h"
+
+#include <algorithm>
+#include <cmath>
+#include <thread>
+#include <vector>
+
+namespace {
+
+// Слагаемых за один вызов f: x и y вместе занимают 32 КБ
+const size_t BATCH = 2048;
+// Куски диапазона суммы: не меньше MIN_CHUNK слагаемых и не больше MAX_CHUNKS кусков
+const uint64_t MIN_CHUNK = 1 << 16;
+const uint64_t MAX_CHUNKS = 4096;
+
+bool isCancelled(const std::atomic<bool> *cancel) {
+    return cancel && cancel->load(std::memory_order_relaxed);
+}
+
+// Шаг суммирования Ноймайера: потерянные младшие биты копятся в compensation
+inline void neumaierAdd(double &sum, double &compensation, double x) {
+
+    double t = sum + x;
+    if (std::fabs(sum) >= std::fabs(x)) {
+        compensation += (sum - t) + x;
+    } else {
+        compensation += (x - t) + sum;
+    }
+    sum = t;
+}
+
+// Поправка имеет смысл только для конечной суммы: при inf она равна nan
+inline double compensated(double sum, double compensation) {
+    return std::isfinite(sum) ? sum + compensation : sum;
+}
+
+// Сумма или произведение f(first + j) для j из [begin, end)
+bool reduceChunk(const BatchFunction &f, double first, uint64_t begin, uint64_t end, bool product,
+                 const std::atomic<bool> *cancel, double &result) {
+
+    double x[BATCH];
+    double y[BATCH];
+
+    double productValue = 1.0;
+    simd::vdouble sum = simd::set1(0.0);
+    simd::vdouble compensation = simd::set1(0.0);
+    double tailSum = 0.0;
+    double tailCompensation = 0.0;
+
+    for (uint64_t start = begin; start < end; start += BATCH) {
+        if (isCancelled(cancel)) {
+            return false;
+        }
+        size_t n = static_cast<size_t>(std::min<uint64_t>(BATCH, end - start));
+        for (size_t j = 0; j < n; j++) {
+            x[j] = first + static_cast<double>(start + j);
+        }
+        f(x, y, n);
+
+        if (product) {
+            for (size_t j = 0; j < n; j++) {
+                productValue *= y[j];
+            }
+            continue;
+        }
+
+        // Ноймайер по дорожкам: каждая дорожка копит свою сумму и поправку
+        size_t j = 0;
+        for (; j + simd::width <= n; j += simd::width) {
+            simd::vdouble v = simd::load(y + j);
+            simd::vdouble t = sum + v;
+            simd::vdouble smaller = simd::lt(simd::abs(sum), simd::abs(v));
+            compensation = compensation + simd::select(smaller, (v - t) + sum, (sum - t) + v);
+            sum = t;
+        }
+        for (; j < n; j++) {
+            neumaierAdd(tailSum, tailCompensation, y[j]);
+        }
+    }
+
+    if (product) {
+        result = productValue;
+        return true;
+    }
+
+    double lanes[simd::width];
+    double lanesCompensation[simd::width];
+    simd::store(lanes, sum);
+    simd::store(lanesCompensation, compensation);
+    for (int lane = 0; lane < simd::width; lane++) {
+        neumaierAdd(tailSum, tailCompensation, compensated(lanes[lane], lanesCompensation[lane]));
+    }
+    result = compensated(tailSum, tailCompensation);
+    return true;
+}
+
+// Попарное сложение (умножение) результатов кусков
+double combinePairwise(const double *values, size_t count, bool product) {
+
+    if (count == 1) {
+        return values[0];
+    }
+    double left = combinePairwise(values, count / 2, product);
+    double right = combinePairwise(values + count / 2, count - count / 2, product);
+    return product ? left * right : left + right;
+}
+
+// Узлы и веса Гаусса-Кронрода на [-1, 1]: xgk[1], xgk[3], xgk[5] и 0 - узлы Гаусса
+const double KRONROD_NODES[8] = {
+    0.991455371120812639206854697526329, 0.949107912342758524526189684047851,
+    0.864864423359769072789712788640926, 0.741531185599394439863864773280788,
+    0.586087235467691130294144845693013, 0.405845151377397166906606412076961,
+    0.207784955007898467600689403773245, 0.000000000000000000000000000000000
+};
+const double KRONROD_WEIGHTS[8] = {
+    0.022935322010529224963732008058970, 0.063092092629978553290700663189204,
+    0.104790010322250183839876322541518, 0.140653259715525918745189590510238,
+    0.169004726639267902826583426598550, 0.190350578064785409913256402421014,
+    0.204432940075298892414161999234649, 0.209482141084727828012999174891714
+};
+const double GAUSS_WEIGHTS[4] = {
+    0.129484966168869693270611432679082, 0.279705391489276667901467771423780,
+    0.381830050505118944950369775488975, 0.417959183673469387755102040816327
+};
+const size_t KRONROD_POINTS = 15;
+
+// Делим за шаг не больше SPLIT интервалов, всего интервалов - не больше MAX_INTERVALS
+const size_t SPLIT = 32;
+const size_t MAX_INTERVALS = 4096;
+const double RELATIVE_TOLERANCE = 1e-12;
+const double ABSOLUTE_TOLERANCE = 1e-15;   // относительно интеграла |f|
+
+struct Interval {
+    double a;
+    double b;
+    double value;
+    double error;       // |K15 - G7|, заведомо завышенная оценка
+    double magnitude;   // интеграл |f| по правилу Кронрода
+};
+
+// Значения f во всех узлах интервалов одним пакетом
+void evaluateIntervals(const BatchFunction &f, std::vector<Interval> &intervals, size_t first,
+                       std::vector<double> &x, std::vector<double> &y) {
+
+    size_t count = intervals.size() - first;
+    x.resize(count * KRONROD_POINTS);
+    y.resize(count * KRONROD_POINTS);
+    for (size_t k = 0; k < count; k++) {
+        const Interval& interval = intervals[first + k];
+        double center = 0.5 * (interval.a + interval.b);
+        double half = 0.5 * (interval.b - interval.a);
+        double* nodes = x.data() + k * KRONROD_POINTS;
+        for (size_t i = 0; i < 7; i++) {
+            nodes[2 * i] = center - half * KRONROD_NODES[i];
+            nodes[2 * i + 1] = center + half * KRONROD_NODES[i];
+        }
+        nodes[14] = center;
+    }
+
+    f(x.data(), y.data(), x.size());
+
+    for (size_t k = 0; k < count; k++) {
+        Interval& interval = intervals[first + k];
+        const double* values = y.data() + k * KRONROD_POINTS;
+        double half = 0.5 * (interval.b - interval.a);
+        double kronrod = KRONROD_WEIGHTS[7] * values[14];
+        double gauss = GAUSS_WEIGHTS[3] * values[14];
+        double magnitude = KRONROD_WEIGHTS[7] * std::fabs(values[14]);
+        for (size_t i = 0; i < 7; i++) {
+            double pair = values[2 * i] + values[2 * i + 1];
+            kronrod += KRONROD_WEIGHTS[i] * pair;
+            magnitude += KRONROD_WEIGHTS[i] * (std::fabs(values[2 * i]) + std::fabs(values[2 * i + 1]));
+            if (i % 2 == 1) {
+                gauss += GAUSS_WEIGHTS[i / 2] * pair;
+            }
+        }
+        interval.value = kronrod * half;
+        interval.error = std::fabs((kronrod - gauss) * half);
+        interval.magnitude = std::fabs(magnitude * half);
+    }
+}
+
+} // namespace
+
+bool reduceRange(const BatchFunction &f, double first, uint64_t count, bool product,
+                 const std::atomic<bool> *cancel, double &result) {
+
+    if (count == 0) {
+        result = product ? 1.0 : 0.0;
+        return true;
+    }
+
+    uint64_t chunkSize = std::max(MIN_CHUNK, (count + MAX_CHUNKS - 1) / MAX_CHUNKS);
+    size_t chunks = static_cast<size_t>((count + chunkSize - 1) / chunkSize);
+    std::vector<double> partial(chunks);
+
+    size_t threads = std::min<size_t>(chunks, std::max(1u, std::thread::hardware_concurrency()));
+    if (threads <= 1) {
+        for (size_t chunk = 0; chunk < chunks; chunk++) {
+            uint64_t begin = chunk * chunkSize;
+            if (!reduceChunk(f, first, begin, std::min(count, begin + chunkSize), product, cancel, partial[chunk])) {
+                return false;
+            }
+        }
+    } else {
+        // Потоки разбирают куски по очереди; результат куска пишется
+        // в свою ячейку, поэтому порядок сложения от потоков не зависит
+        std::atomic<size_t> next(0);
+        std::atomic<bool> stopped(false);
+        auto worker = [&]() {
+            for (size_t chunk = next++; chunk < chunks && !stopped.load(); chunk = next++) {
+                uint64_t begin = chunk * chunkSize;
+                if (!reduceChunk(f, first, begin, std::min(count, begin + chunkSize), product, cancel, partial[chunk])) {
+                    stopped = true;
+                }
+            }
+        };
+        std::vector<std::thread> pool;
+        for (size_t i = 1; i < threads; i++) {
+            pool.emplace_back(worker);
+        }
+        worker();
+        for (std::thread& thread : pool) {
+            thread.join();
+        }
+        if (stopped) {
+            return false;
+        }
+    }
+
+    result = combinePairwise(partial.data(), partial.size(), product);
+    return true;
+}
+
+IntegrationStatus integrate(const BatchFunction &f, double a, double b,
+                            const std::atomic<bool> *cancel, double &result) {
+
+    if (a == b) {
+        result = 0.0;
+        return INTEGRATION_DONE;
+    }
+
+    std::vector<Interval> intervals;
+    std::vector<double> x;
+    std::vector<double> y;
+    Interval whole = { a, b, 0.0, 0.0, 0.0 };
+    intervals.push_back(whole);
+    evaluateIntervals(f, intervals, 0, x, y);
+
+    double total = 0.0;
+    double error = 0.0;
+    double tolerance = 0.0;
+    while (true) {
+        double compensation = 0.0;
+        error = 0.0;
+        double magnitude = 0.0;
+        total = 0.0;
+        for (const Interval& interval : intervals) {
+            neumaierAdd(total, compensation, interval.value);
+            error += interval.error;
+            magnitude += interval.magnitude;
+        }
+        total = compensated(total, compensation);
+
+        tolerance = std::max(RELATIVE_TOLERANCE * std::fabs(total), ABSOLUTE_TOLERANCE * magnitude);
+        if (!std::isfinite(total) || error <= tolerance || intervals.size() >= MAX_INTERVALS) {
+            break;
+        }
+        if (isCancelled(cancel)) {
+            return INTEGRATION_CANCELLED;
+        }
+
+        // Интервалы с наибольшей ошибкой - в начало
+        std::sort(intervals.begin(), intervals.end(), [](const Interval& p, const Interval& q) {
+            return p.error > q.error;
+        });
+        size_t split = std::min(std::min(SPLIT, intervals.size()), MAX_INTERVALS - intervals.size());
+
+        // Разделённый интервал помечается отрицательной ошибкой и удаляется
+        // после того, как узлы всех половин вычислены одним пакетом
+        size_t first = intervals.size();
+        for (size_t k = 0; k < split; k++) {
+            Interval parent = intervals[k];
+            double middle = 0.5 * (parent.a + parent.b);
+            if (middle == parent.a || middle == parent.b || parent.error == 0.0) {
+                // Делить дальше нельзя или незачем
+                continue;
+            }
+            intervals[k].error = -1.0;
+            Interval left = { parent.a, middle, 0.0, 0.0, 0.0 };
+            Interval right = { middle, parent.b, 0.0, 0.0, 0.0 };
+            intervals.push_back(left);
+            intervals.push_back(right);
+        }
+        if (intervals.size() == first) {
+            break;
+        }
+        evaluateIntervals(f, intervals, first, x, y);
+        intervals.erase(std::remove_if(intervals.begin(), intervals.end(), [](const Interval& interval) {
+            return interval.error < 0.0;
+        }), intervals.end());
+    }
+
+    // Бесконечность или NaN в сумме - значение подынтегральной функции,
+    // его разбирает вызывающий
+    if (std::isfinite(total) && !(error <= tolerance)) {
+        return INTEGRATION_NO_CONVERGENCE;
+    }
+    result = total;
+    return INTEGRATION_DONE;
+}
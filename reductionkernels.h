@@ -0,0 +1,38 @@
+#ifndef REDUCTIONKERNELS_H
+#define REDUCTIONKERNELS_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+// Ядра для sum, prod и integral. Подынтегральная функция или слагаемое
+// вычисляется пакетами: f(x, y, n) записывает в y[j] значение в точке x[j].
+// f вызывается из нескольких потоков одновременно.
+// cancel (может быть nullptr) проверяется между пакетами; при отмене
+// ядро возвращает false как можно быстрее.
+typedef std::function<void(const double* x, double* y, size_t n)> BatchFunction;
+
+// Сумма (или произведение) f(first + j) по j = 0..count-1.
+// Диапазон делится на куски, размер которых зависит только от count,
+// так что результат не зависит от числа потоков. Внутри куска - суммирование
+// Ноймайера по векторным дорожкам, куски складываются попарно
+bool reduceRange(const BatchFunction& f, double first, uint64_t count, bool product,
+                 const std::atomic<bool>* cancel, double& result);
+
+enum IntegrationStatus {
+    INTEGRATION_DONE,
+    INTEGRATION_CANCELLED,
+    // Точность не достигнута за MAX_INTERVALS интервалов или интервалы
+    // больше не делятся (расходящийся интеграл, особенность, сильные
+    // колебания); result тогда не задаётся
+    INTEGRATION_NO_CONVERGENCE
+};
+
+// Интеграл f по [a, b] адаптивной квадратурой Гаусса-Кронрода (7/15 узлов).
+// За шаг делятся пополам несколько интервалов с наибольшей оценкой ошибки,
+// и узлы всех новых интервалов вычисляются одним пакетом
+IntegrationStatus integrate(const BatchFunction& f, double a, double b,
+                            const std::atomic<bool>* cancel, double& result);
+
+#endif // REDUCTIONKERNELS_H
@@ -0,0 +1,67 @@
+#include "compiledcache.h"
+
+#include <functional>
+
+CompiledCache::CompiledCache(const ExpressionCalculator &calculator, size_t capacity)
+    : calculator(calculator)
+    , shardCapacity(capacity / SHARDS + 1)
+    , hitCount(0)
+    , missCount(0)
+{
+}
+
+std::string CompiledCache::makeKey(const std::string &expression, const std::vector<std::string> &variables) {
+
+    // Имена переменных не содержат '\n', поэтому ключ однозначен
+    std::string key = expression;
+    for (const std::string& name : variables) {
+        key += '\n';
+        key += name;
+    }
+    return key;
+}
+
+void CompiledCache::pin(const std::string &expression, const std::vector<std::string> &variables,
+                        const CompiledExpression &program) {
+
+    std::shared_ptr<Entry> entry = std::make_shared<Entry>();
+    entry->program = program;
+    pinned[makeKey(expression, variables)] = entry;
+}
+
+std::shared_ptr<const CompiledCache::Entry> CompiledCache::get(const std::string &expression,
+                                                               const std::vector<std::string> &variables) {
+
+    std::string key = makeKey(expression, variables);
+    if (!pinned.empty()) {
+        auto it = pinned.find(key);
+        if (it != pinned.end()) {
+            hitCount.fetch_add(1, std::memory_order_relaxed);
+            return it->second;
+        }
+    }
+
+    Shard& shard = shards[std::hash<std::string>()(key) % SHARDS];
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.entries.find(key);
+        if (it != shard.entries.end()) {
+            hitCount.fetch_add(1, std::memory_order_relaxed);
+            return it->second;
+        }
+    }
+
+    missCount.fetch_add(1, std::memory_order_relaxed);
+    std::shared_ptr<Entry> entry = std::make_shared<Entry>();
+    calculator.tryCompile(expression, variables, entry->program, entry->error);
+
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    if (shard.entries.size() >= shardCapacity) {
+        // Переполненный сегмент просто сбрасываем: записи, которые
+        // ещё используются потоками, живут до освобождения shared_ptr
+        shard.entries.clear();
+    }
+    // Если другой поток успел скомпилировать то же выражение, берём его запись
+    auto inserted = shard.entries.emplace(key, entry);
+    return inserted.first->second;
+}
@@ -0,0 +1,57 @@
+#ifndef COMPILEDCACHE_H
+#define COMPILEDCACHE_H
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "expressioncalculator.h"
+
+// Общий для всех рабочих потоков кэш скомпилированных выражений.
+// Ключ - текст выражения вместе со списком имён переменных.
+// Таблица разбита на сегменты со своими мьютексами, чтобы потоки
+// не упирались в одну блокировку; компиляция идёт вне блокировки.
+// Ошибки компиляции тоже кэшируются
+class CompiledCache
+{
+public:
+    struct Entry {
+        CompiledExpression program;
+        CalculationError error;    // error.ok() - программа готова к вычислению
+    };
+
+    explicit CompiledCache(const ExpressionCalculator& calculator, size_t capacity = 4096);
+
+    std::shared_ptr<const Entry> get(const std::string& expression,
+                                     const std::vector<std::string>& variables);
+
+    // Заранее скомпилированная программа (из CompiledLibrary): не вытесняется
+    // и находится без блокировки. Вызывается до начала обслуживания запросов
+    void pin(const std::string& expression, const std::vector<std::string>& variables,
+             const CompiledExpression& program);
+
+    size_t hits() const { return hitCount.load(std::memory_order_relaxed); }
+    size_t misses() const { return missCount.load(std::memory_order_relaxed); }
+
+private:
+    static const size_t SHARDS = 16;
+
+    struct Shard {
+        std::mutex mutex;
+        std::unordered_map<std::string, std::shared_ptr<const Entry>> entries;
+    };
+
+    static std::string makeKey(const std::string& expression, const std::vector<std::string>& variables);
+
+    const ExpressionCalculator& calculator;
+    size_t shardCapacity;
+    Shard shards[SHARDS];
+    std::unordered_map<std::string, std::shared_ptr<const Entry>> pinned;
+    std::atomic<size_t> hitCount;
+    std::atomic<size_t> missCount;
+};
+
+#endif // COMPILEDCACHE_H
@@ -0,0 +1,509 @@
+#include "expressionserver.h"
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+// Метки в epoll_event.data.u64: соединения нумеруются с единицы
+static const uint64_t WAKE_TOKEN = 1ull << 62;
+static const uint64_t LISTENER_TAG = 1ull << 63;
+
+// Пачка строк, отдаваемая одной задаче пула
+static const size_t MAX_BATCH_LINES = 256;
+// Ограничения, после которых соединение перестаёт читаться,
+// пока клиент не заберёт ответы
+static const size_t MAX_PENDING_BATCHES = 64;
+static const size_t MAX_OUTPUT_BYTES = 4 << 20;
+// Строка без '\n' длиннее этого считается ошибкой протокола
+static const size_t MAX_LINE_BYTES = 1 << 20;
+
+static bool setNonBlocking(int fd) {
+
+    int flags = fcntl(fd, F_GETFL, 0);
+    return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+static std::string trim(const std::string &text) {
+
+    size_t begin = text.find_first_not_of(" \t");
+    if (begin == std::string::npos) return std::string();
+    size_t end = text.find_last_not_of(" \t");
+    return text.substr(begin, end - begin + 1);
+}
+
+// Первая ';' вне скобок, начиная с from (';' делит строки литерала
+// матрицы); limit, если её нет
+static size_t findSeparator(const std::string &line, size_t from, size_t limit) {
+
+    int depth = 0;
+    for (size_t i = from; i < limit; i++) {
+        char c = line[i];
+        if (c == '(' || c == '[') depth++;
+        else if ((c == ')' || c == ']') && depth > 0) depth--;
+        else if (c == ';' && depth == 0) return i;
+    }
+    return limit;
+}
+
+static void appendError(std::string &response, size_t offset, size_t length, const std::string &message) {
+
+    char prefix[64];
+    std::snprintf(prefix, sizeof(prefix), "! %zu %zu ", offset, length);
+    response += prefix;
+    response += message;
+    response += '\n';
+}
+
+ExpressionServer::ExpressionServer(const ExpressionCalculator &calculator, size_t threads)
+    : calculator(calculator)
+    , cache(calculator)
+    , stopping(false)
+    , requestCount(0)
+    , pool(new ThreadPool(threads))
+{
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+    epoll_event event;
+    std::memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.u64 = WAKE_TOKEN;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &event);
+}
+
+ExpressionServer::~ExpressionServer() {
+
+    // Дожидаемся рабочих потоков до закрытия дескрипторов
+    pool.reset();
+
+    for (auto& item : connections) {
+        close(item.second.fd);
+    }
+    for (int fd : listeners) {
+        close(fd);
+    }
+    if (!unixPath.empty()) {
+        unlink(unixPath.c_str());
+    }
+    close(wakeFd);
+    close(epollFd);
+}
+
+bool ExpressionServer::addListener(int fd, std::string &error) {
+
+    if (listen(fd, SOMAXCONN) != 0 || !setNonBlocking(fd)) {
+        error = std::strerror(errno);
+        close(fd);
+        return false;
+    }
+
+    epoll_event event;
+    std::memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.u64 = LISTENER_TAG | listeners.size();
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event);
+    listeners.push_back(fd);
+    return true;
+}
+
+bool ExpressionServer::listenUnix(const std::string &path, std::string &error) {
+
+    sockaddr_un address;
+    std::memset(&address, 0, sizeof(address));
+    if (path.size() >= sizeof(address.sun_path)) {
+        error = "Socket path is too long";
+        return false;
+    }
+    address.sun_family = AF_UNIX;
+    std::memcpy(address.sun_path, path.c_str(), path.size());
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        error = std::strerror(errno);
+        return false;
+    }
+
+    // Файл, оставшийся от прошлого запуска, мешает bind
+    unlink(path.c_str());
+    if (bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+        error = std::strerror(errno);
+        close(fd);
+        return false;
+    }
+    unixPath = path;
+    return addListener(fd, error);
+}
+
+bool ExpressionServer::listenTcp(unsigned short port, std::string &error) {
+
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        error = std::strerror(errno);
+        return false;
+    }
+
+    int enable = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+
+    sockaddr_in address;
+    std::memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+        error = std::strerror(errno);
+        close(fd);
+        return false;
+    }
+    return addListener(fd, error);
+}
+
+void ExpressionServer::run() {
+
+    epoll_event events[64];
+    while (!stopping.load()) {
+        int count = epoll_wait(epollFd, events, 64, -1);
+        if (count < 0) {
+            if (errno == EINTR) continue;
+            std::perror("epoll_wait");
+            break;
+        }
+
+        for (int i = 0; i < count; i++) {
+            uint64_t token = events[i].data.u64;
+            if (token == WAKE_TOKEN) {
+                uint64_t value;
+                while (read(wakeFd, &value, sizeof(value)) > 0) {
+                }
+                collectCompletions();
+            } else if (token & LISTENER_TAG) {
+                acceptConnections(listeners[token & ~LISTENER_TAG]);
+            } else {
+                if (events[i].events & (EPOLLHUP | EPOLLERR)) {
+                    // Клиент закрыл соединение полностью: ответы доставить некуда
+                    closeConnection(token);
+                    continue;
+                }
+                if (events[i].events & EPOLLIN) {
+                    readConnection(token);
+                }
+                // Соединение могло закрыться при чтении
+                if ((events[i].events & EPOLLOUT) && connections.count(token)) {
+                    writeConnection(token);
+                }
+            }
+        }
+    }
+}
+
+void ExpressionServer::stop() {
+
+    stopping.store(true);
+    wake();
+}
+
+void ExpressionServer::wake() {
+
+    uint64_t one = 1;
+    ssize_t result = write(wakeFd, &one, sizeof(one));
+    (void)result;
+}
+
+void ExpressionServer::acceptConnections(int listener) {
+
+    for (;;) {
+        int fd = accept4(listener, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            // EAGAIN - очередь пуста; остальные ошибки касаются одного клиента
+            return;
+        }
+
+        int enable = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+
+        uint64_t id = nextConnectionId++;
+        Connection& connection = connections[id];
+        connection.fd = fd;
+        connection.events = EPOLLIN;
+
+        epoll_event event;
+        std::memset(&event, 0, sizeof(event));
+        event.events = connection.events;
+        event.data.u64 = id;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event);
+    }
+}
+
+void ExpressionServer::readConnection(uint64_t id) {
+
+    Connection& connection = connections[id];
+    char buffer[65536];
+    for (;;) {
+        ssize_t received = read(connection.fd, buffer, sizeof(buffer));
+        if (received > 0) {
+            connection.input.append(buffer, static_cast<size_t>(received));
+            continue;
+        }
+        if (received == 0) {
+            connection.peerClosed = true;
+        } else if (errno == EINTR) {
+            continue;
+        } else if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            closeConnection(id);
+            return;
+        }
+        break;
+    }
+
+    // Нарезаем полные строки на пачки и отдаём их пулу
+    size_t begin = 0;
+    std::vector<std::string> lines;
+    for (;;) {
+        size_t end = connection.input.find('\n', begin);
+        if (end != std::string::npos) {
+            lines.push_back(connection.input.substr(begin, end - begin));
+            begin = end + 1;
+        }
+        if (lines.size() == MAX_BATCH_LINES || (end == std::string::npos && !lines.empty())) {
+            uint64_t sequence = connection.nextSequence++;
+            connection.pending++;
+            requestCount.fetch_add(lines.size(), std::memory_order_relaxed);
+            std::shared_ptr<std::vector<std::string>> batch =
+                    std::make_shared<std::vector<std::string>>(std::move(lines));
+            lines.clear();
+            pool->submit([this, id, sequence, batch]() {
+                Completion completion = { id, sequence, evaluateLines(*batch) };
+                {
+                    std::lock_guard<std::mutex> lock(completionMutex);
+                    completions.push_back(std::move(completion));
+                }
+                wake();
+            });
+        }
+        if (end == std::string::npos) break;
+    }
+    connection.input.erase(0, begin);
+
+    if (connection.input.size() > MAX_LINE_BYTES) {
+        closeConnection(id);
+        return;
+    }
+    if (connection.peerClosed && connection.pending == 0 && connection.written == connection.output.size()) {
+        closeConnection(id);
+        return;
+    }
+    updateEvents(id);
+}
+
+void ExpressionServer::writeConnection(uint64_t id) {
+
+    Connection& connection = connections[id];
+    while (connection.written < connection.output.size()) {
+        ssize_t sent = send(connection.fd, connection.output.data() + connection.written,
+                            connection.output.size() - connection.written, MSG_NOSIGNAL);
+        if (sent > 0) {
+            connection.written += static_cast<size_t>(sent);
+        } else if (sent < 0 && errno == EINTR) {
+            continue;
+        } else if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        } else {
+            closeConnection(id);
+            return;
+        }
+    }
+
+    if (connection.written == connection.output.size()) {
+        connection.output.clear();
+        connection.written = 0;
+        if (connection.peerClosed && connection.pending == 0) {
+            closeConnection(id);
+            return;
+        }
+    }
+    updateEvents(id);
+}
+
+void ExpressionServer::collectCompletions() {
+
+    std::vector<Completion> finished;
+    {
+        std::lock_guard<std::mutex> lock(completionMutex);
+        finished.swap(completions);
+    }
+
+    std::vector<uint64_t> touched;
+    for (Completion& completion : finished) {
+        auto it = connections.find(completion.connection);
+        if (it == connections.end()) {
+            // Клиент отключился, не дождавшись ответа
+            continue;
+        }
+        Connection& connection = it->second;
+        connection.pending--;
+        connection.ready[completion.sequence] = std::move(completion.response);
+
+        // Отправляем ответы строго по порядку пачек
+        for (auto next = connection.ready.find(connection.nextToSend);
+             next != connection.ready.end();
+             next = connection.ready.find(connection.nextToSend)) {
+            connection.output += next->second;
+            connection.ready.erase(next);
+            connection.nextToSend++;
+        }
+        touched.push_back(completion.connection);
+    }
+
+    // Ответы всех пачек, готовых к этому моменту, уходят одной записью
+    for (uint64_t id : touched) {
+        if (connections.count(id)) {
+            writeConnection(id);
+        }
+    }
+}
+
+void ExpressionServer::updateEvents(uint64_t id) {
+
+    Connection& connection = connections[id];
+    uint32_t events = 0;
+    bool backlog = connection.pending >= MAX_PENDING_BATCHES
+            || connection.output.size() - connection.written >= MAX_OUTPUT_BYTES;
+    if (!connection.peerClosed && !backlog) {
+        events |= EPOLLIN;
+    }
+    if (connection.written < connection.output.size()) {
+        events |= EPOLLOUT;
+    }
+    if (events == connection.events) {
+        return;
+    }
+
+    epoll_event event;
+    std::memset(&event, 0, sizeof(event));
+    event.events = events;
+    event.data.u64 = id;
+    epoll_ctl(epollFd, EPOLL_CTL_MOD, connection.fd, &event);
+    connection.events = events;
+}
+
+void ExpressionServer::closeConnection(uint64_t id) {
+
+    auto it = connections.find(id);
+    if (it == connections.end()) return;
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, it->second.fd, nullptr);
+    close(it->second.fd);
+    connections.erase(it);
+}
+
+size_t ExpressionServer::preload(const CompiledLibrary &library, std::string &error) {
+
+    size_t count = 0;
+    for (size_t i = 0; i < library.size(); i++) {
+        std::string source = library.source(i);
+        if (source.empty()) continue;
+        CompiledExpression program;
+        if (!library.load(i, program, error)) {
+            return count;
+        }
+        if (program.angleMode != calculator.getAngleMode() || program.outputCount != 1) continue;
+        cache.pin(source, program.variables, program);
+        count++;
+    }
+    return count;
+}
+
+std::string ExpressionServer::evaluateLines(const std::vector<std::string> &lines) {
+
+    std::string response;
+    std::vector<std::string> names;
+    std::vector<double> values;
+    std::vector<Matrix> matrices;
+
+    for (const std::string& rawLine : lines) {
+        size_t lineLength = rawLine.size();
+        if (lineLength && rawLine[lineLength - 1] == '\r') {
+            lineLength--;
+        }
+
+        // Выражение до первой ';' вне скобок, дальше привязки переменных
+        size_t end = findSeparator(rawLine, 0, lineLength);
+        std::string expression = rawLine.substr(0, end);
+
+        names.clear();
+        values.clear();
+        matrices.clear();
+        bool bindingsOk = true;
+        bool matrixBinding = false;
+        while (end < lineLength) {
+            size_t begin = end + 1;
+            end = findSeparator(rawLine, begin, lineLength);
+
+            size_t equals = rawLine.find('=', begin);
+            char* parsedEnd = nullptr;
+            std::string value;
+            if (equals != std::string::npos && equals < end && equals > begin) {
+                value = trim(rawLine.substr(equals + 1, end - equals - 1));
+            }
+            // Массив данных - литерал матрицы: x=[1,2,3]
+            Matrix matrix;
+            bool valid = false;
+            if (!value.empty() && value[0] == '[') {
+                CompiledExpression program;
+                CalculationError valueError;
+                valid = calculator.tryCompile(value, std::vector<std::string>(), program, valueError)
+                        && calculator.tryEvaluateMatrix(program, std::vector<Matrix>(), matrix, valueError);
+                matrixBinding = true;
+            } else if (!value.empty()) {
+                matrix = Matrix::scalar(std::strtod(value.c_str(), &parsedEnd));
+                valid = *parsedEnd == '\0';
+            }
+            if (!valid) {
+                appendError(response, begin, end - begin, "Invalid variable binding");
+                bindingsOk = false;
+                break;
+            }
+            names.push_back(trim(rawLine.substr(begin, equals - begin)));
+            values.push_back(matrix.size() ? matrix(0, 0) : 0.0);
+            matrices.push_back(std::move(matrix));
+        }
+        if (!bindingsOk) continue;
+
+        std::shared_ptr<const CompiledCache::Entry> entry = cache.get(expression, names);
+        CalculationError error = entry->error;
+        double result = 0.0;
+        if (error.ok() && !matrixBinding && calculator.tryEvaluate(entry->program, values, result, error)) {
+            char text[64];
+            std::snprintf(text, sizeof(text), "= %.17g\n", result);
+            response += text;
+            continue;
+        }
+        // Массивы и функции над ними (mean, median, correlation) - матричный режим
+        Matrix matrixResult;
+        if (error.ok() || error.code == CalculationError::MATRIX_IN_SCALAR_MODE) {
+            error = entry->error;
+            if (error.ok() && calculator.tryEvaluateMatrix(entry->program, matrices, matrixResult, error)) {
+                if (matrixResult.isScalar()) {
+                    char text[64];
+                    std::snprintf(text, sizeof(text), "= %.17g\n", matrixResult(0, 0));
+                    response += text;
+                } else {
+                    response += "= " + matrixResult.toString(17) + "\n";
+                }
+                continue;
+            }
+        }
+        appendError(response, error.offset, error.length, error.message(expression));
+    }
+    return response;
+}
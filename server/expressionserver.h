@@ -0,0 +1,113 @@
+#ifndef EXPRESSIONSERVER_H
+#define EXPRESSIONSERVER_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "compiledcache.h"
+#include "compiledlibrary.h"
+#include "threadpool.h"
+
+// Сервер вычисления выражений для других процессов (Linux, epoll).
+//
+// Протокол текстовый, построчный. Запрос:
+//     выражение[;имя=значение[;имя=значение...]]\n
+// например "sin(x)*y;x=0.5;y=2". Значение переменной может быть массивом
+// данных - литералом матрицы: "median(x);x=[3,1,2]", "correlation(x,y);
+// x=[1,2,3];y=[2,4,7]"; такое выражение и выражение с матричными
+// функциями вычисляются в матричном режиме. Ответ на каждую строку:
+//     = значение\n                       - успешное вычисление (матрица -
+//                                          литералом [1,2;3,4])
+//     ! смещение длина сообщение\n       - ошибка, смещение в байтах от начала строки
+// Запросы можно отправлять пачкой, не дожидаясь ответов: ответы приходят
+// в порядке запросов внутри соединения.
+//
+// Один поток обслуживает сокеты через epoll, вычисления идут в пуле потоков
+// с общим кэшем скомпилированных выражений. Строки, прочитанные за один раз,
+// вычисляются одной задачей, а их ответы отправляются одной записью
+class ExpressionServer
+{
+public:
+    ExpressionServer(const ExpressionCalculator& calculator, size_t threads);
+    ~ExpressionServer();
+
+    ExpressionServer(const ExpressionServer&) = delete;
+    ExpressionServer& operator=(const ExpressionServer&) = delete;
+
+    // Unix-сокет по пути path; существующий файл сокета заменяется
+    bool listenUnix(const std::string& path, std::string& error);
+    // TCP только на 127.0.0.1
+    bool listenTcp(unsigned short port, std::string& error);
+
+    // Цикл обработки событий; возвращается после stop()
+    void run();
+    // Безопасно вызывать из обработчика сигнала
+    void stop();
+
+    // Ответы на пачку строк запросов
+    std::string evaluateLines(const std::vector<std::string>& lines);
+
+    // Формулы библиотеки с исходным текстом попадают в кэш до запуска:
+    // первые запросы с ними не разбираются. Программы, скомпилированные
+    // для других единиц углов, пропускаются. Возвращает число формул
+    size_t preload(const CompiledLibrary& library, std::string& error);
+
+    size_t requests() const { return requestCount.load(std::memory_order_relaxed); }
+    const CompiledCache& compiledCache() const { return cache; }
+
+private:
+    struct Connection {
+        int fd = -1;
+        std::string input;                          // хвост без завершающего '\n'
+        std::string output;                         // ответы, готовые к отправке
+        size_t written = 0;                         // уже отправленная часть output
+        uint64_t nextSequence = 0;                  // номер следующей пачки запросов
+        uint64_t nextToSend = 0;                    // номер пачки, ответ на которую ждём
+        std::unordered_map<uint64_t, std::string> ready;  // ответы, пришедшие не по порядку
+        size_t pending = 0;                         // пачек в работе
+        bool peerClosed = false;
+        uint32_t events = 0;
+    };
+
+    struct Completion {
+        uint64_t connection;
+        uint64_t sequence;
+        std::string response;
+    };
+
+    bool addListener(int fd, std::string& error);
+    void acceptConnections(int listener);
+    void readConnection(uint64_t id);
+    void writeConnection(uint64_t id);
+    void collectCompletions();
+    void updateEvents(uint64_t id);
+    void closeConnection(uint64_t id);
+    void wake();
+
+    const ExpressionCalculator& calculator;
+    CompiledCache cache;
+
+    int epollFd = -1;
+    int wakeFd = -1;
+    std::vector<int> listeners;
+    std::string unixPath;
+
+    std::unordered_map<uint64_t, Connection> connections;
+    uint64_t nextConnectionId = 1;
+
+    std::mutex completionMutex;
+    std::vector<Completion> completions;
+
+    std::atomic<bool> stopping;
+    std::atomic<size_t> requestCount;
+
+    // Пул останавливается первым, пока живы очередь ответов и eventfd
+    std::unique_ptr<ThreadPool> pool;
+};
+
+#endif // EXPRESSIONSERVER_H
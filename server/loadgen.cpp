@@ -0,0 +1,206 @@
+// Генератор нагрузки для expression-server.
+// Каждое соединение держит в полёте заданное число запросов (конвейер)
+// и измеряет задержку каждого ответа; в конце печатаются p50/p90/p99
+// и число запросов в секунду.
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+typedef std::chrono::steady_clock Clock;
+
+struct Options {
+    std::string socketPath = "/tmp/expression-server.sock";
+    int tcpPort = 0;
+    int connections = 4;
+    int depth = 16;
+    double duration = 5.0;
+    std::string expression = "sin(x)*cos(x)+x^2/(1+x)";
+};
+
+struct WorkerResult {
+    std::vector<double> latencies;   // микросекунды
+    size_t errors = 0;
+    bool failed = false;
+};
+
+static int connectToServer(const Options &options) {
+
+    if (options.tcpPort > 0) {
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in address;
+        std::memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_port = htons(static_cast<unsigned short>(options.tcpPort));
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (fd < 0 || connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+            if (fd >= 0) close(fd);
+            return -1;
+        }
+        int enable = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+        return fd;
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un address;
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    std::strncpy(address.sun_path, options.socketPath.c_str(), sizeof(address.sun_path) - 1);
+    if (fd < 0 || connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+        if (fd >= 0) close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static bool sendAll(int fd, const std::string &data) {
+
+    size_t sent = 0;
+    while (sent < data.size()) {
+        ssize_t result = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (result <= 0) return false;
+        sent += static_cast<size_t>(result);
+    }
+    return true;
+}
+
+static void runWorker(const Options &options, unsigned seed, Clock::time_point deadline, WorkerResult &result) {
+
+    int fd = connectToServer(options);
+    if (fd < 0) {
+        result.failed = true;
+        return;
+    }
+
+    std::mt19937 generator(seed);
+    std::uniform_real_distribution<double> distribution(-10.0, 10.0);
+    std::deque<Clock::time_point> inFlight;
+    std::string request;
+    char text[64];
+
+    // Дозаполняем конвейер до нужной глубины одной записью
+    auto refill = [&](bool allowNew) {
+        request.clear();
+        Clock::time_point now = Clock::now();
+        while (allowNew && inFlight.size() < static_cast<size_t>(options.depth)) {
+            std::snprintf(text, sizeof(text), ";x=%.17g\n", distribution(generator));
+            request += options.expression;
+            request += text;
+            inFlight.push_back(now);
+        }
+        return request.empty() || sendAll(fd, request);
+    };
+
+    if (!refill(true)) {
+        result.failed = true;
+        close(fd);
+        return;
+    }
+
+    char buffer[65536];
+    std::string pendingLine;
+    while (!inFlight.empty()) {
+        ssize_t received = read(fd, buffer, sizeof(buffer));
+        if (received <= 0) {
+            result.failed = true;
+            break;
+        }
+        Clock::time_point now = Clock::now();
+        for (ssize_t i = 0; i < received; i++) {
+            if (buffer[i] != '\n') {
+                pendingLine += buffer[i];
+                continue;
+            }
+            if (!pendingLine.empty() && pendingLine[0] == '!') {
+                result.errors++;
+            }
+            pendingLine.clear();
+            result.latencies.push_back(
+                        std::chrono::duration<double, std::micro>(now - inFlight.front()).count());
+            inFlight.pop_front();
+        }
+        if (!refill(now < deadline)) {
+            result.failed = true;
+            break;
+        }
+    }
+    close(fd);
+}
+
+static double percentile(const std::vector<double> &sorted, double p) {
+
+    if (sorted.empty()) return 0.0;
+    size_t index = static_cast<size_t>(p * (sorted.size() - 1) + 0.5);
+    return sorted[std::min(index, sorted.size() - 1)];
+}
+
+int main(int argc, char *argv[])
+{
+    Options options;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string option = argv[i];
+        std::string value = argv[i + 1];
+        if (option == "--socket") options.socketPath = value;
+        else if (option == "--tcp") options.tcpPort = std::atoi(value.c_str());
+        else if (option == "--connections") options.connections = std::max(1, std::atoi(value.c_str()));
+        else if (option == "--depth") options.depth = std::max(1, std::atoi(value.c_str()));
+        else if (option == "--duration") options.duration = std::atof(value.c_str());
+        else if (option == "--expression") options.expression = value;
+        else {
+            std::cerr << "Usage: expression-loadgen [--socket PATH | --tcp PORT] [--connections N]"
+                         " [--depth N] [--duration SECONDS] [--expression EXPR]\n";
+            return 1;
+        }
+    }
+
+    std::vector<WorkerResult> results(static_cast<size_t>(options.connections));
+    std::vector<std::thread> workers;
+    Clock::time_point start = Clock::now();
+    Clock::time_point deadline = start + std::chrono::microseconds(static_cast<long long>(options.duration * 1e6));
+    for (int i = 0; i < options.connections; i++) {
+        workers.emplace_back(runWorker, std::cref(options), 12345u + i, deadline, std::ref(results[i]));
+    }
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+    double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+    std::vector<double> latencies;
+    size_t errors = 0;
+    int failed = 0;
+    for (const WorkerResult& result : results) {
+        latencies.insert(latencies.end(), result.latencies.begin(), result.latencies.end());
+        errors += result.errors;
+        failed += result.failed ? 1 : 0;
+    }
+    std::sort(latencies.begin(), latencies.end());
+
+    std::printf("connections: %d, pipeline depth: %d, duration: %.2f s\n",
+                options.connections, options.depth, elapsed);
+    std::printf("requests: %zu (%zu errors), %.0f req/s\n",
+                latencies.size(), errors, latencies.size() / elapsed);
+    std::printf("latency us: p50 %.1f, p90 %.1f, p99 %.1f, max %.1f\n",
+                percentile(latencies, 0.50), percentile(latencies, 0.90),
+                percentile(latencies, 0.99), latencies.empty() ? 0.0 : latencies.back());
+    if (failed) {
+        std::printf("failed connections: %d\n", failed);
+    }
+    return failed ? 1 : 0;
+}
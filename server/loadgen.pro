@@ -0,0 +1,9 @@
+# Генератор нагрузки для expression-server
+TEMPLATE = app
+TARGET = expression-loadgen
+
+CONFIG += console c++11 thread
+CONFIG -= app_bundle qt
+
+SOURCES += \
+    loadgen.cpp
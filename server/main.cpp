@@ -0,0 +1,151 @@
+#include "columnstatistics.h"
+#include "expressionserver.h"
+#include "instrumentation.h"
+
+#include <cctype>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <thread>
+
+static ExpressionServer* runningServer = nullptr;
+
+static void onSignal(int) {
+    if (runningServer) runningServer->stop();
+}
+
+static void printUsage() {
+    std::cerr << "Usage: expression-server [--socket PATH] [--tcp PORT] [--threads N] [--angle rad|deg|grad]\n"
+                 "                         [--library FILE]\n"
+                 "       expression-server --summarize FILE [--columns 0,2,...] [--threads N]\n";
+}
+
+// Статистика столбцов файла данных без запуска сервера
+static int summarize(const std::string &path, const std::vector<size_t> &columns, size_t threads) {
+
+    FileSummary summary;
+    std::string error;
+    if (!summarizeFile(path, columns, static_cast<unsigned int>(threads), nullptr, summary, error)) {
+        std::cerr << error << "\n";
+        return 1;
+    }
+    std::printf("rows %llu\n", static_cast<unsigned long long>(summary.rows));
+    for (size_t k = 0; k < summary.columns.size(); k++) {
+        const ColumnSummary& column = summary.summaries[k];
+        std::printf("column %zu: values %llu, skipped %llu, mean %.17g, stddev %.17g, "
+                    "min %.17g, p25 %.17g, median %.17g, p75 %.17g, max %.17g\n",
+                    summary.columns[k], static_cast<unsigned long long>(column.values),
+                    static_cast<unsigned long long>(column.skipped),
+                    column.moments.mean, column.moments.standardDeviation(),
+                    column.moments.minimum, column.quantiles.quantile(0.25),
+                    column.quantiles.quantile(0.5), column.quantiles.quantile(0.75),
+                    column.moments.maximum);
+    }
+    if (summary.columns.size() >= 2) {
+        std::printf("correlation %zu,%zu: %.17g (%llu pairs)\n", summary.columns[0], summary.columns[1],
+                    summary.covariance.correlation(),
+                    static_cast<unsigned long long>(summary.covariance.count));
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    std::string socketPath = "/tmp/expression-server.sock";
+    int tcpPort = 0;
+    size_t threads = std::thread::hardware_concurrency();
+    AngleMode angleMode = ANGLE_RADIANS;
+    std::string libraryPath;
+    std::string summarizePath;
+    std::vector<size_t> columns;
+
+    for (int i = 1; i < argc; i++) {
+        std::string option = argv[i];
+        if (i + 1 >= argc) {
+            printUsage();
+            return 1;
+        }
+        std::string value = argv[++i];
+        if (option == "--socket") {
+            socketPath = value;
+        } else if (option == "--tcp") {
+            tcpPort = std::atoi(value.c_str());
+        } else if (option == "--threads") {
+            threads = static_cast<size_t>(std::atoi(value.c_str()));
+        } else if (option == "--angle") {
+            if (value == "deg") angleMode = ANGLE_DEGREES;
+            else if (value == "grad") angleMode = ANGLE_GRADIANS;
+            else angleMode = ANGLE_RADIANS;
+        } else if (option == "--library") {
+            libraryPath = value;
+        } else if (option == "--summarize") {
+            summarizePath = value;
+        } else if (option == "--columns") {
+            for (const char* p = value.c_str(); *p; p += *p == ',') {
+                char* end = nullptr;
+                columns.push_back(static_cast<size_t>(std::strtoul(p, &end, 10)));
+                // Номер столбца - не больше шести цифр
+                if (end == p || !std::isdigit(static_cast<unsigned char>(*p)) || end - p > 6) {
+                    printUsage();
+                    return 1;
+                }
+                p = end;
+            }
+        } else {
+            printUsage();
+            return 1;
+        }
+    }
+
+    if (!summarizePath.empty()) {
+        return summarize(summarizePath, columns, threads);
+    }
+
+    // Калькулятор настраивается до старта и дальше только читается потоками
+    ExpressionCalculator calculator;
+    calculator.setAngleMode(angleMode);
+
+    ExpressionServer server(calculator, threads);
+    std::string error;
+
+    // Библиотека нужна только на время загрузки: программы копируются в кэш
+    if (!libraryPath.empty()) {
+        CompiledLibrary library;
+        size_t preloaded = library.open(libraryPath, error) ? server.preload(library, error) : 0;
+        if (!error.empty()) {
+            std::cerr << "Cannot load " << libraryPath << ": " << error << "\n";
+            return 1;
+        }
+        std::cerr << "expression-server: " << preloaded << " formulas from " << libraryPath << "\n";
+    }
+    if (!socketPath.empty() && !server.listenUnix(socketPath, error)) {
+        std::cerr << "Cannot listen on " << socketPath << ": " << error << "\n";
+        return 1;
+    }
+    if (tcpPort > 0 && !server.listenTcp(static_cast<unsigned short>(tcpPort), error)) {
+        std::cerr << "Cannot listen on 127.0.0.1:" << tcpPort << ": " << error << "\n";
+        return 1;
+    }
+
+    runningServer = &server;
+    std::signal(SIGINT, onSignal);
+    std::signal(SIGTERM, onSignal);
+    std::signal(SIGPIPE, SIG_IGN);
+
+    std::cerr << "expression-server: " << socketPath;
+    if (tcpPort > 0) std::cerr << ", 127.0.0.1:" << tcpPort;
+    std::cerr << ", " << (threads ? threads : 1) << " threads\n";
+
+    server.run();
+    runningServer = nullptr;
+
+    std::cerr << "requests: " << server.requests()
+              << ", compiled cache hits: " << server.compiledCache().hits()
+              << ", misses: " << server.compiledCache().misses() << "\n";
+#ifdef CALC_INSTRUMENTATION
+    std::cout << Instrumentation::toPrometheus(Instrumentation::snapshot());
+#endif
+    return 0;
+}
@@ -0,0 +1,141 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+#include <cmath>
+
+// Минимальная обёртка над векторными регистрами для пакетных вычислений.
+// Выбирается самый широкий доступный набор инструкций: AVX, SSE2 или скаляр.
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define SIMD_AVX 1
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SIMD_SSE2 1
+#endif
+
+namespace simd {
+
+#if defined(SIMD_AVX)
+
+const int width = 4;
+
+struct vdouble { __m256d v; };
+
+inline vdouble load(const double* p) { return { _mm256_loadu_pd(p) }; }
+inline void store(double* p, vdouble a) { _mm256_storeu_pd(p, a.v); }
+inline vdouble set1(double x) { return { _mm256_set1_pd(x) }; }
+
+inline vdouble operator+(vdouble a, vdouble b) { return { _mm256_add_pd(a.v, b.v) }; }
+inline vdouble operator-(vdouble a, vdouble b) { return { _mm256_sub_pd(a.v, b.v) }; }
+inline vdouble operator*(vdouble a, vdouble b) { return { _mm256_mul_pd(a.v, b.v) }; }
+inline vdouble operator/(vdouble a, vdouble b) { return { _mm256_div_pd(a.v, b.v) }; }
+
+inline vdouble min(vdouble a, vdouble b) { return { _mm256_min_pd(a.v, b.v) }; }
+inline vdouble max(vdouble a, vdouble b) { return { _mm256_max_pd(a.v, b.v) }; }
+inline vdouble sqrt(vdouble a) { return { _mm256_sqrt_pd(a.v) }; }
+inline vdouble abs(vdouble a) { return { _mm256_andnot_pd(_mm256_set1_pd(-0.0), a.v) }; }
+
+inline vdouble fma(vdouble a, vdouble b, vdouble c) {
+#if defined(__FMA__)
+    return { _mm256_fmadd_pd(a.v, b.v, c.v) };
+#else
+    return a * b + c;
+#endif
+}
+
+// Маски сравнения: во всех битах дорожки единицы или нули
+inline vdouble eq(vdouble a, vdouble b) { return { _mm256_cmp_pd(a.v, b.v, _CMP_EQ_OQ) }; }
+inline vdouble lt(vdouble a, vdouble b) { return { _mm256_cmp_pd(a.v, b.v, _CMP_LT_OQ) }; }
+inline vdouble gt(vdouble a, vdouble b) { return { _mm256_cmp_pd(a.v, b.v, _CMP_GT_OQ) }; }
+inline vdouble maskOr(vdouble a, vdouble b) { return { _mm256_or_pd(a.v, b.v) }; }
+inline vdouble select(vdouble mask, vdouble a, vdouble b) {
+    return { _mm256_or_pd(_mm256_and_pd(mask.v, a.v), _mm256_andnot_pd(mask.v, b.v)) };
+}
+inline vdouble negate(vdouble a) { return { _mm256_xor_pd(a.v, _mm256_set1_pd(-0.0)) }; }
+inline bool any(vdouble mask) { return _mm256_movemask_pd(mask.v) != 0; }
+inline bool all(vdouble mask) { return _mm256_movemask_pd(mask.v) == 0xF; }
+
+#elif defined(SIMD_SSE2)
+
+const int width = 2;
+
+struct vdouble { __m128d v; };
+
+inline vdouble load(const double* p) { return { _mm_loadu_pd(p) }; }
+inline void store(double* p, vdouble a) { _mm_storeu_pd(p, a.v); }
+inline vdouble set1(double x) { return { _mm_set1_pd(x) }; }
+
+inline vdouble operator+(vdouble a, vdouble b) { return { _mm_add_pd(a.v, b.v) }; }
+inline vdouble operator-(vdouble a, vdouble b) { return { _mm_sub_pd(a.v, b.v) }; }
+inline vdouble operator*(vdouble a, vdouble b) { return { _mm_mul_pd(a.v, b.v) }; }
+inline vdouble operator/(vdouble a, vdouble b) { return { _mm_div_pd(a.v, b.v) }; }
+
+inline vdouble min(vdouble a, vdouble b) { return { _mm_min_pd(a.v, b.v) }; }
+inline vdouble max(vdouble a, vdouble b) { return { _mm_max_pd(a.v, b.v) }; }
+inline vdouble sqrt(vdouble a) { return { _mm_sqrt_pd(a.v) }; }
+inline vdouble abs(vdouble a) { return { _mm_andnot_pd(_mm_set1_pd(-0.0), a.v) }; }
+
+inline vdouble fma(vdouble a, vdouble b, vdouble c) { return a * b + c; }
+
+// Маски сравнения: во всех битах дорожки единицы или нули
+inline vdouble eq(vdouble a, vdouble b) { return { _mm_cmpeq_pd(a.v, b.v) }; }
+inline vdouble lt(vdouble a, vdouble b) { return { _mm_cmplt_pd(a.v, b.v) }; }
+inline vdouble gt(vdouble a, vdouble b) { return { _mm_cmpgt_pd(a.v, b.v) }; }
+inline vdouble maskOr(vdouble a, vdouble b) { return { _mm_or_pd(a.v, b.v) }; }
+inline vdouble select(vdouble mask, vdouble a, vdouble b) {
+    return { _mm_or_pd(_mm_and_pd(mask.v, a.v), _mm_andnot_pd(mask.v, b.v)) };
+}
+inline vdouble negate(vdouble a) { return { _mm_xor_pd(a.v, _mm_set1_pd(-0.0)) }; }
+inline bool any(vdouble mask) { return _mm_movemask_pd(mask.v) != 0; }
+inline bool all(vdouble mask) { return _mm_movemask_pd(mask.v) == 0x3; }
+
+#else
+
+const int width = 1;
+
+struct vdouble { double v; };
+
+inline vdouble load(const double* p) { return { *p }; }
+inline void store(double* p, vdouble a) { *p = a.v; }
+inline vdouble set1(double x) { return { x }; }
+
+inline vdouble operator+(vdouble a, vdouble b) { return { a.v + b.v }; }
+inline vdouble operator-(vdouble a, vdouble b) { return { a.v - b.v }; }
+inline vdouble operator*(vdouble a, vdouble b) { return { a.v * b.v }; }
+inline vdouble operator/(vdouble a, vdouble b) { return { a.v / b.v }; }
+
+inline vdouble min(vdouble a, vdouble b) { return { a.v < b.v ? a.v : b.v }; }
+inline vdouble max(vdouble a, vdouble b) { return { a.v > b.v ? a.v : b.v }; }
+inline vdouble sqrt(vdouble a) { return { std::sqrt(a.v) }; }
+inline vdouble abs(vdouble a) { return { std::fabs(a.v) }; }
+
+inline vdouble fma(vdouble a, vdouble b, vdouble c) { return { a.v * b.v + c.v }; }
+
+// Маски сравнения: в скалярном варианте маска - это 1.0 или 0.0
+inline vdouble eq(vdouble a, vdouble b) { return { a.v == b.v ? 1.0 : 0.0 }; }
+inline vdouble lt(vdouble a, vdouble b) { return { a.v < b.v ? 1.0 : 0.0 }; }
+inline vdouble gt(vdouble a, vdouble b) { return { a.v > b.v ? 1.0 : 0.0 }; }
+inline vdouble maskOr(vdouble a, vdouble b) { return { (a.v != 0.0 || b.v != 0.0) ? 1.0 : 0.0 }; }
+inline vdouble select(vdouble mask, vdouble a, vdouble b) { return mask.v != 0.0 ? a : b; }
+inline vdouble negate(vdouble a) { return { -a.v }; }
+inline bool any(vdouble mask) { return mask.v != 0.0; }
+inline bool all(vdouble mask) { return mask.v != 0.0; }
+
+#endif
+
+// Округление до ближайшего целого для |a| < 2^51 прибавлением "магической"
+// константы 1.5 * 2^52: дробная часть вытесняется за пределы мантиссы
+inline vdouble roundNearest(vdouble a) {
+    const vdouble magic = set1(6755399441055744.0);
+    return (a + magic) - magic;
+}
+
+inline vdouble floor(vdouble a) {
+    vdouble r = roundNearest(a);
+    return r - select(gt(r, a), set1(1.0), set1(0.0));
+}
+
+} // namespace simd
+
+#endif // SIMD_H
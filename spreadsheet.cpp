@@ -0,0 +1,807 @@
+#include "spreadsheet.h"
+#include "csvformat.h"
+#include "grammar.h"
+#include "threadpool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <limits>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+namespace {
+
+// Уровень меньше этого числа формул вычисляется в вызывающем потоке:
+// раздача задач пулу дороже самого вычисления
+const size_t PARALLEL_MIN_CELLS = 1024;
+const size_t PARALLEL_CHUNK = 256;
+// Добавленные рёбра сливаются с отсортированными, когда их становится
+// больше четверти (но не меньше этого числа)
+const size_t MIN_EDGE_REBUILD = 4096;
+
+const char REFERENCE_BEGIN = '\x01';
+const char REFERENCE_END = '\x02';
+
+// Разбор текста формулы "=...": ссылки на ячейки заменяются в key их
+// сдвигами от (row, column). Числа и имена пропускаются целиком, как
+// в калькуляторе, поэтому "x1" и "2A1" не дают ссылок, а имя перед "("
+// - функция. Различные ссылки - в names и offsets в порядке появления,
+// spans - положение первого появления каждой
+struct FormulaReferences {
+    std::string key;
+    std::vector<std::pair<int, int>> offsets;
+    std::vector<std::string> names;
+    std::vector<std::pair<size_t, size_t>> spans;
+};
+
+void scanFormula(const std::string& text, int row, int column, FormulaReferences& result) {
+
+    result.key.assign(1, '=');
+    size_t i = 1;
+    while (i < text.size()) {
+        char c = text[i];
+        if (grammar::isNumberChar(c)) {
+            size_t j = i;
+            while (j < text.size() && grammar::isNumberChar(text[j])) j++;
+            result.key.append(text, i, j - i);
+            i = j;
+            continue;
+        }
+        if (!grammar::isLetter(c)) {
+            result.key += c;
+            i++;
+            continue;
+        }
+        size_t j = i + 1;
+        while (j < text.size() && grammar::isIdentifierChar(text[j])) j++;
+        std::string name = text.substr(i, j - i);
+        size_t next = j;
+        while (next < text.size() && grammar::isSpace(text[next])) next++;
+        int refRow = 0, refColumn = 0;
+        if ((next == text.size() || text[next] != '(') && Spreadsheet::parseCellName(name, refRow, refColumn)) {
+            std::pair<int, int> offset(refRow - row, refColumn - column);
+            if (std::find(result.offsets.begin(), result.offsets.end(), offset) == result.offsets.end()) {
+                result.offsets.push_back(offset);
+                result.names.push_back(name);
+                result.spans.push_back(std::make_pair(i, j - i));
+            }
+            result.key += REFERENCE_BEGIN;
+            result.key += std::to_string(offset.first);
+            result.key += ',';
+            result.key += std::to_string(offset.second);
+            result.key += REFERENCE_END;
+        } else {
+            result.key += name;
+        }
+        i = j;
+    }
+}
+
+} // namespace
+
+Spreadsheet::Spreadsheet(const ExpressionCalculator& calculator)
+    : calculator(calculator), shapes(1) {
+}
+
+Spreadsheet::~Spreadsheet() = default;
+
+const Spreadsheet::Block* Spreadsheet::findBlock(uint64_t key) const {
+
+    auto it = blocks.find(blockKey(key));
+    return it == blocks.end() ? nullptr : it->second.get();
+}
+
+const Spreadsheet::Block* Spreadsheet::findBlock(uint64_t key, BlockCache& cache) const {
+
+    uint64_t k = blockKey(key);
+    if (k != cache.key) {
+        auto it = blocks.find(k);
+        cache.key = k;
+        cache.block = it == blocks.end() ? nullptr : it->second.get();
+    }
+    return cache.block;
+}
+
+Spreadsheet::Block* Spreadsheet::findBlock(uint64_t key) {
+
+    auto it = blocks.find(blockKey(key));
+    return it == blocks.end() ? nullptr : it->second.get();
+}
+
+Spreadsheet::Block& Spreadsheet::block(uint64_t key) {
+
+    std::unique_ptr<Block>& slot = blocks[blockKey(key)];
+    if (!slot) {
+        slot.reset(new Block());
+    }
+    return *slot;
+}
+
+std::string Spreadsheet::columnName(int column) {
+
+    std::string name;
+    for (int c = column + 1; c > 0; c = (c - 1) / 26) {
+        name.insert(name.begin(), static_cast<char>('A' + (c - 1) % 26));
+    }
+    return name;
+}
+
+std::string Spreadsheet::cellName(int row, int column) {
+    return columnName(column) + std::to_string(row + 1);
+}
+
+bool Spreadsheet::parseCellName(const std::string& name, int& row, int& column) {
+
+    size_t i = 0;
+    int c = 0;
+    while (i < name.size() && i < 4 && name[i] >= 'A' && name[i] <= 'Z') {
+        c = c * 26 + (name[i++] - 'A' + 1);
+    }
+    if (i == 0 || i > 3 || i == name.size() || name[i] == '0') {
+        return false;
+    }
+    size_t digits = name.size() - i;
+    if (digits > 7) {
+        return false;
+    }
+    int r = 0;
+    for (; i < name.size(); i++) {
+        if (!grammar::isDigit(name[i])) {
+            return false;
+        }
+        r = r * 10 + (name[i] - '0');
+    }
+    if (r > MAX_ROWS || c > MAX_COLUMNS) {
+        return false;
+    }
+    row = r - 1;
+    column = c - 1;
+    return true;
+}
+
+void Spreadsheet::touch(int row, int column) {
+
+    changed.push_back(cellKey(row, column));
+    rows = std::max(rows, row + 1);
+    columns = std::max(columns, column + 1);
+}
+
+void Spreadsheet::resetCell(Block& b, int index, uint64_t key) {
+
+    if (b.kind[index] == FORMULA) {
+        releaseShape(b.shape[index]);
+        formulas--;
+    } else if (b.kind[index] == TEXT) {
+        texts.erase(key);
+    }
+    b.kind[index] = EMPTY;
+    b.value[index] = 0.0;
+    b.shape[index] = 0;
+    b.status[index] = OK;
+}
+
+void Spreadsheet::setCell(int row, int column, const std::string& text) {
+
+    if (row < 0 || row >= MAX_ROWS || column < 0 || column >= MAX_COLUMNS) {
+        return;
+    }
+    double number = 0.0;
+    if (text.empty()) {
+        uint64_t key = cellKey(row, column);
+        if (Block* b = findBlock(key)) {
+            resetCell(*b, blockIndex(key), key);
+        }
+        touch(row, column);
+    } else if (text[0] == '=') {
+        setFormula(row, column, text);
+    } else if (csv::parseNumber(text.data(), text.data() + text.size(), '.', number)) {
+        setNumber(row, column, number);
+    } else {
+        setText(row, column, text);
+    }
+}
+
+void Spreadsheet::setNumber(int row, int column, double number) {
+
+    uint64_t key = cellKey(row, column);
+    Block& b = block(key);
+    int index = blockIndex(key);
+    resetCell(b, index, key);
+    b.kind[index] = NUMBER;
+    b.value[index] = number;
+    touch(row, column);
+}
+
+void Spreadsheet::setText(int row, int column, const std::string& text) {
+
+    uint64_t key = cellKey(row, column);
+    Block& b = block(key);
+    int index = blockIndex(key);
+    resetCell(b, index, key);
+    b.kind[index] = TEXT;
+    b.value[index] = std::numeric_limits<double>::quiet_NaN();
+    texts[key] = text;
+    touch(row, column);
+}
+
+void Spreadsheet::setFormula(int row, int column, const std::string& text) {
+
+    FormulaReferences references;
+    scanFormula(text, row, column, references);
+
+    uint64_t key = cellKey(row, column);
+    Block& b = block(key);
+    int index = blockIndex(key);
+    // Вид берётся до освобождения старого: при записи той же формулы
+    // программа не компилируется заново
+    uint32_t shape = acquireShape(references.key, text, references.offsets, references.names);
+    resetCell(b, index, key);
+    b.kind[index] = FORMULA;
+    b.shape[index] = shape;
+    b.value[index] = std::numeric_limits<double>::quiet_NaN();
+    formulas++;
+    for (const std::pair<int, int>& offset : references.offsets) {
+        addedEdges.push_back(Edge{cellKey(row + offset.first, column + offset.second), key});
+    }
+    touch(row, column);
+}
+
+uint32_t Spreadsheet::acquireShape(const std::string& key, const std::string& source,
+                                   const std::vector<std::pair<int, int>>& offsets,
+                                   const std::vector<std::string>& names) {
+
+    auto it = shapeIndex.find(key);
+    if (it != shapeIndex.end()) {
+        shapes[it->second].cells++;
+        return it->second;
+    }
+    uint32_t id;
+    if (!freeShapes.empty()) {
+        id = freeShapes.back();
+        freeShapes.pop_back();
+    } else {
+        id = static_cast<uint32_t>(shapes.size());
+        shapes.emplace_back();
+    }
+    Shape& shape = shapes[id];
+    shape.key = key;
+    shape.offsets = offsets;
+    shape.source = source;
+    shape.names = names;
+    CalculationError error;
+    shape.compiled = calculator.tryCompile(source.substr(1), names, shape.program, error);
+    shape.cells = 1;
+    shapeIndex[key] = id;
+    return id;
+}
+
+void Spreadsheet::releaseShape(uint32_t id) {
+
+    Shape& shape = shapes[id];
+    if (--shape.cells == 0) {
+        shapeIndex.erase(shape.key);
+        shape = Shape();
+        freeShapes.push_back(id);
+    }
+}
+
+void Spreadsheet::clear() {
+
+    blocks.clear();
+    texts.clear();
+    shapes.assign(1, Shape());
+    freeShapes.clear();
+    shapeIndex.clear();
+    edges.clear();
+    addedEdges.clear();
+    changed.clear();
+    rows = 0;
+    columns = 0;
+    formulas = 0;
+}
+
+Spreadsheet::CellKind Spreadsheet::kind(int row, int column) const {
+
+    uint64_t key = cellKey(row, column);
+    const Block* b = findBlock(key);
+    return b ? static_cast<CellKind>(b->kind[blockIndex(key)]) : EMPTY;
+}
+
+double Spreadsheet::value(int row, int column) const {
+
+    uint64_t key = cellKey(row, column);
+    const Block* b = findBlock(key);
+    return b ? b->value[blockIndex(key)] : 0.0;
+}
+
+std::string Spreadsheet::text(int row, int column) const {
+
+    uint64_t key = cellKey(row, column);
+    const Block* b = findBlock(key);
+    if (!b) {
+        return std::string();
+    }
+    int index = blockIndex(key);
+    switch (b->kind[index]) {
+    case NUMBER:
+        return csv::formatNumber(b->value[index]);
+    case TEXT:
+        return texts.at(key);
+    case FORMULA:
+        break;
+    default:
+        return std::string();
+    }
+
+    // Сдвиги в виде формулы заменяются именами ячеек
+    const std::string& shape = shapes[b->shape[index]].key;
+    std::string text;
+    text.reserve(shape.size());
+    for (size_t i = 0; i < shape.size(); i++) {
+        if (shape[i] != REFERENCE_BEGIN) {
+            text += shape[i];
+            continue;
+        }
+        char* end = nullptr;
+        long dr = std::strtol(shape.c_str() + i + 1, &end, 10);
+        long dc = std::strtol(end + 1, &end, 10);
+        text += cellName(row + static_cast<int>(dr), column + static_cast<int>(dc));
+        i = static_cast<size_t>(end - shape.c_str());
+    }
+    return text;
+}
+
+// Значения ссылок формулы key; при ссылке на текст или на формулу
+// с ошибкой возвращается false и номер этой ссылки
+bool Spreadsheet::referenceValues(uint64_t key, const Shape& shape, std::vector<double>& values,
+                                  size_t& bad, BlockCache& cache) const {
+
+    int row = keyRow(key);
+    int column = keyColumn(key);
+    values.resize(shape.offsets.size());
+    for (size_t k = 0; k < shape.offsets.size(); k++) {
+        uint64_t ref = cellKey(row + shape.offsets[k].first, column + shape.offsets[k].second);
+        const Block* cached = findBlock(ref, cache);
+        values[k] = 0.0;
+        if (!cached) {
+            continue;
+        }
+        int index = blockIndex(ref);
+        uint8_t refKind = cached->kind[index];
+        if (refKind == TEXT || (refKind == FORMULA && cached->status[index] != OK)) {
+            bad = k;
+            return false;
+        }
+        values[k] = cached->value[index];
+    }
+    return true;
+}
+
+void Spreadsheet::evaluateCell(uint64_t key, std::vector<double>& values, BlockCache& cache) {
+
+    // Запись - только в ячейку key, блоки не добавляются и не удаляются
+    Block* b = const_cast<Block*>(findBlock(key, cache));
+    int index = blockIndex(key);
+    const Shape& shape = shapes[b->shape[index]];
+    b->value[index] = std::numeric_limits<double>::quiet_NaN();
+    if (!shape.compiled) {
+        b->status[index] = EVALUATION_ERROR;
+        return;
+    }
+    size_t bad = 0;
+    if (!referenceValues(key, shape, values, bad, cache)) {
+        b->status[index] = BAD_REFERENCE;
+        return;
+    }
+    double result = 0.0;
+    CalculationError error;
+    if (calculator.tryEvaluate(shape.program, values, result, error)) {
+        b->value[index] = result;
+        b->status[index] = OK;
+    } else {
+        b->status[index] = EVALUATION_ERROR;
+    }
+}
+
+bool Spreadsheet::hasError(int row, int column) const {
+
+    uint64_t key = cellKey(row, column);
+    const Block* b = findBlock(key);
+    int index = blockIndex(key);
+    return b && b->kind[index] == FORMULA && b->status[index] != OK;
+}
+
+CalculationError Spreadsheet::error(int row, int column) const {
+
+    CalculationError error;
+    uint64_t key = cellKey(row, column);
+    const Block* b = findBlock(key);
+    int index = blockIndex(key);
+    if (!b || b->kind[index] != FORMULA || b->status[index] == OK) {
+        return error;
+    }
+
+    // Позиции ошибки относятся к тексту этой ячейки, а программа вида
+    // скомпилирована из текста первой ячейки, поэтому формула
+    // компилируется и вычисляется заново
+    std::string source = text(row, column);
+    FormulaReferences references;
+    scanFormula(source, row, column, references);
+    const Shape& shape = shapes[b->shape[index]];
+    uint8_t status = b->status[index];
+
+    if (status == CYCLE) {
+        error.code = CalculationError::CIRCULAR_REFERENCE;
+        error.offset = 0;
+        error.length = source.size();
+        for (size_t k = 0; k < shape.offsets.size(); k++) {
+            uint64_t ref = cellKey(row + shape.offsets[k].first, column + shape.offsets[k].second);
+            const Block* r = findBlock(ref);
+            if (r && r->kind[blockIndex(ref)] == FORMULA && r->status[blockIndex(ref)] == CYCLE) {
+                error.offset = references.spans[k].first;
+                error.length = references.spans[k].second;
+                break;
+            }
+        }
+        return error;
+    }
+
+    std::vector<double> values;
+    size_t bad = 0;
+    BlockCache cache;
+    if (!referenceValues(key, shape, values, bad, cache)) {
+        error.code = CalculationError::INVALID_REFERENCE;
+        error.offset = references.spans[bad].first;
+        error.length = references.spans[bad].second;
+        return error;
+    }
+
+    CompiledExpression program;
+    double result = 0.0;
+    if (calculator.tryCompile(source.substr(1), references.names, program, error)
+            && calculator.tryEvaluate(program, values, result, error)) {
+        error.code = CalculationError::INVALID_EXPRESSION;
+        error.offset = 0;
+        error.length = source.size();
+        return error;
+    }
+    error.offset++;
+    return error;
+}
+
+bool Spreadsheet::references(uint64_t formula, uint64_t target) const {
+
+    const Block* b = findBlock(formula);
+    int index = blockIndex(formula);
+    if (!b || b->kind[index] != FORMULA) {
+        return false;
+    }
+    std::pair<int, int> offset(keyRow(target) - keyRow(formula), keyColumn(target) - keyColumn(formula));
+    const std::vector<std::pair<int, int>>& offsets = shapes[b->shape[index]].offsets;
+    return std::find(offsets.begin(), offsets.end(), offset) != offsets.end();
+}
+
+template <typename F>
+void Spreadsheet::forEachDependent(uint64_t target, F f) const {
+
+    auto range = edgeBlocks.find(blockKey(target));
+    if (range != edgeBlocks.end()) {
+        int index = blockIndex(target);
+        for (size_t i = range->second[index]; i < range->second[index + 1]; i++) {
+            f(edges[i].formula);
+        }
+    }
+    auto it = std::lower_bound(addedEdges.begin(), addedEdges.end(), Edge{target, 0});
+    for (; it != addedEdges.end() && it->target == target; ++it) {
+        f(it->formula);
+    }
+}
+
+void Spreadsheet::rebuildEdges() {
+
+    edges.insert(edges.end(), addedEdges.begin(), addedEdges.end());
+    addedEdges.clear();
+    edges.erase(std::remove_if(edges.begin(), edges.end(), [this](const Edge& edge) {
+        return !references(edge.formula, edge.target);
+    }), edges.end());
+    std::sort(edges.begin(), edges.end());
+    edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+
+    edgeBlocks.clear();
+    for (size_t i = 0; i < edges.size();) {
+        uint64_t block = blockKey(edges[i].target);
+        std::vector<size_t>& start = edgeBlocks[block];
+        start.assign(BLOCK_CELLS + 1, i);
+        for (; i < edges.size() && blockKey(edges[i].target) == block; i++) {
+            start[blockIndex(edges[i].target) + 1] = i + 1;
+        }
+        // У ячейки без рёбер пустой диапазон с концом предыдущей
+        for (int index = 1; index <= BLOCK_CELLS; index++) {
+            start[index] = std::max(start[index], start[index - 1]);
+        }
+    }
+}
+
+Spreadsheet::RecalculationStats Spreadsheet::recalculate(unsigned int threads) {
+
+    // Изменена большая часть таблицы (загрузка, вставка): пересчитать всё
+    // дешевле, чем искать зависимые формулы
+    if (changed.size() >= std::max(MIN_EDGE_REBUILD, formulas / 2)) {
+        return recalculateAll(threads);
+    }
+    if (addedEdges.size() > std::max(MIN_EDGE_REBUILD, edges.size() / 4)) {
+        rebuildEdges();
+    } else {
+        std::sort(addedEdges.begin(), addedEdges.end());
+        addedEdges.erase(std::unique(addedEdges.begin(), addedEdges.end()), addedEdges.end());
+    }
+
+    // Изменённые формулы и все формулы, зависящие от изменённых ячеек
+    // (обход в ширину); mark - номер формулы в order + 1
+    std::vector<uint64_t> order;
+    BlockCache cache;
+    auto visit = [this, &order, &cache](uint64_t key) {
+        Block* b = const_cast<Block*>(findBlock(key, cache));
+        int index = blockIndex(key);
+        if (b && b->kind[index] == FORMULA && b->mark[index] == 0) {
+            order.push_back(key);
+            b->mark[index] = static_cast<uint32_t>(order.size());
+        }
+    };
+    for (uint64_t key : changed) {
+        visit(key);
+        forEachDependent(key, visit);
+    }
+    changed.clear();
+    for (size_t i = 0; i < order.size(); i++) {
+        forEachDependent(order[i], visit);
+    }
+    return recalculateMarked(order, threads);
+}
+
+Spreadsheet::RecalculationStats Spreadsheet::recalculateAll(unsigned int threads) {
+
+    changed.clear();
+    std::vector<uint64_t> order;
+    order.reserve(formulas);
+    for (auto& entry : blocks) {
+        Block& b = *entry.second;
+        uint64_t top = (entry.first >> 32) << BLOCK_BITS;
+        uint64_t left = (entry.first & 0xffffffffu) << BLOCK_BITS;
+        for (int index = 0; index < BLOCK_CELLS; index++) {
+            if (b.kind[index] == FORMULA) {
+                order.push_back((top + (index >> BLOCK_BITS)) << 32 | (left + (index & (BLOCK_SIZE - 1))));
+                b.mark[index] = static_cast<uint32_t>(order.size());
+            }
+        }
+    }
+    return recalculateMarked(order, threads);
+}
+
+Spreadsheet::RecalculationStats Spreadsheet::recompileAll(unsigned int threads) {
+
+    for (Shape& shape : shapes) {
+        if (shape.cells > 0) {
+            CalculationError error;
+            shape.program = CompiledExpression();
+            shape.compiled = calculator.tryCompile(shape.source.substr(1), shape.names, shape.program, error);
+        }
+    }
+    return recalculateAll(threads);
+}
+
+Spreadsheet::RecalculationStats Spreadsheet::recalculateMarked(std::vector<uint64_t>& order,
+                                                               unsigned int threads) {
+
+    RecalculationStats stats;
+    size_t n = order.size();
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    // Рёбра между пересчитываемыми формулами в локальных номерах:
+    // pending[i] - число ещё не вычисленных ссылок формулы i (их номера
+    // подряд в parents), children[first[i]..first[i + 1]) - формулы,
+    // ссылающиеся на i. Повторная ссылка на ячейку в формуле не повторяет
+    // ребро, потому что ссылки вида различны
+    std::vector<uint32_t> pending(n, 0);
+    std::vector<uint32_t> parents;
+    std::vector<uint32_t> first(n + 1, 0);
+    BlockCache cellCache, refCache;
+    for (size_t i = 0; i < n; i++) {
+        uint64_t key = order[i];
+        const Block* b = findBlock(key, cellCache);
+        const Shape& shape = shapes[b->shape[blockIndex(key)]];
+        for (const std::pair<int, int>& offset : shape.offsets) {
+            uint64_t ref = cellKey(keyRow(key) + offset.first, keyColumn(key) + offset.second);
+            const Block* r = findBlock(ref, refCache);
+            uint32_t mark = r ? r->mark[blockIndex(ref)] : 0;
+            if (mark != 0) {
+                parents.push_back(mark - 1);
+                pending[i]++;
+                first[mark]++;
+            }
+        }
+    }
+    for (size_t i = 0; i < n; i++) {
+        first[i + 1] += first[i];
+    }
+    std::vector<uint32_t> children(parents.size());
+    std::vector<uint32_t> fill(first.begin(), first.end() - 1);
+    for (size_t i = 0, p = 0; i < n; i++) {
+        for (uint32_t k = 0; k < pending[i]; k++) {
+            children[fill[parents[p++]]++] = static_cast<uint32_t>(i);
+        }
+    }
+
+    // Уровни Кана: формулы уровня ссылаются только на предыдущие уровни
+    std::vector<uint32_t> sequence;
+    sequence.reserve(n);
+    for (size_t i = 0; i < n; i++) {
+        if (pending[i] == 0) sequence.push_back(static_cast<uint32_t>(i));
+    }
+    std::vector<size_t> levels(1, 0);
+    while (levels.back() < sequence.size()) {
+        size_t begin = levels.back();
+        size_t end = sequence.size();
+        for (size_t j = begin; j < end; j++) {
+            uint32_t i = sequence[j];
+            for (uint32_t c = first[i]; c < first[i + 1]; c++) {
+                if (--pending[children[c]] == 0) sequence.push_back(children[c]);
+            }
+        }
+        levels.push_back(end);
+    }
+
+    for (size_t level = 0; level + 1 < levels.size(); level++) {
+        size_t begin = levels[level];
+        parallelFor(levels[level + 1] - begin, threads,
+                    [this, &order, &sequence, begin](size_t from, size_t to, std::vector<double>& values) {
+            BlockCache cache;
+            for (size_t j = from; j < to; j++) {
+                evaluateCell(order[sequence[begin + j]], values, cache);
+            }
+        });
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        Block* b = findBlock(order[i]);
+        int index = blockIndex(order[i]);
+        b->mark[index] = 0;
+        if (pending[i] != 0) {
+            b->status[index] = CYCLE;
+            b->value[index] = std::numeric_limits<double>::quiet_NaN();
+            stats.cycles++;
+        }
+    }
+    stats.formulas = n;
+    stats.levels = levels.size() - 1;
+    return stats;
+}
+
+template <typename F>
+void Spreadsheet::parallelFor(size_t count, unsigned int threads, F f) {
+
+    if (threads <= 1 || count < PARALLEL_MIN_CELLS) {
+        std::vector<double> values;
+        f(0, count, values);
+        return;
+    }
+    if (!pool || pool->size() != threads - 1) {
+        pool.reset(new ThreadPool(threads - 1));
+    }
+
+    // Куски раздаются по атомарному счётчику; вызывающий поток тоже считает
+    std::atomic<size_t> next(0);
+    auto work = [&next, count, &f]() {
+        std::vector<double> values;
+        for (;;) {
+            size_t from = next.fetch_add(PARALLEL_CHUNK);
+            if (from >= count) break;
+            f(from, std::min(count, from + PARALLEL_CHUNK), values);
+        }
+    };
+    size_t helpers = std::min<size_t>(threads - 1, (count - 1) / PARALLEL_CHUNK);
+    std::mutex mutex;
+    std::condition_variable done;
+    size_t finished = 0;
+    for (size_t h = 0; h < helpers; h++) {
+        pool->submit([&]() {
+            work();
+            std::lock_guard<std::mutex> lock(mutex);
+            finished++;
+            done.notify_one();
+        });
+    }
+    work();
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [&]() { return finished == helpers; });
+}
+
+size_t Spreadsheet::importCsvText(const std::string& text, int row, int column) {
+
+    char delimiter = csv::detectDelimiter(text.data(), text.data() + text.size());
+    char decimal = csv::decimalFor(delimiter);
+
+    size_t cells = 0;
+    int r = row;
+    int c = column;
+    std::string field;
+    bool fieldQuoted = false;
+    auto store = [&]() {
+        if (r < MAX_ROWS && c < MAX_COLUMNS && (!field.empty() || fieldQuoted)) {
+            double number = 0.0;
+            if (!fieldQuoted && (csv::parseNumber(field.data(), field.data() + field.size(), '.', number)
+                                 || csv::parseNumber(field.data(), field.data() + field.size(), decimal, number))) {
+                setNumber(r, c, number);
+            } else if (!field.empty()) {
+                setText(r, c, field);
+            }
+            cells++;
+        }
+        field.clear();
+        fieldQuoted = false;
+    };
+
+    size_t i = 0;
+    while (i < text.size()) {
+        char ch = text[i];
+        if (ch == '"' && field.empty() && !fieldQuoted) {
+            // Поле в кавычках: "" внутри - одна кавычка, переводы строк сохраняются
+            fieldQuoted = true;
+            for (i++; i < text.size(); i++) {
+                if (text[i] == '"') {
+                    if (i + 1 < text.size() && text[i + 1] == '"') {
+                        field += '"';
+                        i++;
+                    } else {
+                        i++;
+                        break;
+                    }
+                } else {
+                    field += text[i];
+                }
+            }
+            continue;
+        }
+        if (ch == delimiter) {
+            store();
+            c++;
+        } else if (ch == '\n' || ch == '\r') {
+            store();
+            if (ch == '\r' && i + 1 < text.size() && text[i + 1] == '\n') i++;
+            r++;
+            c = column;
+        } else {
+            field += ch;
+        }
+        i++;
+    }
+    if (!field.empty() || fieldQuoted) {
+        store();
+    }
+    return cells;
+}
+
+bool Spreadsheet::importCsv(const std::string& path, int row, int column, std::string& error) {
+
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        error = "Cannot open file: " + path;
+        return false;
+    }
+    std::ostringstream contents;
+    contents << file.rdbuf();
+    if (file.bad()) {
+        error = "Cannot read file: " + path;
+        return false;
+    }
+    importCsvText(contents.str(), row, column);
+    return true;
+}
@@ -0,0 +1,220 @@
+#ifndef SPREADSHEET_H
+#define SPREADSHEET_H
+
+#include "expressioncalculator.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class ThreadPool;
+
+// Таблица ячеек с формулами (без Qt). Ячейка - пусто, число, текст
+// или формула "=A1*2 + sin(B3)", ссылки - заглавные буквы столбца и номер
+// строки. Формулы компилируются калькулятором; формулы, которые отличаются
+// только сдвигом ссылок (протянутые вниз или вправо), имеют общий "вид"
+// и компилируются один раз.
+//
+// Ячейки хранятся блоками 64 x 64, поэтому таблица в миллион ячеек
+// занимает около 20 байт на ячейку. Пересчёт затрагивает только формулы,
+// зависящие от изменённых ячеек: они упорядочиваются по уровням
+// (алгоритм Кана), ячейки одного уровня друг от друга не зависят и
+// вычисляются параллельно. Формулы, оставшиеся вне уровней, входят в цикл
+// или зависят от него и получают ошибку CIRCULAR_REFERENCE.
+//
+// Запись и пересчёт - из одного потока; чтение - между пересчётами
+class Spreadsheet
+{
+public:
+    enum CellKind {
+        EMPTY,
+        NUMBER,
+        TEXT,
+        FORMULA
+    };
+
+    static const int MAX_ROWS = 1048576;
+    static const int MAX_COLUMNS = 16384;
+
+    struct RecalculationStats {
+        size_t formulas = 0;    // пересчитано формул
+        size_t levels = 0;      // уровней зависимостей
+        size_t cycles = 0;      // формул в циклах и зависящих от них
+    };
+
+    explicit Spreadsheet(const ExpressionCalculator&);
+    ~Spreadsheet();
+
+    Spreadsheet(const Spreadsheet&) = delete;
+    Spreadsheet& operator=(const Spreadsheet&) = delete;
+
+    // Содержимое ячейки: "=..." - формула, конечное число - число,
+    // пустая строка очищает ячейку, остальное - текст. Значения
+    // формул обновляет следующий recalculate
+    void setCell(int row, int column, const std::string& text);
+    void clear();
+
+    // Пересчёт формул, зависящих от изменённых после прошлого пересчёта
+    // ячеек; threads = 0 - по числу процессоров
+    RecalculationStats recalculate(unsigned int threads = 0);
+    RecalculationStats recalculateAll(unsigned int threads = 0);
+    // Повторная компиляция всех видов формул и полный пересчёт: программы
+    // зависят от режима углов калькулятора, вызывать после его смены
+    RecalculationStats recompileAll(unsigned int threads = 0);
+
+    CellKind kind(int row, int column) const;
+    // Значение числа или формулы; NaN для формулы с ошибкой, 0 для пустой
+    double value(int row, int column) const;
+    // Текст ячейки в том виде, в каком его можно ввести заново
+    std::string text(int row, int column) const;
+    // Формула с ошибкой (без её разбора, для отображения)
+    bool hasError(int row, int column) const;
+    // Ошибка формулы; смещение - в строке text(row, column), с "="
+    CalculationError error(int row, int column) const;
+
+    // Загрузка CSV с левым верхним углом в (row, column): разделитель
+    // (',', ';' или табуляция) определяется по первой строке, поля
+    // в кавычках - по RFC 4180. Поля становятся числами или текстом,
+    // формулы не распознаются. Десятичная запятая допускается, если
+    // разделитель не запятая
+    bool importCsv(const std::string& path, int row, int column, std::string& error);
+    size_t importCsvText(const std::string& text, int row, int column);
+
+    // Границы занятой области (строки и столбцы с номерами меньше)
+    int usedRows() const { return rows; }
+    int usedColumns() const { return columns; }
+    size_t formulaCount() const { return formulas; }
+
+    // "A", ..., "Z", "AA", ... и "B12"; номера с нуля
+    static std::string columnName(int column);
+    static std::string cellName(int row, int column);
+    static bool parseCellName(const std::string&, int& row, int& column);
+
+private:
+    static const int BLOCK_BITS = 6;
+    static const int BLOCK_SIZE = 1 << BLOCK_BITS;
+    static const int BLOCK_CELLS = BLOCK_SIZE * BLOCK_SIZE;
+
+    enum Status : uint8_t {
+        OK,
+        EVALUATION_ERROR,   // ошибка компиляции или вычисления
+        BAD_REFERENCE,      // ссылка на текст или ячейку с ошибкой
+        CYCLE
+    };
+
+    struct Block {
+        double value[BLOCK_CELLS];
+        uint32_t shape[BLOCK_CELLS];    // вид формулы, 0 - не формула
+        uint32_t mark[BLOCK_CELLS];     // номер в текущем пересчёте + 1
+        uint8_t kind[BLOCK_CELLS];
+        uint8_t status[BLOCK_CELLS];
+    };
+
+    // Формула с точностью до сдвига ссылок. Программа скомпилирована
+    // из текста первой ячейки этого вида; переменные - различные ссылки
+    // в порядке появления, offsets - их сдвиги от ячейки
+    struct Shape {
+        std::string key;        // текст с "=", ссылки заменены сдвигами
+        std::vector<std::pair<int, int>> offsets;
+        std::string source;     // текст первой ячейки и имена её ссылок
+        std::vector<std::string> names;
+        CompiledExpression program;
+        bool compiled = false;
+        size_t cells = 0;
+    };
+
+    // Ссылка target -> formula для поиска зависимых ячеек. Рёбра
+    // упорядочены по блоку target, затем по ячейке в блоке, так что
+    // рёбра одного блока лежат подряд
+    struct Edge {
+        uint64_t target;
+        uint64_t formula;
+        bool operator<(const Edge& other) const {
+            uint64_t a = edgeOrder(target);
+            uint64_t b = edgeOrder(other.target);
+            return a < b || (a == b && formula < other.formula);
+        }
+        bool operator==(const Edge& other) const {
+            return target == other.target && formula == other.formula;
+        }
+    };
+
+    static uint64_t cellKey(int row, int column) {
+        return static_cast<uint64_t>(row) << 32 | static_cast<uint32_t>(column);
+    }
+    static int keyRow(uint64_t key) { return static_cast<int>(key >> 32); }
+    static int keyColumn(uint64_t key) { return static_cast<int>(key & 0xffffffffu); }
+    static uint64_t blockKey(uint64_t key) {
+        return (key >> (32 + BLOCK_BITS)) << 32 | (key & 0xffffffffu) >> BLOCK_BITS;
+    }
+    static int blockIndex(uint64_t key) {
+        return static_cast<int>(((key >> 32) & (BLOCK_SIZE - 1)) << BLOCK_BITS | (key & (BLOCK_SIZE - 1)));
+    }
+    static uint64_t edgeOrder(uint64_t key) {
+        return blockKey(key) << (2 * BLOCK_BITS) | static_cast<uint64_t>(blockIndex(key));
+    }
+
+    // Последний найденный блок: соседние ячейки обычно в одном блоке
+    struct BlockCache {
+        uint64_t key = ~static_cast<uint64_t>(0);
+        const Block* block = nullptr;
+    };
+
+    const Block* findBlock(uint64_t key) const;
+    const Block* findBlock(uint64_t key, BlockCache&) const;
+    Block* findBlock(uint64_t key);
+    Block& block(uint64_t key);
+
+    // Сброс ячейки в пустую с освобождением вида формулы
+    void resetCell(Block&, int index, uint64_t key);
+    void setNumber(int row, int column, double);
+    void setText(int row, int column, const std::string&);
+    void setFormula(int row, int column, const std::string&);
+    void touch(int row, int column);
+    uint32_t acquireShape(const std::string& key, const std::string& source,
+                          const std::vector<std::pair<int, int>>& offsets,
+                          const std::vector<std::string>& names);
+    void releaseShape(uint32_t);
+
+    // Ссылается ли формула formula на ячейку target: рёбра устаревают
+    // при замене формулы и отбрасываются при перестройке
+    bool references(uint64_t formula, uint64_t target) const;
+    // Формулы, зависящие от target, по отсортированным и добавленным
+    // рёбрам. Устаревшие рёбра до перестройки дают лишний пересчёт
+    // формулы, но не ошибку
+    template <typename F>
+    void forEachDependent(uint64_t target, F f) const;
+    void rebuildEdges();
+
+    RecalculationStats recalculateMarked(std::vector<uint64_t>& order, unsigned int threads);
+    bool referenceValues(uint64_t key, const Shape&, std::vector<double>& values, size_t& bad,
+                         BlockCache&) const;
+    void evaluateCell(uint64_t key, std::vector<double>& values, BlockCache&);
+    template <typename F>
+    void parallelFor(size_t count, unsigned int threads, F f);
+
+    const ExpressionCalculator& calculator;
+
+    std::unordered_map<uint64_t, std::unique_ptr<Block>> blocks;
+    std::unordered_map<uint64_t, std::string> texts;
+
+    std::vector<Shape> shapes;                      // 0 не используется
+    std::vector<uint32_t> freeShapes;
+    std::unordered_map<std::string, uint32_t> shapeIndex;
+
+    std::vector<Edge> edges;        // по возрастанию
+    // Блок -> начала рёбер его ячеек в edges (BLOCK_CELLS + 1 чисел)
+    std::unordered_map<uint64_t, std::vector<size_t>> edgeBlocks;
+    std::vector<Edge> addedEdges;   // после последней перестройки
+
+    std::vector<uint64_t> changed;  // ячейки, изменённые после пересчёта
+    int rows = 0;
+    int columns = 0;
+    size_t formulas = 0;
+
+    std::unique_ptr<ThreadPool> pool;
+};
+
+#endif // SPREADSHEET_H
@@ -0,0 +1,108 @@
+#include "spreadsheetmodel.h"
+
+#include <QElapsedTimer>
+
+SpreadsheetModel::SpreadsheetModel(const ExpressionCalculator& calculator, QObject* parent)
+    : QAbstractTableModel(parent), spreadsheet(calculator) {
+}
+
+int SpreadsheetModel::rowCount(const QModelIndex& parent) const {
+    return parent.isValid() ? 0 : Spreadsheet::MAX_ROWS;
+}
+
+int SpreadsheetModel::columnCount(const QModelIndex& parent) const {
+    return parent.isValid() ? 0 : Spreadsheet::MAX_COLUMNS;
+}
+
+QVariant SpreadsheetModel::data(const QModelIndex& index, int role) const {
+
+    if (!index.isValid()) {
+        return QVariant();
+    }
+    int row = index.row();
+    int column = index.column();
+    Spreadsheet::CellKind kind = spreadsheet.kind(row, column);
+
+    switch (role) {
+    case Qt::DisplayRole:
+        if (kind == Spreadsheet::TEXT) {
+            return QString::fromStdString(spreadsheet.text(row, column));
+        }
+        if (kind == Spreadsheet::EMPTY) {
+            return QVariant();
+        }
+        if (spreadsheet.hasError(row, column)) {
+            return QStringLiteral("#ОШИБКА");
+        }
+        return QString::number(spreadsheet.value(row, column), 'g', 12);
+    case Qt::EditRole:
+        return QString::fromStdString(spreadsheet.text(row, column));
+    case Qt::ToolTipRole:
+        if (spreadsheet.hasError(row, column)) {
+            std::string text = spreadsheet.text(row, column);
+            return QString::fromStdString(spreadsheet.error(row, column).message(text));
+        }
+        return QVariant();
+    case Qt::TextAlignmentRole:
+        if (kind == Spreadsheet::NUMBER || kind == Spreadsheet::FORMULA) {
+            return int(Qt::AlignRight | Qt::AlignVCenter);
+        }
+        return int(Qt::AlignLeft | Qt::AlignVCenter);
+    default:
+        return QVariant();
+    }
+}
+
+bool SpreadsheetModel::setData(const QModelIndex& index, const QVariant& value, int role) {
+
+    if (!index.isValid() || role != Qt::EditRole) {
+        return false;
+    }
+    spreadsheet.setCell(index.row(), index.column(), value.toString().toStdString());
+    recalculate();
+    return true;
+}
+
+QVariant SpreadsheetModel::headerData(int section, Qt::Orientation orientation, int role) const {
+
+    if (role != Qt::DisplayRole) {
+        return QVariant();
+    }
+    if (orientation == Qt::Horizontal) {
+        return QString::fromStdString(Spreadsheet::columnName(section));
+    }
+    return section + 1;
+}
+
+Qt::ItemFlags SpreadsheetModel::flags(const QModelIndex& index) const {
+    return QAbstractTableModel::flags(index) | Qt::ItemIsEditable;
+}
+
+bool SpreadsheetModel::importCsv(const QString& path, int row, int column, QString& error) {
+
+    std::string message;
+    if (!spreadsheet.importCsv(path.toStdString(), row, column, message)) {
+        error = QString::fromStdString(message);
+        return false;
+    }
+    recalculate();
+    return true;
+}
+
+void SpreadsheetModel::angleModeChanged() {
+    recalculate(true);
+}
+
+// Какие ячейки изменились, пересчёт не сообщает: обновляется вся занятая
+// область, а представление перерисовывает только видимые ячейки
+void SpreadsheetModel::recalculate(bool recompile) {
+
+    QElapsedTimer timer;
+    timer.start();
+    Spreadsheet::RecalculationStats stats = recompile ? spreadsheet.recompileAll() : spreadsheet.recalculate();
+    double milliseconds = timer.nsecsElapsed() / 1e6;
+    if (spreadsheet.usedRows() > 0 && spreadsheet.usedColumns() > 0) {
+        emit dataChanged(index(0, 0), index(spreadsheet.usedRows() - 1, spreadsheet.usedColumns() - 1));
+    }
+    emit recalculated(stats, milliseconds);
+}
@@ -0,0 +1,40 @@
+#ifndef SPREADSHEETMODEL_H
+#define SPREADSHEETMODEL_H
+
+#include "spreadsheet.h"
+
+#include <QAbstractTableModel>
+
+// Модель вкладки таблицы: все MAX_ROWS x MAX_COLUMNS ячеек, представление
+// запрашивает только видимые. Редактирование ячейки сразу пересчитывает
+// зависящие от неё формулы
+class SpreadsheetModel : public QAbstractTableModel
+{
+    Q_OBJECT
+
+public:
+    explicit SpreadsheetModel(const ExpressionCalculator&, QObject* parent = nullptr);
+
+    int rowCount(const QModelIndex& parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex& parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex&, int role = Qt::DisplayRole) const override;
+    bool setData(const QModelIndex&, const QVariant&, int role = Qt::EditRole) override;
+    QVariant headerData(int section, Qt::Orientation, int role = Qt::DisplayRole) const override;
+    Qt::ItemFlags flags(const QModelIndex&) const override;
+
+    // CSV с левым верхним углом в (row, column)
+    bool importCsv(const QString& path, int row, int column, QString& error);
+    const Spreadsheet& sheet() const { return spreadsheet; }
+    // Перекомпиляция и пересчёт всех формул после смены режима углов
+    void angleModeChanged();
+
+signals:
+    void recalculated(const Spreadsheet::RecalculationStats&, double milliseconds);
+
+private:
+    void recalculate(bool recompile = false);
+
+    Spreadsheet spreadsheet;
+};
+
+#endif // SPREADSHEETMODEL_H
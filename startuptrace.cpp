@@ -0,0 +1,90 @@
+#include "startuptrace.h"
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QEvent>
+#include <QTimer>
+#include <QWidget>
+
+#include <cstdio>
+
+namespace {
+
+QElapsedTimer& startupClock() {
+    static QElapsedTimer timer;
+    return timer;
+}
+
+bool traceEnabled = false;
+double startupBudget = 0.0;
+
+double elapsedMs() {
+    return startupClock().nsecsElapsed() / 1e6;
+}
+
+// Ловит первую отрисовку окна и снимает себя
+class FirstFrameFilter : public QObject
+{
+public:
+    explicit FirstFrameFilter(QObject* parent) : QObject(parent) {}
+
+    bool eventFilter(QObject* watched, QEvent* event) override {
+
+        if (event->type() != QEvent::Paint) {
+            return false;
+        }
+        watched->removeEventFilter(this);
+        // Отложенные вызовы выполняются после того, как кадр дорисован
+        // и выведен, а следующий - после событий, накопившихся за это время
+        QTimer::singleShot(0, [this]() {
+            StartupTrace::mark("first frame");
+            QTimer::singleShot(0, [this]() {
+                StartupTrace::mark("interactive");
+                finish();
+                deleteLater();
+            });
+        });
+        return false;
+    }
+
+private:
+    void finish() {
+
+        if (startupBudget <= 0.0) {
+            return;
+        }
+        double total = elapsedMs();
+        bool exceeded = total > startupBudget;
+        std::fprintf(stderr, "startup: budget %.1f ms %s\n", startupBudget, exceeded ? "exceeded" : "met");
+        QCoreApplication::exit(exceeded ? 1 : 0);
+    }
+};
+
+} // namespace
+
+void StartupTrace::start() {
+    startupClock().start();
+}
+
+void StartupTrace::enable(double budgetMs) {
+    traceEnabled = true;
+    startupBudget = budgetMs;
+}
+
+bool StartupTrace::enabled() {
+    return traceEnabled;
+}
+
+void StartupTrace::mark(const char *phase) {
+
+    if (traceEnabled) {
+        std::fprintf(stderr, "startup: %s %.1f ms\n", phase, elapsedMs());
+    }
+}
+
+void StartupTrace::watch(QWidget *window) {
+
+    if (traceEnabled) {
+        window->installEventFilter(new FirstFrameFilter(window));
+    }
+}
@@ -0,0 +1,28 @@
+#ifndef STARTUPTRACE_H
+#define STARTUPTRACE_H
+
+class QWidget;
+
+// Трассировка запуска: время от начала main до этапов конструирования окна,
+// первого кадра и готовности к вводу. Включается флагом --startup-trace,
+// без него mark() ничего не делает. С --startup-budget MS приложение
+// закрывается после выхода на готовность с кодом 1, если бюджет превышен.
+//
+// Строки печатаются в stderr:
+//     startup: main window 41.2 ms
+class StartupTrace
+{
+public:
+    // Отсчёт времени; вызывается первой строкой main
+    static void start();
+    static void enable(double budgetMs = 0.0);
+    static bool enabled();
+
+    static void mark(const char* phase);
+
+    // Первый кадр - первая отрисовка окна, готовность - момент, когда
+    // после него очередь событий обработана и окно принимает ввод
+    static void watch(QWidget* window);
+};
+
+#endif // STARTUPTRACE_H
@@ -0,0 +1,499 @@
+#ifndef STATICEXPRESSION_H
+#define STATICEXPRESSION_H
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+#include "calculationerror.h"
+#include "grammar.h"
+#include "trigcore.h"
+
+// Разбор выражения во время компиляции для формул, встроенных в код на C++:
+//
+//     auto area = CALC_EXPRESSION("pi*r^2/4", r);
+//     double a = area(2.0);
+//
+// Строка разбирается constexpr-вариантом того же алгоритма, что
+// и ExpressionCalculator::toRPN (лексика и приоритеты - из grammar.h),
+// ОПН превращается в тип-дерево, и компилятор встраивает вычисление
+// целиком - как написанное вручную выражение. Синтаксические ошибки -
+// ошибки компиляции. Функции те же, что у калькулятора в радианах (trigcore
+// для тригонометрии), деление на ноль даёт inf/nan, как evaluateBatch.
+// Матрицы, sum/prod/integral и мнимая единица не поддерживаются, число
+// должно переводиться в double точно (до 19 значащих цифр, мантисса до 2^53
+// при дробной части). Нужен C++14.
+
+#if __cplusplus < 201402L && !(defined(_MSVC_LANG) && _MSVC_LANG >= 201402L)
+#error "staticexpression.h requires C++14"
+#else
+
+namespace compiletime {
+
+// Возможности калькулятора, которых нет у разбора во время компиляции
+enum Limitation {
+    NO_LIMITATION,
+    MATRIX,         // [1,2;3,4], det, inv, matmul, solve, transpose
+    REDUCTION,      // sum, prod, integral
+    IMAGINARY,      // i
+    LONG_NUMBER     // число нельзя точно перевести в double без strtod
+};
+
+// Токен ОПН
+struct Token {
+    enum Kind {
+        NUMBER,
+        VARIABLE,
+        OPERATOR,
+        FUNCTION,
+        UNKNOWN_NAME,   // имя перед скобкой, которого нет среди функций
+        BAD_NUMBER,     // цифры и точки, не образующие числа: 1.5.2
+        OPEN
+    };
+
+    enum { NOT_VARIABLE = -1, IMAGINARY_UNIT = -2 };
+
+    Kind kind = NUMBER;
+    char op = 0;
+    int index = 0;          // VARIABLE - номер переменной, FUNCTION - grammar::Function,
+                            // UNKNOWN_NAME - номер переменной или NOT_VARIABLE, IMAGINARY_UNIT
+    double value = 0.0;
+    size_t offset = 0;      // в исходной строке
+};
+
+template <size_t N>
+struct Program {
+    Token tokens[N] = {};
+    int count = 0;
+    int variableCount = 0;
+    CalculationError::Code error = CalculationError::NONE;
+    Limitation limitation = NO_LIMITATION;
+    size_t errorOffset = 0;
+
+    constexpr bool ok() const { return error == CalculationError::NONE && limitation == NO_LIMITATION; }
+
+    constexpr void fail(CalculationError::Code code, size_t offset) {
+        if (ok()) {
+            error = code;
+            errorOffset = offset;
+        }
+    }
+
+    constexpr void unsupported(Limitation what, size_t offset) {
+        if (ok()) {
+            limitation = what;
+            errorOffset = offset;
+        }
+    }
+
+    constexpr void emit(const Token& token) {
+        tokens[count++] = token;
+    }
+};
+
+constexpr size_t textLength(const char* text) {
+
+    size_t length = 0;
+    while (text[length] != '\0') length++;
+    return length;
+}
+
+constexpr bool sameText(const char* a, size_t aLength, const char* b, size_t bLength) {
+
+    if (aLength != bLength) return false;
+    for (size_t i = 0; i < aLength; i++) {
+        if (a[i] != b[i]) return false;
+    }
+    return true;
+}
+
+// Номер имени в списке переменных "x, y, z" или -1; count - число переменных
+constexpr int findVariable(const char* variables, const char* name, size_t length, int* count = nullptr) {
+
+    int found = -1;
+    int index = 0;
+    size_t i = 0;
+    while (true) {
+        while (grammar::isSpace(variables[i]) || variables[i] == ',') i++;
+        if (variables[i] == '\0') break;
+        size_t begin = i;
+        while (variables[i] != '\0' && variables[i] != ',' && !grammar::isSpace(variables[i])) i++;
+        if (found < 0 && sameText(variables + begin, i - begin, name, length)) found = index;
+        index++;
+    }
+    if (count) *count = index;
+    return found;
+}
+
+// Число из цифр и точки: принимается то же, что isNumber калькулятора
+// (одна точка, хотя бы одна цифра). Перевод в double точен, пока мантисса
+// и степень десяти представимы точно: одно деление округляется верно
+constexpr bool parseNumber(const char* text, size_t length, double& value, bool& exact) {
+
+    int dots = 0, digits = 0, significant = 0, fraction = 0;
+    uint64_t mantissa = 0;
+    for (size_t i = 0; i < length; i++) {
+        if (text[i] == '.') {
+            dots++;
+            continue;
+        }
+        digits++;
+        if (dots) fraction++;
+        if (mantissa == 0 && text[i] == '0') continue;
+        if (++significant <= 19) mantissa = mantissa * 10 + static_cast<uint64_t>(text[i] - '0');
+    }
+    if (dots > 1 || digits == 0) return false;
+
+    // Целое из uint64_t округляется верно; дробное - одно верно
+    // округлённое деление точного числа на точную степень десяти
+    exact = significant <= 19 && (fraction == 0 || (mantissa <= (uint64_t(1) << 53) && fraction <= 22));
+    double scale = 1.0;
+    for (int i = 0; i < fraction; i++) scale *= 10.0;
+    value = static_cast<double>(mantissa) / scale;
+    return true;
+}
+
+constexpr bool isMatrixFunction(const char* text, size_t length) {
+    return sameText(text, length, "det", 3) || sameText(text, length, "inv", 3)
+            || sameText(text, length, "matmul", 6) || sameText(text, length, "solve", 5)
+            || sameText(text, length, "transpose", 9);
+}
+
+// Перевод в ОПН: шаг за шагом как ExpressionCalculator::toRPN,
+// затем проверки стека как при построении дерева (buildTree)
+template <size_t N>
+constexpr Program<N> compile(const char* source, const char* variables) {
+
+    Program<N> program;
+    findVariable(variables, "", 0, &program.variableCount);
+
+    // Пробелы удаляются, позиции в исходной строке сохраняются
+    char text[N] = {};
+    size_t positions[N] = {};
+    size_t length = 0;
+    for (size_t i = 0; source[i] != '\0'; i++) {
+        if (!grammar::isSpace(source[i])) {
+            positions[length] = i;
+            text[length++] = source[i];
+        }
+    }
+
+    // Баланс круглых и квадратных скобок
+    char open[N] = {};
+    size_t openAt[N] = {};
+    size_t depth = 0;
+    for (size_t i = 0; i < length && program.ok(); i++) {
+        if (text[i] == '(' || text[i] == '[') {
+            open[depth] = text[i];
+            openAt[depth++] = i;
+        } else if (text[i] == ')' || text[i] == ']') {
+            if (depth == 0 || open[depth - 1] != (text[i] == ')' ? '(' : '[')) {
+                program.fail(CalculationError::UNBALANCED_PARENTHESES, positions[i]);
+            } else {
+                depth--;
+            }
+        }
+    }
+    if (program.ok() && depth > 0) {
+        program.fail(CalculationError::UNBALANCED_PARENTHESES, positions[openAt[depth - 1]]);
+    }
+
+    Token operators[N] = {};
+    int top = 0;
+
+    for (size_t i = 0; i < length && program.ok(); i++) {
+        char c = text[i];
+        Token token;
+        token.offset = positions[i];
+
+        if (grammar::isNumberChar(c)) {
+            size_t begin = i;
+            while (i + 1 < length && grammar::isNumberChar(text[i + 1])) i++;
+            bool exact = true;
+            if (!parseNumber(text + begin, i + 1 - begin, token.value, exact)) {
+                // Как у калькулятора: проверяется при построении дерева
+                token.kind = Token::BAD_NUMBER;
+            } else if (!exact) {
+                program.unsupported(LONG_NUMBER, positions[begin]);
+            }
+            program.emit(token);
+        } else if (grammar::isLetter(c)) {
+            size_t begin = i;
+            while (i + 1 < length && grammar::isIdentifierChar(text[i + 1])) i++;
+            const char* name = text + begin;
+            size_t nameLength = i + 1 - begin;
+            bool call = i + 1 < length && text[i + 1] == '(';
+            int variable = findVariable(variables, name, nameLength);
+            if (call && grammar::isReduction(name, nameLength)) {
+                program.unsupported(REDUCTION, token.offset);
+            } else if (call && isMatrixFunction(name, nameLength)) {
+                program.unsupported(MATRIX, token.offset);
+            } else if (call) {
+                // Имя, которого нет среди функций, остаётся на стеке операторов
+                // и попадает в ОПН как операнд: x(2) - это два операнда подряд
+                int function = grammar::findFunction(name, nameLength);
+                if (function >= 0) {
+                    token.kind = Token::FUNCTION;
+                    token.index = grammar::FUNCTION_NAMES[function].function;
+                } else {
+                    token.kind = Token::UNKNOWN_NAME;
+                    token.index = variable >= 0 ? variable
+                                : sameText(name, nameLength, "i", 1) ? Token::IMAGINARY_UNIT : Token::NOT_VARIABLE;
+                }
+                operators[top++] = token;
+            } else if (variable >= 0) {
+                token.kind = Token::VARIABLE;
+                token.index = variable;
+                program.emit(token);
+            } else if (sameText(name, nameLength, "pi", 2)) {
+                token.value = grammar::PI;
+                program.emit(token);
+            } else if (sameText(name, nameLength, "e", 1)) {
+                token.value = grammar::E;
+                program.emit(token);
+            } else if (sameText(name, nameLength, "i", 1)) {
+                program.unsupported(IMAGINARY, token.offset);
+            } else {
+                program.fail(CalculationError::UNKNOWN_IDENTIFIER, token.offset);
+            }
+        } else if (c == '(') {
+            token.kind = Token::OPEN;
+            operators[top++] = token;
+        } else if (c == '[' || c == ']') {
+            // ';' и ',' внутри [] не встречаются: разбор останавливается на '['
+            program.unsupported(MATRIX, token.offset);
+        } else if (c == ')') {
+            while (top > 0 && operators[top - 1].kind != Token::OPEN) program.emit(operators[--top]);
+            if (top > 0) {
+                top--;
+                if (top > 0 && operators[top - 1].kind == Token::FUNCTION) program.emit(operators[--top]);
+            }
+        } else if (grammar::isOperator(c)) {
+            if (c == '-' && (i == 0 || grammar::opensOperand(text[i - 1]))) {
+                Token zero;
+                zero.offset = token.offset;
+                program.emit(zero);
+            }
+            while (top > 0 && operators[top - 1].kind == Token::OPERATOR
+                   && grammar::precedence(operators[top - 1].op) >= grammar::precedence(c)) {
+                program.emit(operators[--top]);
+            }
+            token.kind = Token::OPERATOR;
+            token.op = c;
+            operators[top++] = token;
+        } else if (c == ',') {
+            while (top > 0 && operators[top - 1].kind != Token::OPEN) program.emit(operators[--top]);
+        } else {
+            program.fail(CalculationError::UNEXPECTED_CHARACTER, token.offset);
+        }
+    }
+    while (top > 0 && program.ok()) program.emit(operators[--top]);
+
+    // Операндов хватает каждому оператору и функции, в конце ровно одно значение
+    int stack = 0;
+    for (int k = 0; k < program.count && program.ok(); k++) {
+        Token& token = program.tokens[k];
+        switch (token.kind) {
+        case Token::OPERATOR:
+            if (stack < 2) program.fail(CalculationError::INVALID_EXPRESSION, token.offset);
+            stack--;
+            break;
+        case Token::FUNCTION:
+            if (stack < 1) program.fail(CalculationError::INVALID_FUNCTION_ARGUMENT, token.offset);
+            break;
+        case Token::UNKNOWN_NAME:
+            if (token.index >= 0) {
+                token.kind = Token::VARIABLE;
+                stack++;
+            } else if (token.index == Token::IMAGINARY_UNIT) {
+                program.unsupported(IMAGINARY, token.offset);
+            } else {
+                program.fail(CalculationError::UNKNOWN_FUNCTION, token.offset);
+            }
+            break;
+        case Token::BAD_NUMBER:
+            program.fail(CalculationError::INVALID_EXPRESSION, token.offset);
+            break;
+        case Token::OPEN:
+            program.fail(CalculationError::UNKNOWN_FUNCTION, token.offset);
+            break;
+        default:
+            stack++;
+            break;
+        }
+    }
+    if (program.ok() && stack != 1) {
+        program.fail(CalculationError::INVALID_EXPRESSION, 0);
+    }
+    return program;
+}
+
+// Число токенов поддерева ОПН с корнем в позиции root
+template <size_t N>
+constexpr int subtreeSize(const Program<N>& program, int root) {
+
+    int needed = 1;
+    int i = root;
+    while (needed > 0) {
+        const Token& token = program.tokens[i--];
+        needed += token.kind == Token::OPERATOR ? 1 : token.kind == Token::FUNCTION ? 0 : -1;
+    }
+    return root - i;
+}
+
+// Программа для текста Text (структура со статическими source() и variables())
+template <class Text>
+struct Compiled {
+    static constexpr size_t CAPACITY = 2 * textLength(Text::source()) + 2;
+    static constexpr Program<CAPACITY> program = compile<CAPACITY>(Text::source(), Text::variables());
+};
+
+template <class Text>
+constexpr Program<Compiled<Text>::CAPACITY> Compiled<Text>::program;
+
+template <grammar::Function F> struct Builtin;
+
+#define COMPILETIME_BUILTIN(function, expression) \
+    template <> struct Builtin<grammar::function> { \
+        static inline double apply(double x) { return expression; } \
+    }
+
+COMPILETIME_BUILTIN(FUNCTION_ABS, std::abs(x));
+COMPILETIME_BUILTIN(FUNCTION_ACOS, std::acos(x));
+COMPILETIME_BUILTIN(FUNCTION_ASIN, std::asin(x));
+COMPILETIME_BUILTIN(FUNCTION_ATAN, std::atan(x));
+COMPILETIME_BUILTIN(FUNCTION_COS, trigCos(x));
+COMPILETIME_BUILTIN(FUNCTION_COSH, std::cosh(x));
+COMPILETIME_BUILTIN(FUNCTION_COT, trigCot(x));
+COMPILETIME_BUILTIN(FUNCTION_CSC, trigCsc(x));
+COMPILETIME_BUILTIN(FUNCTION_EXP, std::exp(x));
+COMPILETIME_BUILTIN(FUNCTION_LN, std::log(x));
+COMPILETIME_BUILTIN(FUNCTION_LOG, std::log10(x));
+COMPILETIME_BUILTIN(FUNCTION_SEC, trigSec(x));
+COMPILETIME_BUILTIN(FUNCTION_SIN, trigSin(x));
+COMPILETIME_BUILTIN(FUNCTION_SINH, std::sinh(x));
+COMPILETIME_BUILTIN(FUNCTION_SQRT, std::sqrt(x));
+COMPILETIME_BUILTIN(FUNCTION_TAN, trigTan(x));
+COMPILETIME_BUILTIN(FUNCTION_TANH, std::tanh(x));
+
+#undef COMPILETIME_BUILTIN
+
+template <char Op> struct Operation;
+template <> struct Operation<'+'> { static inline double apply(double a, double b) { return a + b; } };
+template <> struct Operation<'-'> { static inline double apply(double a, double b) { return a - b; } };
+template <> struct Operation<'*'> { static inline double apply(double a, double b) { return a * b; } };
+template <> struct Operation<'/'> { static inline double apply(double a, double b) { return a / b; } };
+template <> struct Operation<'^'> { static inline double apply(double a, double b) { return std::pow(a, b); } };
+
+// Узел дерева - токен ОПН номер I; вид узла выбирается специализацией
+template <class Text, int I, Token::Kind Kind = Compiled<Text>::program.tokens[I].kind>
+struct Node;
+
+template <class Text, int I>
+struct Node<Text, I, Token::NUMBER> {
+    static constexpr double VALUE = Compiled<Text>::program.tokens[I].value;
+    static inline double evaluate(const double*) { return VALUE; }
+};
+
+template <class Text, int I>
+struct Node<Text, I, Token::VARIABLE> {
+    static constexpr int INDEX = Compiled<Text>::program.tokens[I].index;
+    static inline double evaluate(const double* values) { return values[INDEX]; }
+};
+
+template <class Text, int I>
+struct Node<Text, I, Token::OPERATOR> {
+    static constexpr char OP = Compiled<Text>::program.tokens[I].op;
+    typedef Node<Text, I - 1> Right;
+    typedef Node<Text, I - 1 - subtreeSize(Compiled<Text>::program, I - 1)> Left;
+    static inline double evaluate(const double* values) {
+        return Operation<OP>::apply(Left::evaluate(values), Right::evaluate(values));
+    }
+};
+
+template <class Text, int I>
+struct Node<Text, I, Token::FUNCTION> {
+    static constexpr grammar::Function FUNCTION =
+            static_cast<grammar::Function>(Compiled<Text>::program.tokens[I].index);
+    typedef Node<Text, I - 1> Argument;
+    static inline double evaluate(const double* values) {
+        return Builtin<FUNCTION>::apply(Argument::evaluate(values));
+    }
+};
+
+// Вместо дерева ошибочного выражения, чтобы не порождать лишних сообщений
+struct InvalidNode {
+    static inline double evaluate(const double*) { return 0.0; }
+};
+
+template <class Text, bool Ok> struct RootNode { typedef InvalidNode type; };
+template <class Text> struct RootNode<Text, true> { typedef Node<Text, Compiled<Text>::program.count - 1> type; };
+
+// Смещение ошибки видно в сообщении компилятора как аргумент шаблона
+template <long Offset> struct ErrorAtOffset;
+template <> struct ErrorAtOffset<-1> {};
+
+template <class Text>
+class StaticExpression
+{
+    typedef Compiled<Text> Source;
+
+    static_assert(Source::program.error != CalculationError::UNBALANCED_PARENTHESES,
+                  "CALC_EXPRESSION: unbalanced parentheses");
+    static_assert(Source::program.error != CalculationError::UNEXPECTED_CHARACTER,
+                  "CALC_EXPRESSION: unexpected character");
+    static_assert(Source::program.error != CalculationError::UNKNOWN_IDENTIFIER,
+                  "CALC_EXPRESSION: unknown identifier (not a variable, pi or e)");
+    static_assert(Source::program.error != CalculationError::UNKNOWN_FUNCTION,
+                  "CALC_EXPRESSION: unknown function");
+    static_assert(Source::program.error != CalculationError::INVALID_EXPRESSION,
+                  "CALC_EXPRESSION: invalid expression (missing or extra operand, malformed number)");
+    static_assert(Source::program.error != CalculationError::INVALID_FUNCTION_ARGUMENT,
+                  "CALC_EXPRESSION: function without argument");
+    static_assert(Source::program.limitation != MATRIX,
+                  "CALC_EXPRESSION: matrices are not supported at compile time");
+    static_assert(Source::program.limitation != REDUCTION,
+                  "CALC_EXPRESSION: sum, prod and integral are not supported at compile time");
+    static_assert(Source::program.limitation != IMAGINARY,
+                  "CALC_EXPRESSION: complex numbers are not supported at compile time");
+    static_assert(Source::program.limitation != LONG_NUMBER,
+                  "CALC_EXPRESSION: number cannot be converted to double exactly at compile time");
+    static_assert(sizeof(ErrorAtOffset<Source::program.ok() ? -1 : static_cast<long>(Source::program.errorOffset)>) > 0,
+                  "CALC_EXPRESSION: error position");
+
+    typedef typename RootNode<Text, Source::program.ok()>::type Root;
+
+public:
+    static constexpr int VARIABLE_COUNT = Source::program.variableCount;
+
+    static constexpr const char* source() { return Text::source(); }
+
+    // Значения переменных в порядке их перечисления в CALC_EXPRESSION
+    template <typename... Values>
+    inline double operator()(Values... values) const {
+        static_assert(sizeof...(Values) == VARIABLE_COUNT, "CALC_EXPRESSION: wrong number of variable values");
+        const double array[sizeof...(Values) + 1] = { static_cast<double>(values)..., 0.0 };
+        return Root::evaluate(array);
+    }
+
+    inline double evaluate(const double* values) const {
+        return Root::evaluate(values);
+    }
+};
+
+} // namespace compiletime
+
+// CALC_EXPRESSION("строка", имена переменных...) - объект-функция, вычисляющая
+// выражение; строка разбирается при компиляции
+#define CALC_EXPRESSION(text, ...) \
+    ([]() { \
+        struct CalcExpressionText { \
+            static constexpr const char* source() { return text; } \
+            static constexpr const char* variables() { return "" #__VA_ARGS__; } \
+        }; \
+        return compiletime::StaticExpression<CalcExpressionText>(); \
+    }())
+
+#endif // C++14
+
+#endif // STATICEXPRESSION_H
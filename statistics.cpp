@@ -0,0 +1,473 @@
+#include "statistics.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iterator>
+#include <limits>
+
+namespace {
+
+const double PI = 3.14159265358979323846;
+
+// Буфер центроидов других набросков - столько размеров сжатия
+const double BUFFER_FACTOR = 5.0;
+// Буфер одиночных значений: поразрядная сортировка окупается на больших буферах
+const size_t VALUE_BUFFER = 8192;
+
+// Правая граница доли веса для центроида, начинающегося с доли q:
+// k(q) = compression / 2pi * asin(2q - 1) вырастает на 1
+double centroidLimit(double q, double compression) {
+
+    double angle = std::asin(std::min(1.0, std::max(-1.0, 2.0 * q - 1.0))) + 2.0 * PI / compression;
+    return angle >= PI / 2 ? 1.0 : (std::sin(angle) + 1.0) / 2.0;
+}
+
+// Сортировка значений буфера поразрядно (LSD, 6 проходов по 11 бит)
+// по ключам, упорядоченным как double: у отрицательных инвертируются
+// все биты, у остальных - знаковый. Гистограммы всех разрядов
+// собираются за один проход; разряд, одинаковый у всех ключей, пропускается
+void radixSort(std::vector<double>& values, std::vector<uint64_t>& keys, std::vector<uint64_t>& scratch) {
+
+    const int BITS = 11;
+    const int PASSES = 6;
+    const size_t BUCKETS = size_t(1) << BITS;
+    size_t n = values.size();
+    if (n < 2) {
+        return;
+    }
+    keys.resize(n);
+    scratch.resize(n);
+    std::vector<uint32_t> counts(PASSES * BUCKETS, 0);
+    for (size_t i = 0; i < n; i++) {
+        uint64_t bits;
+        std::memcpy(&bits, &values[i], sizeof(bits));
+        uint64_t key = bits >> 63 ? ~bits : bits | (uint64_t(1) << 63);
+        keys[i] = key;
+        for (int pass = 0; pass < PASSES; pass++) {
+            counts[pass * BUCKETS + ((key >> (pass * BITS)) & (BUCKETS - 1))]++;
+        }
+    }
+    for (int pass = 0; pass < PASSES; pass++) {
+        uint32_t* count = &counts[pass * BUCKETS];
+        if (count[(keys[0] >> (pass * BITS)) & (BUCKETS - 1)] == n) {
+            continue;
+        }
+        uint32_t offset = 0;
+        for (size_t bucket = 0; bucket < BUCKETS; bucket++) {
+            uint32_t size = count[bucket];
+            count[bucket] = offset;
+            offset += size;
+        }
+        for (size_t i = 0; i < n; i++) {
+            scratch[count[(keys[i] >> (pass * BITS)) & (BUCKETS - 1)]++] = keys[i];
+        }
+        keys.swap(scratch);
+    }
+    for (size_t i = 0; i < n; i++) {
+        uint64_t key = keys[i];
+        uint64_t bits = key >> 63 ? key & ~(uint64_t(1) << 63) : ~key;
+        std::memcpy(&values[i], &bits, sizeof(bits));
+    }
+}
+
+} // namespace
+
+void RunningMoments::add(double x) {
+
+    if (!std::isfinite(x)) {
+        return;
+    }
+    if (count == 0) {
+        minimum = maximum = x;
+    } else {
+        minimum = std::min(minimum, x);
+        maximum = std::max(maximum, x);
+    }
+    count++;
+    double delta = x - mean;
+    mean += delta / count;
+    m2 += delta * (x - mean);
+}
+
+void RunningMoments::add(const double *x, size_t n) {
+
+    // Первый проход: число конечных значений, сумма, границы.
+    // x - x == 0 только для конечных x, так что цикл без ветвлений
+    RunningMoments batch;
+    double sum = 0.0;
+    double low = std::numeric_limits<double>::infinity();
+    double high = -low;
+    uint64_t finite = 0;
+    for (size_t i = 0; i < n; i++) {
+        bool isFinite = x[i] - x[i] == 0.0;
+        double value = isFinite ? x[i] : 0.0;
+        sum += value;
+        finite += isFinite;
+        low = isFinite ? std::min(low, value) : low;
+        high = isFinite ? std::max(high, value) : high;
+    }
+    if (finite == 0) {
+        return;
+    }
+    if (!std::isfinite(sum)) {
+        // Сумма переполнилась: по одному значению
+        for (size_t i = 0; i < n; i++) {
+            add(x[i]);
+        }
+        return;
+    }
+
+    // Второй проход: отклонения от среднего пакета
+    batch.count = finite;
+    batch.mean = sum / finite;
+    batch.minimum = low;
+    batch.maximum = high;
+    for (size_t i = 0; i < n; i++) {
+        double delta = x[i] - x[i] == 0.0 ? x[i] - batch.mean : 0.0;
+        batch.m2 += delta * delta;
+    }
+    merge(batch);
+}
+
+void RunningMoments::merge(const RunningMoments &other) {
+
+    if (other.count == 0) {
+        return;
+    }
+    if (count == 0) {
+        *this = other;
+        return;
+    }
+    double total = static_cast<double>(count) + static_cast<double>(other.count);
+    double delta = other.mean - mean;
+    mean += delta * (other.count / total);
+    m2 += other.m2 + delta * delta * (count / total) * other.count;
+    count += other.count;
+    minimum = std::min(minimum, other.minimum);
+    maximum = std::max(maximum, other.maximum);
+}
+
+double RunningMoments::variance() const {
+
+    return count > 1 ? m2 / (count - 1) : 0.0;
+}
+
+double RunningMoments::standardDeviation() const {
+
+    return std::sqrt(variance());
+}
+
+void RunningCovariance::add(double x, double y) {
+
+    if (!std::isfinite(x) || !std::isfinite(y)) {
+        return;
+    }
+    count++;
+    double deltaX = x - meanX;
+    double deltaY = y - meanY;
+    meanX += deltaX / count;
+    meanY += deltaY / count;
+    m2X += deltaX * (x - meanX);
+    m2Y += deltaY * (y - meanY);
+    cXY += deltaX * (y - meanY);
+}
+
+void RunningCovariance::add(const double *x, const double *y, size_t n) {
+
+    // Как у RunningMoments: средние пакета, затем отклонения от них
+    RunningCovariance batch;
+    double sumX = 0.0, sumY = 0.0;
+    uint64_t finite = 0;
+    for (size_t i = 0; i < n; i++) {
+        bool isFinite = x[i] - x[i] == 0.0 && y[i] - y[i] == 0.0;
+        sumX += isFinite ? x[i] : 0.0;
+        sumY += isFinite ? y[i] : 0.0;
+        finite += isFinite;
+    }
+    if (finite == 0) {
+        return;
+    }
+    if (!std::isfinite(sumX) || !std::isfinite(sumY)) {
+        for (size_t i = 0; i < n; i++) {
+            add(x[i], y[i]);
+        }
+        return;
+    }
+    batch.count = finite;
+    batch.meanX = sumX / finite;
+    batch.meanY = sumY / finite;
+    for (size_t i = 0; i < n; i++) {
+        bool isFinite = x[i] - x[i] == 0.0 && y[i] - y[i] == 0.0;
+        double deltaX = isFinite ? x[i] - batch.meanX : 0.0;
+        double deltaY = isFinite ? y[i] - batch.meanY : 0.0;
+        batch.m2X += deltaX * deltaX;
+        batch.m2Y += deltaY * deltaY;
+        batch.cXY += deltaX * deltaY;
+    }
+    merge(batch);
+}
+
+void RunningCovariance::merge(const RunningCovariance &other) {
+
+    if (other.count == 0) {
+        return;
+    }
+    if (count == 0) {
+        *this = other;
+        return;
+    }
+    double total = static_cast<double>(count) + static_cast<double>(other.count);
+    double deltaX = other.meanX - meanX;
+    double deltaY = other.meanY - meanY;
+    double weight = (count / total) * other.count;
+    meanX += deltaX * (other.count / total);
+    meanY += deltaY * (other.count / total);
+    m2X += other.m2X + deltaX * deltaX * weight;
+    m2Y += other.m2Y + deltaY * deltaY * weight;
+    cXY += other.cXY + deltaX * deltaY * weight;
+    count += other.count;
+}
+
+double RunningCovariance::covariance() const {
+
+    return count > 1 ? cXY / (count - 1) : 0.0;
+}
+
+double RunningCovariance::correlation() const {
+
+    if (count < 2 || m2X <= 0.0 || m2Y <= 0.0) {
+        return std::numeric_limits<double>::quiet_NaN();
+    }
+    // Округление может дать модуль чуть больше 1
+    return std::max(-1.0, std::min(1.0, cXY / std::sqrt(m2X * m2Y)));
+}
+
+QuantileSketch::QuantileSketch(double compression)
+    : compression(std::max(10.0, compression)) {
+}
+
+void QuantileSketch::add(double x, double weight) {
+
+    if (!std::isfinite(x) || !(weight > 0.0)) {
+        return;
+    }
+    if (totalWeight() == 0.0) {
+        minimum = maximum = x;
+    } else {
+        minimum = std::min(minimum, x);
+        maximum = std::max(maximum, x);
+    }
+    if (weight == 1.0) {
+        values.push_back(x);
+    } else {
+        buffer.push_back({ x, weight });
+    }
+    bufferedWeight += weight;
+    if (values.size() >= VALUE_BUFFER || buffer.size() >= compression * BUFFER_FACTOR) {
+        compress();
+    }
+}
+
+void QuantileSketch::add(const double *x, size_t n) {
+
+    for (size_t i = 0; i < n; i++) {
+        if (!std::isfinite(x[i])) {
+            continue;
+        }
+        if (totalWeight() == 0.0) {
+            minimum = maximum = x[i];
+        } else {
+            minimum = std::min(minimum, x[i]);
+            maximum = std::max(maximum, x[i]);
+        }
+        values.push_back(x[i]);
+        bufferedWeight += 1.0;
+        if (values.size() >= VALUE_BUFFER) {
+            compress();
+        }
+    }
+}
+
+void QuantileSketch::merge(const QuantileSketch &other) {
+
+    if (other.totalWeight() == 0.0) {
+        return;
+    }
+    if (totalWeight() == 0.0) {
+        minimum = other.minimum;
+        maximum = other.maximum;
+    } else {
+        minimum = std::min(minimum, other.minimum);
+        maximum = std::max(maximum, other.maximum);
+    }
+    buffer.insert(buffer.end(), other.centroids.begin(), other.centroids.end());
+    buffer.insert(buffer.end(), other.buffer.begin(), other.buffer.end());
+    values.insert(values.end(), other.values.begin(), other.values.end());
+    bufferedWeight += other.totalWeight();
+    if (values.size() >= VALUE_BUFFER || buffer.size() >= compression * BUFFER_FACTOR) {
+        compress();
+    }
+}
+
+void QuantileSketch::compress() {
+
+    if (values.empty() && buffer.empty()) {
+        return;
+    }
+    // Центроиды с равными mean и weight неразличимы, поэтому порядок
+    // после сортировки не зависит от алгоритма сортировки
+    auto less = [](const Centroid& a, const Centroid& b) {
+        return a.mean < b.mean || (a.mean == b.mean && a.weight < b.weight);
+    };
+    std::vector<uint64_t> keys, scratch;
+    radixSort(values, keys, scratch);
+    std::sort(buffer.begin(), buffer.end(), less);
+    std::vector<Centroid> weighted;
+    weighted.reserve(centroids.size() + buffer.size());
+    std::merge(centroids.begin(), centroids.end(), buffer.begin(), buffer.end(),
+               std::back_inserter(weighted), less);
+
+    // Проход по объединению двух упорядоченных последовательностей:
+    // соседние элементы сливаются, пока центроид не превысит границу
+    double total = mergedWeight + bufferedWeight;
+    centroids.clear();
+    size_t i = 0, j = 0;
+    auto takeNext = [&]() -> Centroid {
+        if (j == values.size() || (i < weighted.size() && weighted[i].mean <= values[j])) {
+            return weighted[i++];
+        }
+        return { values[j++], 1.0 };
+    };
+    // Центроид копит сумму отклонений от первого (наименьшего) элемента,
+    // деление - одно на центроид; среднее не выходит за его элементы
+    Centroid current = takeNext();
+    double base = current.mean;
+    double last = current.mean;
+    double sum = 0.0;
+    double weightBefore = 0.0;
+    double weightLimit = centroidLimit(0.0, compression) * total;
+    auto finish = [&]() {
+        current.mean = std::min(last, std::max(base, base + sum / current.weight));
+        centroids.push_back(current);
+    };
+    while (i < weighted.size() || j < values.size()) {
+        Centroid next = takeNext();
+        if (weightBefore + current.weight + next.weight <= weightLimit) {
+            current.weight += next.weight;
+            sum += (next.mean - base) * next.weight;
+            last = next.mean;
+        } else {
+            finish();
+            weightBefore += current.weight;
+            weightLimit = centroidLimit(weightBefore / total, compression) * total;
+            current = next;
+            base = last = current.mean;
+            sum = 0.0;
+        }
+    }
+    finish();
+
+    values.clear();
+    buffer.clear();
+    mergedWeight = total;
+    bufferedWeight = 0.0;
+}
+
+const std::vector<QuantileSketch::Centroid> &QuantileSketch::merged(QuantileSketch &copy) const {
+
+    if (values.empty() && buffer.empty()) {
+        return centroids;
+    }
+    copy = *this;
+    copy.compress();
+    return copy.centroids;
+}
+
+size_t QuantileSketch::centroidCount() const {
+
+    QuantileSketch copy;
+    return merged(copy).size();
+}
+
+double QuantileSketch::quantile(double q) const {
+
+    double total = totalWeight();
+    if (total == 0.0 || std::isnan(q)) {
+        return std::numeric_limits<double>::quiet_NaN();
+    }
+    QuantileSketch copy;
+    const std::vector<Centroid>& c = merged(copy);
+    size_t n = c.size();
+
+    // Ранг искомого значения; первое и последнее значения известны точно,
+    // между ними и центрами крайних центроидов - линейно
+    double index = std::min(1.0, std::max(0.0, q)) * total;
+    if (index < 1.0) {
+        return minimum;
+    }
+    if (index > total - 1.0) {
+        return maximum;
+    }
+    double value;
+    double firstHalf = c[0].weight / 2.0;
+    double lastHalf = c[n - 1].weight / 2.0;
+    if (index < firstHalf) {
+        value = minimum + (index - 1.0) / (firstHalf - 1.0) * (c[0].mean - minimum);
+    } else if (total - index < lastHalf) {
+        value = maximum - (total - index - 1.0) / (lastHalf - 1.0) * (maximum - c[n - 1].mean);
+    } else {
+        // Между центрами соседних центроидов
+        value = c[n - 1].mean;
+        double weightSoFar = firstHalf;
+        for (size_t i = 0; i + 1 < n; i++) {
+            double step = (c[i].weight + c[i + 1].weight) / 2.0;
+            if (weightSoFar + step > index) {
+                double left = index - weightSoFar;
+                double right = weightSoFar + step - index;
+                value = (c[i].mean * right + c[i + 1].mean * left) / (left + right);
+                break;
+            }
+            weightSoFar += step;
+        }
+    }
+    return std::min(maximum, std::max(minimum, value));
+}
+
+double QuantileSketch::cdf(double x) const {
+
+    double total = totalWeight();
+    if (total == 0.0 || std::isnan(x)) {
+        return std::numeric_limits<double>::quiet_NaN();
+    }
+    if (x < minimum) {
+        return 0.0;
+    }
+    if (x >= maximum) {
+        return 1.0;
+    }
+    QuantileSketch copy;
+    const std::vector<Centroid>& c = merged(copy);
+    size_t n = c.size();
+    if (n == 1) {
+        return (x - minimum) / (maximum - minimum);
+    }
+
+    double firstHalf = c[0].weight / 2.0;
+    double lastHalf = c[n - 1].weight / 2.0;
+    if (x < c[0].mean) {
+        return firstHalf * (x - minimum) / (c[0].mean - minimum) / total;
+    }
+    if (x >= c[n - 1].mean) {
+        return 1.0 - lastHalf * (maximum - x) / (maximum - c[n - 1].mean) / total;
+    }
+    double weightSoFar = firstHalf;
+    for (size_t i = 0; i + 1 < n; i++) {
+        double step = (c[i].weight + c[i + 1].weight) / 2.0;
+        if (x < c[i + 1].mean) {
+            return (weightSoFar + step * (x - c[i].mean) / (c[i + 1].mean - c[i].mean)) / total;
+        }
+        weightSoFar += step;
+    }
+    return 1.0;
+}
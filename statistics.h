@@ -0,0 +1,108 @@
+#ifndef STATISTICS_H
+#define STATISTICS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Однопроходная статистика потока значений с частичными состояниями,
+// которые можно объединять: поток делится на куски, каждый кусок
+// обрабатывается отдельно (в своём потоке), состояния кусков
+// объединяются. При объединении в одном и том же порядке результат
+// не зависит от того, сколько потоков обрабатывало куски.
+//
+// Значения inf и nan пропускаются, их число ведёт вызывающий код.
+
+// Число значений, среднее, сумма квадратов отклонений (Уэлфорд),
+// наименьшее и наибольшее. Объединение - формула Чана, без потери
+// точности на больших выборках со средним, далёким от нуля
+struct RunningMoments
+{
+    uint64_t count = 0;
+    double mean = 0.0;
+    double m2 = 0.0;        // сумма (x - mean)^2
+    double minimum = 0.0;
+    double maximum = 0.0;
+
+    void add(double x);
+    // Пакет значений: среднее и m2 считаются в два прохода по пакету
+    // (векторизуются), затем пакет объединяется с текущим состоянием
+    void add(const double* x, size_t n);
+    void merge(const RunningMoments& other);
+
+    // Выборочная дисперсия (делитель count - 1), 0 для одного значения
+    double variance() const;
+    double standardDeviation() const;
+};
+
+// Совместные моменты пар (x, y) для ковариации и корреляции Пирсона:
+// средние, суммы квадратов отклонений и сумма произведений отклонений
+// обновляются по Уэлфорду, объединение - формула Чана для ковариации.
+// Пара, в которой хотя бы одно значение не конечно, пропускается
+struct RunningCovariance
+{
+    uint64_t count = 0;
+    double meanX = 0.0;
+    double meanY = 0.0;
+    double m2X = 0.0;
+    double m2Y = 0.0;
+    double cXY = 0.0;       // сумма (x - meanX)(y - meanY)
+
+    void add(double x, double y);
+    void add(const double* x, const double* y, size_t n);
+    void merge(const RunningCovariance& other);
+
+    // Выборочная ковариация (делитель count - 1)
+    double covariance() const;
+    // NaN, если пар меньше двух или одна из величин постоянна
+    double correlation() const;
+};
+
+// Приближённые квантили потока (t-digest с объединением, Даннинг):
+// значения собираются в центроиды (среднее и вес), размер которых
+// ограничен функцией масштаба k(q) = compression / 2pi * asin(2q - 1),
+// поэтому на хвостах центроиды мелкие и крайние квантили точнее
+// середины. Состояние занимает O(compression) независимо от числа
+// значений. Точное наименьшее и наибольшее значения хранятся отдельно
+class QuantileSketch
+{
+public:
+    explicit QuantileSketch(double compression = 200.0);
+
+    void add(double x, double weight = 1.0);
+    void add(const double* x, size_t n);
+    void merge(const QuantileSketch& other);
+
+    // Значение, меньше которого доля q всех значений (0 <= q <= 1);
+    // NaN, если значений нет
+    double quantile(double q) const;
+    // Доля значений не больше x
+    double cdf(double x) const;
+
+    double totalWeight() const { return mergedWeight + bufferedWeight; }
+    size_t centroidCount() const;
+
+private:
+    struct Centroid {
+        double mean;
+        double weight;
+    };
+
+    // Слить буфер с центроидами
+    void compress();
+    // Центроиды вместе с буфером (копия сжимается, если буфер не пуст)
+    const std::vector<Centroid>& merged(QuantileSketch& copy) const;
+
+    double compression;
+    std::vector<Centroid> centroids;    // по возрастанию mean
+    // Ещё не слитые значения: одиночные отдельно от центроидов других
+    // набросков, их сортировка дешевле
+    std::vector<double> values;
+    std::vector<Centroid> buffer;
+    double mergedWeight = 0.0;
+    double bufferedWeight = 0.0;
+    double minimum = 0.0;
+    double maximum = 0.0;
+};
+
+#endif // STATISTICS_H
@@ -0,0 +1,494 @@
+#include "tabulatedfunction.h"
+#include "expressioncalculator.h"
+#include "simd.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <thread>
+
+namespace {
+
+const double PI = 3.14159265358979323846;
+
+// Узлы Чебышёва первого рода на кусок (степень до NODES - 1, размер Piece::c).
+// Кусок меньшей степени дешевле вычислять, хотя кусков и больше
+const unsigned int NODES = 8;
+// Контрольные точки куска: равномерно вместе с концами, между каждой парой узлов
+const unsigned int CHECKS = 2 * NODES + 1;
+// Кусок делится не больше MAX_DEPTH раз, кусков не больше MAX_PIECES
+const unsigned int MAX_DEPTH = 24;
+const size_t MAX_PIECES = 1 << 16;
+
+// Сплайн: начальная сетка и наибольшее число интервалов (2 МБ коэффициентов).
+// Сетка не сгущается, если при конечных значениях точность не достигнута
+// не больше чем на 1/FALLBACK_SHARE отрезка: это окрестности особенностей,
+// где сгущение всей сетки почти ничего не даёт, они вычисляются программой
+const size_t FIRST_INTERVALS = 64;
+const size_t MAX_INTERVALS = 1 << 16;
+const size_t FALLBACK_SHARE = 1024;
+
+// Пакеты меньше PARALLEL_COUNT точек вычисляются в одном потоке
+const size_t PARALLEL_COUNT = 1 << 12;
+
+const double NaN = std::numeric_limits<double>::quiet_NaN();
+
+// Сумма c[k] T_k(t) по схеме Кленшоу. Те же операции в том же порядке,
+// что и в векторном варианте TabulatedFunction::evaluate, так что проверенная
+// погрешность - это погрешность того, что потом вычисляется
+inline double clenshaw(const double *c, unsigned int degree, double t) {
+
+    double b1 = 0.0, b2 = 0.0;
+    double twoT = 2.0 * t;
+    for (unsigned int k = degree; k >= 1; k--) {
+        double b0 = twoT * b1 + (c[k] - b2);
+        b2 = b1;
+        b1 = b0;
+    }
+    return t * b1 + (c[0] - b2);
+}
+
+// Кубический многочлен интервала сплайна от t из [0, 1]
+inline double cubic(const double *c, double t) {
+    return ((c[3] * t + c[2]) * t + c[1]) * t + c[0];
+}
+
+// Погрешность в единицах tolerance: абсолютная до 1, дальше относительная
+inline double scaledError(double approximation, double exact) {
+    return std::fabs(approximation - exact) / std::max(1.0, std::fabs(exact));
+}
+
+inline double checkPoint(unsigned int j) {
+    return -1.0 + 2.0 * j / (CHECKS - 1);
+}
+
+inline double node(unsigned int j) {
+    return std::cos(PI * (j + 0.5) / NODES);
+}
+
+// Кусок Чебышёва по значениям в узлах y и в контрольных точках z.
+// Хвост коэффициентов, который заведомо меньше погрешности, отбрасывается;
+// если с усечённой степенью проверка не проходит, берётся полная
+bool fitChebyshev(const double *y, const double *z, double tolerance,
+                  double *c, unsigned int &degree, double &error) {
+
+    double scale = 1.0;
+    for (unsigned int j = 0; j < NODES; j++) {
+        if (!std::isfinite(y[j])) return false;
+        scale = std::max(scale, std::fabs(y[j]));
+    }
+    for (unsigned int j = 0; j < CHECKS; j++) {
+        if (!std::isfinite(z[j])) return false;
+    }
+
+    for (unsigned int k = 0; k < NODES; k++) {
+        double s = 0.0;
+        for (unsigned int j = 0; j < NODES; j++) {
+            s += y[j] * std::cos(PI * k * (j + 0.5) / NODES);
+        }
+        c[k] = (k == 0 ? 1.0 : 2.0) * s / NODES;
+    }
+
+    unsigned int truncated = NODES - 1;
+    double tail = 0.0;
+    while (truncated > 0 && tail + std::fabs(c[truncated]) <= 0.125 * tolerance * scale) {
+        tail += std::fabs(c[truncated]);
+        truncated--;
+    }
+
+    for (unsigned int d : { truncated, NODES - 1 }) {
+        error = 0.0;
+        for (unsigned int j = 0; j < CHECKS; j++) {
+            error = std::max(error, scaledError(clenshaw(c, d, checkPoint(j)), z[j]));
+        }
+        for (unsigned int j = 0; j < NODES; j++) {
+            error = std::max(error, scaledError(clenshaw(c, d, node(j)), y[j]));
+        }
+        if (error <= tolerance) {
+            degree = d;
+            std::fill(c + d + 1, c + NODES, 0.0);
+            return true;
+        }
+        if (d == NODES - 1) break;
+    }
+    return false;
+}
+
+} // namespace
+
+bool TabulatedFunction::build(const ExpressionCalculator &calculator, const CompiledExpression &program,
+                              double lower, double upper, double tolerance, Method method,
+                              std::string &error) {
+
+    if (program.variables.size() != 1 || program.outputCount != 1) {
+        error = "Expression must have one variable and one result";
+        return false;
+    }
+    if (!(std::isfinite(lower) && std::isfinite(upper) && lower < upper && std::isfinite(upper - lower))) {
+        error = "Invalid domain";
+        return false;
+    }
+    if (!(tolerance > 0.0 && std::isfinite(tolerance))) {
+        error = "Invalid tolerance";
+        return false;
+    }
+
+    *this = TabulatedFunction();
+    this->calculator = &calculator;
+    this->program = program;
+    lowerBound = lower;
+    upperBound = upper;
+    this->tolerance = tolerance;
+    tableMethod = method;
+    return method == SPLINE ? buildSpline(error) : buildChebyshev(error);
+}
+
+void TabulatedFunction::sample(const double *x, size_t count, double *y) const {
+
+    size_t threads = std::max(1u, std::thread::hardware_concurrency());
+    if (count < PARALLEL_COUNT || threads == 1) {
+        calculator->evaluateBatch(program, { x }, count, y);
+        return;
+    }
+
+    size_t stripe = (count + threads - 1) / threads;
+    std::vector<std::thread> pool;
+    for (size_t begin = stripe; begin < count; begin += stripe) {
+        size_t end = std::min(count, begin + stripe);
+        pool.emplace_back([this, x, y, begin, end]() {
+            calculator->evaluateBatch(program, { x + begin }, end - begin, y + begin);
+        });
+    }
+    calculator->evaluateBatch(program, { x }, std::min(count, stripe), y);
+    for (std::thread& thread : pool) {
+        thread.join();
+    }
+}
+
+bool TabulatedFunction::buildChebyshev(std::string &) {
+
+    struct Span {
+        double lower;
+        double upper;
+        unsigned int depth;
+    };
+    struct Leaf {
+        double lower;
+        double upper;
+        Piece piece;
+    };
+
+    // Все куски одного уровня деления вычисляются одним пакетом
+    std::vector<Span> pending(1, Span{ lowerBound, upperBound, 0 });
+    std::vector<Leaf> leaves;
+    std::vector<double> x, y;
+    size_t total = 1;
+    while (!pending.empty()) {
+        const size_t stride = NODES + CHECKS;
+        x.resize(pending.size() * stride);
+        y.resize(x.size());
+        for (size_t i = 0; i < pending.size(); i++) {
+            double middle = 0.5 * (pending[i].lower + pending[i].upper);
+            double half = 0.5 * (pending[i].upper - pending[i].lower);
+            double* px = &x[i * stride];
+            for (unsigned int j = 0; j < NODES; j++) {
+                px[j] = middle + half * node(j);
+            }
+            for (unsigned int j = 0; j < CHECKS; j++) {
+                px[NODES + j] = j == 0 ? pending[i].lower
+                              : j == CHECKS - 1 ? pending[i].upper
+                              : middle + half * checkPoint(j);
+            }
+        }
+        sample(x.data(), x.size(), y.data());
+        sampleCount += x.size();
+
+        std::vector<Span> next;
+        for (size_t i = 0; i < pending.size(); i++) {
+            const Span& span = pending[i];
+            Leaf leaf;
+            leaf.lower = span.lower;
+            leaf.upper = span.upper;
+            leaf.piece.middle = 0.5 * (span.lower + span.upper);
+            leaf.piece.inverseHalfWidth = 2.0 / (span.upper - span.lower);
+            double pieceError = 0.0;
+            if (fitChebyshev(&y[i * stride], &y[i * stride + NODES], tolerance,
+                             leaf.piece.c, leaf.piece.degree, pieceError)) {
+                certifiedError = std::max(certifiedError, pieceError);
+                leaves.push_back(leaf);
+                continue;
+            }
+            // Кусок, где нет ни одного конечного значения (вне области
+            // определения, переполнение, матрица), не делится
+            const double* values = &y[i * stride];
+            bool defined = std::any_of(values, values + stride, [](double v) { return std::isfinite(v); });
+            double middle = leaf.piece.middle;
+            if (defined && span.depth < MAX_DEPTH && total < MAX_PIECES
+                    && middle > span.lower && middle < span.upper) {
+                next.push_back(Span{ span.lower, middle, span.depth + 1 });
+                next.push_back(Span{ middle, span.upper, span.depth + 1 });
+                total++;
+            } else {
+                leaf.piece.degree = 0;
+                std::fill(leaf.piece.c, leaf.piece.c + NODES, 0.0);
+                leaf.piece.c[0] = NaN;
+                leaves.push_back(leaf);
+                fallbackCount++;
+            }
+        }
+        pending.swap(next);
+    }
+
+    std::sort(leaves.begin(), leaves.end(), [](const Leaf& a, const Leaf& b) {
+        return a.lower < b.lower;
+    });
+    // Соседние куски без таблицы объединяются: поиск короче
+    for (const Leaf& leaf : leaves) {
+        if (!chebyshev.empty() && std::isnan(leaf.piece.c[0]) && std::isnan(chebyshev.back().c[0])) {
+            upperEdges.back() = leaf.upper;
+            continue;
+        }
+        chebyshev.push_back(leaf.piece);
+        upperEdges.push_back(leaf.upper);
+    }
+    upperEdges.back() = upperBound;
+
+    size_t cellCount = 1;
+    while (cellCount < 2 * chebyshev.size()) {
+        cellCount *= 2;
+    }
+    cellScale = cellCount / (upperBound - lowerBound);
+    cells.resize(cellCount + 1);
+    for (size_t k = 0; k <= cellCount; k++) {
+        double position = lowerBound + k / cellScale;
+        size_t i = std::upper_bound(upperEdges.begin(), upperEdges.end(), position) - upperEdges.begin();
+        cells[k] = static_cast<unsigned int>(std::min(i, chebyshev.size() - 1));
+    }
+    return true;
+}
+
+bool TabulatedFunction::buildSpline(std::string &) {
+
+    size_t n = FIRST_INTERVALS;
+    double step = (upperBound - lowerBound) / n;
+    std::vector<double> knots(n + 1), middles(n), quarters, x;
+
+    x.resize(n + 1);
+    for (size_t k = 0; k <= n; k++) {
+        x[k] = k == n ? upperBound : lowerBound + k * step;
+    }
+    sample(x.data(), n + 1, knots.data());
+    x.resize(n);
+    for (size_t k = 0; k < n; k++) {
+        x[k] = lowerBound + (k + 0.5) * step;
+    }
+    sample(x.data(), n, middles.data());
+    sampleCount += 2 * n + 1;
+
+    std::vector<double> derivatives;
+    std::vector<unsigned char> failed;
+    for (;;) {
+        // Четверти интервалов: в середине вклады производных почти
+        // сокращаются и ошибка в них не видна. После сгущения четверти
+        // становятся серединами, так что новых значений 2n на уровень
+        x.resize(2 * n);
+        for (size_t k = 0; k < 2 * n; k++) {
+            x[k] = lowerBound + (k / 2 + (k % 2 ? 0.75 : 0.25)) * step;
+        }
+        quarters.resize(2 * n);
+        sample(x.data(), 2 * n, quarters.data());
+        sampleCount += 2 * n;
+
+        // Производные в узлах (умноженные на шаг): центральная разность
+        // 4-го порядка, у концов - односторонние того же порядка
+        const double* f = knots.data();
+        derivatives.resize(n + 1);
+        for (size_t k = 0; k <= n; k++) {
+            if (k >= 2 && k + 2 <= n) {
+                derivatives[k] = (f[k - 2] - 8.0 * f[k - 1] + 8.0 * f[k + 1] - f[k + 2]) / 12.0;
+            } else if (k < 2) {
+                const double* g = f + k;
+                derivatives[k] = k == 0
+                    ? (-25.0 * g[0] + 48.0 * g[1] - 36.0 * g[2] + 16.0 * g[3] - 3.0 * g[4]) / 12.0
+                    : (-3.0 * g[-1] - 10.0 * g[0] + 18.0 * g[1] - 6.0 * g[2] + g[3]) / 12.0;
+            } else {
+                const double* g = f + k;
+                derivatives[k] = k == n
+                    ? (25.0 * g[0] - 48.0 * g[-1] + 36.0 * g[-2] - 16.0 * g[-3] + 3.0 * g[-4]) / 12.0
+                    : (3.0 * g[1] + 10.0 * g[0] - 18.0 * g[-1] + 6.0 * g[-2] - g[-3]) / 12.0;
+            }
+        }
+
+        // Многочлен Эрмита интервала и проверка в середине и четвертях
+        spline.resize(4 * n);
+        failed.assign(n, 0);
+        size_t failures = 0;
+        double levelError = 0.0;
+        for (size_t k = 0; k < n; k++) {
+            double y0 = f[k], y1 = f[k + 1], d0 = derivatives[k], d1 = derivatives[k + 1];
+            double* c = &spline[4 * k];
+            c[0] = y0;
+            c[1] = d0;
+            c[2] = 3.0 * (y1 - y0) - 2.0 * d0 - d1;
+            c[3] = 2.0 * (y0 - y1) + d0 + d1;
+            bool finite = std::isfinite(c[0]) && std::isfinite(c[1]) && std::isfinite(c[2])
+                       && std::isfinite(c[3]) && std::isfinite(middles[k])
+                       && std::isfinite(quarters[2 * k]) && std::isfinite(quarters[2 * k + 1]);
+            double e = NaN;
+            if (finite) {
+                e = std::max(scaledError(cubic(c, 0.5), middles[k]),
+                             std::max(scaledError(cubic(c, 0.25), quarters[2 * k]),
+                                      scaledError(cubic(c, 0.75), quarters[2 * k + 1])));
+            }
+            if (e <= tolerance) {
+                levelError = std::max(levelError, e);
+            } else {
+                // Сгущение помогает только там, где значения конечны
+                failed[k] = 1;
+                failures += finite;
+            }
+        }
+
+        if (failures * FALLBACK_SHARE <= n || 2 * n > MAX_INTERVALS) {
+            for (size_t k = 0; k < n; k++) {
+                if (failed[k]) {
+                    std::fill(&spline[4 * k], &spline[4 * k] + 4, NaN);
+                    fallbackCount++;
+                }
+            }
+            certifiedError = levelError;
+            break;
+        }
+
+        // Сетка вдвое гуще: прежние середины становятся узлами,
+        // четверти - серединами
+        std::vector<double> refined(2 * n + 1);
+        for (size_t k = 0; k < n; k++) {
+            refined[2 * k] = knots[k];
+            refined[2 * k + 1] = middles[k];
+        }
+        refined[2 * n] = knots[n];
+        knots.swap(refined);
+        middles.swap(quarters);
+        n *= 2;
+        step = (upperBound - lowerBound) / n;
+    }
+
+    intervals = n;
+    inverseStep = n / (upperBound - lowerBound);
+    return true;
+}
+
+size_t TabulatedFunction::pieces() const {
+    return tableMethod == SPLINE ? intervals : chebyshev.size();
+}
+
+const TabulatedFunction::Piece &TabulatedFunction::locate(double x) const {
+
+    size_t cell = std::min(static_cast<size_t>((x - lowerBound) * cellScale), cells.size() - 2);
+    size_t i = cells[cell];
+    size_t last = cells[cell + 1];
+    if (i != last) {
+        i = std::upper_bound(upperEdges.begin() + i, upperEdges.begin() + last, x) - upperEdges.begin();
+    }
+    return chebyshev[i];
+}
+
+double TabulatedFunction::tabulated(double x) const {
+
+    if (!(x >= lowerBound && x <= upperBound)) {
+        return NaN;
+    }
+    if (tableMethod == SPLINE) {
+        double u = (x - lowerBound) * inverseStep;
+        size_t k = std::min(static_cast<size_t>(u), intervals - 1);
+        return cubic(&spline[4 * k], u - static_cast<double>(k));
+    }
+    const Piece& piece = locate(x);
+    return clenshaw(piece.c, piece.degree, (x - piece.middle) * piece.inverseHalfWidth);
+}
+
+double TabulatedFunction::operator()(double x) const {
+
+    double value = tabulated(x);
+    if (std::isnan(value)) {
+        calculator->evaluateBatch(program, { &x }, 1, &value);
+    }
+    return value;
+}
+
+void TabulatedFunction::evaluate(const double *x, size_t count, double *out) const {
+
+    // Точки без таблицы собираются и вычисляются программой одним пакетом
+    std::vector<double> fallback;
+    std::vector<size_t> positions;
+    auto store = [&](size_t i, double value) {
+        if (std::isnan(value)) {
+            fallback.push_back(x[i]);
+            positions.push_back(i);
+        }
+        out[i] = value;
+    };
+
+    size_t i = 0;
+    if (tableMethod == CHEBYSHEV) {
+        // Схема Кленшоу - цепочка зависимых операций длиной в степень,
+        // поэтому точки идут группами по LANES в двух векторах с независимыми
+        // цепочками. Коэффициенты выше степени куска нулевые, и b остаются
+        // точными нулями до его старшего коэффициента
+        const size_t LANES = 2 * simd::width;
+        for (; i + LANES <= count; i += LANES) {
+            double t[LANES], values[LANES];
+            bool inside[LANES];
+            const Piece* piece[LANES];
+            unsigned int degree = 0;
+            bool shared = true;
+            for (size_t l = 0; l < LANES; l++) {
+                inside[l] = x[i + l] >= lowerBound && x[i + l] <= upperBound;
+                piece[l] = inside[l] ? &locate(x[i + l]) : &chebyshev[0];
+                t[l] = inside[l] ? (x[i + l] - piece[l]->middle) * piece[l]->inverseHalfWidth : 0.0;
+                degree = std::max(degree, piece[l]->degree);
+                shared = shared && piece[l] == piece[0];
+            }
+            // Упорядоченные точки (график) обычно попадают в один кусок:
+            // коэффициенты тогда общие, иначе они собираются по дорожкам
+            double coefficients[NODES][LANES];
+            if (!shared) {
+                for (size_t l = 0; l < LANES; l++) {
+                    for (unsigned int k = 0; k <= degree; k++) {
+                        coefficients[k][l] = piece[l]->c[k];
+                    }
+                }
+            }
+            auto coefficient = [&](unsigned int k, size_t lane) {
+                return shared ? simd::set1(piece[0]->c[k]) : simd::load(coefficients[k] + lane);
+            };
+            simd::vdouble t0 = simd::load(t), t1 = simd::load(t + simd::width);
+            simd::vdouble twoT0 = t0 + t0, twoT1 = t1 + t1;
+            simd::vdouble b10 = simd::set1(0.0), b11 = b10, b20 = b10, b21 = b10;
+            for (unsigned int k = degree; k >= 1; k--) {
+                simd::vdouble b00 = simd::fma(twoT0, b10, coefficient(k, 0) - b20);
+                simd::vdouble b01 = simd::fma(twoT1, b11, coefficient(k, simd::width) - b21);
+                b20 = b10;
+                b21 = b11;
+                b10 = b00;
+                b11 = b01;
+            }
+            simd::store(values, simd::fma(t0, b10, coefficient(0, 0) - b20));
+            simd::store(values + simd::width, simd::fma(t1, b11, coefficient(0, simd::width) - b21));
+            for (size_t l = 0; l < LANES; l++) {
+                store(i + l, inside[l] ? values[l] : NaN);
+            }
+        }
+    }
+    for (; i < count; i++) {
+        store(i, tabulated(x[i]));
+    }
+
+    if (!fallback.empty()) {
+        calculator->evaluateBatch(program, { fallback.data() }, fallback.size(), fallback.data());
+        for (size_t j = 0; j < positions.size(); j++) {
+            out[positions[j]] = fallback[j];
+        }
+    }
+}
@@ -0,0 +1,107 @@
+#ifndef TABULATEDFUNCTION_H
+#define TABULATEDFUNCTION_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "compiledexpression.h"
+
+class ExpressionCalculator;
+
+// Таблица приближения выражения с одной переменной на отрезке [lower, upper]
+// для многократного вычисления (графики, поиск по значению): вместо
+// интерпретации программы - поиск куска и несколько умножений.
+//
+// CHEBYSHEV - куски с многочленами Чебышёва до 7-й степени; кусок, где
+// точность не достигнута, делится пополам, поэтому особенности и изломы
+// окружаются мелкими кусками. SPLINE - равномерная сетка кубических
+// сплайнов Эрмита (производные по разностям 4-го порядка), сетка
+// сгущается вдвое, пока точность не достигнута везде; вычисляется быстрее,
+// но на всём отрезке с шагом самого трудного участка.
+//
+// Значения в узлах вычисляются пакетами в нескольких потоках. Каждый кусок
+// проверяется на контрольной сетке (точки между узлами и концы куска):
+// погрешность там не больше tolerance * max(1, |f|), то есть абсолютная
+// для |f| <= 1 и относительная для больших значений. Куски, где точность
+// не достигнута (разрыв, особенность, inf/nan), и точки вне отрезка
+// вычисляются исходной программой, как evaluateBatch: ошибки дают inf/nan.
+class TabulatedFunction
+{
+public:
+    enum Method {
+        CHEBYSHEV,
+        SPLINE
+    };
+
+    TabulatedFunction() = default;
+
+    // Программа копируется, calculator должен жить, пока используется таблица.
+    // false и error - программа не от одной переменной, с несколькими
+    // выходами или некорректный отрезок или tolerance
+    bool build(const ExpressionCalculator& calculator, const CompiledExpression& program,
+               double lower, double upper, double tolerance, Method method, std::string& error);
+
+    bool isBuilt() const { return calculator != nullptr; }
+
+    double operator()(double x) const;
+    // Пакетное вычисление; out можно записывать на место x.
+    // Можно вызывать из нескольких потоков одновременно
+    void evaluate(const double* x, size_t count, double* out) const;
+
+    // Наибольшая погрешность на контрольной сетке по всем табличным кускам
+    // (в тех же единицах, что tolerance)
+    double maxError() const { return certifiedError; }
+    // Число кусков (интервалов сплайна) и из них вычисляемых программой
+    size_t pieces() const;
+    size_t fallbackPieces() const { return fallbackCount; }
+    // Число вычислений программы при построении
+    size_t samples() const { return sampleCount; }
+    Method method() const { return tableMethod; }
+
+private:
+    // Кусок Чебышёва: t = (x - middle) * inverseHalfWidth, значение -
+    // сумма c[k] T_k(t) по k = 0..degree, старшие c нулевые.
+    // Кусок без таблицы - c[0] = NaN
+    struct Piece {
+        double middle;
+        double inverseHalfWidth;
+        unsigned int degree;
+        double c[8];
+    };
+
+    bool buildChebyshev(std::string& error);
+    bool buildSpline(std::string& error);
+    // Значения программы в точках x[0..count-1], большие пакеты - в нескольких потоках
+    void sample(const double* x, size_t count, double* y) const;
+    // Кусок Чебышёва, содержащий x из [lowerBound, upperBound]
+    const Piece& locate(double x) const;
+    // Табличное значение или NaN, если точка вычисляется программой
+    double tabulated(double x) const;
+
+    const ExpressionCalculator* calculator = nullptr;
+    CompiledExpression program;
+    double lowerBound = 0.0;
+    double upperBound = 0.0;
+    double tolerance = 0.0;
+    Method tableMethod = CHEBYSHEV;
+
+    // CHEBYSHEV: куски по возрастанию, upperEdges[i] - правый конец куска i.
+    // cells - равномерная сетка поиска: куски, пересекающие ячейку k, -
+    // с cells[k] по cells[k + 1]
+    std::vector<Piece> chebyshev;
+    std::vector<double> upperEdges;
+    std::vector<unsigned int> cells;
+    double cellScale = 0.0;
+
+    // SPLINE: по 4 коэффициента многочлена от t = (x - x_k) / h на интервал
+    std::vector<double> spline;
+    size_t intervals = 0;
+    double inverseStep = 0.0;
+
+    double certifiedError = 0.0;
+    size_t fallbackCount = 0;
+    size_t sampleCount = 0;
+};
+
+#endif // TABULATEDFUNCTION_H
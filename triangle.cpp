@@ -1,10 +1,10 @@
 #include "triangle.h"
 
-Triangle::Triangle() : side_a(3), side_b(4), side_c(5) {
+Triangle::Triangle() : side_a(3), side_b(4), side_c(5), derivedValid(false) {
 
 }
 
-Triangle::Triangle(double a, double b, double c) {
+Triangle::Triangle(double a, double b, double c) : derivedValid(false) {
 
     if (!isValidTriangle(a, b, c)) {
         throw std::invalid_argument("Invalid triangle sides");
@@ -43,6 +43,7 @@ void Triangle::setSideA(double a) {
         throw std::invalid_argument("Invalid triangle side");
     }
     side_a = a;
+    derivedValid = false;
 }
 
 void Triangle::setSideB(double b) {
@@ -51,6 +52,7 @@ void Triangle::setSideB(double b) {
         throw std::invalid_argument("Invalid triangle side");
     }
     side_b = b;
+    derivedValid = false;
 }
 
 void Triangle::setSideC(double c) {
@@ -59,6 +61,7 @@ void Triangle::setSideC(double c) {
         throw std::invalid_argument("Invalid triangle side");
     }
     side_c = c;
+    derivedValid = false;
 }
 
 void Triangle::setSides(double a, double b, double c) {
@@ -69,6 +72,35 @@ void Triangle::setSides(double a, double b, double c) {
     side_a = a;
     side_b = b;
     side_c = c;
+    derivedValid = false;
+}
+
+std::vector<Triangle> Triangle::solve(const TriangleSpec &spec) {
+
+    TriangleSolution solution = solveTriangle(spec);
+    if (solution.status == TriangleSolution::INVALID_SPEC) {
+        throw std::invalid_argument("Invalid triangle specification");
+    }
+    std::vector<Triangle> triangles;
+    for (int i = 0; i < solution.count; i++) {
+        triangles.push_back(Triangle(solution.sides[i][0], solution.sides[i][1], solution.sides[i][2]));
+    }
+    return triangles;
+}
+
+const Triangle::Derived& Triangle::ensureDerived() const {
+
+    if (!derivedValid) {
+        triangleAngles(side_a, side_b, side_c, derived.angles);
+        derived.area = triangleArea(side_a, side_b, side_c);
+        derived.heights[0] = 2 * derived.area / side_a;
+        derived.heights[1] = 2 * derived.area / side_b;
+        derived.heights[2] = 2 * derived.area / side_c;
+        derived.inradius = 2 * derived.area / perimeter();
+        derived.circumradius = side_a / (2 * std::sin(derived.angles[0]));
+        derivedValid = true;
+    }
+    return derived;
 }
 
 double Triangle::perimeter() const {
@@ -76,9 +108,7 @@ double Triangle::perimeter() const {
 }
 
 double Triangle::area() const {
-
-    double p = perimeter() / 2;
-    return std::sqrt(p * (p - side_a) * (p - side_b) * (p - side_c));
+    return ensureDerived().area;
 }
 
 std::string Triangle::type() const {
@@ -135,9 +165,8 @@ std::vector<QPointF> Triangle::getVertices(double centerX, double centerY, doubl
     // Первая вершина в центре
     QPointF A(centerX, centerY);
 
-    // Вычисляем углы треугольника по теореме косинусов
-    double angleA = std::acos((side_b * side_b + side_c * side_c - side_a * side_a) / (2 * side_b * side_c));
-    double angleB = std::acos((side_a * side_a + side_c * side_c - side_b * side_b) / (2 * side_a * side_c));
+    // Угол A считается один раз и хранится в кэше
+    double angleA = getAngleA();
 
     // Вторая вершина - вдоль оси X
     QPointF B(centerX + side_c * scale, centerY);
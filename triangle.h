@@ -1,16 +1,35 @@
+#ifndef TRIANGLE_H
+#define TRIANGLE_H
+
 #include <iostream>
 #include <cmath>
 #include <stdexcept>
 #include <vector>
 #include <QPointF>
 
+#include "trianglesolver.h"
+
 class Triangle {
 private:
     double side_a;
     double side_b;
     double side_c;
 
+    // Производные величины считаются при первом обращении и сбрасываются
+    // при изменении сторон. Кэш не защищён: один объект Triangle
+    // не читается из нескольких потоков одновременно
+    struct Derived {
+        double angles[3];
+        double heights[3];
+        double area;
+        double inradius;
+        double circumradius;
+    };
+    mutable Derived derived;
+    mutable bool derivedValid;
+
     bool isValidTriangle(double a, double b, double c) const;
+    const Derived& ensureDerived() const;
 
 public:
     Triangle();
@@ -21,6 +40,11 @@ public:
     // Конструктор для создания равностороннего треугольника
     Triangle(double side);
 
+    // Все треугольники по трём известным элементам (SSS, SAS, ASA, AAS, SSA),
+    // углы в радианах. Для SSA может быть два решения, пустой результат -
+    // треугольник не существует. Некорректные данные - std::invalid_argument
+    static std::vector<Triangle> solve(const TriangleSpec& spec);
+
     // Методы для получения длины нужной стороны
     double getSideA() const;
     double getSideB() const;
@@ -39,6 +63,17 @@ public:
     // Метод для вычисления площади треугольника через полупериметр
     double area() const;
 
+    // Углы против сторон a, b, c (радианы), высоты к ним,
+    // радиусы вписанной и описанной окружностей
+    double getAngleA() const { return ensureDerived().angles[0]; }
+    double getAngleB() const { return ensureDerived().angles[1]; }
+    double getAngleC() const { return ensureDerived().angles[2]; }
+    double getHeightA() const { return ensureDerived().heights[0]; }
+    double getHeightB() const { return ensureDerived().heights[1]; }
+    double getHeightC() const { return ensureDerived().heights[2]; }
+    double inradius() const { return ensureDerived().inradius; }
+    double circumradius() const { return ensureDerived().circumradius; }
+
     std::string type() const;
 
     bool isCongruent(const Triangle& other) const;
@@ -54,3 +89,5 @@ public:
 
     static Triangle createRightIsosceles(double leg); // ?
 };
+
+#endif // TRIANGLE_H
@@ -0,0 +1,229 @@
+#include "trianglebatchitem.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// Пороги уровня детализации в пикселях среднего размера треугольника
+const double OUTLINE_PIXELS = 3.0;      // меньше - только заливка
+const double VERTEX_PIXELS = 16.0;      // меньше - без точек вершин
+const double LABEL_PIXELS = 80.0;       // меньше - без подписей
+// Больше подписей за кадр не рисуется
+const size_t MAX_LABELS = 3000;
+
+} // namespace
+
+TriangleBatchItem::TriangleBatchItem()
+    : labelsVisible(true)
+    , totalExtent(0.0)
+{
+    setFlag(QGraphicsItem::ItemUsesExtendedStyleOption);
+}
+
+int TriangleBatchItem::addStyle(const QPen &pen, const QBrush &brush) {
+
+    Style style = { pen, brush };
+    styles.push_back(style);
+    visibleByStyle.resize(styles.size());
+    return static_cast<int>(styles.size() - 1);
+}
+
+void TriangleBatchItem::reserve(size_t count) {
+
+    for (std::vector<double>* array : { &ax, &ay, &bx, &by, &cx, &cy }) {
+        array->reserve(count);
+    }
+    styleOf.reserve(count);
+    labelAB.reserve(count);
+    labelBC.reserve(count);
+    labelCA.reserve(count);
+}
+
+uint32_t TriangleBatchItem::labelFor(double length) {
+
+    // Длины с одинаковой подписью делят один QStaticText
+    QString text = QString::number(length, 'f', 1);
+    auto found = labelIds.constFind(text);
+    if (found != labelIds.constEnd()) {
+        return found.value();
+    }
+    uint32_t id = static_cast<uint32_t>(labels.size());
+    QStaticText label(text);
+    label.setPerformanceHint(QStaticText::AggressiveCaching);
+    labels.push_back(label);
+    labelIds.insert(text, id);
+    return id;
+}
+
+void TriangleBatchItem::addTriangle(const Triangle &triangle, QPointF pos, double scale, int style) {
+
+    if (styles.empty()) {
+        addStyle(QPen(Qt::black, 1), QBrush(Qt::lightGray));
+    }
+    std::vector<QPointF> vertices = triangle.getVertices(pos.x(), pos.y(), scale);
+    QPointF a = vertices[0], b = vertices[1], c = vertices[2];
+
+    // Подписи как у TriangleGraphicsItem: против вершины - её сторона
+    uint32_t ab = labelFor(triangle.getSideC());
+    uint32_t bc = labelFor(triangle.getSideA());
+    uint32_t ca = labelFor(triangle.getSideB());
+
+    // Единый обход: при отрицательной ориентации меняем B и C
+    double cross = (b.x() - a.x()) * (c.y() - a.y()) - (b.y() - a.y()) * (c.x() - a.x());
+    if (cross < 0.0) {
+        std::swap(b, c);
+        std::swap(ab, ca);
+    }
+
+    prepareGeometryChange();
+    ax.push_back(a.x()); ay.push_back(a.y());
+    bx.push_back(b.x()); by.push_back(b.y());
+    cx.push_back(c.x()); cy.push_back(c.y());
+    styleOf.push_back(static_cast<uint16_t>(std::max(0, std::min(style, static_cast<int>(styles.size()) - 1))));
+    labelAB.push_back(ab);
+    labelBC.push_back(bc);
+    labelCA.push_back(ca);
+
+    QRectF box = QRectF(QPointF(std::min({ a.x(), b.x(), c.x() }), std::min({ a.y(), b.y(), c.y() })),
+                        QPointF(std::max({ a.x(), b.x(), c.x() }), std::max({ a.y(), b.y(), c.y() })));
+    bounds = ax.size() == 1 ? box : bounds.united(box);
+    totalExtent += std::max(box.width(), box.height());
+}
+
+void TriangleBatchItem::clear() {
+
+    prepareGeometryChange();
+    for (std::vector<double>* array : { &ax, &ay, &bx, &by, &cx, &cy }) {
+        array->clear();
+    }
+    styleOf.clear();
+    labelAB.clear();
+    labelBC.clear();
+    labelCA.clear();
+    labels.clear();
+    labelIds.clear();
+    bounds = QRectF();
+    totalExtent = 0.0;
+}
+
+void TriangleBatchItem::setLabelsVisible(bool visible) {
+
+    labelsVisible = visible;
+    update();
+}
+
+QRectF TriangleBatchItem::boundingRect() const {
+
+    // Запас на перо, точки вершин и подписи задаётся в единицах сцены
+    // для масштаба 1; при другом масштабе края всё равно попадают в exposedRect
+    return bounds.adjusted(-8.0, -8.0, 8.0, 8.0);
+}
+
+void TriangleBatchItem::paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget) {
+    Q_UNUSED(widget);
+
+    size_t n = ax.size();
+    if (n == 0) {
+        return;
+    }
+    double pixels = option->levelOfDetailFromTransform(painter->worldTransform());
+    double meanPixels = totalExtent / n * pixels;
+    QRectF exposed = option->exposedRect;
+    double left = exposed.left(), right = exposed.right();
+    double top = exposed.top(), bottom = exposed.bottom();
+
+    // Отсечение по габаритам: проход по массивам координат без ветвлений в данных
+    for (std::vector<uint32_t>& visible : visibleByStyle) {
+        visible.clear();
+    }
+    const double *pax = ax.data(), *pay = ay.data(), *pbx = bx.data();
+    const double *pby = by.data(), *pcx = cx.data(), *pcy = cy.data();
+    for (size_t i = 0; i < n; i++) {
+        double minX = std::min(pax[i], std::min(pbx[i], pcx[i]));
+        double maxX = std::max(pax[i], std::max(pbx[i], pcx[i]));
+        double minY = std::min(pay[i], std::min(pby[i], pcy[i]));
+        double maxY = std::max(pay[i], std::max(pby[i], pcy[i]));
+        if (maxX >= left && minX <= right && maxY >= top && minY <= bottom) {
+            visibleByStyle[styleOf[i]].push_back(static_cast<uint32_t>(i));
+        }
+    }
+
+    size_t visibleCount = 0;
+    for (size_t s = 0; s < styles.size(); s++) {
+        const std::vector<uint32_t>& visible = visibleByStyle[s];
+        if (visible.empty()) continue;
+        visibleCount += visible.size();
+
+        // Заливка: один многоугольник, каждый треугольник вписан петлёй
+        // от общей начальной точки. Петли-связки нулевой площади, а при
+        // одинаковом обходе и правиле Winding перекрытия не вычитаются
+        fillBuffer.clear();
+        fillBuffer.reserve(static_cast<int>(5 * visible.size() + 1));
+        QPointF anchor(pax[visible[0]], pay[visible[0]]);
+        fillBuffer << anchor;
+        for (uint32_t i : visible) {
+            QPointF a(pax[i], pay[i]);
+            fillBuffer << a << QPointF(pbx[i], pby[i]) << QPointF(pcx[i], pcy[i]) << a << anchor;
+        }
+        painter->setPen(Qt::NoPen);
+        painter->setBrush(styles[s].brush);
+        painter->drawPolygon(fillBuffer, Qt::WindingFill);
+
+        if (meanPixels < OUTLINE_PIXELS) continue;
+
+        lineBuffer.clear();
+        for (uint32_t i : visible) {
+            QPointF a(pax[i], pay[i]), b(pbx[i], pby[i]), c(pcx[i], pcy[i]);
+            lineBuffer.push_back(QLineF(a, b));
+            lineBuffer.push_back(QLineF(b, c));
+            lineBuffer.push_back(QLineF(c, a));
+        }
+        painter->setPen(styles[s].pen);
+        painter->setBrush(Qt::NoBrush);
+        painter->drawLines(lineBuffer.data(), static_cast<int>(lineBuffer.size()));
+    }
+
+    // Вершины - точки круглым косметическим пером вместо drawEllipse
+    if (meanPixels >= VERTEX_PIXELS) {
+        pointBuffer.clear();
+        for (const std::vector<uint32_t>& visible : visibleByStyle) {
+            for (uint32_t i : visible) {
+                pointBuffer.push_back(QPointF(pax[i], pay[i]));
+                pointBuffer.push_back(QPointF(pbx[i], pby[i]));
+                pointBuffer.push_back(QPointF(pcx[i], pcy[i]));
+            }
+        }
+        QPen vertexPen(Qt::red, 6.0, Qt::SolidLine, Qt::RoundCap);
+        vertexPen.setCosmetic(true);
+        painter->setPen(vertexPen);
+        painter->drawPoints(pointBuffer.data(), static_cast<int>(pointBuffer.size()));
+    }
+
+    if (labelsVisible && meanPixels >= LABEL_PIXELS && visibleCount <= MAX_LABELS) {
+        for (const std::vector<uint32_t>& visible : visibleByStyle) {
+            drawLabels(painter, visible);
+        }
+    }
+}
+
+void TriangleBatchItem::drawLabels(QPainter *painter, const std::vector<uint32_t> &visible) {
+
+    // Подписи постоянного размера в пикселях: рисуем без преобразования
+    // вида, переводя только точку привязки
+    QTransform transform = painter->worldTransform();
+    painter->save();
+    painter->resetTransform();
+    QFont font = painter->font();
+    font.setPointSize(8);
+    painter->setFont(font);
+    painter->setPen(Qt::darkBlue);
+
+    for (uint32_t i : visible) {
+        QPointF a(ax[i], ay[i]), b(bx[i], by[i]), c(cx[i], cy[i]);
+        painter->drawStaticText(transform.map((a + b) / 2), labels[labelAB[i]]);
+        painter->drawStaticText(transform.map((b + c) / 2), labels[labelBC[i]]);
+        painter->drawStaticText(transform.map((c + a) / 2), labels[labelCA[i]]);
+    }
+    painter->restore();
+}
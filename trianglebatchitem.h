@@ -0,0 +1,74 @@
+#ifndef TRIANGLEBATCHITEM_H
+#define TRIANGLEBATCHITEM_H
+
+#include "triangle.h"
+
+#include <QBrush>
+#include <QGraphicsItem>
+#include <QHash>
+#include <QPainter>
+#include <QPen>
+#include <QPointF>
+#include <QStaticText>
+#include <QStyleOptionGraphicsItem>
+
+#include <cstdint>
+#include <vector>
+
+// Много треугольников одним элементом сцены вместо TriangleGraphicsItem
+// на каждый. Вершины хранятся отдельными массивами координат, отрисовка
+// отсекает треугольники вне видимой области, заливает каждый стиль одним
+// drawPolygon, рёбра и вершины - одним drawLines и drawPoints на стиль.
+// Подписи сторон - закэшированные QStaticText, при мелком масштабе
+// или большом числе видимых треугольников не рисуются
+class TriangleBatchItem : public QGraphicsItem
+{
+public:
+    TriangleBatchItem();
+
+    // Стиль заливки и рёбер; возвращает номер для addTriangle
+    int addStyle(const QPen& pen, const QBrush& brush);
+
+    void reserve(size_t count);
+    // Треугольник с вершиной A в pos, как у TriangleGraphicsItem
+    void addTriangle(const Triangle& triangle, QPointF pos, double scale, int style = 0);
+    void clear();
+    size_t count() const { return ax.size(); }
+
+    void setLabelsVisible(bool visible);
+
+    QRectF boundingRect() const override;
+    void paint(QPainter* painter, const QStyleOptionGraphicsItem* option, QWidget* widget = nullptr) override;
+
+private:
+    struct Style {
+        QPen pen;
+        QBrush brush;
+    };
+
+    uint32_t labelFor(double length);
+    void drawLabels(QPainter* painter, const std::vector<uint32_t>& visible);
+
+    // Вершины A, B, C; все треугольники обходятся в одном направлении,
+    // чтобы заливка одним многоугольником не вычитала перекрытия
+    std::vector<double> ax, ay, bx, by, cx, cy;
+    std::vector<uint16_t> styleOf;
+    // Номера подписей сторон AB, BC и CA в labels
+    std::vector<uint32_t> labelAB, labelBC, labelCA;
+
+    std::vector<Style> styles;
+    std::vector<QStaticText> labels;
+    QHash<QString, uint32_t> labelIds;
+    bool labelsVisible;
+
+    QRectF bounds;
+    double totalExtent;     // сумма габаритов, средний размер для уровня детализации
+
+    // Видимые треугольники по стилям, буферы переиспользуются между кадрами
+    std::vector<std::vector<uint32_t>> visibleByStyle;
+    QPolygonF fillBuffer;
+    std::vector<QLineF> lineBuffer;
+    std::vector<QPointF> pointBuffer;
+};
+
+#endif // TRIANGLEBATCHITEM_H
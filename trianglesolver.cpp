@@ -0,0 +1,179 @@
+#include "trianglesolver.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <thread>
+#include <vector>
+
+const double TRIANGLE_UNKNOWN = std::numeric_limits<double>::quiet_NaN();
+
+namespace {
+
+const double PI = 3.14159265358979323846;
+// Меньшие пакеты решаются в одном потоке
+const size_t PARALLEL_COUNT = 1 << 14;
+// Допуск для sin = 1 в случае SSA: несколько ulp
+const double TANGENT_TOLERANCE = 8 * std::numeric_limits<double>::epsilon();
+
+bool known(double value) {
+    return !std::isnan(value);
+}
+
+// Оставшиеся стороны по теореме синусов, когда известны все углы
+// и сторона i
+void completeBySines(double sides[3], const double angles[3], int i) {
+
+    double ratio = sides[i] / std::sin(angles[i]);
+    for (int k = 0; k < 3; k++) {
+        if (k != i) sides[k] = ratio * std::sin(angles[k]);
+    }
+}
+
+// Одно решение: стороны и углы известны полностью
+void store(TriangleSolution &solution, const double sides[3], const double angles[3]) {
+
+    std::copy(sides, sides + 3, solution.sides[solution.count]);
+    std::copy(angles, angles + 3, solution.angles[solution.count]);
+    solution.count++;
+    solution.status = TriangleSolution::SOLVED;
+}
+
+} // namespace
+
+double triangleArea(double a, double b, double c) {
+
+    // a >= b >= c, скобки расставлены так, чтобы не вычитать близкие числа
+    if (a < b) std::swap(a, b);
+    if (a < c) std::swap(a, c);
+    if (b < c) std::swap(b, c);
+    double product = (a + (b + c)) * (c - (a - b)) * (c + (a - b)) * (a + (b - c));
+    return 0.25 * std::sqrt(std::max(0.0, product));
+}
+
+void triangleAngles(double a, double b, double c, double angles[3]) {
+
+    // tg A = 4S / (b^2 + c^2 - a^2)
+    double fourArea = 4.0 * triangleArea(a, b, c);
+    angles[0] = std::atan2(fourArea, (b - a) * (b + a) + c * c);
+    angles[1] = std::atan2(fourArea, (a - b) * (a + b) + c * c);
+    angles[2] = PI - angles[0] - angles[1];
+}
+
+TriangleSolution solveTriangle(const TriangleSpec &spec) {
+
+    TriangleSolution solution;
+    solution.status = TriangleSolution::INVALID_SPEC;
+    solution.count = 0;
+
+    double sides[3], angles[3];
+    int sideCount = 0, angleCount = 0;
+    for (int k = 0; k < 3; k++) {
+        sides[k] = spec.sides[k];
+        angles[k] = spec.angles[k];
+        if (known(sides[k])) {
+            if (!(sides[k] > 0.0) || std::isinf(sides[k])) return solution;
+            sideCount++;
+        }
+        if (known(angles[k])) {
+            if (!(angles[k] > 0.0 && angles[k] < PI)) return solution;
+            angleCount++;
+        }
+    }
+    if (sideCount + angleCount != 3 || sideCount == 0) {
+        return solution;
+    }
+    solution.status = TriangleSolution::NO_SOLUTION;
+
+    if (sideCount == 3) {
+        // SSS
+        double a = sides[0], b = sides[1], c = sides[2];
+        if (a + b <= c || a + c <= b || b + c <= a) return solution;
+        triangleAngles(a, b, c, angles);
+        store(solution, sides, angles);
+        return solution;
+    }
+
+    if (sideCount == 1) {
+        // ASA и AAS: третий угол из суммы, стороны по теореме синусов
+        int side = known(sides[0]) ? 0 : known(sides[1]) ? 1 : 2;
+        int missing = !known(angles[0]) ? 0 : !known(angles[1]) ? 1 : 2;
+        double rest = PI;
+        for (int k = 0; k < 3; k++) {
+            if (k != missing) rest -= angles[k];
+        }
+        if (!(rest > 0.0)) return solution;
+        angles[missing] = rest;
+        completeBySines(sides, angles, side);
+        store(solution, sides, angles);
+        return solution;
+    }
+
+    // Две стороны и угол
+    int angle = known(angles[0]) ? 0 : known(angles[1]) ? 1 : 2;
+    int missingSide = !known(sides[0]) ? 0 : !known(sides[1]) ? 1 : 2;
+
+    if (angle == missingSide) {
+        // SAS: угол между известными сторонами, третья сторона по теореме
+        // косинусов в форме (x - y)^2 + 4xy sin^2(C/2) - без вычитания близких
+        double x = sides[(angle + 1) % 3], y = sides[(angle + 2) % 3];
+        double half = std::sin(angles[angle] / 2.0);
+        sides[angle] = std::sqrt((x - y) * (x - y) + 4.0 * x * y * half * half);
+        triangleAngles(sides[0], sides[1], sides[2], angles);
+        store(solution, sides, angles);
+        return solution;
+    }
+
+    // SSA: известен угол i против стороны i и сторона j.
+    // sin(Bj) = s_j sin(Ai) / s_i; при s_j > s_i и остром Ai - два решения
+    int i = angle, j = 3 - angle - missingSide;
+    // Синус в пределах погрешности округления от 1 - касание, прямой угол
+    double sine = sides[j] * std::sin(angles[i]) / sides[i];
+    bool tangent = std::fabs(sine - 1.0) <= TANGENT_TOLERANCE;
+    if (sine > 1.0 && !tangent) return solution;
+
+    double acute = tangent ? PI / 2 : std::asin(sine);
+    double candidates[2] = { acute, PI - acute };
+    int candidateCount = sides[j] > sides[i] && !tangent ? 2 : 1;
+    for (int n = 0; n < candidateCount; n++) {
+        double trial[3], trialSides[3];
+        std::copy(angles, angles + 3, trial);
+        std::copy(sides, sides + 3, trialSides);
+        trial[j] = candidates[n];
+        trial[missingSide] = PI - trial[i] - trial[j];
+        if (!(trial[missingSide] > 0.0)) continue;
+        completeBySines(trialSides, trial, i);
+        // Известная сторона j остаётся точно заданной
+        trialSides[j] = sides[j];
+        store(solution, trialSides, trial);
+    }
+    return solution;
+}
+
+void solveTriangles(const TriangleSpec *specs, size_t count, TriangleSolution *solutions) {
+
+    size_t threads = std::max(1u, std::thread::hardware_concurrency());
+    if (count < PARALLEL_COUNT || threads == 1) {
+        for (size_t i = 0; i < count; i++) {
+            solutions[i] = solveTriangle(specs[i]);
+        }
+        return;
+    }
+
+    size_t stripe = (count + threads - 1) / threads;
+    std::vector<std::thread> pool;
+    for (size_t begin = stripe; begin < count; begin += stripe) {
+        size_t end = std::min(count, begin + stripe);
+        pool.emplace_back([specs, solutions, begin, end]() {
+            for (size_t i = begin; i < end; i++) {
+                solutions[i] = solveTriangle(specs[i]);
+            }
+        });
+    }
+    for (size_t i = 0; i < std::min(count, stripe); i++) {
+        solutions[i] = solveTriangle(specs[i]);
+    }
+    for (std::thread& thread : pool) {
+        thread.join();
+    }
+}
@@ -0,0 +1,47 @@
+#ifndef TRIANGLESOLVER_H
+#define TRIANGLESOLVER_H
+
+#include <cstddef>
+
+// Решение треугольника по трём известным элементам: SSS, SAS, ASA, AAS
+// и неоднозначный SSA (до двух решений). Сторона a лежит против угла A
+// и т.д., углы в радианах. Без Qt: используется и в окне, и в пакетной
+// обработке данных.
+
+// Известные элементы; неизвестные - NaN (TRIANGLE_UNKNOWN)
+struct TriangleSpec {
+    double sides[3];    // a, b, c
+    double angles[3];   // A, B, C
+};
+
+extern const double TRIANGLE_UNKNOWN;
+
+// До двух решений; count == 0 - треугольника с такими данными нет
+// или данные некорректны (см. status)
+struct TriangleSolution {
+    enum Status {
+        SOLVED,
+        NO_SOLUTION,        // данные корректны, но треугольник не существует
+        INVALID_SPEC        // известно не ровно три элемента, нет ни одной стороны,
+                            // сторона <= 0 или угол вне (0, pi)
+    };
+
+    Status status;
+    int count;
+    double sides[2][3];
+    double angles[2][3];
+};
+
+TriangleSolution solveTriangle(const TriangleSpec& spec);
+
+// Пакетное решение: строки независимы, большие пакеты делятся между потоками
+void solveTriangles(const TriangleSpec* specs, size_t count, TriangleSolution* solutions);
+
+// Углы треугольника по сторонам (a, b, c уже проверены на неравенство
+// треугольника). Через площадь по устойчивой формуле Герона и atan2,
+// без потери точности acos у вырожденных треугольников
+void triangleAngles(double a, double b, double c, double angles[3]);
+// Площадь по сторонам (формула Герона в форме Кэхэна)
+double triangleArea(double a, double b, double c);
+
+#endif // TRIANGLESOLVER_H
@@ -0,0 +1,374 @@
+#include "trigcore.h"
+#include "simd.h"
+
+#include <cmath>
+#include <cstdint>
+
+// Коэффициенты минимаксных многочленов (fdlibm, k_sin.c и k_cos.c)
+static const double S1 = -1.66666666666666324348e-01;
+static const double S2 =  8.33333333332248946124e-03;
+static const double S3 = -1.98412698298579493134e-04;
+static const double S4 =  2.75573137070700676789e-06;
+static const double S5 = -2.50507602534068634195e-08;
+static const double S6 =  1.58969099521155010221e-10;
+
+static const double C1 =  4.16666666666666019037e-02;
+static const double C2 = -1.38888888888741095749e-03;
+static const double C3 =  2.48015872894767294178e-05;
+static const double C4 = -2.75573143513906633035e-07;
+static const double C5 =  2.08757232129817482790e-09;
+static const double C6 = -1.13596475577881948265e-11;
+
+// pi/2, разбитое на части по 33 бита: произведение n * PIO2_k точно при n < 2^20
+static const double INV_PIO2 = 6.36619772367581382433e-01;
+static const double PIO2_1 = 1.57079632673412561417e+00;
+static const double PIO2_2 = 6.07710050630396597660e-11;
+static const double PIO2_3 = 2.02226624871116645580e-21;
+static const double PIO2_3T = 8.47842766036889956997e-32;
+
+// pi/2 в виде суммы двух чисел double
+static const double PIO2_HI = 1.57079632679489655800e+00;
+static const double PIO2_LO = 6.12323399573676603587e-17;
+
+// Границы путей приведения
+static const double PI_4 = 7.85398163397448278999e-01;
+static const double MEDIUM_LIMIT = 1647099.0;        // ~ 2^20 * pi/2
+static const double VECTOR_LIMIT = 823549.0;         // ~ 2^19 * pi/2
+
+// Двоичные цифры 2/pi по 32 бита, начиная с первого бита после запятой
+static const uint32_t TWO_OVER_PI[] = {
+    0xA2F9836E, 0x4E441529, 0xFC2757D1, 0xF534DDC0, 0xDB629599, 0x3C439041, 0xFE5163AB, 0xDEBBC561,
+    0xB7246E3A, 0x424DD2E0, 0x06492EEA, 0x09D1921C, 0xFE1DEB1C, 0xB129A73E, 0xE88235F5, 0x2EBB4484,
+    0xE99C7026, 0xB45F7E41, 0x3991D639, 0x835339F4, 0x9C845F8B, 0xBDF9283B, 0x1FF897FF, 0xDE05980F,
+    0xEF2F118B, 0x5A0A6D1F, 0x6D367ECF, 0x27CB09B7, 0x4F463F66, 0x9E5FEA2D, 0x7527BAC7, 0xEBE5F17B,
+    0x3D0739F7, 0x8A5292EA, 0x6BFB5FB1, 0x1F8D5D08, 0x56033046, 0xFC7B6BAB, 0xF0CFBC20, 0x9AF4361D
+};
+
+// Точная сумма: a + b = s + погрешность
+static double twoSumError(double a, double b, double s) {
+
+    double bb = s - a;
+    return (a - (s - bb)) + (b - bb);
+}
+
+// Приведение Коди-Уэйта для |x| < 2^20 * pi/2
+static int reduceMedium(double x, double &hi, double &lo) {
+
+    double n = std::nearbyint(x * INV_PIO2);
+    double r = x - n * PIO2_1;           // точно по лемме Стербенца
+    double b = n * PIO2_2;
+    double s = r - b;
+    double e1 = twoSumError(r, -b, s);
+    double c = n * PIO2_3;
+    double s2 = s - c;
+    double e2 = twoSumError(s, -c, s2);
+    double tail = e1 + e2 - n * PIO2_3T;
+
+    hi = s2 + tail;
+    lo = (s2 - hi) + tail;
+    return static_cast<int>(static_cast<int64_t>(n) & 3);
+}
+
+// 32 бита произведения, начиная с бита pos (младшие разряды первыми)
+static uint32_t bitsAt(const uint32_t *limbs, int count, int pos) {
+
+    int word = pos / 32;
+    int shift = pos % 32;
+    uint64_t low = word < count ? limbs[word] : 0;
+    uint64_t high = word + 1 < count ? limbs[word + 1] : 0;
+    return static_cast<uint32_t>(((high << 32) | low) >> shift);
+}
+
+// Прибавление 64-битного числа к длинному, начиная со слова pos
+static void addAt(uint32_t *limbs, int count, uint64_t value, int pos) {
+
+    uint64_t carry = value;
+    for (int j = pos; j < count && carry; j++) {
+        uint64_t sum = static_cast<uint64_t>(limbs[j]) + (carry & 0xFFFFFFFFu);
+        limbs[j] = static_cast<uint32_t>(sum);
+        carry = (carry >> 32) + (sum >> 32);
+    }
+}
+
+// Приведение Пейна-Хэнека для огромных x > 0: берётся только то окно
+// двоичных цифр 2/pi, которое влияет на остаток по модулю 4
+static int reduceHuge(double x, double &hi, double &lo) {
+
+    int exponent;
+    double fraction = std::frexp(x, &exponent);
+    uint64_t m = static_cast<uint64_t>(std::ldexp(fraction, 53));
+    int e = exponent - 53;                         // x = m * 2^e
+
+    // Биты 2/pi с номерами i <= e - 2 дают слагаемые, кратные 4
+    int first = e - 1 > 1 ? e - 1 : 1;
+    int w0 = (first - 1) / 32;
+    const int WINDOW = 7;
+
+    // Произведение m * окно, 9 слов по 32 бита, младшие первыми
+    uint32_t product[WINDOW + 2] = { 0 };
+    uint64_t mLow = m & 0xFFFFFFFFu, mHigh = m >> 32;
+    for (int k = 0; k < WINDOW; k++) {
+        uint64_t w = TWO_OVER_PI[w0 + WINDOW - 1 - k];
+        addAt(product, WINDOW + 2, mLow * w, k);
+        addAt(product, WINDOW + 2, mHigh * w, k + 1);
+    }
+
+    // Значение x * 2/pi = product * 2^-shift
+    int shift = 32 * w0 + 32 * WINDOW - e;
+    int quadrant = bitsAt(product, WINDOW + 2, shift) & 3;
+    uint64_t fHigh = (static_cast<uint64_t>(bitsAt(product, WINDOW + 2, shift - 32)) << 32) |
+                      bitsAt(product, WINDOW + 2, shift - 64);
+    uint64_t fLow = (static_cast<uint64_t>(bitsAt(product, WINDOW + 2, shift - 96)) << 32) |
+                     bitsAt(product, WINDOW + 2, shift - 128);
+
+    // Дробная часть >= 1/2: округляем к следующей четверти, остаток отрицательный
+    bool negative = (fHigh >> 63) != 0;
+    if (negative) {
+        quadrant = (quadrant + 1) & 3;
+        fLow = ~fLow + 1;
+        fHigh = ~fHigh + (fLow == 0 ? 1 : 0);
+    }
+
+    if (fHigh == 0 && fLow == 0) {
+        hi = lo = 0.0;
+        return quadrant;
+    }
+
+    // Нормализация и перевод 128-битной дроби в сумму двух double
+    int lz = 0;
+    while (!(fHigh >> 63)) {
+        fHigh = (fHigh << 1) | (fLow >> 63);
+        fLow <<= 1;
+        lz++;
+    }
+    double fHi = std::ldexp(static_cast<double>(fHigh >> 11), -53 - lz);
+    double fLo = std::ldexp(static_cast<double>(((fHigh & 0x7FF) << 42) | (fLow >> 22)), -106 - lz);
+
+    // (fHi + fLo) * pi/2 с точным старшим произведением
+    double rHi = fHi * PIO2_HI;
+    double rLo = std::fma(fHi, PIO2_HI, -rHi) + fHi * PIO2_LO + fLo * PIO2_HI;
+    hi = rHi + rLo;
+    lo = rLo - (hi - rHi);
+
+    if (negative) {
+        hi = -hi;
+        lo = -lo;
+    }
+    return quadrant;
+}
+
+int trigReduce(double x, double &hi, double &lo) {
+
+    double ax = std::fabs(x);
+    if (ax <= PI_4) {
+        hi = x;
+        lo = 0.0;
+        return 0;
+    }
+    if (!std::isfinite(x)) {
+        hi = lo = x - x;
+        return 0;
+    }
+    if (ax < MEDIUM_LIMIT) {
+        return reduceMedium(x, hi, lo);
+    }
+
+    int quadrant = reduceHuge(ax, hi, lo);
+    if (x < 0) {
+        hi = -hi;
+        lo = -lo;
+        quadrant = (4 - quadrant) & 3;
+    }
+    return quadrant;
+}
+
+double trigKernelSin(double x, double y) {
+
+    // Для крошечных x sin(x) = x с точностью округления (и знак нуля сохраняется)
+    if (y == 0 && std::fabs(x) < 7.450580596923828e-9) {
+        return x;
+    }
+    double z = x * x;
+    double w = z * z;
+    double r = S2 + z * (S3 + z * S4) + z * w * (S5 + z * S6);
+    double v = z * x;
+    if (y == 0) {
+        return x + v * (S1 + z * r);
+    }
+    return x - ((z * (0.5 * y - v * r) - y) - v * S1);
+}
+
+double trigKernelCos(double x, double y) {
+
+    double z = x * x;
+    double w = z * z;
+    double r = z * (C1 + z * (C2 + z * C3)) + w * w * (C4 + z * (C5 + z * C6));
+    double hz = 0.5 * z;
+    w = 1.0 - hz;
+    return w + (((1.0 - w) - hz) + (z * r - x * y));
+}
+
+double trigSin(double x) {
+
+    double hi, lo;
+    switch (trigReduce(x, hi, lo)) {
+    case 0: return trigKernelSin(hi, lo);
+    case 1: return trigKernelCos(hi, lo);
+    case 2: return -trigKernelSin(hi, lo);
+    default: return -trigKernelCos(hi, lo);
+    }
+}
+
+double trigCos(double x) {
+
+    double hi, lo;
+    switch (trigReduce(x, hi, lo)) {
+    case 0: return trigKernelCos(hi, lo);
+    case 1: return -trigKernelSin(hi, lo);
+    case 2: return -trigKernelCos(hi, lo);
+    default: return trigKernelSin(hi, lo);
+    }
+}
+
+void trigSinCos(double x, double &s, double &c) {
+
+    double hi, lo;
+    int quadrant = trigReduce(x, hi, lo);
+    double ks = trigKernelSin(hi, lo);
+    double kc = trigKernelCos(hi, lo);
+    switch (quadrant) {
+    case 0: s = ks; c = kc; break;
+    case 1: s = kc; c = -ks; break;
+    case 2: s = -ks; c = -kc; break;
+    default: s = -kc; c = ks; break;
+    }
+}
+
+double trigTan(double x) {
+
+    double hi, lo;
+    int quadrant = trigReduce(x, hi, lo);
+    double ks = trigKernelSin(hi, lo);
+    double kc = trigKernelCos(hi, lo);
+    return (quadrant & 1) ? -kc / ks : ks / kc;
+}
+
+double trigSec(double x) {
+    return 1.0 / trigCos(x);
+}
+
+double trigCsc(double x) {
+    return 1.0 / trigSin(x);
+}
+
+double trigCot(double x) {
+
+    double s, c;
+    trigSinCos(x, s, c);
+    return c / s;
+}
+
+// Векторное приведение и многочлены: аргумент hi + lo и четверть для
+// каждой дорожки. Приведение то же, что у reduceMedium, с погрешностью
+// вычитаний: рядом с кратными pi/2 остаток на много порядков меньше
+// вычитаемых частей, и без неё теряются почти все его разряды
+static simd::vdouble twoSumErrorVector(simd::vdouble a, simd::vdouble b, simd::vdouble s) {
+
+    simd::vdouble bb = s - a;
+    return (a - (s - bb)) + (b - bb);
+}
+
+static void reduceVector(simd::vdouble x, simd::vdouble &hi, simd::vdouble &lo, simd::vdouble &quadrant) {
+
+    simd::vdouble n = simd::roundNearest(x * simd::set1(INV_PIO2));
+    simd::vdouble r = x - n * simd::set1(PIO2_1);
+    simd::vdouble b = simd::negate(n * simd::set1(PIO2_2));
+    simd::vdouble s = r + b;
+    simd::vdouble e1 = twoSumErrorVector(r, b, s);
+    simd::vdouble c = simd::negate(n * simd::set1(PIO2_3));
+    simd::vdouble s2 = s + c;
+    simd::vdouble e2 = twoSumErrorVector(s, c, s2);
+    simd::vdouble tail = (e1 + e2) - n * simd::set1(PIO2_3T);
+    hi = s2 + tail;
+    lo = (s2 - hi) + tail;
+    // n mod 4 в диапазоне [0, 4)
+    quadrant = n - simd::set1(4.0) * simd::floor(n * simd::set1(0.25));
+}
+
+static simd::vdouble kernelSinVector(simd::vdouble x, simd::vdouble y) {
+
+    simd::vdouble z = x * x;
+    simd::vdouble w = z * z;
+    simd::vdouble r = simd::set1(S2) + z * (simd::set1(S3) + z * simd::set1(S4)) +
+                      z * w * (simd::set1(S5) + z * simd::set1(S6));
+    simd::vdouble v = z * x;
+    return x - ((z * (simd::set1(0.5) * y - v * r) - y) - v * simd::set1(S1));
+}
+
+static simd::vdouble kernelCosVector(simd::vdouble x, simd::vdouble y) {
+
+    simd::vdouble z = x * x;
+    simd::vdouble w = z * z;
+    simd::vdouble r = z * (simd::set1(C1) + z * (simd::set1(C2) + z * simd::set1(C3))) +
+                      w * w * (simd::set1(C4) + z * (simd::set1(C5) + z * simd::set1(C6)));
+    simd::vdouble hz = simd::set1(0.5) * z;
+    simd::vdouble one = simd::set1(1.0);
+    simd::vdouble h = one - hz;
+    return h + (((one - h) - hz) + (z * r - x * y));
+}
+
+// Нужен ли скалярный путь: огромный аргумент, nan или inf
+// (для nan сравнение "меньше" ложно, так что он тоже сюда попадает)
+static bool needsScalar(simd::vdouble x) {
+    return !simd::all(simd::lt(simd::abs(x), simd::set1(VECTOR_LIMIT)));
+}
+
+static void sinCosBlock(const double *in, double *sinOut, double *cosOut, size_t n) {
+
+    size_t i = 0;
+    for (; i + simd::width <= n; i += simd::width) {
+        simd::vdouble x = simd::load(in + i);
+        if (needsScalar(x)) {
+            for (int k = 0; k < simd::width; k++) {
+                double s, c;
+                trigSinCos(in[i + k], s, c);
+                if (sinOut) sinOut[i + k] = s;
+                if (cosOut) cosOut[i + k] = c;
+            }
+            continue;
+        }
+        simd::vdouble hi, lo, quadrant;
+        reduceVector(x, hi, lo, quadrant);
+        simd::vdouble ks = kernelSinVector(hi, lo);
+        simd::vdouble kc = kernelCosVector(hi, lo);
+
+        // Четверти 1 и 3 меняют sin и cos местами, знак зависит от четверти
+        simd::vdouble odd = simd::maskOr(simd::eq(quadrant, simd::set1(1.0)), simd::eq(quadrant, simd::set1(3.0)));
+        simd::vdouble s = simd::select(odd, kc, ks);
+        simd::vdouble c = simd::select(odd, ks, kc);
+        simd::vdouble sinNegative = simd::gt(quadrant, simd::set1(1.5));
+        simd::vdouble cosNegative = simd::maskOr(simd::eq(quadrant, simd::set1(1.0)), simd::eq(quadrant, simd::set1(2.0)));
+        // sin(±0) = ±0, как у скалярного пути: многочлен теряет знак нуля
+        s = simd::select(sinNegative, simd::negate(s), s);
+        if (sinOut) simd::store(sinOut + i, simd::select(simd::eq(x, simd::set1(0.0)), x, s));
+        if (cosOut) simd::store(cosOut + i, simd::select(cosNegative, simd::negate(c), c));
+    }
+    for (; i < n; i++) {
+        double s, c;
+        trigSinCos(in[i], s, c);
+        if (sinOut) sinOut[i] = s;
+        if (cosOut) cosOut[i] = c;
+    }
+}
+
+void trigSinArray(const double *in, double *out, size_t n) {
+    sinCosBlock(in, out, nullptr, n);
+}
+
+void trigCosArray(const double *in, double *out, size_t n) {
+    sinCosBlock(in, nullptr, out, n);
+}
+
+void trigSinCosArray(const double *in, double *sinOut, double *cosOut, size_t n) {
+    sinCosBlock(in, sinOut, cosOut, n);
+}
@@ -0,0 +1,37 @@
+#ifndef TRIGCORE_H
+#define TRIGCORE_H
+
+#include <cstddef>
+
+// Общее ядро тригонометрических функций.
+// Аргумент приводится к [-pi/4, pi/4] (Коди-Уэйт для умеренных значений,
+// Пейн-Хэнек для огромных), после чего вычисляются минимаксные многочлены.
+// Погрешность sin и cos, скалярных и векторных, - в пределах 1 ulp на всей
+// числовой оси; sec и csc - до 2 ulp, tan и cot (отношение двух
+// округлённых многочленов) - до 2.5 ulp. Проверка против libm:
+// fuzz/trigaccuracy.pro.
+
+// Приведение: x = n * pi/2 + (hi + lo), возвращает n mod 4
+int trigReduce(double x, double& hi, double& lo);
+
+// Многочлены на [-pi/4, pi/4]; y - младшая часть приведённого аргумента
+double trigKernelSin(double x, double y);
+double trigKernelCos(double x, double y);
+
+double trigSin(double x);
+double trigCos(double x);
+double trigTan(double x);
+double trigSec(double x);
+double trigCsc(double x);
+double trigCot(double x);
+
+// Синус и косинус за одно приведение аргумента
+void trigSinCos(double x, double& s, double& c);
+
+// Векторные варианты для пакетного вычисления.
+// Дорожки с |x| > 2^19 * pi/2 и nan/inf обрабатываются скалярным путём
+void trigSinArray(const double* in, double* out, size_t n);
+void trigCosArray(const double* in, double* out, size_t n);
+void trigSinCosArray(const double* in, double* sinOut, double* cosOut, size_t n);
+
+#endif // TRIGCORE_H